@@ -38,10 +38,13 @@
 // to target a specific device.
 #define MQTT_SUB_TOPIC_LEDS   MQTT_BASE_TOPIC "/cmd/leds"
 #define MQTT_SUB_TOPIC_UPDATE MQTT_BASE_TOPIC "/cmd/update"
+// Command of the trace recorder, followed by the client ID (only if ENABLE_COMMAND_TRACE is defined)
+#define MQTT_SUB_TOPIC_TRACE  MQTT_BASE_TOPIC "/cmd/trace"
 
 // Topics published by the device followed by the client ID
 #define MQTT_PUB_TOPIC_STATUS        MQTT_BASE_TOPIC "/status/device"
 #define MQTT_PUB_TOPIC_UPDATE_STATUS MQTT_BASE_TOPIC "/status/update"
+#define MQTT_PUB_TOPIC_DIAGNOSTICS   MQTT_BASE_TOPIC "/status/diagnostics"
 
 // ============================================================================
 // LED Effect Configuration
@@ -1,18 +1,24 @@
 #include <ArduinoJson.h>
 #include <WiFiClientSecure.h>
 #include "aws_iot.h"
+#include "boot_trace.h"
+#include "command_latency.h"
+#include "command_trace.h"
 #include "constants.h"
 #include "leds_parser.h"
 #include "leds.h"
+#include "local_api.h"
+#include "logger.h"
 #include "firmware_update.h"
 #include "ha_client.h"
-
-// Interval for publishing device status (in milliseconds)
-#define STATUS_PUBLISH_INTERVAL 60 * 1000
-// Initial delay before attempting to reconnect to AWS IoT (in milliseconds)
-#define RECONNECT_INITIAL_DELAY 100
-// Maximum delay between reconnection attempts to AWS IoT (in milliseconds)
-#define RECONNECT_MAX_DELAY     30000
+#include "power.h"
+#include "realtime_udp.h"
+#include "system_clock.h"
+#include "task_monitor.h"
+#include "wifi_manager.h"
+
+// Interval for publishing the firmware update progress (in milliseconds)
+#define UPDATE_PROGRESS_PUBLISH_INTERVAL 5 * 1000
 // MQTT buffer size for handling larger messages
 #define MQTT_BUFFER_SIZE        8192
 // Maximum length of the client ID (could be extended if needed)
@@ -35,16 +41,30 @@ const char *clientId = NULL;
 // Variables to store device-specific MQTT topics to subscribe
 static char ledsSubTopic[sizeof(MQTT_SUB_TOPIC_LEDS) + MAX_CLIENT_ID_LENGTH];
 static char updateSubTopic[sizeof(MQTT_SUB_TOPIC_UPDATE) + MAX_CLIENT_ID_LENGTH];
+#ifdef ENABLE_COMMAND_TRACE
+static char traceSubTopic[sizeof(MQTT_SUB_TOPIC_TRACE) + MAX_CLIENT_ID_LENGTH];
+#endif
 
 // Variables to store device-specific MQTT topics to publish
 static char statusPubTopic[sizeof(MQTT_PUB_TOPIC_STATUS) + MAX_CLIENT_ID_LENGTH];
 static char updateStatusPubTopic[sizeof(MQTT_PUB_TOPIC_UPDATE_STATUS) + MAX_CLIENT_ID_LENGTH];
+static char diagnosticsPubTopic[sizeof(MQTT_PUB_TOPIC_DIAGNOSTICS) + MAX_CLIENT_ID_LENGTH];
+
+// Reconnection backoff state
+static uint32_t reconnectDelay = 0;
+static uint32_t lastReconnectAttempt = 0;
 
 // Function declarations
 void connectToAWS();
+void onWiFiLinkChange(bool linkUp);
 void publishStatusAWS();
+void publishBootTraceAWS();
+void publishDiagnosticsAWS();
 void messageHandler(char *topic, byte *payload, unsigned int length);
 void handleUpdateCommand(JsonDocument &doc);
+#ifdef ENABLE_COMMAND_TRACE
+void handleTraceCommand(JsonDocument &doc);
+#endif
 
 /**
  * @brief Initializes the AWS IoT connection.
@@ -99,14 +119,41 @@ void initAWS(const char *id, size_t idLength)
     // Compose topics to subscribe with the client ID
     snprintf(ledsSubTopic, sizeof(ledsSubTopic), "%s/%s", MQTT_SUB_TOPIC_LEDS, clientId);
     snprintf(updateSubTopic, sizeof(updateSubTopic), "%s/%s", MQTT_SUB_TOPIC_UPDATE, clientId);
+#ifdef ENABLE_COMMAND_TRACE
+    snprintf(traceSubTopic, sizeof(traceSubTopic), "%s/%s", MQTT_SUB_TOPIC_TRACE, clientId);
+#endif
 
     // Compose topics to publish with the client ID
     snprintf(statusPubTopic, sizeof(statusPubTopic), "%s/%s", MQTT_PUB_TOPIC_STATUS, clientId);
     snprintf(updateStatusPubTopic, sizeof(updateStatusPubTopic), "%s/%s", MQTT_PUB_TOPIC_UPDATE_STATUS, clientId);
+    snprintf(diagnosticsPubTopic, sizeof(diagnosticsPubTopic), "%s/%s", MQTT_PUB_TOPIC_DIAGNOSTICS, clientId);
 
-    // Attempt to connect to AWS IoT
-    Serial.println(F("Connecting to AWS IoT..."));
-    connectToAWS();
+    // Follow the WiFi link changes to reconnect as soon as the link is restored
+    addWiFiLinkListener(onWiFiLinkChange);
+
+    // Attempt to connect to AWS IoT, otherwise the connection is started when WiFi connects
+    if (WiFi.status() == WL_CONNECTED)
+    {
+        Serial.println(F("Connecting to AWS IoT..."));
+        connectToAWS();
+    }
+}
+
+/**
+ * @brief Handles the WiFi link changes reported by the WiFi supervisor.
+ *
+ * When the link is restored, the reconnection backoff is reset so that the connection
+ * to AWS IoT is attempted immediately. When the link is lost, the MQTT client is
+ * disconnected without waiting for the keepalive timeout.
+ *
+ * @param linkUp true if the WiFi link is up, false otherwise.
+ */
+void onWiFiLinkChange(bool linkUp)
+{
+    if (linkUp)
+        reconnectDelay = 0;
+    else if (client.connected())
+        client.disconnect();
 }
 
 /**
@@ -119,9 +166,6 @@ void initAWS(const char *id, size_t idLength)
  */
 void connectToAWS()
 {
-    static uint32_t reconnectDelay = 0;
-    static uint32_t lastReconnectAttempt = 0;
-
     // Indicate connection attempt if the map is turned on
     if (isMapOn())
         circleLedEffect(CRGB::Purple, CIRCLE_EFFECT_FAST_FADE_DURATION, LOOP_INDEFINITELY);
@@ -133,7 +177,7 @@ void connectToAWS()
         return;
     }
 
-    uint32_t timeNow = millis();
+    uint32_t timeNow = clockMillis();
 
     // Attempt to connect only if the delay has passed
     if (!client.connected() && (timeNow - lastReconnectAttempt >= reconnectDelay))
@@ -145,7 +189,11 @@ void connectToAWS()
         {
             // Connection successful
             Serial.println(F("Connected to AWS IoT"));
-            reconnectDelay = RECONNECT_INITIAL_DELAY; // Reset reconnect delay
+
+            // Show where the boot time was spent after the first connection
+            if (bootTraceMark(BOOT_STAGE_AWS_CONNECTED))
+                printBootTrace();
+            reconnectDelay = AWS_RECONNECT_INITIAL_DELAY; // Reset reconnect delay
 
             // Subscribe to the generic MQTT topics
             client.subscribe(MQTT_SUB_TOPIC_LEDS);
@@ -154,9 +202,13 @@ void connectToAWS()
             // Subscribe to device-specific MQTT topics
             client.subscribe(ledsSubTopic);
             client.subscribe(updateSubTopic);
+#ifdef ENABLE_COMMAND_TRACE
+            client.subscribe(traceSubTopic);
+#endif
 
             // Publish the device status after successful connection
             publishStatusAWS();
+            publishBootTraceAWS();
 
             // Indicate connection success if the map is turned on
             if (isMapOn())
@@ -166,12 +218,15 @@ void connectToAWS()
         {
             // Connection failed - apply exponential backoff
             Serial.printf("Connection to AWS IoT failed, rc=%d\n", client.state());
-            Serial.printf("Retrying in %lu ms\n", reconnectDelay);
-
-            if (reconnectDelay < RECONNECT_MAX_DELAY / 2)
+            // The delay is 0 after the boot and after the WiFi link came up, start the backoff from the initial delay
+            if (reconnectDelay < AWS_RECONNECT_INITIAL_DELAY)
+                reconnectDelay = AWS_RECONNECT_INITIAL_DELAY;
+            else if (reconnectDelay < AWS_RECONNECT_MAX_DELAY / 2)
                 reconnectDelay *= 2;
             else
-                reconnectDelay = RECONNECT_MAX_DELAY;
+                reconnectDelay = AWS_RECONNECT_MAX_DELAY;
+
+            Serial.printf("Retrying in %lu ms\n", reconnectDelay);
         }
     }
 }
@@ -207,80 +262,290 @@ void maintainAWSConnection()
  *
  * @param topic The MQTT topic to publish the JSON document to.
  * @param doc The JSON document to be published.
+ * @return true if the message was published, false otherwise.
  */
-void publishJson(const char *topic, const JsonDocument &doc)
+bool publishJson(const char *topic, const JsonDocument &doc)
 {
-#define BUFFER_SIZE 256 // Size of the buffer for serializing JSON
-
     // Allocate a buffer for the JSON document and serialize it
-    char buffer[BUFFER_SIZE];
-    size_t serializedSize = serializeJson(doc, buffer, BUFFER_SIZE);
+    char buffer[AWS_PUBLISH_BUFFER_SIZE];
+    size_t serializedSize = serializeJson(doc, buffer, AWS_PUBLISH_BUFFER_SIZE);
 
     // Check if the buffer is large enough for the JSON document
-    if (serializedSize >= BUFFER_SIZE)
+    if (serializedSize >= AWS_PUBLISH_BUFFER_SIZE)
     {
-        Serial.printf("Failed to publish message to topic '%s': Buffer (%d bytes) too small for JSON (%d bytes)\n",
-                      topic, BUFFER_SIZE, serializedSize);
-        lastAwsPublishTime = millis(); // Update last publish time to prevent rapid publishing
-        return;
+        LOG_ERROR("Failed to publish message to topic '%s': Buffer (%d bytes) too small for JSON (%d bytes)",
+                  topic, AWS_PUBLISH_BUFFER_SIZE, (uint32_t)serializedSize);
+        lastAwsPublishTime = clockMillis(); // Update last publish time to prevent rapid publishing
+        return false;
     }
 
     // Check if MQTT client is connected
     if (!client.connected())
     {
-        Serial.printf("Error publishing to topic '%s': AWS IoT client not connected\n", topic);
-        lastAwsPublishTime = millis(); // Update last publish time to prevent rapid publishing
-        return;
+        LOG_ERROR("Error publishing to topic '%s': AWS IoT client not connected", topic);
+        lastAwsPublishTime = clockMillis(); // Update last publish time to prevent rapid publishing
+        return false;
     }
 
     // Publish the message to the specified topic
-    if (client.publish(topic, buffer))
-        Serial.printf("Published %d bytes to topic '%s'\n", serializedSize, topic);
+    bool published = client.publish(topic, buffer);
+    if (published)
+        LOG_INFO("Published %u bytes to topic '%s'", (uint32_t)serializedSize, topic);
     else
-        Serial.printf("Failed to publish message to topic '%s'\n", topic);
+        LOG_ERROR("Failed to publish message to topic '%s'", topic);
 
     // Set last publish time to the current time after attempting to publish
-    lastAwsPublishTime = millis();
+    lastAwsPublishTime = clockMillis();
+    return published;
 }
 
 /**
- * @brief Publishes the device status, including firmware version and other relevant information.
+ * @brief Adds the minimum, average and maximum of a frame time to the JSON object.
  *
- * This function constructs a JSON document containing the device's current status,
- * such as firmware version, Wi-Fi status, IP address, and any other pertinent details.
- * It then publishes this JSON document to the predefined MQTT status topic.
+ * @param obj The JSON object.
+ * @param stats The frame time statistics.
  */
-void publishStatusAWS()
+void addFrameTimeStats(JsonObject obj, const FrameTimeStats &stats)
 {
-    // Allocate the JSON document
-    JsonDocument doc;
+    obj["min"] = stats.minUs;
+    obj["avg"] = stats.avgUs;
+    obj["max"] = stats.maxUs;
+}
 
+/**
+ * @brief Fills the JSON document with the device status.
+ *
+ * The status contains the firmware version, Wi-Fi status, IP address, and the statistics
+ * of the Wi-Fi connections and of the standby mode.
+ *
+ * @param doc The JSON document to fill.
+ */
+void fillStatusJson(JsonDocument &doc)
+{
     // Populate the JSON document with status information
     doc["fw_version"] = FIRMWARE_VERSION;
-    doc["uptime"] = millis() / 1000;
+    doc["uptime"] = clockUptimeSeconds();
     doc["reconnects"] = awsReconnectAttempts;
     doc["reset_reason"] = esp_reset_reason();
     doc["wifi_ssid"] = WiFi.SSID();
     doc["ip_address"] = WiFi.localIP().toString();
     doc["mac_address"] = WiFi.macAddress();
+    doc["fw_update"] = firmwareUpdateStateToString(getFirmwareUpdateStatus().state);
+
+    // Add statistics of the WiFi connections
+    const WiFiConnectStats &wifiStats = getWiFiConnectStats();
+    JsonObject wifi = doc["wifi"].to<JsonObject>();
+    wifi["boot_to_connected_ms"] = wifiStats.bootToConnectedMs;
+    wifi["connect_ms"] = wifiStats.lastConnectMs;
+    wifi["fast_path"] = wifiStats.lastFastPath;
+    wifi["fast_connects"] = wifiStats.fastConnects;
+    wifi["scan_connects"] = wifiStats.scanConnects;
+
+    // Add statistics of the standby mode
+    PowerStats powerStats = getPowerStats();
+    JsonObject power = doc["power"].to<JsonObject>();
+    power["standby"] = isInStandby();
+    power["standby_entries"] = powerStats.standbyEntries;
+    power["standby_time"] = powerStats.standbyTimeMs / 1000;
+    power["wake_latency_us"] = powerStats.lastWakeLatencyUs;
+    power["est_current_ma"] = powerStats.estimatedCurrentMa;
+
+    // Add the statistics of the rendered frames
+    FrameStats frameStats = getFrameStats();
+    JsonObject frames = doc["frames"].to<JsonObject>();
+    frames["count"] = frameStats.frames;
+    frames["missed"] = frameStats.deadlineMisses;
+    frames["total_missed"] = frameStats.totalMisses;
+    frames["command_drops"] = getLedCommandDrops();
+    addFrameTimeStats(frames["compute_us"].to<JsonObject>(), frameStats.compute);
+    addFrameTimeStats(frames["show_us"].to<JsonObject>(), frameStats.show);
+    addFrameTimeStats(frames["jitter_us"].to<JsonObject>(), frameStats.jitter);
+
+#ifdef USE_LOCAL_API
+    // Add the counters of the local API
+    LocalApiStats localApiStats = getLocalApiStats();
+    JsonObject localApi = doc["local_api"].to<JsonObject>();
+    localApi["clients"] = localApiStats.clients;
+    localApi["messages"] = localApiStats.messages;
+    localApi["rejected"] = localApiStats.rejected;
+    localApi["dropped"] = localApiStats.dropped;
+#endif
+
+#ifdef USE_REALTIME_UDP
+    // Add the counters of the realtime frame streaming
+    RealtimeStats realtimeStats = getRealtimeStats();
+    JsonObject realtime = doc["realtime"].to<JsonObject>();
+    realtime["active"] = realtimeStats.active;
+    realtime["frames"] = realtimeStats.frames;
+    realtime["shown"] = realtimeStats.shown;
+    realtime["replaced"] = realtimeStats.replaced;
+    realtime["late"] = realtimeStats.late;
+    realtime["invalid"] = realtimeStats.invalid;
+    realtime["latency_avg_us"] = realtimeStats.latencyAvgUs;
+    realtime["latency_max_us"] = realtimeStats.latencyMaxUs;
+#endif
+
+    // Add the percentiles of the LEDs command latency
+    JsonObject latency = doc["latency_us"].to<JsonObject>();
+    for (uint8_t stage = 0; stage < LATENCY_STAGES_COUNT; stage++)
+    {
+        LatencyHistogram histogram;
+        getLatencyHistogram((LatencyStage)stage, histogram);
+
+        JsonObject stageLatency = latency[latencyStageToString(stage)].to<JsonObject>();
+        stageLatency["count"] = histogram.count;
+        stageLatency["p50"] = latencyPercentileUs(histogram, 50);
+        stageLatency["p90"] = latencyPercentileUs(histogram, 90);
+        stageLatency["p99"] = latencyPercentileUs(histogram, 99);
+        stageLatency["max"] = histogram.maxUs;
+    }
+}
+
+/**
+ * @brief Publishes the device status, including firmware version and other relevant information.
+ *
+ * This function constructs a JSON document containing the device's current status,
+ * such as firmware version, Wi-Fi status, IP address, and any other pertinent details.
+ * It then publishes this JSON document to the predefined MQTT status topic.
+ */
+void publishStatusAWS()
+{
+    // Allocate the JSON document and populate it with status information
+    JsonDocument doc;
+    fillStatusJson(doc);
 
     // Publish device status to the MQTT topic
     publishJson(statusPubTopic, doc);
 }
 
+/**
+ * @brief Publishes the boot trace once after the first connection to AWS IoT.
+ *
+ * The trace is sent as a separate message on the diagnostics topic and streamed with its
+ * measured length, so it does not compete with the status for the serialization buffer.
+ * It is attempted only once, the trace is printed on the serial console anyway.
+ */
+void publishBootTraceAWS()
+{
+    static bool bootTraceAttempted = false;
+    if (bootTraceAttempted)
+        return;
+    bootTraceAttempted = true;
+
+    BootTraceEntry entries[BOOT_STAGE_COUNT];
+    uint8_t count = getBootTrace(entries, BOOT_STAGE_COUNT);
+
+    JsonDocument doc;
+    JsonObject boot = doc["boot_us"].to<JsonObject>();
+    for (uint8_t i = 0; i < count; i++)
+        boot[bootStageToString(entries[i].stage)] = entries[i].timeUs;
+
+    size_t length = measureJson(doc);
+    if (!client.beginPublish(diagnosticsPubTopic, length, false))
+    {
+        LOG_ERROR("Failed to publish the boot trace to topic '%s'", diagnosticsPubTopic);
+        return;
+    }
+
+    serializeJson(doc, client);
+    if (client.endPublish())
+        LOG_INFO("Published %u bytes to topic '%s'", (unsigned)length, diagnosticsPubTopic);
+    else
+        LOG_ERROR("Failed to publish the boot trace to topic '%s'", diagnosticsPubTopic);
+}
+
+/**
+ * @brief Publishes the diagnostics with the full latency histograms of the LEDs commands and
+ * the usage of the heap, the cores and the tasks.
+ *
+ * The "limits_us" array holds the upper limits of the buckets, the last bucket is unbounded.
+ * The "heap" array holds the free, the minimum free and the largest free block in bytes, the
+ * "cpu" array the load of each core in percent (only if measured) and every entry of "tasks"
+ * the free stack in bytes, the CPU share in percent and the core (-1 if not pinned).
+ */
+void publishDiagnosticsAWS()
+{
+    JsonDocument doc;
+
+    JsonArray limits = doc["limits_us"].to<JsonArray>();
+    for (uint8_t i = 0; i < LATENCY_BUCKETS_COUNT - 1; i++)
+        limits.add(latencyBucketLimitUs(i));
+
+    JsonObject latency = doc["latency"].to<JsonObject>();
+    for (uint8_t stage = 0; stage < LATENCY_STAGES_COUNT; stage++)
+    {
+        LatencyHistogram histogram;
+        getLatencyHistogram((LatencyStage)stage, histogram);
+
+        JsonArray buckets = latency[latencyStageToString(stage)].to<JsonArray>();
+        for (uint8_t i = 0; i < LATENCY_BUCKETS_COUNT; i++)
+            buckets.add(histogram.buckets[i]);
+    }
+
+    // Keep the usage compact, the message is published every status interval
+    static SystemUsage usage;
+    sampleSystemUsage(usage);
+
+    JsonArray heap = doc["heap"].to<JsonArray>();
+    heap.add(usage.freeHeap);
+    heap.add(usage.minFreeHeap);
+    heap.add(usage.largestFreeBlock);
+
+    if (usage.cpuAvailable)
+    {
+        JsonArray cpu = doc["cpu"].to<JsonArray>();
+        cpu.add(usage.coreLoad[0]);
+        cpu.add(usage.coreLoad[1]);
+    }
+
+    JsonObject tasks = doc["tasks"].to<JsonObject>();
+    for (uint8_t i = 0; i < usage.taskCount; i++)
+    {
+        JsonArray task = tasks[usage.tasks[i].name].to<JsonArray>();
+        task.add(usage.tasks[i].stackFreeBytes);
+        task.add(usage.tasks[i].cpuPercent);
+        task.add(usage.tasks[i].core);
+    }
+
+#ifdef ENABLE_COMMAND_TRACE
+    // Add the counters of the trace recorder and the result of the last replay
+    TraceStats traceStats = getTraceStats();
+    JsonObject trace = doc["trace"].to<JsonObject>();
+    trace["recorded"] = traceStats.recorded;
+    trace["dropped"] = traceStats.dropped;
+    trace["replaying"] = traceStats.replaying;
+
+    JsonObject replay = trace["replay"].to<JsonObject>();
+    replay["replayed"] = traceStats.replayed;
+    replay["skipped"] = traceStats.skipped;
+    replay["invalid"] = traceStats.invalid;
+    replay["boots"] = traceStats.boots;
+    replay["lag_avg_ms"] = traceStats.lagAvgMs;
+    replay["lag_max_ms"] = traceStats.lagMaxMs;
+    replay["rendered"] = traceStats.rendered;
+    replay["queue_drops"] = traceStats.queueDrops;
+    replay["missed_frames"] = traceStats.deadlineMisses;
+#endif
+
+    publishJson(diagnosticsPubTopic, doc);
+}
+
 /**
  * @brief Publishes the status periodically to the AWS IoT topic.
  *
  * This function checks the elapsed time since the last status publish and
  * publishes the status if the elapsed time is greater than or equal to the
- * STATUS_PUBLISH_INTERVAL.
+ * AWS_STATUS_PUBLISH_INTERVAL.
  *
  * @note Variable lastAwsPublishTime is updated in the publishStatusAWS() function.
  */
 void periodicStatusPublishAWS()
 {
-    if (millis() - lastAwsPublishTime >= STATUS_PUBLISH_INTERVAL)
+    if (clockMillis() - lastAwsPublishTime >= AWS_STATUS_PUBLISH_INTERVAL)
+    {
         publishStatusAWS();
+        publishDiagnosticsAWS();
+    }
 }
 
 /**
@@ -304,6 +569,47 @@ void publishFirmwareUpdateStart(const char *firmwareUrl)
     publishJson(updateStatusPubTopic, doc);
 }
 
+/**
+ * @brief Publishes a message indicating that the firmware update command was rejected.
+ *
+ * @param reason A C-string describing why the command was rejected.
+ */
+void publishFirmwareUpdateRejected(const char *reason)
+{
+    String statusMessage = "Firmware update rejected. " + String(reason);
+    Serial.println(statusMessage);
+
+    // Allocate the JSON document
+    JsonDocument doc;
+
+    // Populate the JSON document with the rejection reason
+    doc["status"] = "rejected";
+    doc["message"] = statusMessage;
+
+    // Publish FW update rejection message to the MQTT topic
+    publishJson(updateStatusPubTopic, doc);
+}
+
+/**
+ * @brief Publishes the progress of the running firmware update.
+ *
+ * @param status The status of the firmware update.
+ */
+void publishFirmwareUpdateProgress(const FirmwareUpdateStatus &status)
+{
+    // Allocate the JSON document
+    JsonDocument doc;
+
+    // Populate the JSON document with the update progress
+    doc["status"] = "in_progress";
+    doc["state"] = firmwareUpdateStateToString(status.state);
+    doc["progress"] = status.progress;
+    doc["message"] = status.message;
+
+    // Publish FW update progress message to the MQTT topic
+    publishJson(updateStatusPubTopic, doc);
+}
+
 /**
  * @brief Publishes the firmware update result to the AWS IoT topic.
  *
@@ -324,10 +630,60 @@ void publishFirmwareUpdateResult(bool success, const char *message)
     doc["status"] = success ? "success" : "failure";
     doc["message"] = statusMessage;
 
+    // Add the download metrics if the firmware was downloaded
+    FirmwareUpdateMetrics metrics = getFirmwareUpdateMetrics();
+    if (metrics.bytes > 0)
+    {
+        JsonObject metricsObj = doc["metrics"].to<JsonObject>();
+        metricsObj["bytes"] = metrics.bytes;
+        metricsObj["downloaded"] = metrics.downloadedBytes;
+        metricsObj["time_ms"] = metrics.totalTimeMs;
+        metricsObj["kbps"] = metrics.throughputKBps;
+        metricsObj["receive_ms"] = metrics.receiveTimeMs;
+        metricsObj["write_ms"] = metrics.writeTimeMs;
+        metricsObj["hash_ms"] = metrics.hashTimeMs;
+        metricsObj["receiver_stalls"] = metrics.receiverStalls;
+        metricsObj["writer_stalls"] = metrics.writerStalls;
+        metricsObj["resumes"] = metrics.resumes;
+    }
+
     // Publish FW update result message to the MQTT topic
     publishJson(updateStatusPubTopic, doc);
 }
 
+/**
+ * @brief Publishes the status of the firmware update running in the background.
+ *
+ * State changes are published immediately, the progress every UPDATE_PROGRESS_PUBLISH_INTERVAL
+ * while the update runs. The result is published once the update fails or succeeds.
+ */
+void periodicFirmwareUpdatePublishAWS()
+{
+    static uint32_t lastSequence = 0;
+    static uint32_t lastProgressPublishTime = 0;
+
+    FirmwareUpdateStatus status = getFirmwareUpdateStatus();
+
+    if (status.sequence != lastSequence)
+    {
+        lastSequence = status.sequence;
+
+        if (status.state == FW_UPDATE_REBOOTING || status.state == FW_UPDATE_FAILED)
+        {
+            publishFirmwareUpdateResult(status.state == FW_UPDATE_REBOOTING, status.message);
+            return;
+        }
+    }
+    else if (status.state == FW_UPDATE_IDLE || status.state == FW_UPDATE_FAILED ||
+             clockMillis() - lastProgressPublishTime < UPDATE_PROGRESS_PUBLISH_INTERVAL)
+    {
+        return;
+    }
+
+    lastProgressPublishTime = clockMillis();
+    publishFirmwareUpdateProgress(status);
+}
+
 /**
  * @brief Handles incoming IoT messages.
  *
@@ -341,14 +697,24 @@ void publishFirmwareUpdateResult(bool success, const char *message)
  */
 void messageHandler(char *topic, byte *payload, unsigned int length)
 {
-#define MAX_PRINTABLE_LENGTH 128 // Maximum length of payload to print
+    // The copies of the logged topic and payload must not be truncated by the logger
+    static_assert(sizeof(updateSubTopic) + AWS_MAX_PRINTABLE_LENGTH + 1 <= LOG_STRINGS_SIZE, "LOG_STRINGS_SIZE is too small for the logged messages");
+
+    uint32_t receivedAt = micros(); // Start of the LEDs command latency measurement
 
-    if (length <= MAX_PRINTABLE_LENGTH)
-        Serial.printf("IoT message arrived. Topic: %s. Size: %u bytes. Payload: %.*s\n",
-                      topic, length, length, payload);
+    if (length <= AWS_MAX_PRINTABLE_LENGTH)
+        LOG_INFO("IoT message arrived. Topic: %s. Size: %u bytes. Payload: %.*s",
+                 topic, length, length, (const char *)payload);
     else
-        Serial.printf("IoT message arrived. Topic: %s. Size: %u bytes. Payload (first %d bytes): %.*s\n",
-                      topic, length, MAX_PRINTABLE_LENGTH, MAX_PRINTABLE_LENGTH, payload);
+        LOG_INFO("IoT message arrived. Topic: %s. Size: %u bytes. Payload (first %d bytes): %.*s",
+                 topic, length, AWS_MAX_PRINTABLE_LENGTH, AWS_MAX_PRINTABLE_LENGTH, (const char *)payload);
+
+    bool isLedsTopic = strcmp(topic, ledsSubTopic) == 0 || strcmp(topic, MQTT_SUB_TOPIC_LEDS) == 0;
+
+    // Record the raw message for a later replay
+#ifdef ENABLE_COMMAND_TRACE
+    traceRecordCommand(isLedsTopic ? TRACE_TOPIC_LEDS : TRACE_TOPIC_OTHER, payload, length);
+#endif
 
     // Allocate the JSON document
     JsonDocument doc;
@@ -357,23 +723,29 @@ void messageHandler(char *topic, byte *payload, unsigned int length)
     DeserializationError error = deserializeJson(doc, payload, length);
     if (error)
     {
-        Serial.printf("deserializeJson() failed: %s\n", error.c_str());
+        LOG_ERROR("deserializeJson() failed: %s", error.c_str());
         return;
     }
 
     // Dispatch to appropriate handler based on topic
-    if (strcmp(topic, ledsSubTopic) == 0 || strcmp(topic, MQTT_SUB_TOPIC_LEDS) == 0)
+    if (isLedsTopic)
     {
         if (isMapOn()) // Parse and set LEDs only if the map is turned on
-            setLedsFromJsonDoc(doc);
+            handleLedsCommand(doc, receivedAt);
     }
     else if (strcmp(topic, updateSubTopic) == 0 || strcmp(topic, MQTT_SUB_TOPIC_UPDATE) == 0)
     {
         handleUpdateCommand(doc);
     }
+#ifdef ENABLE_COMMAND_TRACE
+    else if (strcmp(topic, traceSubTopic) == 0)
+    {
+        handleTraceCommand(doc);
+    }
+#endif
     else
     {
-        Serial.printf("Unknown topic received: %s\n", topic);
+        LOG_ERROR("Unknown topic received: %s", topic);
     }
 
     awsMsgsReceived++; // Increment the number of received messages
@@ -382,34 +754,84 @@ void messageHandler(char *topic, byte *payload, unsigned int length)
 /**
  * @brief Handles the firmware update command received in a JSON document.
  *
- * This function extracts the firmware URL from the provided JSON document and initiates
- * the firmware update process if the URL is valid. It also publishes the start and result
- * of the firmware update process.
+ * This function extracts the firmware URL from the provided JSON document and starts
+ * the firmware update in the background if the URL is valid. It also publishes the start
+ * of the update or the reason why it was rejected, e.g. when another update is running.
+ * The progress and the result are published by periodicFirmwareUpdatePublishAWS().
+ * The firmware binary may be gzip compressed, the optional
+ * "firmware_size" key specifies its decompressed size used for the progress indication.
+ * The optional "firmware_sha256" key is verified before the new firmware is activated and
+ * "firmware_signature" is required if signed firmware is enabled (USE_FIRMWARE_SIGNATURE).
  *
  * @param doc The JSON document containing the firmware update command.
  *
  * The JSON document is expected to have the following structure:
  * {
- *     "firmware_url": "http://example.com/firmware.bin"
+ *     "firmware_url": "http://example.com/firmware.bin.gz",
+ *     "firmware_size": 1048576, // Optional
+ *     "firmware_sha256": "<64 hexadecimal characters>", // Optional
+ *     "firmware_signature": "<Base64 signature>" // Optional
  * }
  */
 void handleUpdateCommand(JsonDocument &doc)
 {
-#define FIRMWARE_URL_KEY "firmware_url"
-
-    // Extract the firmware URL from the JSON document
-    const char *firmwareUrl = doc[FIRMWARE_URL_KEY];
-
-    if (firmwareUrl && strlen(firmwareUrl) > 0)
+#define FIRMWARE_URL_KEY       "firmware_url"
+#define FIRMWARE_SIZE_KEY      "firmware_size"
+#define FIRMWARE_SHA256_KEY    "firmware_sha256"
+#define FIRMWARE_SIGNATURE_KEY "firmware_signature"
+
+    // Extract the firmware URL and the optional parameters from the JSON document
+    FirmwareUpdateRequest request;
+    request.url = doc[FIRMWARE_URL_KEY];
+    request.imageSize = doc[FIRMWARE_SIZE_KEY] | 0;
+    request.sha256 = doc[FIRMWARE_SHA256_KEY];
+    request.signature = doc[FIRMWARE_SIGNATURE_KEY];
+
+    if (request.url && strlen(request.url) > 0)
     {
-        // Publish the start of the firmware update
-        publishFirmwareUpdateStart(firmwareUrl);
+        // Start the firmware update in the background
+        const char *rejectReason = startFirmwareUpdate(request);
 
-        // Perform the firmware update
-        performFirmwareUpdate(firmwareUrl, publishFirmwareUpdateResult);
+        // Publish the start of the firmware update or why it was rejected
+        if (rejectReason == NULL)
+            publishFirmwareUpdateStart(request.url);
+        else
+            publishFirmwareUpdateRejected(rejectReason);
     }
     else
     {
         publishFirmwareUpdateResult(false, "Invalid update command received: no '" FIRMWARE_URL_KEY "' key found");
     }
 }
+
+#ifdef ENABLE_COMMAND_TRACE
+/**
+ * @brief Handles the command of the trace recorder received in a JSON document.
+ *
+ * The "replay" action passes the recorded LEDs commands through the parser and the LED engine
+ * again, with the recorded timing scaled by the optional "speed" in percent (0 replays without
+ * delays). The report is printed on the serial console and published in the diagnostics.
+ * The "stop" action stops the replay and the "clear" action deletes the trace.
+ *
+ * @param doc The JSON document containing the trace command.
+ *
+ * The JSON document is expected to have the following structure:
+ * {
+ *     "action": "replay", // "replay", "stop" or "clear"
+ *     "speed": 100 // Optional
+ * }
+ */
+void handleTraceCommand(JsonDocument &doc)
+{
+    const char *action = doc["action"] | "";
+
+    if (strcmp(action, "replay") == 0)
+        startTraceReplay(doc["speed"] | 100);
+    else if (strcmp(action, "stop") == 0)
+        stopTraceReplay();
+    else if (strcmp(action, "clear") == 0)
+        clearCommandTrace();
+    else
+        LOG_ERROR("Invalid trace command received: %s", action);
+}
+#endif
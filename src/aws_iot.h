@@ -1,10 +1,24 @@
 #ifndef AWS_IOT_H
 #define AWS_IOT_H
 
+#include <ArduinoJson.h>
 #include <PubSubClient.h>
 
+// Size of the buffer serializing the published JSON messages (in bytes)
+#define AWS_PUBLISH_BUFFER_SIZE 1536
+// Interval for publishing device status (in milliseconds)
+#define AWS_STATUS_PUBLISH_INTERVAL (60 * 1000)
+// Maximum length of the payload printed for a received message
+#define AWS_MAX_PRINTABLE_LENGTH 128
+// Initial delay before attempting to reconnect to AWS IoT (in milliseconds)
+#define AWS_RECONNECT_INITIAL_DELAY 100
+// Maximum delay between reconnection attempts to AWS IoT (in milliseconds)
+#define AWS_RECONNECT_MAX_DELAY     30000
+
 void initAWS(const char *id, size_t idLength);
 void maintainAWSConnection();
 void periodicStatusPublishAWS();
+void periodicFirmwareUpdatePublishAWS();
+void fillStatusJson(JsonDocument &doc);
 
 #endif // AWS_IOT_H
\ No newline at end of file
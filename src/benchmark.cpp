@@ -0,0 +1,272 @@
+#include "benchmark.h"
+
+#ifdef RUN_BENCHMARKS
+
+#include <ArduinoJson.h>
+#include <esp_timer.h>
+#include "aws_iot.h"
+#include "leds_parser.h"
+#include "leds.h"
+#include "logger.h"
+
+// Minimal LEDs command, the same as test/example_leds_minimal_payload.json
+static const char MINIMAL_LEDS_PAYLOAD[] = "{\"leds\":[{\"id\":64,\"cl\":\"FFFF00\"}]}";
+
+// Case of the benchmark suite
+struct BenchmarkCase
+{
+    const char *name;  // Name of the case in the results
+    void (*prepare)(); // Called before every run, not timed (could be NULL)
+    void (*run)();     // Timed code
+};
+
+// Payloads and documents used by the cases
+static String fullLedsPayload;
+static JsonDocument minimalLedsDoc;
+static JsonDocument fullLedsDoc;
+
+// Number of LEDs running an effect in the frame benchmark
+static uint8_t activeLeds = 0;
+// Progress shown by the progress indicator benchmark
+static uint8_t progress = 0;
+
+/**
+ * @brief Builds the largest LEDs command: all LEDs with all the optional fields and a color palette.
+ *
+ * @param payload Receives the serialized command.
+ */
+void buildFullLedsPayload(String &payload)
+{
+    JsonDocument doc;
+    doc["bright"] = 200;
+    doc["duration"] = 500;
+    doc["count"] = 20;
+
+    JsonArray colors = doc["colors"].to<JsonArray>();
+    colors.add("FF0000");
+    colors.add("00FF00");
+    colors.add("0000FF");
+    colors.add("FFFF00");
+    colors.add("FF00FF");
+
+    JsonArray ledsArray = doc["leds"].to<JsonArray>();
+    for (uint8_t i = 1; i <= LEDS_COUNT; i++)
+    {
+        JsonObject led = ledsArray.add<JsonObject>();
+        led["id"] = i;
+        if (i % 2)
+            led["cl"] = "FF8000";
+        else
+            led["cx"] = i % 5;
+        led["br"] = 100 + i;
+        led["dr"] = 600;
+        led["ct"] = 3;
+    }
+
+    payload = "";
+    serializeJson(doc, payload);
+}
+
+/**
+ * @brief Drops the commands queued by the previous run.
+ */
+void prepareClearLeds()
+{
+    resetLedsStates();
+}
+
+/**
+ * @brief Applies the minimal LEDs command.
+ */
+void runParseMinimal()
+{
+    setLedsFromJsonDoc(minimalLedsDoc);
+}
+
+/**
+ * @brief Applies the LEDs command for all LEDs.
+ */
+void runParseFull()
+{
+    setLedsFromJsonDoc(fullLedsDoc);
+}
+
+/**
+ * @brief Deserializes the LEDs command for all LEDs, as done for every received MQTT message.
+ */
+void runDeserializeFull()
+{
+    JsonDocument doc;
+    deserializeJson(doc, fullLedsPayload);
+}
+
+/**
+ * @brief Starts an infinite fade effect on the first activeLeds LEDs.
+ */
+void prepareFrame()
+{
+    static uint8_t preparedLeds = UINT8_MAX;
+    if (preparedLeds == activeLeds)
+        return;
+
+    resetLedsStates();
+    LedCommand command = {255, 1000, LOOP_INDEFINITELY, CRGB::White};
+    for (uint8_t i = 0; i < activeLeds; i++)
+        pushLedCommand(i, command);
+
+    // Take the commands from the queues, so the timed frames only render the effect
+    refreshLeds();
+    preparedLeds = activeLeds;
+}
+
+/**
+ * @brief Calculates and shows a single frame.
+ */
+void runFrame()
+{
+    refreshLeds();
+}
+
+/**
+ * @brief Builds and serializes the device status.
+ */
+void runStatusSerialization()
+{
+    JsonDocument doc;
+    char buffer[AWS_PUBLISH_BUFFER_SIZE];
+    fillStatusJson(doc);
+    serializeJson(doc, buffer, sizeof(buffer));
+}
+
+/**
+ * @brief Updates the progress indicator.
+ */
+void runProgressIndicator()
+{
+    progressIndicator(progress, CRGB::Blue);
+    progress = (progress + 1) % 101;
+}
+
+/**
+ * @brief Logs the largest message of the hot paths, the arrival of an MQTT message in messageHandler().
+ *
+ * Only the copying of the arguments is timed, the message is formatted later by the logger task.
+ * Most of the runs are dropped by the rate limiter, which is checked after the arguments are copied.
+ */
+void runLogCall()
+{
+    LOG_INFO("IoT message arrived. Topic: %s. Size: %u bytes. Payload (first %d bytes): %.*s",
+             MQTT_SUB_TOPIC_LEDS, (uint32_t)fullLedsPayload.length(), AWS_MAX_PRINTABLE_LENGTH,
+             AWS_MAX_PRINTABLE_LENGTH, fullLedsPayload.c_str());
+}
+
+/**
+ * @brief Compares two samples for sorting.
+ *
+ * @param a Pointer to the first sample.
+ * @param b Pointer to the second sample.
+ * @return Negative, zero or positive value as required by qsort().
+ */
+int compareSamples(const void *a, const void *b)
+{
+    uint32_t first = *(const uint32_t *)a;
+    uint32_t second = *(const uint32_t *)b;
+    return (first > second) - (first < second);
+}
+
+/**
+ * @brief Runs one case of the suite and prints its results as a CSV line.
+ *
+ * @param benchmark The case to run.
+ * @param param Parameter of the case printed in the results (e.g. number of active LEDs).
+ * @param samples Buffer for BENCHMARK_RUNS samples.
+ */
+void runBenchmark(const BenchmarkCase &benchmark, uint32_t param, uint32_t *samples)
+{
+    for (uint16_t i = 0; i < BENCHMARK_WARMUP_RUNS; i++)
+    {
+        if (benchmark.prepare)
+            benchmark.prepare();
+        benchmark.run();
+    }
+
+    uint64_t total = 0;
+    for (uint16_t i = 0; i < BENCHMARK_RUNS; i++)
+    {
+        if (benchmark.prepare)
+            benchmark.prepare();
+
+        int64_t start = esp_timer_get_time();
+        benchmark.run();
+        samples[i] = esp_timer_get_time() - start;
+        total += samples[i];
+    }
+
+    qsort(samples, BENCHMARK_RUNS, sizeof(uint32_t), compareSamples);
+
+    // name,param,runs,min,p50,p90,p99,max,mean
+    Serial.printf("BENCH,%s,%u,%u,%u,%u,%u,%u,%u,%u\n", benchmark.name, param, BENCHMARK_RUNS,
+                  samples[0], samples[BENCHMARK_RUNS * 50 / 100], samples[BENCHMARK_RUNS * 90 / 100],
+                  samples[BENCHMARK_RUNS * 99 / 100], samples[BENCHMARK_RUNS - 1], (uint32_t)(total / BENCHMARK_RUNS));
+}
+
+/**
+ * @brief Runs the benchmarks of the hot paths and prints the results on the serial console.
+ *
+ * Every case is run BENCHMARK_WARMUP_RUNS times untimed and then BENCHMARK_RUNS times timed.
+ * Results are printed as CSV lines prefixed with "BENCH," (times in microseconds), so they
+ * could be extracted from the serial log and compared between firmware releases.
+ *
+ * The LED rendering is stopped while the benchmarks run, so the frames are rendered only
+ * by the benchmarks. The progress indicator runs last, as it wakes the LED task.
+ *
+ * @note Only built if RUN_BENCHMARKS is defined. Should be called at the end of the setup.
+ */
+void runBenchmarks()
+{
+    uint32_t *samples = (uint32_t *)malloc(BENCHMARK_RUNS * sizeof(uint32_t));
+    if (samples == NULL)
+    {
+        Serial.println(F("Benchmarks: not enough memory"));
+        return;
+    }
+
+    // Prepare the payloads
+    buildFullLedsPayload(fullLedsPayload);
+    deserializeJson(minimalLedsDoc, MINIMAL_LEDS_PAYLOAD);
+    deserializeJson(fullLedsDoc, fullLedsPayload);
+
+    setLedsRendering(false);
+    delay(100); // Let the LED task finish the current frame
+
+    Serial.printf("BENCH_START,%s,%u\n", FIRMWARE_VERSION, fullLedsPayload.length());
+    Serial.println(F("BENCH_HEADER,name,param,runs,min_us,p50_us,p90_us,p99_us,max_us,mean_us"));
+
+    runBenchmark({"parse_minimal", prepareClearLeds, runParseMinimal}, 0, samples);
+    runBenchmark({"parse_full", prepareClearLeds, runParseFull}, 0, samples);
+    runBenchmark({"deserialize_full", NULL, runDeserializeFull}, fullLedsPayload.length(), samples);
+
+    const uint8_t activeLedsCounts[] = {0, LEDS_COUNT / 4, LEDS_COUNT / 2, LEDS_COUNT};
+    for (uint8_t count : activeLedsCounts)
+    {
+        activeLeds = count;
+        runBenchmark({"frame", prepareFrame, runFrame}, count, samples);
+    }
+
+    runBenchmark({"status_json", NULL, runStatusSerialization}, 0, samples);
+    runBenchmark({"log_call", NULL, runLogCall}, AWS_MAX_PRINTABLE_LENGTH, samples);
+    runBenchmark({"progress_indicator", NULL, runProgressIndicator}, 0, samples);
+
+    Serial.println(F("BENCH_END"));
+
+    stopProgressIndication();
+    resetLedsStates();
+    setLedsRendering(true);
+
+    free(samples);
+    fullLedsPayload = String();
+    minimalLedsDoc.clear();
+    fullLedsDoc.clear();
+}
+
+#endif // RUN_BENCHMARKS
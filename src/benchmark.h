@@ -0,0 +1,14 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "constants.h"
+
+#ifdef RUN_BENCHMARKS
+// Number of untimed runs before the measurement and number of timed runs
+#define BENCHMARK_WARMUP_RUNS 10
+#define BENCHMARK_RUNS        200
+
+void runBenchmarks();
+#endif
+
+#endif // BENCHMARK_H
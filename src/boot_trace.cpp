@@ -0,0 +1,104 @@
+#include <esp_timer.h>
+#include "boot_trace.h"
+
+// Names of the boot stages used in the status message and on the serial console
+static const char *const bootStageNames[BOOT_STAGE_COUNT] = {
+    "setup_start",
+    "serial",
+    "leds_init",
+    "leds_first_frame",
+    "power",
+    "filesystem",
+    "drd",
+    "config",
+    "wifi_manager",
+    "aws_init",
+    "ha_init",
+    "setup_done",
+    "wifi_connected",
+    "aws_connected",
+};
+
+// Spinlock protecting the trace, stages are recorded from multiple tasks
+static portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Recorded stages in the order they were reached, every stage is recorded only once
+static BootTraceEntry trace[BOOT_STAGE_COUNT];
+static uint8_t traceCount = 0;
+static uint32_t recordedStages = 0;
+
+/**
+ * @brief Records the time when the boot stage was reached.
+ *
+ * Only the first occurrence of every stage is recorded, so the function could be called
+ * from code that runs repeatedly, e.g. on every reconnection.
+ *
+ * @param stage The reached boot stage.
+ * @return true if the stage was recorded, false if it was already recorded before.
+ */
+bool bootTraceMark(BootStage stage)
+{
+    uint32_t timeUs = (uint32_t)esp_timer_get_time();
+    uint32_t stageBit = 1UL << stage;
+    bool recorded = false;
+
+    portENTER_CRITICAL(&traceMux);
+    if (stage < BOOT_STAGE_COUNT && !(recordedStages & stageBit))
+    {
+        recordedStages |= stageBit;
+        trace[traceCount].stage = stage;
+        trace[traceCount].timeUs = timeUs;
+        traceCount++;
+        recorded = true;
+    }
+    portEXIT_CRITICAL(&traceMux);
+
+    return recorded;
+}
+
+/**
+ * @brief Copies the recorded boot stages.
+ *
+ * @param entries Buffer for the recorded stages.
+ * @param maxEntries Size of the buffer.
+ * @return Number of the copied stages.
+ */
+uint8_t getBootTrace(BootTraceEntry *entries, uint8_t maxEntries)
+{
+    portENTER_CRITICAL(&traceMux);
+    uint8_t count = min(traceCount, maxEntries);
+    memcpy(entries, trace, count * sizeof(BootTraceEntry));
+    portEXIT_CRITICAL(&traceMux);
+
+    return count;
+}
+
+/**
+ * @brief Returns the name of the boot stage.
+ *
+ * @param stage The boot stage.
+ * @return The name of the stage.
+ */
+const char *bootStageToString(uint8_t stage)
+{
+    return stage < BOOT_STAGE_COUNT ? bootStageNames[stage] : "unknown";
+}
+
+/**
+ * @brief Prints the recorded boot stages with the time spent in each of them.
+ */
+void printBootTrace()
+{
+    BootTraceEntry entries[BOOT_STAGE_COUNT];
+    uint8_t count = getBootTrace(entries, BOOT_STAGE_COUNT);
+
+    Serial.println(F("Boot trace (time since power-on, time since the previous stage):"));
+
+    uint32_t previousUs = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        Serial.printf("  %-18s %8.1f ms %8.1f ms\n", bootStageToString(entries[i].stage),
+                      entries[i].timeUs / 1000.0f, (entries[i].timeUs - previousUs) / 1000.0f);
+        previousUs = entries[i].timeUs;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef BOOT_TRACE_H
+#define BOOT_TRACE_H
+
+#include <Arduino.h>
+
+// Stages of the boot sequence, recorded in the order they are reached
+enum BootStage
+{
+    BOOT_STAGE_SETUP_START,      // setup() entered
+    BOOT_STAGE_SERIAL,           // Serial port initialized
+    BOOT_STAGE_LEDS_INIT,        // LED task created
+    BOOT_STAGE_LEDS_FIRST_FRAME, // First frame shown by the LED task
+    BOOT_STAGE_POWER,            // Power management initialized
+    BOOT_STAGE_FILESYSTEM,       // LittleFS mounted
+    BOOT_STAGE_DRD,              // Double reset detection started
+    BOOT_STAGE_CONFIG,           // Config portal decision made (portal closed if it was opened)
+    BOOT_STAGE_WIFI_MANAGER,     // WiFi manager initialized, connection started
+    BOOT_STAGE_AWS_INIT,         // AWS IoT client initialized
+    BOOT_STAGE_HA_INIT,          // Home Assistant task created
+    BOOT_STAGE_SETUP_DONE,       // setup() finished
+    BOOT_STAGE_WIFI_CONNECTED,   // First WiFi connection established
+    BOOT_STAGE_AWS_CONNECTED,    // First connection to AWS IoT established
+    BOOT_STAGE_COUNT
+};
+
+// Recorded boot stage
+struct BootTraceEntry
+{
+    uint8_t stage;   // Stage ID (BootStage)
+    uint32_t timeUs; // Time since power-on (in microseconds)
+};
+
+bool bootTraceMark(BootStage stage);
+uint8_t getBootTrace(BootTraceEntry *entries, uint8_t maxEntries);
+const char *bootStageToString(uint8_t stage);
+void printBootTrace();
+
+#endif // BOOT_TRACE_H
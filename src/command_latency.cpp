@@ -0,0 +1,216 @@
+#include "command_latency.h"
+
+// Number of commands tracked at once, older incomplete commands are dropped
+#define LATENCY_PENDING_SLOTS 4
+
+// Upper limits of the histogram buckets (in microseconds), the last bucket collects the rest
+static const uint32_t bucketLimitsUs[LATENCY_BUCKETS_COUNT] = {
+    100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, UINT32_MAX};
+
+// Names of the stages used in the status messages
+static const char *const stageNames[LATENCY_STAGES_COUNT] = {"parse", "enqueue", "render", "total"};
+
+// Timestamps of a command waiting to be shown (in microseconds)
+struct PendingCommand
+{
+    uint8_t batch;       // Batch ID of the command, 0 if the slot is free
+    uint32_t receivedAt; // Message received
+    uint32_t parsedAt;   // JSON parsed
+    uint32_t enqueuedAt; // All LED commands queued, 0 if not yet
+    uint32_t renderedAt; // First frame shown, 0 if not yet
+};
+
+// Spinlock protecting the pending commands and the histograms, used by the MQTT and the LED tasks
+static portMUX_TYPE latencyMux = portMUX_INITIALIZER_UNLOCKED;
+
+static PendingCommand pending[LATENCY_PENDING_SLOTS];
+static LatencyHistogram histograms[LATENCY_STAGES_COUNT];
+
+// Batch ID of the last command and of the command being queued (0 if none)
+static uint8_t lastBatch = 0;
+static volatile uint8_t currentBatch = 0;
+
+/**
+ * @brief Adds a sample to the histogram of the stage. Must be called with latencyMux held.
+ *
+ * @param stage The stage.
+ * @param latencyUs The latency in microseconds.
+ */
+void recordLatency(LatencyStage stage, uint32_t latencyUs)
+{
+    LatencyHistogram &histogram = histograms[stage];
+
+    uint8_t bucket = 0;
+    while (latencyUs > bucketLimitsUs[bucket])
+        bucket++;
+
+    histogram.buckets[bucket]++;
+    histogram.count++;
+    if (latencyUs > histogram.maxUs)
+        histogram.maxUs = latencyUs;
+}
+
+/**
+ * @brief Records the latencies of the command once it was both queued and shown. Must be called with latencyMux held.
+ *
+ * @param command The command.
+ */
+void completeCommand(PendingCommand &command)
+{
+    if (command.enqueuedAt == 0 || command.renderedAt == 0)
+        return;
+
+    // The first LED could be shown before the last LED command was queued
+    uint32_t renderLatency = (int32_t)(command.renderedAt - command.enqueuedAt) > 0 ? command.renderedAt - command.enqueuedAt : 0;
+
+    recordLatency(LATENCY_PARSE, command.parsedAt - command.receivedAt);
+    recordLatency(LATENCY_ENQUEUE, command.enqueuedAt - command.parsedAt);
+    recordLatency(LATENCY_RENDER, renderLatency);
+    recordLatency(LATENCY_TOTAL, command.renderedAt - command.receivedAt);
+
+    command.batch = 0;
+}
+
+/**
+ * @brief Starts tracking a parsed LEDs command.
+ *
+ * LED commands queued until latencyCommandEnqueued() is called are tagged with the returned
+ * batch ID (see getLatencyBatch()), so the LED task could report when the command is shown.
+ *
+ * @param receivedAtUs Time when the message was received (micros()).
+ * @return The batch ID of the command.
+ */
+uint8_t latencyCommandParsed(uint32_t receivedAtUs)
+{
+    uint32_t timeNow = micros();
+
+    portENTER_CRITICAL(&latencyMux);
+    if (++lastBatch == 0)
+        lastBatch = 1;
+
+    PendingCommand &command = pending[lastBatch % LATENCY_PENDING_SLOTS];
+    command.batch = lastBatch;
+    command.receivedAt = receivedAtUs;
+    command.parsedAt = timeNow;
+    command.enqueuedAt = 0;
+    command.renderedAt = 0;
+    currentBatch = lastBatch;
+    portEXIT_CRITICAL(&latencyMux);
+
+    return lastBatch;
+}
+
+/**
+ * @brief Returns the batch ID for tagging the LED commands being queued.
+ *
+ * @return The batch ID of the command being queued, or 0 if no command is tracked.
+ */
+uint8_t getLatencyBatch()
+{
+    return currentBatch;
+}
+
+/**
+ * @brief Records that all LED commands of the command are queued.
+ *
+ * @param batch The batch ID of the command.
+ */
+void latencyCommandEnqueued(uint8_t batch)
+{
+    uint32_t timeNow = micros();
+
+    portENTER_CRITICAL(&latencyMux);
+    currentBatch = 0;
+
+    PendingCommand &command = pending[batch % LATENCY_PENDING_SLOTS];
+    if (command.batch == batch && command.enqueuedAt == 0)
+    {
+        command.enqueuedAt = timeNow;
+        completeCommand(command);
+    }
+    portEXIT_CRITICAL(&latencyMux);
+}
+
+/**
+ * @brief Records that a frame showing an LED command of the command was rendered.
+ *
+ * Only the first frame of every command is recorded, later calls are ignored.
+ *
+ * @param batch The batch ID of the command.
+ */
+void latencyCommandRendered(uint8_t batch)
+{
+    uint32_t timeNow = micros();
+
+    portENTER_CRITICAL(&latencyMux);
+    PendingCommand &command = pending[batch % LATENCY_PENDING_SLOTS];
+    if (command.batch == batch && command.renderedAt == 0)
+    {
+        command.renderedAt = timeNow;
+        completeCommand(command);
+    }
+    portEXIT_CRITICAL(&latencyMux);
+}
+
+/**
+ * @brief Copies the histogram of the stage.
+ *
+ * @param stage The stage.
+ * @param histogram Receives the histogram.
+ */
+void getLatencyHistogram(LatencyStage stage, LatencyHistogram &histogram)
+{
+    portENTER_CRITICAL(&latencyMux);
+    histogram = histograms[stage];
+    portEXIT_CRITICAL(&latencyMux);
+}
+
+/**
+ * @brief Estimates the percentile from the histogram.
+ *
+ * The result is the upper limit of the bucket containing the percentile, but never more than
+ * the largest sample.
+ *
+ * @param histogram The histogram.
+ * @param percentile The percentile (0-100).
+ * @return The latency in microseconds, 0 if there are no samples.
+ */
+uint32_t latencyPercentileUs(const LatencyHistogram &histogram, uint8_t percentile)
+{
+    if (histogram.count == 0)
+        return 0;
+
+    // Nearest rank, at least the first sample, so empty buckets below it are not reported
+    uint32_t target = max((uint32_t)(((uint64_t)histogram.count * percentile + 99) / 100), (uint32_t)1);
+    uint32_t cumulative = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS_COUNT; i++)
+    {
+        cumulative += histogram.buckets[i];
+        if (cumulative >= target)
+            return min(bucketLimitsUs[i], histogram.maxUs);
+    }
+
+    return histogram.maxUs;
+}
+
+/**
+ * @brief Returns the upper limit of the histogram bucket.
+ *
+ * @param bucket The bucket index.
+ * @return The limit in microseconds, UINT32_MAX for the last bucket.
+ */
+uint32_t latencyBucketLimitUs(uint8_t bucket)
+{
+    return bucket < LATENCY_BUCKETS_COUNT ? bucketLimitsUs[bucket] : UINT32_MAX;
+}
+
+/**
+ * @brief Returns the name of the stage.
+ *
+ * @param stage The stage.
+ * @return The name of the stage.
+ */
+const char *latencyStageToString(uint8_t stage)
+{
+    return stage < LATENCY_STAGES_COUNT ? stageNames[stage] : "unknown";
+}
@@ -0,0 +1,36 @@
+#ifndef COMMAND_LATENCY_H
+#define COMMAND_LATENCY_H
+
+#include <Arduino.h>
+
+// Number of buckets of the latency histograms
+#define LATENCY_BUCKETS_COUNT 14
+
+// Stages of the LEDs command measured by the histograms
+enum LatencyStage
+{
+    LATENCY_PARSE,   // Receive to JSON parsed
+    LATENCY_ENQUEUE, // JSON parsed to all LED commands queued
+    LATENCY_RENDER,  // All LED commands queued to the first frame showing the command
+    LATENCY_TOTAL,   // Receive to the first frame showing the command
+    LATENCY_STAGES_COUNT
+};
+
+// Histogram of the latency of one stage
+struct LatencyHistogram
+{
+    uint32_t buckets[LATENCY_BUCKETS_COUNT]; // Number of samples in each bucket
+    uint32_t count;                          // Number of samples
+    uint32_t maxUs;                          // Largest sample (in microseconds)
+};
+
+uint8_t latencyCommandParsed(uint32_t receivedAtUs);
+uint8_t getLatencyBatch();
+void latencyCommandEnqueued(uint8_t batch);
+void latencyCommandRendered(uint8_t batch);
+void getLatencyHistogram(LatencyStage stage, LatencyHistogram &histogram);
+uint32_t latencyPercentileUs(const LatencyHistogram &histogram, uint8_t percentile);
+uint32_t latencyBucketLimitUs(uint8_t bucket);
+const char *latencyStageToString(uint8_t stage);
+
+#endif // COMMAND_LATENCY_H
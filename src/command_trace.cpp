@@ -0,0 +1,422 @@
+#include "command_trace.h"
+
+#ifdef ENABLE_COMMAND_TRACE
+
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
+#include "command_latency.h"
+#include "ha_client.h"
+#include "leds_parser.h"
+#include "leds.h"
+#include "logger.h"
+#include "system_clock.h"
+
+// Files of the trace, the older segment is discarded when the current one is full
+#define TRACE_FILENAME     "/trace.bin"
+#define TRACE_OLD_FILENAME "/trace.old"
+// Size of a trace segment in the flash (in bytes)
+#define TRACE_SEGMENT_SIZE (24 * 1024U)
+
+// Size of the RAM buffer holding the records until they are written to the flash (in bytes)
+#define TRACE_STAGING_SIZE 4096
+
+// Largest payload stored in the trace, longer ones are recorded by the hash and size only
+#define TRACE_MAX_PAYLOAD_SIZE 1024
+// Maximum number of records replayed in one call, so the loop keeps serving MQTT at full speed
+#define TRACE_REPLAY_BURST     8
+
+// The record is followed by the payload
+#define TRACE_FLAG_PAYLOAD 0x01
+
+// Header of a record in the trace
+struct __attribute__((packed)) TraceRecordHeader
+{
+    uint32_t timeMs; // Time when the message was received (clockMillis())
+    uint32_t crc;    // CRC32 of the payload
+    uint16_t length; // Length of the payload
+    uint8_t topic;   // TraceTopic of the message
+    uint8_t flags;   // TRACE_FLAG_* bits
+};
+
+// Records waiting to be written to the flash. The recorder and the replay run in the loop task
+static uint8_t staging[TRACE_STAGING_SIZE];
+static size_t stagingUsed = 0;
+static uint32_t lastFlushTime = 0;
+
+static TraceStats traceStats = {};
+
+// Segments in the order of replay
+static const char *const segmentFilenames[] = {TRACE_OLD_FILENAME, TRACE_FILENAME};
+
+// State of the replay
+static File replayFile;
+static uint8_t replaySegment = 0;
+static uint16_t replaySpeed = 100;
+static uint32_t replayBeganMs = 0;
+// Schedule of the records of the current boot: time of its start and recorded time of its first record
+static uint32_t replayStartMs = 0;
+static uint32_t replayFirstRecordMs = 0;
+// Time when the last replayed record was due
+static uint32_t replayLastDueMs = 0;
+static bool replayRecordLoaded = false;
+static TraceRecordHeader replayRecord;
+static uint8_t replayPayload[TRACE_MAX_PAYLOAD_SIZE];
+static uint64_t replayLagSumMs = 0;
+
+// Counters at the start of the replay
+static uint32_t renderedAtStart = 0;
+static uint32_t queueDropsAtStart = 0;
+static uint32_t deadlineMissesAtStart = 0;
+
+/**
+ * @brief Appends the record to the RAM buffer.
+ *
+ * @param header The header of the record.
+ * @param payload The payload stored with the record, NULL if none.
+ * @return true if the record was buffered, false if the buffer is full.
+ */
+bool stageRecord(const TraceRecordHeader &header, const uint8_t *payload)
+{
+    size_t payloadSize = (header.flags & TRACE_FLAG_PAYLOAD) ? header.length : 0;
+    if (stagingUsed + sizeof(header) + payloadSize > sizeof(staging))
+        return false;
+
+    memcpy(staging + stagingUsed, &header, sizeof(header));
+    if (payloadSize > 0)
+        memcpy(staging + stagingUsed + sizeof(header), payload, payloadSize);
+    stagingUsed += sizeof(header) + payloadSize;
+    return true;
+}
+
+/**
+ * @brief Starts the records of this boot with a boot marker.
+ *
+ * The times of the records restart at every boot, so the replay starts a new schedule at the
+ * marker instead of mixing the times of different boots. Records buffered before the call are
+ * discarded, as they were lost with the RAM on a real reboot.
+ *
+ * @note This function should be called once during the setup phase of the program.
+ */
+void initCommandTrace()
+{
+    stopTraceReplay();
+    stagingUsed = 0;
+    lastFlushTime = clockMillis();
+
+    TraceRecordHeader header = {clockMillis(), 0, 0, TRACE_TOPIC_BOOT, 0};
+    stageRecord(header, NULL);
+}
+
+/**
+ * @brief Records a received MQTT message into the trace.
+ *
+ * The record is only copied into a RAM buffer, it is written to the flash later by
+ * handleCommandTrace(). LEDs commands up to TRACE_MAX_PAYLOAD_SIZE bytes are stored with the
+ * payload, other messages (and all messages if COMMAND_TRACE_HASH_ONLY is defined) only with
+ * the CRC32 and the size. Messages are dropped and counted if the buffer is full.
+ *
+ * @param topic The kind of the topic.
+ * @param payload The payload of the message.
+ * @param length The length of the payload.
+ */
+void traceRecordCommand(TraceTopic topic, const uint8_t *payload, size_t length)
+{
+    TraceRecordHeader header;
+    header.timeMs = clockMillis();
+    header.crc = esp_rom_crc32_le(0, payload, length);
+    header.length = min(length, (size_t)UINT16_MAX);
+    header.topic = topic;
+    header.flags = 0;
+#ifndef COMMAND_TRACE_HASH_ONLY
+    if (topic == TRACE_TOPIC_LEDS && length <= TRACE_MAX_PAYLOAD_SIZE)
+        header.flags |= TRACE_FLAG_PAYLOAD;
+#endif
+
+    if (!stageRecord(header, payload))
+    {
+        traceStats.dropped++;
+        return;
+    }
+
+    traceStats.recorded++;
+}
+
+/**
+ * @brief Appends the buffered records to the current segment and starts a new segment when
+ * the current one is full.
+ */
+void flushCommandTrace()
+{
+    lastFlushTime = clockMillis();
+    if (stagingUsed == 0)
+        return;
+
+    File file = LittleFS.open(TRACE_FILENAME, "a");
+    if (!file)
+    {
+        LOG_ERROR("Failed to open %s, %u bytes of the trace lost", TRACE_FILENAME, (uint32_t)stagingUsed);
+        stagingUsed = 0;
+        return;
+    }
+
+    size_t written = file.write(staging, stagingUsed);
+    size_t segmentSize = file.size();
+    file.close();
+
+    if (written != stagingUsed)
+        LOG_ERROR("Failed to write the trace, %u of %u bytes written", (uint32_t)written, (uint32_t)stagingUsed);
+    stagingUsed = 0;
+
+    // The oldest records are discarded
+    if (segmentSize >= TRACE_SEGMENT_SIZE)
+    {
+        if (LittleFS.exists(TRACE_OLD_FILENAME))
+            LittleFS.remove(TRACE_OLD_FILENAME);
+        LittleFS.rename(TRACE_FILENAME, TRACE_OLD_FILENAME);
+    }
+}
+
+/**
+ * @brief Reads the next record of the trace into replayRecord and replayPayload.
+ *
+ * A truncated or corrupted record ends the segment.
+ *
+ * @return true if a record was read, false at the end of the trace.
+ */
+bool readNextRecord()
+{
+    for (;;)
+    {
+        if (!replayFile)
+        {
+            if (replaySegment >= sizeof(segmentFilenames) / sizeof(segmentFilenames[0]))
+                return false;
+
+            const char *filename = segmentFilenames[replaySegment++];
+            if (LittleFS.exists(filename))
+                replayFile = LittleFS.open(filename, "r");
+            continue;
+        }
+
+        bool valid = replayFile.readBytes((char *)&replayRecord, sizeof(replayRecord)) == sizeof(replayRecord);
+        if (valid && (replayRecord.flags & TRACE_FLAG_PAYLOAD))
+        {
+            valid = replayRecord.length <= TRACE_MAX_PAYLOAD_SIZE &&
+                    replayFile.readBytes((char *)replayPayload, replayRecord.length) == replayRecord.length;
+        }
+
+        if (valid)
+            return true;
+
+        replayFile.close();
+        replayFile = File();
+    }
+}
+
+/**
+ * @brief Passes the loaded record through the parser and the LED engine like a received message.
+ *
+ * @param lagMs The delay of the record behind the schedule.
+ */
+void replayRecordNow(uint32_t lagMs)
+{
+    if (replayRecord.topic != TRACE_TOPIC_LEDS || !(replayRecord.flags & TRACE_FLAG_PAYLOAD))
+    {
+        traceStats.skipped++;
+        return;
+    }
+
+    if (esp_rom_crc32_le(0, replayPayload, replayRecord.length) != replayRecord.crc)
+    {
+        traceStats.invalid++;
+        return;
+    }
+
+    JsonDocument doc;
+    if (deserializeJson(doc, replayPayload, replayRecord.length))
+    {
+        traceStats.invalid++;
+        return;
+    }
+
+    // Commands are measured like received ones, they are not shown if the map is off
+    if (isMapOn())
+        handleLedsCommand(doc, micros());
+
+    traceStats.replayed++;
+    replayLagSumMs += lagMs;
+    if (lagMs > traceStats.lagMaxMs)
+        traceStats.lagMaxMs = lagMs;
+}
+
+/**
+ * @brief Ends the replay and prints the report on the serial console.
+ */
+void finishTraceReplay()
+{
+    if (replayFile)
+        replayFile.close();
+    replayFile = File();
+    replayRecordLoaded = false;
+
+    LatencyHistogram histogram;
+    getLatencyHistogram(LATENCY_TOTAL, histogram);
+
+    traceStats.replaying = false;
+    traceStats.lagAvgMs = traceStats.replayed > 0 ? replayLagSumMs / traceStats.replayed : 0;
+    traceStats.rendered = histogram.count - renderedAtStart;
+    traceStats.queueDrops = getLedCommandDrops() - queueDropsAtStart;
+    traceStats.deadlineMisses = getFrameStats().totalMisses - deadlineMissesAtStart;
+
+    Serial.printf("Trace replay finished in %u ms: %u replayed, %u skipped, %u invalid, %u boots\n",
+                  (uint32_t)(clockMillis() - replayBeganMs), traceStats.replayed, traceStats.skipped, traceStats.invalid, traceStats.boots);
+    Serial.printf("Trace replay lag: avg %u ms, max %u ms. Rendered: %u, queue drops: %u, missed frames: %u\n",
+                  traceStats.lagAvgMs, traceStats.lagMaxMs, traceStats.rendered, traceStats.queueDrops,
+                  traceStats.deadlineMisses);
+}
+
+/**
+ * @brief Replays the records that are due.
+ *
+ * The schedule restarts at every boot marker: the records of the next boot follow the last
+ * record of the previous one, as the time between the boots is not known.
+ */
+void replayDueRecords()
+{
+    for (uint8_t i = 0; i < TRACE_REPLAY_BURST && replayRecordLoaded; i++)
+    {
+        if (replayRecord.topic == TRACE_TOPIC_BOOT)
+        {
+            traceStats.boots++;
+            replayStartMs = replayLastDueMs;
+            replayFirstRecordMs = replayRecord.timeMs;
+            replayRecordLoaded = readNextRecord();
+            continue;
+        }
+
+        uint32_t offsetMs = replayRecord.timeMs - replayFirstRecordMs;
+        uint32_t dueAt = replayStartMs + (replaySpeed > 0 ? (uint64_t)offsetMs * 100 / replaySpeed : 0);
+        uint32_t timeNow = clockMillis();
+        if (!clockReached(timeNow, dueAt))
+            return;
+
+        replayRecordNow(timeNow - dueAt);
+        replayLastDueMs = dueAt;
+        replayRecordLoaded = readNextRecord();
+    }
+
+    if (!replayRecordLoaded)
+        finishTraceReplay();
+}
+
+/**
+ * @brief Writes the recorded messages to the flash and runs the replay.
+ *
+ * The records are written every TRACE_FLUSH_INTERVAL_MS or when the buffer is half full.
+ * Nothing is written while a replay is running, so the records stay in the buffer until
+ * the replay ends.
+ *
+ * @note This function should be called in the main loop.
+ */
+void handleCommandTrace()
+{
+    if (traceStats.replaying)
+    {
+        replayDueRecords();
+        return;
+    }
+
+    if (stagingUsed > 0 && (stagingUsed >= TRACE_STAGING_SIZE / 2 || clockMillis() - lastFlushTime >= TRACE_FLUSH_INTERVAL_MS))
+        flushCommandTrace();
+}
+
+/**
+ * @brief Starts the replay of the recorded LEDs commands.
+ *
+ * The commands are passed through the parser and the LED engine with the recorded timing
+ * scaled by the speed. The report with the lag behind the schedule, the drops and the rendered
+ * frames is printed when the replay ends and returned by getTraceStats().
+ *
+ * @param speedPercent The replay speed in percent of the recorded timing, 0 for no delays.
+ * @return true if the replay started, false if a replay is already running or the trace is empty.
+ */
+bool startTraceReplay(uint16_t speedPercent)
+{
+    if (traceStats.replaying)
+        return false;
+
+    flushCommandTrace();
+
+    replaySegment = 0;
+    replayRecordLoaded = readNextRecord();
+    if (!replayRecordLoaded)
+    {
+        LOG_WARN("The command trace is empty");
+        return false;
+    }
+
+    LatencyHistogram histogram;
+    getLatencyHistogram(LATENCY_TOTAL, histogram);
+    renderedAtStart = histogram.count;
+    queueDropsAtStart = getLedCommandDrops();
+    deadlineMissesAtStart = getFrameStats().totalMisses;
+
+    traceStats.replaying = true;
+    traceStats.replayed = 0;
+    traceStats.skipped = 0;
+    traceStats.invalid = 0;
+    traceStats.boots = 0;
+    traceStats.lagAvgMs = 0;
+    traceStats.lagMaxMs = 0;
+    traceStats.rendered = 0;
+    traceStats.queueDrops = 0;
+    traceStats.deadlineMisses = 0;
+    replayLagSumMs = 0;
+    replaySpeed = speedPercent;
+    replayFirstRecordMs = replayRecord.timeMs;
+    replayBeganMs = clockMillis();
+    replayStartMs = replayBeganMs;
+    replayLastDueMs = replayBeganMs;
+
+    LOG_INFO("Replaying the command trace at %u %% speed", speedPercent);
+    return true;
+}
+
+/**
+ * @brief Stops the running replay and prints the report.
+ */
+void stopTraceReplay()
+{
+    if (traceStats.replaying)
+        finishTraceReplay();
+}
+
+/**
+ * @brief Stops the replay and deletes the recorded trace.
+ */
+void clearCommandTrace()
+{
+    stopTraceReplay();
+
+    stagingUsed = 0;
+    for (const char *filename : segmentFilenames)
+    {
+        if (LittleFS.exists(filename))
+            LittleFS.remove(filename);
+    }
+
+    LOG_INFO("Command trace cleared");
+}
+
+/**
+ * @brief Returns the counters of the recorder and the result of the last replay.
+ *
+ * @return The counters.
+ */
+TraceStats getTraceStats()
+{
+    return traceStats;
+}
+
+#endif // ENABLE_COMMAND_TRACE
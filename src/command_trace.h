@@ -0,0 +1,47 @@
+#ifndef COMMAND_TRACE_H
+#define COMMAND_TRACE_H
+
+#include <Arduino.h>
+#include "constants.h"
+
+#ifdef ENABLE_COMMAND_TRACE
+
+// Interval of writing the buffered records to the flash (in milliseconds)
+#define TRACE_FLUSH_INTERVAL_MS 2000
+
+// Kind of the topic of a recorded message, only LEDs commands are replayed
+enum TraceTopic : uint8_t
+{
+    TRACE_TOPIC_LEDS,
+    TRACE_TOPIC_OTHER,
+    TRACE_TOPIC_BOOT // Marker recorded at every boot, the recorded times restart at it
+};
+
+// Counters of the recorder and the result of the last replay
+struct TraceStats
+{
+    uint32_t recorded;       // Messages written to the trace since boot
+    uint32_t dropped;        // Messages not recorded because the staging buffer was full
+    bool replaying;          // Whether a replay is running
+    uint32_t replayed;       // LEDs commands passed to the parser by the replay
+    uint32_t skipped;        // Records without a payload or of other topics
+    uint32_t invalid;        // Records with a corrupted payload or rejected by the parser
+    uint32_t boots;          // Boot markers passed by the replay
+    uint32_t lagAvgMs;       // Average delay of the replayed commands behind the schedule
+    uint32_t lagMaxMs;       // Largest delay of the replayed commands behind the schedule
+    uint32_t rendered;       // Commands shown during the replay
+    uint32_t queueDrops;     // LED commands dropped during the replay because the queues were full
+    uint32_t deadlineMisses; // Frames that missed the deadline during the replay
+};
+
+void initCommandTrace();
+void traceRecordCommand(TraceTopic topic, const uint8_t *payload, size_t length);
+void handleCommandTrace();
+bool startTraceReplay(uint16_t speedPercent);
+void stopTraceReplay();
+void clearCommandTrace();
+TraceStats getTraceStats();
+
+#endif // ENABLE_COMMAND_TRACE
+
+#endif // COMMAND_TRACE_H
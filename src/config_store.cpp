@@ -0,0 +1,487 @@
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
+#include "config_store.h"
+
+// Identification of the store file ("CZCF") and version of its layout
+#define CONFIG_STORE_MAGIC          0x46435A43
+#define CONFIG_STORE_SCHEMA_VERSION 1
+
+// Header of the store file, followed by the records
+struct ConfigFileHeader
+{
+    uint32_t magic;       // CONFIG_STORE_MAGIC
+    uint16_t version;     // CONFIG_STORE_SCHEMA_VERSION of the writer
+    uint16_t recordCount; // Number of the records
+    uint32_t dataSize;    // Size of the records (in bytes)
+    uint32_t crc;         // CRC32 of the records
+};
+
+// Header of a record in the store file, followed by the key and the value
+struct ConfigRecordHeader
+{
+    uint8_t type;       // ConfigType
+    uint8_t keyLength;  // Length of the key without the null terminator
+    uint16_t valueSize; // Size of the value (in bytes)
+};
+
+// Record cached in RAM
+struct ConfigRecord
+{
+    char key[CONFIG_KEY_MAX_LENGTH + 1];
+    ConfigType type;
+    uint16_t size;
+    uint8_t *value;
+};
+
+// Maximum size of the records in the store file
+#define CONFIG_MAX_DATA_SIZE (CONFIG_MAX_RECORDS * (sizeof(ConfigRecordHeader) + CONFIG_KEY_MAX_LENGTH + CONFIG_MAX_VALUE_SIZE))
+
+// Records cached in RAM, reads are served from here only
+static ConfigRecord records[CONFIG_MAX_RECORDS];
+static uint8_t recordCount = 0;
+// Indicates that the cache differs from the store file
+static bool dirty = false;
+
+// Mutex protecting the cache, the store could be used from multiple tasks
+static SemaphoreHandle_t storeMutex = NULL;
+
+/**
+ * @brief Finds the cached record with the given key.
+ *
+ * @param key The key of the record.
+ * @return The record, or NULL if there is no such record.
+ */
+ConfigRecord *findConfigRecord(const char *key)
+{
+    for (uint8_t i = 0; i < recordCount; i++)
+    {
+        if (strcmp(records[i].key, key) == 0)
+            return &records[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Removes all the cached records.
+ */
+void clearConfigRecords()
+{
+    for (uint8_t i = 0; i < recordCount; i++)
+        free(records[i].value);
+
+    recordCount = 0;
+}
+
+/**
+ * @brief Stores the record in the cache, replacing the record with the same key.
+ *
+ * The cache is marked dirty only if the record has really changed, so setting the same
+ * value again does not cause a flash write on the next commit.
+ *
+ * @param key The key of the record.
+ * @param type The type of the record.
+ * @param value The value of the record.
+ * @param size The size of the value (in bytes).
+ * @return true if the record was stored, false if the key or value is too long or the store is full.
+ */
+bool putConfigRecord(const char *key, ConfigType type, const void *value, size_t size)
+{
+    if (key == NULL || strlen(key) == 0 || strlen(key) > CONFIG_KEY_MAX_LENGTH || size > CONFIG_MAX_VALUE_SIZE)
+    {
+        Serial.printf("Config: invalid record '%s' (%u bytes)\n", key ? key : "", (uint32_t)size);
+        return false;
+    }
+
+    ConfigRecord *record = findConfigRecord(key);
+    if (record != NULL && record->type == type && record->size == size && memcmp(record->value, value, size) == 0)
+        return true;
+
+    if (record == NULL && recordCount >= CONFIG_MAX_RECORDS)
+    {
+        Serial.printf("Config: no space for the record '%s'\n", key);
+        return false;
+    }
+
+    uint8_t *copy = (uint8_t *)realloc(record != NULL ? record->value : NULL, size > 0 ? size : 1);
+    if (copy == NULL)
+    {
+        Serial.printf("Config: not enough memory for the record '%s'\n", key);
+        return false;
+    }
+
+    // A new record is added only with its value, so a failed allocation leaves no partial record
+    if (record == NULL)
+    {
+        record = &records[recordCount++];
+        strlcpy(record->key, key, sizeof(record->key));
+    }
+
+    memcpy(copy, value, size);
+    record->value = copy;
+    record->type = type;
+    record->size = size;
+    dirty = true;
+
+    return true;
+}
+
+/**
+ * @brief Parses the records of the store file into the cache.
+ *
+ * @param data The records read from the store file.
+ * @param size The size of the records (in bytes).
+ * @param count The number of the records.
+ * @return true if all records were parsed, false if the data are malformed.
+ */
+bool parseConfigRecords(const uint8_t *data, size_t size, uint16_t count)
+{
+    size_t offset = 0;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        ConfigRecordHeader header;
+        if (size - offset < sizeof(header))
+            return false;
+
+        memcpy(&header, data + offset, sizeof(header));
+        offset += sizeof(header);
+
+        if (header.keyLength == 0 || header.keyLength > CONFIG_KEY_MAX_LENGTH ||
+            size - offset < (size_t)header.keyLength + header.valueSize)
+            return false;
+
+        char key[CONFIG_KEY_MAX_LENGTH + 1];
+        memcpy(key, data + offset, header.keyLength);
+        key[header.keyLength] = '\0';
+        offset += header.keyLength;
+
+        if (!putConfigRecord(key, (ConfigType)header.type, data + offset, header.valueSize))
+            return false;
+        offset += header.valueSize;
+    }
+
+    return offset == size;
+}
+
+/**
+ * @brief Loads the store file into the cache.
+ *
+ * @return true if the store file was loaded, false if it is missing or invalid.
+ */
+bool loadConfigStore()
+{
+    File file = LittleFS.open(CONFIG_STORE_FILENAME, "r");
+    if (!file)
+        return false;
+
+    ConfigFileHeader header;
+    bool loaded = false;
+    uint8_t *data = NULL;
+
+    if (file.readBytes((char *)&header, sizeof(header)) != sizeof(header) || header.magic != CONFIG_STORE_MAGIC)
+        Serial.println(F("Config: store file is not valid"));
+    else if (header.version != CONFIG_STORE_SCHEMA_VERSION)
+        Serial.printf("Config: unsupported schema version %u\n", header.version);
+    else if (header.dataSize > CONFIG_MAX_DATA_SIZE || (data = (uint8_t *)malloc(header.dataSize + 1)) == NULL)
+        Serial.printf("Config: store file too large (%u bytes)\n", header.dataSize);
+    else if (file.readBytes((char *)data, header.dataSize) != header.dataSize ||
+             esp_rom_crc32_le(0, data, header.dataSize) != header.crc)
+        Serial.println(F("Config: store file is corrupted"));
+    else if (!parseConfigRecords(data, header.dataSize, header.recordCount))
+        Serial.println(F("Config: store file contains invalid records"));
+    else
+        loaded = true;
+
+    free(data);
+    file.close();
+
+    if (!loaded)
+        clearConfigRecords();
+
+    return loaded;
+}
+
+/**
+ * @brief Initializes the config store and loads the records into the cache.
+ *
+ * A leftover temporary file means that the last commit was interrupted before the rename,
+ * so the store file still holds the previous complete contents and the temporary file is removed.
+ *
+ * @note This function should be called once after LittleFS is mounted.
+ * @return true if the stored records were loaded, false if the store starts empty.
+ */
+bool configStoreBegin()
+{
+    if (storeMutex == NULL)
+        storeMutex = xSemaphoreCreateMutex();
+
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+
+    if (LittleFS.exists(CONFIG_STORE_TMP_FILENAME))
+    {
+        Serial.println(F("Config: removing incomplete commit"));
+        LittleFS.remove(CONFIG_STORE_TMP_FILENAME);
+    }
+
+    clearConfigRecords();
+    bool loaded = loadConfigStore();
+    dirty = false;
+
+    if (loaded)
+        Serial.printf("Config: loaded %u records\n", recordCount);
+
+    xSemaphoreGive(storeMutex);
+    return loaded;
+}
+
+/**
+ * @brief Writes the changed records to the flash.
+ *
+ * The records are written to a temporary file which then replaces the store file by a rename,
+ * so a power cut during the commit leaves either the previous or the new contents.
+ *
+ * @return true if the store file is up to date, false if writing failed.
+ */
+bool configStoreCommit()
+{
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+
+    if (!dirty)
+    {
+        xSemaphoreGive(storeMutex);
+        return true;
+    }
+
+    size_t dataSize = 0;
+    for (uint8_t i = 0; i < recordCount; i++)
+        dataSize += sizeof(ConfigRecordHeader) + strlen(records[i].key) + records[i].size;
+
+    uint8_t *data = (uint8_t *)malloc(dataSize + 1);
+    if (data == NULL)
+    {
+        Serial.println(F("Config: not enough memory to commit"));
+        xSemaphoreGive(storeMutex);
+        return false;
+    }
+
+    size_t offset = 0;
+    for (uint8_t i = 0; i < recordCount; i++)
+    {
+        ConfigRecordHeader header;
+        header.type = records[i].type;
+        header.keyLength = strlen(records[i].key);
+        header.valueSize = records[i].size;
+
+        memcpy(data + offset, &header, sizeof(header));
+        offset += sizeof(header);
+        memcpy(data + offset, records[i].key, header.keyLength);
+        offset += header.keyLength;
+        memcpy(data + offset, records[i].value, header.valueSize);
+        offset += header.valueSize;
+    }
+
+    ConfigFileHeader fileHeader;
+    fileHeader.magic = CONFIG_STORE_MAGIC;
+    fileHeader.version = CONFIG_STORE_SCHEMA_VERSION;
+    fileHeader.recordCount = recordCount;
+    fileHeader.dataSize = dataSize;
+    fileHeader.crc = esp_rom_crc32_le(0, data, dataSize);
+
+    bool committed = false;
+    File file = LittleFS.open(CONFIG_STORE_TMP_FILENAME, "w");
+    if (file)
+    {
+        bool written = file.write((uint8_t *)&fileHeader, sizeof(fileHeader)) == sizeof(fileHeader) &&
+                       file.write(data, dataSize) == dataSize;
+        file.close();
+
+        committed = written && LittleFS.rename(CONFIG_STORE_TMP_FILENAME, CONFIG_STORE_FILENAME);
+        if (!committed)
+            LittleFS.remove(CONFIG_STORE_TMP_FILENAME);
+    }
+    free(data);
+
+    if (committed)
+    {
+        dirty = false;
+        Serial.printf("Config: committed %u records (%u bytes)\n", recordCount, (uint32_t)(sizeof(fileHeader) + dataSize));
+    }
+    else
+        Serial.println(F("Config: commit failed"));
+
+    xSemaphoreGive(storeMutex);
+    return committed;
+}
+
+/**
+ * @brief Copies the value of the cached record with the given key and type.
+ *
+ * @param key The key of the record.
+ * @param type The expected type of the record.
+ * @param buffer Buffer for the value.
+ * @param size Size of the buffer.
+ * @return The size of the value, or 0 if there is no such record or it does not fit.
+ */
+size_t getConfigRecord(const char *key, ConfigType type, void *buffer, size_t size)
+{
+    if (storeMutex == NULL)
+        return 0;
+
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+
+    size_t copied = 0;
+    ConfigRecord *record = findConfigRecord(key);
+    if (record != NULL && record->type == type && record->size <= size)
+    {
+        memcpy(buffer, record->value, record->size);
+        copied = record->size;
+    }
+
+    xSemaphoreGive(storeMutex);
+    return copied;
+}
+
+/**
+ * @brief Stores the record in the cache under the mutex.
+ *
+ * @param key The key of the record.
+ * @param type The type of the record.
+ * @param value The value of the record.
+ * @param size The size of the value (in bytes).
+ * @return true if the record was stored, false otherwise.
+ */
+bool setConfigRecord(const char *key, ConfigType type, const void *value, size_t size)
+{
+    if (storeMutex == NULL)
+        return false;
+
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+    bool stored = putConfigRecord(key, type, value, size);
+    xSemaphoreGive(storeMutex);
+
+    return stored;
+}
+
+/**
+ * @brief Reads an unsigned integer record.
+ *
+ * @param key The key of the record.
+ * @param value Receives the value, unchanged if the record does not exist.
+ * @return true if the record exists, false otherwise.
+ */
+bool configGetU32(const char *key, uint32_t &value)
+{
+    return getConfigRecord(key, CONFIG_TYPE_U32, &value, sizeof(value)) == sizeof(value);
+}
+
+/**
+ * @brief Reads a signed integer record.
+ *
+ * @param key The key of the record.
+ * @param value Receives the value, unchanged if the record does not exist.
+ * @return true if the record exists, false otherwise.
+ */
+bool configGetI32(const char *key, int32_t &value)
+{
+    return getConfigRecord(key, CONFIG_TYPE_I32, &value, sizeof(value)) == sizeof(value);
+}
+
+/**
+ * @brief Reads a string record.
+ *
+ * @param key The key of the record.
+ * @param buffer Buffer for the string including the null terminator.
+ * @param size Size of the buffer.
+ * @return true if the record exists and fits the buffer, false otherwise.
+ */
+bool configGetString(const char *key, char *buffer, size_t size)
+{
+    return getConfigRecord(key, CONFIG_TYPE_STRING, buffer, size) > 0;
+}
+
+/**
+ * @brief Reads a blob record.
+ *
+ * @param key The key of the record.
+ * @param buffer Buffer for the value.
+ * @param size Size of the buffer.
+ * @return The size of the value, or 0 if the record does not exist or does not fit the buffer.
+ */
+size_t configGetBlob(const char *key, void *buffer, size_t size)
+{
+    return getConfigRecord(key, CONFIG_TYPE_BLOB, buffer, size);
+}
+
+/**
+ * @brief Sets an unsigned integer record. The change is written to the flash by configStoreCommit().
+ *
+ * @param key The key of the record.
+ * @param value The value.
+ * @return true if the record was stored, false otherwise.
+ */
+bool configSetU32(const char *key, uint32_t value)
+{
+    return setConfigRecord(key, CONFIG_TYPE_U32, &value, sizeof(value));
+}
+
+/**
+ * @brief Sets a signed integer record. The change is written to the flash by configStoreCommit().
+ *
+ * @param key The key of the record.
+ * @param value The value.
+ * @return true if the record was stored, false otherwise.
+ */
+bool configSetI32(const char *key, int32_t value)
+{
+    return setConfigRecord(key, CONFIG_TYPE_I32, &value, sizeof(value));
+}
+
+/**
+ * @brief Sets a string record. The change is written to the flash by configStoreCommit().
+ *
+ * @param key The key of the record.
+ * @param value The null-terminated string.
+ * @return true if the record was stored, false otherwise.
+ */
+bool configSetString(const char *key, const char *value)
+{
+    return setConfigRecord(key, CONFIG_TYPE_STRING, value, strlen(value) + 1);
+}
+
+/**
+ * @brief Sets a blob record. The change is written to the flash by configStoreCommit().
+ *
+ * @param key The key of the record.
+ * @param value The value.
+ * @param size The size of the value (in bytes).
+ * @return true if the record was stored, false otherwise.
+ */
+bool configSetBlob(const char *key, const void *value, size_t size)
+{
+    return setConfigRecord(key, CONFIG_TYPE_BLOB, value, size);
+}
+
+/**
+ * @brief Removes a record. The change is written to the flash by configStoreCommit().
+ *
+ * @param key The key of the record.
+ * @return true if the record existed, false otherwise.
+ */
+bool configRemove(const char *key)
+{
+    if (storeMutex == NULL)
+        return false;
+
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+
+    ConfigRecord *record = findConfigRecord(key);
+    if (record != NULL)
+    {
+        free(record->value);
+        *record = records[--recordCount];
+        dirty = true;
+    }
+
+    xSemaphoreGive(storeMutex);
+    return record != NULL;
+}
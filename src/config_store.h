@@ -0,0 +1,40 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+
+// Files of the store, new contents are written to the temporary file and renamed over the store
+#define CONFIG_STORE_FILENAME     "/config.dat"
+#define CONFIG_STORE_TMP_FILENAME "/config.tmp"
+
+// Maximum length of a record key (without the null terminator)
+#define CONFIG_KEY_MAX_LENGTH 15
+// Maximum number of records in the store
+#define CONFIG_MAX_RECORDS    32
+// Maximum size of a record value (in bytes)
+#define CONFIG_MAX_VALUE_SIZE 512
+
+// Types of the stored records
+enum ConfigType : uint8_t
+{
+    CONFIG_TYPE_U32 = 1,    // Unsigned 32-bit integer
+    CONFIG_TYPE_I32 = 2,    // Signed 32-bit integer
+    CONFIG_TYPE_STRING = 3, // Null-terminated string
+    CONFIG_TYPE_BLOB = 4    // Raw bytes
+};
+
+bool configStoreBegin();
+bool configStoreCommit();
+
+bool configGetU32(const char *key, uint32_t &value);
+bool configGetI32(const char *key, int32_t &value);
+bool configGetString(const char *key, char *buffer, size_t size);
+size_t configGetBlob(const char *key, void *buffer, size_t size);
+
+bool configSetU32(const char *key, uint32_t value);
+bool configSetI32(const char *key, int32_t value);
+bool configSetString(const char *key, const char *value);
+bool configSetBlob(const char *key, const void *value, size_t size);
+bool configRemove(const char *key);
+
+#endif // CONFIG_STORE_H
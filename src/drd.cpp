@@ -1,17 +1,16 @@
-#include <LittleFS.h>
+#include <Arduino.h>
+#include <esp_timer.h>
 #include "drd.h"
 
-// Task parameters
-#define DRD_TASK_STACK_SIZE (4 * 1024U)
-#define DRD_TASK_PRIORITY   (tskIDLE_PRIORITY + 2)
-#define DRD_TASK_CORE       1 // Core 0 is used by the WiFi
-
 // Double Reset Detection parameters
-#define DRD_FILENAME   "/drd_flag.dat"
 #define DRD_FLAG_SET   0xD0D01234
 #define DRD_FLAG_CLEAR 0xD0D04321
 
-static uint32_t drdTimeout = 0;
+// Flag kept in the RTC memory, which is not initialized on reset. After a power loss it holds
+// random data, which is very unlikely to match DRD_FLAG_SET
+RTC_NOINIT_ATTR static uint32_t drdFlag;
+
+static esp_timer_handle_t drdTimer = NULL;
 static bool doubleResetDetected = false;
 
 /**
@@ -27,19 +26,19 @@ bool isDoubleResetDetected()
 /**
  * @brief Validates the reset reason of the ESP device.
  *
- * This function checks the reset reason of the ESP device and returns true if the reset reason
- * is due to a power-on event (ESP_RST_POWERON). Otherwise, it returns false.
+ * This function checks the reset reason of the ESP device and returns true if the reset was
+ * caused by the reset button (ESP_RST_POWERON or ESP_RST_EXT). Otherwise, it returns false.
  * This prevents the Double Reset Detection from being triggered on other reset reasons,
  * for example after a firmware update.
  *
- * @return true if the reset reason is ESP_RST_POWERON, false otherwise.
+ * @return true if the reset reason is ESP_RST_POWERON or ESP_RST_EXT, false otherwise.
  */
 bool validateResetReason()
 {
     esp_reset_reason_t resetReason = esp_reset_reason();
-    if (resetReason == ESP_RST_POWERON)
+    if (resetReason == ESP_RST_POWERON || resetReason == ESP_RST_EXT)
     {
-        Serial.println(F("ESP32 reset reason is ESP_RST_POWERON"));
+        Serial.printf("ESP32 reset reason is %s\n", resetReason == ESP_RST_POWERON ? "ESP_RST_POWERON" : "ESP_RST_EXT");
         return true;
     }
 
@@ -48,114 +47,75 @@ bool validateResetReason()
 }
 
 /**
- * @brief Writes the flag to the filesystem.
+ * @brief Clears the flag when the detection timeout expires. Runs in the esp_timer task.
  *
- * @param flag The flag value to write.
- */
-void writeFlag(uint32_t flag)
-{
-    File file = LittleFS.open(DRD_FILENAME, "w");
-    if (file)
-    {
-        file.write((uint8_t *)&flag, sizeof(flag));
-        file.close();
-    }
-}
-
-/**
- * @brief Check if flag is set in the filesystem.
+ * @param arg Not used.
  */
-bool isFlagSetInFS()
+void drdTimeoutCallback(void *arg)
 {
-    uint32_t flag = DRD_FLAG_CLEAR;
-    if (LittleFS.exists(DRD_FILENAME))
-    {
-        File file = LittleFS.open(DRD_FILENAME, "r");
-        if (file)
-        {
-            file.readBytes((char *)&flag, sizeof(flag));
-            file.close();
-        }
-    }
-
-    return flag == DRD_FLAG_SET;
+    drdFlag = DRD_FLAG_CLEAR;
+    Serial.println("Double Reset Detection timeout - flag cleared");
 }
 
 /**
- * @brief The Double Reset Detection Task.
+ * @brief Initializes the Double Reset Detector.
  *
- * @param pvParameters Pointer to DRDTaskParams containing the timeout.
+ * The detection result is available right after this function returns. If the device was
+ * not reset twice, the flag is set and a one-shot timer clears it after the timeout, so a
+ * reset within the timeout is detected on the next boot. Nothing is written to the flash.
+ *
+ * @param timeoutMs The timeout duration in milliseconds for detecting double resets.
+ *
+ * @note This function should be called once during the setup phase of the program. A repeated
+ * call starts the detection over like a reset, which the host tests use to simulate reboots.
  */
-void drdTask(void *pvParameters)
+void drdInit(uint32_t timeoutMs)
 {
-    // Initialize LittleFS
-    if (!LittleFS.begin())
+    // The timer of the previous call must not clear the flag of this one
+    doubleResetDetected = false;
+    if (drdTimer != NULL)
     {
-        Serial.println("Error: Failed to initialize LittleFS in drdTask");
-        vTaskDelete(NULL);
-        return;
+        esp_timer_stop(drdTimer);
+        esp_timer_delete(drdTimer);
+        drdTimer = NULL;
     }
 
     // Check if the reset reason is valid
     if (!validateResetReason())
     {
         Serial.println("Invalid reset reason - skipping Double Reset Detection");
-        // Clear flag
-        writeFlag(DRD_FLAG_CLEAR);
-        // Delete the task
-        vTaskDelete(NULL);
+        drdFlag = DRD_FLAG_CLEAR;
         return;
     }
 
     // Check if flag is set
-    if (isFlagSetInFS())
+    if (drdFlag == DRD_FLAG_SET)
     {
         // Flag was set, double reset detected
         doubleResetDetected = true;
+        drdFlag = DRD_FLAG_CLEAR;
         Serial.println("Double Reset Detected");
-
-        // Clear flag
-        writeFlag(DRD_FLAG_CLEAR);
-    }
-    else
-    {
-        Serial.println("No Double Reset Detected");
-
-        // Set flag for next reset
-        writeFlag(DRD_FLAG_SET);
+        return;
     }
 
-    // Wait for the timeout
-    vTaskDelay(pdMS_TO_TICKS(drdTimeout));
-
-    // Clear flag after timeout
-    writeFlag(DRD_FLAG_CLEAR);
-    Serial.println("Double Reset Detection timeout - flag cleared");
+    Serial.println("No Double Reset Detected");
 
-    vTaskDelete(NULL);
-}
+    // Set flag for next reset
+    drdFlag = DRD_FLAG_SET;
 
-/**
- * @brief Initializes the Double Reset Detector task.
- *
- * This function creates a new task called "drdTask" and assigns it to a specific core.
- *
- * @param timeoutMs The timeout duration in milliseconds for detecting double resets.
- *
- * @note This function should be called once during the setup phase of the program.
- */
-void drdTaskInit(uint32_t timeoutMs)
-{
-    drdTimeout = timeoutMs;
+    // Clear the flag after the timeout
+    const esp_timer_create_args_t timerArgs = {
+        .callback = drdTimeoutCallback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "drd",
+        .skip_unhandled_events = false,
+    };
 
-    if (xTaskCreatePinnedToCore(drdTask,
-                                "drdTask",
-                                DRD_TASK_STACK_SIZE,
-                                NULL,
-                                DRD_TASK_PRIORITY,
-                                NULL,
-                                DRD_TASK_CORE) != pdPASS)
+    if (esp_timer_create(&timerArgs, &drdTimer) != ESP_OK ||
+        esp_timer_start_once(drdTimer, (uint64_t)timeoutMs * 1000) != ESP_OK)
     {
-        Serial.println("Failed to create drdTask");
+        Serial.println("Failed to start Double Reset Detection timer");
+        drdFlag = DRD_FLAG_CLEAR;
     }
-}
\ No newline at end of file
+}
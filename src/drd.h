@@ -1,7 +1,7 @@
 #ifndef DRD_H
 #define DRD_H
 
-void drdTaskInit(uint32_t timeoutMs);
+void drdInit(uint32_t timeoutMs);
 bool isDoubleResetDetected();
 
 #endif // DRD_H
\ No newline at end of file
@@ -1,53 +1,622 @@
 #include <ArduinoJson.h>
 #include <HTTPClient.h>
-#include <Update.h>
+#include <LittleFS.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <mbedtls/sha256.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 #include "constants.h"
 #include "leds.h"
 #include "firmware_update.h"
+#include "gzip_stream.h"
+
+#ifdef USE_FIRMWARE_SIGNATURE
+#include <mbedtls/base64.h>
+#include <mbedtls/pk.h>
+#endif
+
+// Firmware update task parameters
+#define OTA_TASK_STACK_SIZE (8 * 1024U) // Signature verification needs a larger stack
+#define OTA_TASK_PRIORITY   (tskIDLE_PRIORITY + 1)
+#define OTA_TASK_CORE       0 // Keep the loop and LED tasks on core 1 responsive
+
+// Maximum lengths of the firmware URL and the Base64 encoded signature (including the null terminator)
+#define OTA_URL_MAX_LENGTH       512
+#define OTA_SIGNATURE_MAX_LENGTH 700
+
+// Number and size of the buffers in the download ring
+#define OTA_BUFFERS_COUNT 4
+#define OTA_BUFFER_SIZE   2048
+
+// Receiver task parameters
+#define OTA_RECEIVER_TASK_STACK_SIZE (6 * 1024U) // TLS reads need a larger stack
+#define OTA_RECEIVER_TASK_PRIORITY   (tskIDLE_PRIORITY + 2)
+#define OTA_RECEIVER_TASK_CORE       0 // Receive on the core running the WiFi stack
+
+// How long the receiver waits for a free buffer before checking the abort flag (in milliseconds)
+#define OTA_RECEIVER_WAIT_MS 100
+
+// Marker sent through the filled buffers queue when the receiver has finished
+#define OTA_END_OF_STREAM 0xFF
+
+// Size of the flash sector, the OTA partition is erased sector by sector right before writing
+#define OTA_FLASH_SECTOR_SIZE 4096
+
+// Delay before resuming the download, multiplied by the attempt number (in milliseconds)
+#define OTA_RESUME_DELAY_MS      2000
+// How often the state of the download is saved for resuming after a failed update (in bytes)
+#define OTA_RESUME_SAVE_INTERVAL (64 * 1024U)
+// File with the state of the interrupted download
+#define OTA_RESUME_FILENAME      "/ota_resume.dat"
+// Maximum length of the ETag or Last-Modified header identifying the firmware file
+#define OTA_VALIDATOR_SIZE       64
+
+// Size of the SHA-256 digest of the firmware image
+#define OTA_SHA256_SIZE 32
+// Maximum size of the decoded firmware signature (enough for RSA-4096)
+#define OTA_SIGNATURE_MAX_SIZE 512
+
+// Buffer of the download ring
+struct OtaBuffer
+{
+    uint8_t data[OTA_BUFFER_SIZE]; // Downloaded data
+    size_t length;                 // Number of valid bytes in data
+};
+
+// State shared between the receiver task and the writer
+struct OtaPipeline
+{
+    OtaBuffer *buffers;             // Ring of preallocated buffers
+    QueueHandle_t freeQueue;        // Indexes of buffers which could be filled by the receiver
+    QueueHandle_t filledQueue;      // Indexes of downloaded buffers in download order
+    SemaphoreHandle_t receiverDone; // Given by the receiver task right before it exits
+    HTTPClient *http;               // HTTP client with the running request
+    WiFiClient *stream;             // Stream to read the firmware from
+    uint32_t contentLength;         // Number of bytes to receive over this connection
+    volatile bool abort;            // Set by the writer to stop the receiver
+    uint32_t receiveTimeUs;         // Time spent reading the stream
+    uint32_t receiverStalls;        // Number of times the receiver waited for a free buffer
+};
+
+// State of the OTA partition writer shared with the decompression callback
+struct OtaWriter
+{
+    const esp_partition_t *partition; // OTA partition the firmware is written to
+    uint32_t written;                 // Number of bytes written to the partition
+    uint32_t erasedSize;              // Number of bytes erased from the start of the partition
+    uint32_t crc;                     // CRC32 of the written data
+    mbedtls_sha256_context sha256;    // SHA-256 of the written data
+    uint32_t writeTimeUs;             // Time spent writing the flash
+    uint32_t hashTimeUs;              // Time spent hashing the written data
+    esp_err_t error;                  // First flash error, ESP_OK if none
+};
+
+// State of an interrupted download persisted in the filesystem
+struct OtaResumeState
+{
+    uint32_t urlHash;                     // CRC32 of the firmware URL
+    uint32_t contentLength;               // Size of the firmware file
+    char validator[OTA_VALIDATOR_SIZE];   // ETag or Last-Modified of the firmware file
+    uint32_t offset;                      // Number of bytes written to the OTA partition
+    uint32_t crc;                         // CRC32 of the written bytes
+};
+
+// State of the download kept across the connections of one update
+struct OtaDownload
+{
+    OtaWriter writer;                   // Writer of the OTA partition
+    GzipStream gzip;                    // Decoder of compressed images
+    GzipStatus gzipStatus;              // Status of the decoder after the last buffer
+    bool started;                       // Set when the first buffer was written
+    bool compressed;                    // Set if the image is gzip compressed
+    uint32_t urlHash;                   // CRC32 of the firmware URL
+    uint32_t contentLength;             // Size of the firmware file
+    uint32_t imageSize;                 // Size of the decompressed image if known, 0 otherwise
+    uint32_t downloaded;                // Number of bytes downloaded and processed
+    uint32_t lastSavedOffset;           // Offset of the last saved resume state
+    char validator[OTA_VALIDATOR_SIZE]; // ETag or Last-Modified of the firmware file
+    uint8_t lastProgress;               // Last reported progress percentage
+    uint32_t receiveTimeUs;             // Time spent reading the streams
+    uint32_t receiverStalls;            // Number of times the receiver waited for a free buffer
+    uint32_t writerStalls;              // Number of times the writer waited for the network
+    uint32_t resumes;                   // Number of times the download was resumed with a Range request
+};
+
+// Result of a step of the firmware update
+enum OtaResult
+{
+    OTA_OK,     // The step finished successfully
+    OTA_RETRY,  // The connection was lost, the download could be resumed
+    OTA_FAILED  // The update failed, the error is already reported
+};
+
+typedef void (*PublishResult)(bool success, const char *message);
+
+// Metrics of the last firmware update, guarded by statusMux
+static FirmwareUpdateMetrics metrics;
+
+// Status of the firmware update, published by the loop task
+static FirmwareUpdateStatus status = {};
+// Spinlock protecting the status and the metrics
+static portMUX_TYPE statusMux = portMUX_INITIALIZER_UNLOCKED;
+// Set while the update task runs, guarded by statusMux. The task still indicates the failure
+// after the state changed to FW_UPDATE_FAILED, so the state alone does not show that it ended
+static bool taskRunning = false;
+
+// Parameters of the running update, copied from the command
+static FirmwareUpdateRequest activeRequest;
+static char requestUrl[OTA_URL_MAX_LENGTH];
+static char requestSha256[OTA_SHA256_SIZE * 2 + 1];
+static char requestSignature[OTA_SIGNATURE_MAX_LENGTH];
+
+// Set when the progress indication was started by the running update
+static bool progressIndicationStarted = false;
+
+// First error of the running download, reported once the metrics of the download are stored
+static String downloadError;
 
 /**
- * @brief Performs the firmware update using the provided firmware URL.
+ * @brief Returns a snapshot of the metrics of the last firmware update.
  *
- * Downloads the firmware from the specified HTTPS URL and applies the update.
- * If the update is successful, the device restarts to run the new firmware.
+ * @return The metrics of the last firmware update.
+ */
+FirmwareUpdateMetrics getFirmwareUpdateMetrics()
+{
+    portENTER_CRITICAL(&statusMux);
+    FirmwareUpdateMetrics snapshot = metrics;
+    portEXIT_CRITICAL(&statusMux);
+    return snapshot;
+}
+
+/**
+ * @brief Records the first error of the download, so it is published with the metrics of the download.
  *
- * @param firmwareUrl The HTTPS URL from which to download the firmware binary.
+ * @param success Always false, the download reports only errors.
+ * @param message Message describing the error.
  */
-void performFirmwareUpdate(const char *firmwareUrl, PublishResult publishResult)
+void recordDownloadError(bool success, const char *message)
 {
-    // Initialize HTTP client
-    HTTPClient http;
+    if (downloadError.isEmpty())
+        downloadError = message;
+}
 
-#ifdef USE_AWS_FOR_FIRMWARE_UPDATE
-    // Ensure the URL uses HTTPS for secure download
-    if (strncmp(firmwareUrl, "https://", 8) == 0)
+/**
+ * @brief Changes the state of the firmware update.
+ *
+ * @param state The new state.
+ * @param message Message describing the state, NULL to keep the previous one.
+ */
+void setUpdateState(FirmwareUpdateState state, const char *message)
+{
+    portENTER_CRITICAL(&statusMux);
+    status.state = state;
+    if (message != NULL)
+        strlcpy(status.message, message, sizeof(status.message));
+    status.sequence++;
+    portEXIT_CRITICAL(&statusMux);
+}
+
+/**
+ * @brief Updates the progress of the firmware update.
+ *
+ * @param progress Progress percentage (0 to 100).
+ */
+void setUpdateProgress(uint8_t progress)
+{
+    portENTER_CRITICAL(&statusMux);
+    status.progress = progress;
+    portEXIT_CRITICAL(&statusMux);
+}
+
+/**
+ * @brief Returns a snapshot of the firmware update status.
+ *
+ * @return The current status.
+ */
+FirmwareUpdateStatus getFirmwareUpdateStatus()
+{
+    portENTER_CRITICAL(&statusMux);
+    FirmwareUpdateStatus snapshot = status;
+    portEXIT_CRITICAL(&statusMux);
+    return snapshot;
+}
+
+/**
+ * @brief Returns the name of the firmware update state used in the MQTT messages.
+ *
+ * @param state The state.
+ * @return The name of the state.
+ */
+const char *firmwareUpdateStateToString(FirmwareUpdateState state)
+{
+    switch (state)
     {
-        // Set the AWS root CA certificate for secure connection
-        http.begin(firmwareUrl, AWS_CERT_CA);
+    case FW_UPDATE_QUEUED:
+        return "queued";
+    case FW_UPDATE_DOWNLOADING:
+        return "downloading";
+    case FW_UPDATE_VERIFYING:
+        return "verifying";
+    case FW_UPDATE_REBOOTING:
+        return "rebooting";
+    case FW_UPDATE_FAILED:
+        return "failed";
+    default:
+        return "idle";
     }
-    else
+}
+
+/**
+ * @brief Checks if a firmware update is queued or running.
+ *
+ * @param state The state to check.
+ * @return true if the update is in progress, false otherwise.
+ */
+bool isUpdateInProgress(FirmwareUpdateState state)
+{
+    return state != FW_UPDATE_IDLE && state != FW_UPDATE_FAILED;
+}
+
+/**
+ * @brief Task receiving the firmware into the buffers of the download ring.
+ *
+ * The task takes free buffers, fills them from the HTTP stream and passes them to the writer
+ * in download order. When the stream ends, the download is complete or the writer requests
+ * to abort, it sends OTA_END_OF_STREAM, gives the receiverDone semaphore and deletes itself.
+ *
+ * @param pvParameters Pointer to the OtaPipeline.
+ */
+void otaReceiverTask(void *pvParameters)
+{
+    OtaPipeline *pipeline = (OtaPipeline *)pvParameters;
+    uint32_t received = 0;
+
+    while (!pipeline->abort && received < pipeline->contentLength &&
+           (pipeline->http->connected() || pipeline->stream->available()))
     {
-        publishResult(false, "Firmware URL must use HTTPS");
+        // Take a free buffer, count a stall if the writer has not released any yet
+        uint8_t index;
+        if (xQueueReceive(pipeline->freeQueue, &index, 0) != pdTRUE)
+        {
+            pipeline->receiverStalls++;
+            while (!pipeline->abort && xQueueReceive(pipeline->freeQueue, &index, pdMS_TO_TICKS(OTA_RECEIVER_WAIT_MS)) != pdTRUE)
+                ;
+            if (pipeline->abort)
+                break;
+        }
+
+        // Fill the buffer from the stream
+        OtaBuffer &buffer = pipeline->buffers[index];
+        size_t toRead = min((uint32_t)OTA_BUFFER_SIZE, pipeline->contentLength - received);
+        uint32_t readStart = micros();
+        buffer.length = pipeline->stream->readBytes(buffer.data, toRead);
+        pipeline->receiveTimeUs += micros() - readStart;
+
+        if (buffer.length == 0)
+        {
+            // Stream timed out, return the buffer and stop
+            xQueueSend(pipeline->freeQueue, &index, 0);
+            break;
+        }
+
+        received += buffer.length;
+
+        // Pass the buffer to the writer. The queue has room for all buffers and the end marker
+        xQueueSend(pipeline->filledQueue, &index, portMAX_DELAY);
+    }
+
+    // Signal the end of the stream to the writer
+    uint8_t endOfStream = OTA_END_OF_STREAM;
+    xQueueSend(pipeline->filledQueue, &endOfStream, portMAX_DELAY);
+
+    xSemaphoreGive(pipeline->receiverDone);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Prepares the writer of the next OTA partition.
+ *
+ * Must be paired with otaWriterFree() to release the hash context.
+ *
+ * @param writer The writer to prepare.
+ * @param imageSize Size of the image to write, or 0 if it is not known.
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t otaWriterBegin(OtaWriter &writer, uint32_t imageSize)
+{
+    // Release the hash context of a previous attempt (no-op for a zeroed writer)
+    mbedtls_sha256_free(&writer.sha256);
+    memset(&writer, 0, sizeof(writer));
+
+    mbedtls_sha256_init(&writer.sha256);
+    mbedtls_sha256_starts(&writer.sha256, 0); // 0 = SHA-256, not SHA-224
+
+    writer.partition = esp_ota_get_next_update_partition(NULL);
+    if (writer.partition == NULL)
+        return ESP_ERR_NOT_FOUND;
+    if (imageSize > writer.partition->size)
+        return ESP_ERR_INVALID_SIZE;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Releases the hash context of the writer.
+ *
+ * @param writer The writer to release.
+ */
+void otaWriterFree(OtaWriter &writer)
+{
+    mbedtls_sha256_free(&writer.sha256);
+}
+
+/**
+ * @brief Prepares the writer to continue writing an interrupted download.
+ *
+ * The already written part of the partition is read back and its CRC32 is compared
+ * with the one saved during the interrupted download. The read data also restores
+ * the SHA-256 of the image, which could not be saved with the download state.
+ *
+ * @param writer The writer to prepare.
+ * @param offset Number of bytes written by the interrupted download.
+ * @param crc CRC32 of the written bytes.
+ * @return true if the partition contains the expected data, false otherwise.
+ */
+bool otaWriterResume(OtaWriter &writer, uint32_t offset, uint32_t crc)
+{
+    if (otaWriterBegin(writer, offset) != ESP_OK)
+        return false;
+
+    uint8_t *buffer = (uint8_t *)malloc(OTA_BUFFER_SIZE);
+    if (buffer == NULL)
+        return false;
+
+    uint32_t flashCrc = 0;
+    for (uint32_t position = 0; position < offset; position += OTA_BUFFER_SIZE)
+    {
+        size_t length = min((uint32_t)OTA_BUFFER_SIZE, offset - position);
+        if (esp_partition_read(writer.partition, position, buffer, length) != ESP_OK)
+            break;
+        flashCrc = esp_rom_crc32_le(flashCrc, buffer, length);
+        mbedtls_sha256_update(&writer.sha256, buffer, length);
+    }
+    free(buffer);
+
+    if (flashCrc != crc)
+        return false;
+
+    // The sector containing the offset was erased before the interrupted download wrote into it
+    writer.written = offset;
+    writer.erasedSize = (offset + OTA_FLASH_SECTOR_SIZE - 1) & ~(OTA_FLASH_SECTOR_SIZE - 1);
+    writer.crc = crc;
+    return true;
+}
+
+/**
+ * @brief Writes a chunk of the firmware image to the OTA partition.
+ *
+ * Sectors are erased right before the data is written into them and the SHA-256 of the image
+ * is updated with the written data, so no second pass over the flash is needed to verify it.
+ * Used directly for uncompressed images and as the output callback of the gzip decoder.
+ *
+ * @param data The firmware data.
+ * @param length The length of the data.
+ * @param context Pointer to the OtaWriter.
+ * @return true if the whole chunk was written, false otherwise.
+ */
+bool writeFirmwareChunk(const uint8_t *data, size_t length, void *context)
+{
+    OtaWriter *writer = (OtaWriter *)context;
+
+    if (writer->error != ESP_OK)
+        return false;
+
+    if (writer->written + length > writer->partition->size)
+    {
+        writer->error = ESP_ERR_INVALID_SIZE;
+        return false;
+    }
+
+    uint32_t writeStart = micros();
+
+    while (writer->erasedSize < writer->written + length && writer->error == ESP_OK)
+    {
+        writer->error = esp_partition_erase_range(writer->partition, writer->erasedSize, OTA_FLASH_SECTOR_SIZE);
+        writer->erasedSize += OTA_FLASH_SECTOR_SIZE;
+    }
+
+    if (writer->error == ESP_OK)
+        writer->error = esp_partition_write(writer->partition, writer->written, data, length);
+
+    writer->writeTimeUs += micros() - writeStart;
+
+    if (writer->error != ESP_OK)
+        return false;
+
+    uint32_t hashStart = micros();
+    mbedtls_sha256_update(&writer->sha256, data, length);
+    writer->crc = esp_rom_crc32_le(writer->crc, data, length);
+    writer->hashTimeUs += micros() - hashStart;
+    writer->written += length;
+    return true;
+}
+
+/**
+ * @brief Reads the state of the interrupted download from the filesystem.
+ *
+ * @param state The state to fill.
+ * @return true if the state was read, false otherwise.
+ */
+bool loadResumeState(OtaResumeState &state)
+{
+    bool loaded = false;
+    if (LittleFS.exists(OTA_RESUME_FILENAME))
+    {
+        File file = LittleFS.open(OTA_RESUME_FILENAME, "r");
+        if (file)
+        {
+            loaded = file.readBytes((char *)&state, sizeof(state)) == sizeof(state);
+            file.close();
+        }
+    }
+
+    return loaded;
+}
+
+/**
+ * @brief Removes the state of the interrupted download from the filesystem.
+ */
+void clearResumeState()
+{
+    if (LittleFS.exists(OTA_RESUME_FILENAME))
+        LittleFS.remove(OTA_RESUME_FILENAME);
+}
+
+/**
+ * @brief Saves the state of the download, so it could be resumed by the next update.
+ *
+ * Only uncompressed images identified by ETag or Last-Modified could be resumed, because
+ * the state of the decoder is lost and the server must be able to confirm that the file
+ * has not changed.
+ *
+ * @param download The download to save.
+ */
+void saveResumeState(OtaDownload &download)
+{
+    if (download.compressed || download.validator[0] == '\0' || download.writer.written == download.lastSavedOffset)
         return;
+
+    OtaResumeState state = {};
+    state.urlHash = download.urlHash;
+    state.contentLength = download.contentLength;
+    strlcpy(state.validator, download.validator, sizeof(state.validator));
+    state.offset = download.writer.written;
+    state.crc = download.writer.crc;
+
+    File file = LittleFS.open(OTA_RESUME_FILENAME, "w");
+    if (file)
+    {
+        file.write((uint8_t *)&state, sizeof(state));
+        file.close();
+        download.lastSavedOffset = state.offset;
+    }
+}
+
+/**
+ * @brief Continues the download interrupted during the previous update of the same URL.
+ *
+ * @param download The download to continue.
+ */
+void resumeSavedDownload(OtaDownload &download)
+{
+    OtaResumeState state;
+    if (!loadResumeState(state))
+        return;
+
+    if (state.urlHash != download.urlHash || state.offset == 0 || state.offset >= state.contentLength)
+    {
+        clearResumeState();
+        return;
+    }
+
+    if (!otaWriterResume(download.writer, state.offset, state.crc))
+    {
+        Serial.println(F("OTA partition does not match the interrupted download, starting from the beginning"));
+        clearResumeState();
+        return;
+    }
+
+    download.started = true;
+    download.contentLength = state.contentLength;
+    download.downloaded = state.offset;
+    download.lastSavedOffset = state.offset;
+    strlcpy(download.validator, state.validator, sizeof(download.validator));
+
+    Serial.printf("Found interrupted download at %u / %u bytes\n", state.offset, state.contentLength);
+}
+
+/**
+ * @brief Discards the downloaded data, so the download starts from the beginning.
+ *
+ * @param download The download to reset.
+ */
+void resetDownload(OtaDownload &download)
+{
+    gzipEnd(download.gzip);
+    download.started = false;
+    download.compressed = false;
+    download.gzipStatus = GZIP_NEED_MORE_INPUT;
+    download.downloaded = 0;
+    download.lastSavedOffset = 0;
+    download.lastProgress = 0;
+    clearResumeState();
+}
+
+/**
+ * @brief Sends the request for the firmware, continuing the download if a part is already written.
+ *
+ * If some data was already written, only the rest of the file is requested with the Range header.
+ * The If-Range header makes the server send the whole file if it has changed meanwhile, in which
+ * case the download starts from the beginning.
+ *
+ * @param http HTTP client prepared with the firmware URL.
+ * @param download The download to continue.
+ * @param publishResult Callback used to report errors.
+ * @param length Pointer where the number of bytes to receive over this connection will be stored.
+ * @return OTA_OK if the response is ready to be downloaded, OTA_RETRY on connection errors, OTA_FAILED otherwise.
+ */
+OtaResult requestFirmware(HTTPClient &http, OtaDownload &download, PublishResult publishResult, uint32_t *length)
+{
+    const char *headerKeys[] = {"ETag", "Last-Modified", "Content-Range"};
+    http.collectHeaders(headerKeys, sizeof(headerKeys) / sizeof(headerKeys[0]));
+
+    uint32_t offset = download.started ? download.downloaded : 0;
+    if (offset > 0)
+    {
+        http.addHeader("Range", "bytes=" + String(offset) + "-");
+        if (download.validator[0] != '\0')
+            http.addHeader("If-Range", download.validator);
     }
-#else
-    // Use non-secure HTTP
-    http.begin(firmwareUrl);
-#endif
 
     // Start the HTTP request
     int httpCode = http.GET();
 
+    // Connection errors are reported by negative codes and could be retried
+    if (httpCode < 0)
+    {
+        Serial.printf("HTTP client error: %s\n", http.errorToString(httpCode).c_str());
+        return OTA_RETRY;
+    }
+
+    // Check that the server continues the download from the requested offset
+    if (httpCode == HTTP_CODE_PARTIAL_CONTENT && offset > 0)
+    {
+        String contentRange = http.header("Content-Range");
+        unsigned int first, last, total;
+        if (sscanf(contentRange.c_str(), "bytes %u-%u/%u", &first, &last, &total) != 3 ||
+            first != offset || total != download.contentLength)
+        {
+            String details = "Invalid Content-Range: " + contentRange;
+            publishResult(false, details.c_str());
+            return OTA_FAILED;
+        }
+
+        Serial.printf("Resuming firmware download from byte %u\n", offset);
+        download.resumes++;
+        *length = total - offset;
+        return OTA_OK;
+    }
+
     // Check the HTTP response code
     if (httpCode != HTTP_CODE_OK)
     {
-        // Determine if the error is from the HTTP client and retrieve the error message
-        String httpClientError = http.errorToString(httpCode);
-        String details = httpClientError.isEmpty() ? "HTTP request returned: " + String(httpCode) : "HTTP client error: " + httpClientError;
+        String details = "HTTP request returned: " + String(httpCode);
         publishResult(false, details.c_str());
-        // Clean up the HTTP connection
-        http.end();
-        return;
+        return OTA_FAILED;
     }
 
     // Get the payload size
@@ -56,92 +625,603 @@ void performFirmwareUpdate(const char *firmwareUrl, PublishResult publishResult)
     {
         String details = "Invalid content length: " + String(contentLength);
         publishResult(false, details.c_str());
-        http.end();
-        return;
+        return OTA_FAILED;
     }
 
-    // Prepare for update
-    if (!Update.begin(contentLength))
+    // The server sent the whole file, the already written data is discarded
+    if (offset > 0)
     {
-        String details = "Update.begin() failed with error: " + String(Update.errorString());
-        publishResult(false, details.c_str());
-        http.end();
-        return;
+        Serial.println(F("Server does not support resuming or the firmware has changed, starting from the beginning"));
+        resetDownload(download);
     }
 
-    Serial.println(F("URL and content length validated. Starting update..."));
+    download.contentLength = contentLength;
+
+    // Remember the validator of the file to be able to resume the download
+    String validator = http.header("ETag");
+    if (validator.isEmpty())
+        validator = http.header("Last-Modified");
+    strlcpy(download.validator, validator.c_str(), sizeof(download.validator));
 
-    // Create a buffer to hold the firmware data
-    WiFiClient *stream = http.getStreamPtr();
-    uint32_t written = 0;
-    const size_t bufferSize = 2048;
-    uint8_t buffer[bufferSize] = {0};
-    size_t bytesRead = 0;
+    *length = contentLength;
+    return OTA_OK;
+}
 
-    // Variable to track the last progress percentage - used to print log and update the progress indicator
-    uint8_t lastProgress = 0;
+/**
+ * @brief Downloads the firmware and writes it to the flash using a two-stage pipeline.
+ *
+ * A receiver task downloads the firmware into a ring of preallocated buffers while the calling
+ * task writes already downloaded buffers to the OTA partition, so the network and the flash work
+ * in parallel. The buffers are written in the order they were downloaded.
+ *
+ * If the downloaded data starts with the gzip magic bytes, the image is decompressed on the fly
+ * and only the decompressed data is written. The writer is prepared once the first buffer shows
+ * whether the image is compressed.
+ *
+ * The state of the download is kept in the OtaDownload, so the download could continue over
+ * a new connection when this one is lost.
+ *
+ * @param http HTTP client with the running request.
+ * @param length Number of bytes to receive over this connection.
+ * @param download The download to continue.
+ * @param publishResult Callback used to report errors.
+ * @return OTA_OK if the whole firmware was written, OTA_RETRY if the connection was lost,
+ *         OTA_FAILED otherwise (the error is already reported).
+ */
+OtaResult downloadAndWriteFirmware(HTTPClient &http, uint32_t length, OtaDownload &download, PublishResult publishResult)
+{
+    OtaPipeline pipeline = {};
+    pipeline.http = &http;
+    pipeline.stream = http.getStreamPtr();
+    pipeline.contentLength = length;
+    pipeline.buffers = (OtaBuffer *)malloc(sizeof(OtaBuffer) * OTA_BUFFERS_COUNT);
+    pipeline.freeQueue = xQueueCreate(OTA_BUFFERS_COUNT, sizeof(uint8_t));
+    pipeline.filledQueue = xQueueCreate(OTA_BUFFERS_COUNT + 1, sizeof(uint8_t)); // + end of stream marker
+    pipeline.receiverDone = xSemaphoreCreateBinary();
 
-    // Prepare the progress indication
-    startProgressIndication();
+    auto cleanup = [&pipeline]()
+    {
+        if (pipeline.receiverDone)
+            vSemaphoreDelete(pipeline.receiverDone);
+        if (pipeline.filledQueue)
+            vQueueDelete(pipeline.filledQueue);
+        if (pipeline.freeQueue)
+            vQueueDelete(pipeline.freeQueue);
+        free(pipeline.buffers);
+    };
 
-    while (http.connected() && (bytesRead = stream->readBytes(buffer, bufferSize)) > 0)
+    if (!pipeline.buffers || !pipeline.freeQueue || !pipeline.filledQueue || !pipeline.receiverDone)
     {
-        if (Update.write(buffer, bytesRead) != bytesRead)
+        publishResult(false, "Failed to allocate download buffers");
+        cleanup();
+        return OTA_FAILED;
+    }
+
+    // All buffers are free at the beginning
+    for (uint8_t i = 0; i < OTA_BUFFERS_COUNT; i++)
+        xQueueSend(pipeline.freeQueue, &i, 0);
+
+    if (xTaskCreatePinnedToCore(otaReceiverTask,
+                                "otaReceiverTask",
+                                OTA_RECEIVER_TASK_STACK_SIZE,
+                                &pipeline,
+                                OTA_RECEIVER_TASK_PRIORITY,
+                                NULL,
+                                OTA_RECEIVER_TASK_CORE) != pdPASS)
+    {
+        publishResult(false, "Failed to create otaReceiverTask");
+        cleanup();
+        return OTA_FAILED;
+    }
+
+    OtaWriter &writer = download.writer;
+    bool writeFailed = false;
+
+    for (;;)
+    {
+        // Take the next downloaded buffer, count a stall if the receiver has not filled any yet
+        uint8_t index;
+        if (xQueueReceive(pipeline.filledQueue, &index, 0) != pdTRUE)
         {
-            String details = "Update.write() != bytesRead. Written: " + String(written) +
-                             ", Read: " + String(bytesRead);
+            download.writerStalls++;
+            xQueueReceive(pipeline.filledQueue, &index, portMAX_DELAY);
+        }
+
+        if (index == OTA_END_OF_STREAM)
+            break;
+
+        OtaBuffer &buffer = pipeline.buffers[index];
+        download.downloaded += buffer.length;
+
+        // Prepare the writer once it is known if the image is compressed
+        if (!download.started)
+        {
+            download.compressed = isGzipData(buffer.data, buffer.length);
+            esp_err_t err = otaWriterBegin(writer, download.compressed ? download.imageSize : download.contentLength);
+            if (err != ESP_OK)
+            {
+                String details = "Failed to prepare the OTA partition: " + String(esp_err_to_name(err));
+                publishResult(false, details.c_str());
+                writeFailed = true;
+                break;
+            }
+            if (download.compressed && !gzipBegin(download.gzip))
+            {
+                publishResult(false, "Failed to allocate the decompression window");
+                writeFailed = true;
+                break;
+            }
+            Serial.printf("Writing %s firmware image to partition %s\n",
+                          download.compressed ? "compressed" : "uncompressed", writer.partition->label);
+            download.started = true;
+        }
+
+        if (download.compressed)
+        {
+            download.gzipStatus = gzipWrite(download.gzip, buffer.data, buffer.length, writeFirmwareChunk, &writer);
+            if (download.gzipStatus == GZIP_ERROR && writer.error == ESP_OK)
+            {
+                String details = "Corrupted compressed image at byte " + String(download.downloaded);
+                publishResult(false, details.c_str());
+                writeFailed = true;
+                break;
+            }
+        }
+        else
+        {
+            writeFirmwareChunk(buffer.data, buffer.length, &writer);
+        }
+
+        if (writer.error != ESP_OK)
+        {
+            String details = "Flash write failed with error: " + String(esp_err_to_name(writer.error)) +
+                             ". Written: " + String(writer.written);
             publishResult(false, details.c_str());
-            Update.end(false); // Abort the update
-            http.end();
-            return;
+            writeFailed = true;
+            break;
         }
-        written += bytesRead;
 
-        // Calculate the progress percentage
-        uint8_t progress = (written * 100) / contentLength;
+        // Return the buffer to the receiver
+        xQueueSend(pipeline.freeQueue, &index, 0);
+
+        // Save the state of the download from time to time to be able to resume it after a reboot
+        if (writer.written - download.lastSavedOffset >= OTA_RESUME_SAVE_INTERVAL)
+            saveResumeState(download);
+
+        // Calculate the progress percentage against the decompressed size if it is known. An image
+        // inflating past its declared size fails later, the progress is clamped before narrowing
+        uint64_t percent = download.compressed && download.imageSize > 0
+                               ? ((uint64_t)writer.written * 100) / download.imageSize
+                               : ((uint64_t)download.downloaded * 100) / download.contentLength;
+        uint8_t progress = min(percent, (uint64_t)100);
         // Print log and update the progress indicator every 1% change
-        if (progress != lastProgress)
+        if (progress != download.lastProgress)
         {
-            Serial.printf("Firmware update progress: %u%% (%u / %u bytes)\n", progress, written, contentLength);
+            Serial.printf("Firmware update progress: %u%% (%u / %u bytes downloaded, %u bytes written)\n",
+                          progress, download.downloaded, download.contentLength, writer.written);
             progressIndicator(progress, CRGB::Blue);
-            lastProgress = progress;
+            setUpdateProgress(progress);
+            download.lastProgress = progress;
         }
     }
 
-    // Verify that we have written the exact amount of data
-    if (written != (uint32_t)contentLength)
+    // Stop the receiver and wait until it exits before releasing the shared resources
+    pipeline.abort = true;
+    xSemaphoreTake(pipeline.receiverDone, portMAX_DELAY);
+
+    download.receiveTimeUs += pipeline.receiveTimeUs;
+    download.receiverStalls += pipeline.receiverStalls;
+    cleanup();
+
+    if (writeFailed)
+        return OTA_FAILED;
+
+    // The connection was lost before the whole file was received
+    if (download.downloaded < download.contentLength)
+    {
+        Serial.printf("Firmware download interrupted at %u / %u bytes\n", download.downloaded, download.contentLength);
+        saveResumeState(download);
+        return OTA_RETRY;
+    }
+
+    // Verify that the whole image was written
+    String details;
+    if (download.downloaded != download.contentLength)
+        details = "Mismatch in downloaded bytes. Expected: " + String(download.contentLength) +
+                  ", Downloaded: " + String(download.downloaded);
+    else if (download.compressed && download.gzipStatus != GZIP_DONE)
+        details = "Compressed image is truncated or its checksum is invalid";
+    else if (download.compressed && download.imageSize > 0 && writer.written != download.imageSize)
+        details = "Mismatch in decompressed bytes. Expected: " + String(download.imageSize) +
+                  ", Written: " + String(writer.written);
+
+    if (!details.isEmpty())
     {
-        String details = "Mismatch in written bytes. Expected: " + String(contentLength) +
-                         ", Written: " + String(written);
         publishResult(false, details.c_str());
-        Update.end(false); // Abort the update
-        http.end();
+        return OTA_FAILED;
+    }
+
+    return OTA_OK;
+}
+
+/**
+ * @brief Stores the metrics of the download.
+ *
+ * @param download The finished or failed download.
+ * @param startTime Time when the update started (in milliseconds).
+ */
+void storeMetrics(const OtaDownload &download, uint32_t startTime)
+{
+    FirmwareUpdateMetrics result;
+    result.bytes = download.writer.written;
+    result.downloadedBytes = download.downloaded;
+    result.totalTimeMs = millis() - startTime;
+    result.receiveTimeMs = download.receiveTimeUs / 1000;
+    result.writeTimeMs = download.writer.writeTimeUs / 1000;
+    result.hashTimeMs = download.writer.hashTimeUs / 1000;
+    result.receiverStalls = download.receiverStalls;
+    result.writerStalls = download.writerStalls;
+    result.throughputKBps = result.totalTimeMs > 0 ? result.bytes / result.totalTimeMs : 0; // bytes/ms = kB/s
+    result.resumes = download.resumes;
+
+    portENTER_CRITICAL(&statusMux);
+    metrics = result;
+    portEXIT_CRITICAL(&statusMux);
+
+    Serial.printf("Firmware download: %u bytes downloaded, %u bytes written in %u ms (%u kB/s), receive %u ms, write %u ms, hash %u ms, stalls: receiver %u, writer %u, resumes: %u\n",
+                  result.downloadedBytes, result.bytes, result.totalTimeMs, result.throughputKBps,
+                  result.receiveTimeMs, result.writeTimeMs, result.hashTimeMs, result.receiverStalls,
+                  result.writerStalls, result.resumes);
+}
+
+/**
+ * @brief Converts the SHA-256 digest from a hexadecimal string to bytes.
+ *
+ * @param hex The digest as a string of 64 hexadecimal characters.
+ * @param digest Buffer of OTA_SHA256_SIZE bytes for the converted digest.
+ * @return true if the string is a valid digest, false otherwise.
+ */
+bool parseSha256(const char *hex, uint8_t *digest)
+{
+    if (strlen(hex) != OTA_SHA256_SIZE * 2)
+        return false;
+
+    for (uint8_t i = 0; i < OTA_SHA256_SIZE; i++)
+    {
+        if (!isxdigit(hex[2 * i]) || !isxdigit(hex[2 * i + 1]))
+            return false;
+
+        char byteHex[3] = {hex[2 * i], hex[2 * i + 1], '\0'};
+        digest[i] = strtoul(byteHex, NULL, 16);
+    }
+
+    return true;
+}
+
+#ifdef USE_FIRMWARE_SIGNATURE
+/**
+ * @brief Verifies the signature of the firmware image with FIRMWARE_SIGNING_PUBLIC_KEY.
+ *
+ * @param digest The SHA-256 digest of the image.
+ * @param signatureBase64 The Base64 encoded signature of the image.
+ * @return true if the signature is valid, false otherwise.
+ */
+bool verifyFirmwareSignature(const uint8_t *digest, const char *signatureBase64)
+{
+    uint8_t signature[OTA_SIGNATURE_MAX_SIZE];
+    size_t signatureLength = 0;
+    if (mbedtls_base64_decode(signature, sizeof(signature), &signatureLength,
+                              (const uint8_t *)signatureBase64, strlen(signatureBase64)) != 0)
+        return false;
+
+    mbedtls_pk_context publicKey;
+    mbedtls_pk_init(&publicKey);
+
+    // The PEM key must be parsed including its null terminator
+    int ret = mbedtls_pk_parse_public_key(&publicKey, (const uint8_t *)FIRMWARE_SIGNING_PUBLIC_KEY,
+                                          sizeof(FIRMWARE_SIGNING_PUBLIC_KEY));
+    if (ret == 0)
+        ret = mbedtls_pk_verify(&publicKey, MBEDTLS_MD_SHA256, digest, OTA_SHA256_SIZE, signature, signatureLength);
+
+    mbedtls_pk_free(&publicKey);
+    return ret == 0;
+}
+#endif
+
+/**
+ * @brief Verifies the written firmware image before it is activated.
+ *
+ * The SHA-256 calculated while writing is compared with the expected one and, if signed
+ * firmware is required, the signature is verified.
+ *
+ * @param writer The writer with the whole image written.
+ * @param expectedSha256 The expected SHA-256 digest, NULL to skip the check.
+ * @param signature The Base64 encoded signature of the image, NULL if not provided.
+ * @param publishResult Callback used to report errors.
+ * @return true if the image is valid, false otherwise (the error is already reported).
+ */
+bool verifyFirmwareImage(OtaWriter &writer, const uint8_t *expectedSha256, const char *signature, PublishResult publishResult)
+{
+    uint8_t digest[OTA_SHA256_SIZE];
+    uint32_t hashStart = micros();
+    mbedtls_sha256_finish(&writer.sha256, digest);
+    writer.hashTimeUs += micros() - hashStart;
+
+    char digestHex[OTA_SHA256_SIZE * 2 + 1];
+    for (uint8_t i = 0; i < OTA_SHA256_SIZE; i++)
+        snprintf(digestHex + 2 * i, 3, "%02x", digest[i]);
+    Serial.printf("Firmware image SHA-256: %s\n", digestHex);
+
+    if (expectedSha256 != NULL && memcmp(digest, expectedSha256, OTA_SHA256_SIZE) != 0)
+    {
+        String details = "SHA-256 mismatch. Calculated: " + String(digestHex);
+        publishResult(false, details.c_str());
+        return false;
+    }
+
+#ifdef USE_FIRMWARE_SIGNATURE
+    if (!verifyFirmwareSignature(digest, signature))
+    {
+        publishResult(false, "Invalid firmware signature");
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+/**
+ * @brief Performs the firmware update using the provided firmware URL.
+ *
+ * Downloads the firmware from the specified HTTPS URL and applies the update.
+ * The firmware binary may be gzip compressed, in which case it is decompressed while downloading.
+ * If the connection is lost, the download is resumed with HTTP Range requests up to
+ * OTA_RESUME_ATTEMPTS times. Uncompressed downloads are also resumed by the next update
+ * of the same URL, even after a reboot.
+ * The SHA-256 of the image is calculated while writing and, if the expected one is provided,
+ * verified before the boot partition is switched. If USE_FIRMWARE_SIGNATURE is defined,
+ * the signature of the image is verified as well.
+ * Errors of the download are published after its metrics are stored, so the failure result
+ * carries them as well.
+ * If the update is successful, the device restarts to run the new firmware.
+ *
+ * @param request The parameters of the update.
+ * @param publishResult Callback used to report the result.
+ */
+void performFirmwareUpdate(const FirmwareUpdateRequest &request, PublishResult publishResult)
+{
+    const char *firmwareUrl = request.url;
+
+    // Reset the metrics of the previous update
+    portENTER_CRITICAL(&statusMux);
+    metrics = {};
+    portEXIT_CRITICAL(&statusMux);
+
+#ifdef USE_AWS_FOR_FIRMWARE_UPDATE
+    // Ensure the URL uses HTTPS for secure download
+    if (strncmp(firmwareUrl, "https://", 8) != 0)
+    {
+        publishResult(false, "Firmware URL must use HTTPS");
         return;
     }
+#endif
 
-    // Close the stream and end the HTTP connection
-    http.end();
+    // Validate the expected SHA-256 before downloading anything
+    uint8_t expectedSha256[OTA_SHA256_SIZE];
+    bool verifySha256 = request.sha256 != NULL && request.sha256[0] != '\0';
+    if (verifySha256 && !parseSha256(request.sha256, expectedSha256))
+    {
+        publishResult(false, "Invalid SHA-256, expected 64 hexadecimal characters");
+        return;
+    }
 
-    // Finish the update process
-    if (Update.end(true)) // Pass 'true' to set the update as finished
+#ifdef USE_FIRMWARE_SIGNATURE
+    if (request.signature == NULL || request.signature[0] == '\0')
     {
-        if (Update.isFinished())
+        publishResult(false, "Firmware signature is required");
+        return;
+    }
+#endif
+
+    OtaDownload download = {};
+    download.imageSize = request.imageSize;
+    download.urlHash = esp_rom_crc32_le(0, (const uint8_t *)firmwareUrl, strlen(firmwareUrl));
+
+    // Continue the download interrupted during the previous update
+    resumeSavedDownload(download);
+
+    uint32_t startTime = millis();
+    bool progressStarted = false;
+    OtaResult result = OTA_RETRY;
+
+    // Errors of the download are published after its metrics are stored
+    downloadError = "";
+
+    for (uint8_t attempt = 0; result == OTA_RETRY && attempt <= OTA_RESUME_ATTEMPTS; attempt++)
+    {
+        if (attempt > 0)
         {
-            publishResult(true, "Rebooting...");
-            delay(1000);   // Delay to allow the message to be published
-            ESP.restart(); // Reboot to apply the new firmware
+            Serial.printf("Retrying firmware download (attempt %u of %u)\n", attempt, OTA_RESUME_ATTEMPTS);
+            delay(OTA_RESUME_DELAY_MS * attempt);
         }
-        else
+
+        // Initialize HTTP client
+        HTTPClient http;
+#ifdef USE_AWS_FOR_FIRMWARE_UPDATE
+        // Set the AWS root CA certificate for secure connection
+        http.begin(firmwareUrl, AWS_CERT_CA);
+#else
+        // Use non-secure HTTP
+        http.begin(firmwareUrl);
+#endif
+
+        uint32_t length = 0;
+        result = requestFirmware(http, download, recordDownloadError, &length);
+
+        if (result == OTA_OK)
         {
-            publishResult(false, "Update.isFinished() returned false");
+            if (!progressStarted)
+            {
+                Serial.println(F("URL and content length validated. Starting update..."));
+                // Prepare the progress indication
+                startProgressIndication();
+                progressIndicationStarted = true;
+                progressStarted = true;
+            }
+
+            // Download the firmware and write it to the flash
+            result = downloadAndWriteFirmware(http, length, download, recordDownloadError);
         }
+
+        // Close the stream and end the HTTP connection
+        http.end();
+    }
+
+    gzipEnd(download.gzip);
+
+    // Verify the image before it is activated
+    if (result == OTA_OK)
+        setUpdateState(FW_UPDATE_VERIFYING, "Verifying the firmware image");
+    if (result == OTA_OK && !verifyFirmwareImage(download.writer, verifySha256 ? expectedSha256 : NULL,
+                                                 request.signature, recordDownloadError))
+        result = OTA_FAILED;
+
+    otaWriterFree(download.writer);
+    storeMetrics(download, startTime);
+
+    if (result == OTA_RETRY)
+    {
+        String details = "Download failed after " + String(OTA_RESUME_ATTEMPTS) + " retries. Downloaded: " +
+                         String(download.downloaded) + " / " + String(download.contentLength) + " bytes";
+        publishResult(false, details.c_str());
+        return;
+    }
+
+    // The written data could not be resumed anymore
+    clearResumeState();
+
+    if (result != OTA_OK)
+    {
+        publishResult(false, downloadError.c_str());
+        return;
+    }
+
+    // Validate the image and switch the boot partition to it
+    esp_err_t err = esp_ota_set_boot_partition(download.writer.partition);
+    if (err == ESP_OK)
+    {
+        publishResult(true, "Rebooting...");
+        delay(OTA_REBOOT_DELAY_MS); // Delay to allow the message to be published
+        ESP.restart();              // Reboot to apply the new firmware
     }
     else
     {
-        String details = "Update.end() failed with error: " + String(Update.errorString());
+        String details = "Failed to activate the new firmware: " + String(esp_err_to_name(err));
         publishResult(false, details.c_str());
     }
+}
+
+/**
+ * @brief Stores the result of the firmware update, so it could be published by the loop task.
+ *
+ * @param success true if the update succeeded and the device is going to reboot, false otherwise.
+ * @param message Message describing the result.
+ */
+void storeUpdateResult(bool success, const char *message)
+{
+    setUpdateState(success ? FW_UPDATE_REBOOTING : FW_UPDATE_FAILED, message);
+}
+
+/**
+ * @brief Task performing the firmware update in the background.
+ *
+ * The loop task keeps servicing MQTT while the update runs and publishes its status.
+ * On success the device reboots. On failure the progress indication turns red for
+ * OTA_FAILURE_INDICATION_MS and the LEDs return to normal operation.
+ *
+ * @param pvParameters Not used.
+ */
+void otaTask(void *pvParameters)
+{
+    setUpdateState(FW_UPDATE_DOWNLOADING, "Downloading the firmware");
+    progressIndicationStarted = false;
+
+    performFirmwareUpdate(activeRequest, storeUpdateResult);
+
+    // The update returns only if it failed
+    if (progressIndicationStarted)
+    {
+        progressIndicator(100, CRGB::Red);
+        vTaskDelay(pdMS_TO_TICKS(OTA_FAILURE_INDICATION_MS));
+        stopProgressIndication();
+    }
+
+    // Allow the next update only once this one cannot touch the shared state anymore
+    portENTER_CRITICAL(&statusMux);
+    taskRunning = false;
+    portEXIT_CRITICAL(&statusMux);
+
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Starts the firmware update in a background task.
+ *
+ * The parameters are copied, so the request does not need to outlive the call.
+ * Only one update could run at a time, a new one is rejected until the task of the
+ * previous one has ended.
+ *
+ * @param request The parameters of the update.
+ * @return NULL if the update was started, otherwise the reason why it was rejected.
+ */
+const char *startFirmwareUpdate(const FirmwareUpdateRequest &request)
+{
+    if (request.url == NULL || strlen(request.url) >= sizeof(requestUrl))
+        return "Firmware URL is missing or too long";
+    if (request.sha256 != NULL && strlen(request.sha256) >= sizeof(requestSha256))
+        return "Invalid SHA-256, expected 64 hexadecimal characters";
+    if (request.signature != NULL && strlen(request.signature) >= sizeof(requestSignature))
+        return "Firmware signature is too long";
+
+    // Reserve the update, so a concurrent command is rejected
+    portENTER_CRITICAL(&statusMux);
+    bool busy = taskRunning || isUpdateInProgress(status.state);
+    if (!busy)
+    {
+        taskRunning = true;
+        status.state = FW_UPDATE_QUEUED;
+        status.progress = 0;
+        status.sequence++;
+    }
+    portEXIT_CRITICAL(&statusMux);
+
+    if (busy)
+        return "Firmware update already in progress";
+
+    // Copy the parameters of the update
+    strlcpy(requestUrl, request.url, sizeof(requestUrl));
+    strlcpy(requestSha256, request.sha256 ? request.sha256 : "", sizeof(requestSha256));
+    strlcpy(requestSignature, request.signature ? request.signature : "", sizeof(requestSignature));
+    activeRequest.url = requestUrl;
+    activeRequest.imageSize = request.imageSize;
+    activeRequest.sha256 = requestSha256;
+    activeRequest.signature = requestSignature;
+
+    if (xTaskCreatePinnedToCore(otaTask,
+                                "otaTask",
+                                OTA_TASK_STACK_SIZE,
+                                NULL,
+                                OTA_TASK_PRIORITY,
+                                NULL,
+                                OTA_TASK_CORE) != pdPASS)
+    {
+        portENTER_CRITICAL(&statusMux);
+        taskRunning = false;
+        portEXIT_CRITICAL(&statusMux);
+
+        setUpdateState(FW_UPDATE_FAILED, "Failed to create otaTask");
+        return "Failed to create otaTask";
+    }
 
-    // Do not stop progress indication here, as the device will reboot on success.
-    // Otherwise stuck in the progress indication to indicate the failure.
+    return NULL;
 }
\ No newline at end of file
@@ -3,8 +3,60 @@
 
 #include <crgb.h> // Include CRGB type from FastLED library for LED colors
 
-typedef void (*PublishResult)(bool success, const char *message);
+// Time to publish the result before rebooting (in milliseconds)
+#define OTA_REBOOT_DELAY_MS 3000
+// How long the failed update is indicated by the LEDs (in milliseconds)
+#define OTA_FAILURE_INDICATION_MS 5000
+// Number of attempts to resume an interrupted download within one update
+#define OTA_RESUME_ATTEMPTS 5
 
-void performFirmwareUpdate(const char *firmwareUrl, PublishResult publishResult);
+// States of the firmware update
+enum FirmwareUpdateState
+{
+    FW_UPDATE_IDLE,        // No update was requested since boot
+    FW_UPDATE_QUEUED,      // The update task is being started
+    FW_UPDATE_DOWNLOADING, // The firmware is being downloaded and written
+    FW_UPDATE_VERIFYING,   // The written image is being verified
+    FW_UPDATE_REBOOTING,   // The update succeeded, the device is going to reboot
+    FW_UPDATE_FAILED       // The last update failed
+};
+
+// Status of the firmware update
+struct FirmwareUpdateStatus
+{
+    FirmwareUpdateState state; // Current state
+    uint8_t progress;          // Progress of the download in percent
+    uint32_t sequence;         // Incremented on every state change
+    char message[128];         // Message describing the state or the result
+};
+
+// Metrics of a firmware download
+struct FirmwareUpdateMetrics
+{
+    uint32_t bytes;           // Number of bytes written to the flash
+    uint32_t downloadedBytes; // Number of bytes downloaded (smaller than bytes for compressed images)
+    uint32_t totalTimeMs;     // Total time of the download
+    uint32_t receiveTimeMs;   // Time spent reading the HTTP stream
+    uint32_t writeTimeMs;     // Time spent writing the flash
+    uint32_t hashTimeMs;      // Time spent calculating the SHA-256 of the image
+    uint32_t receiverStalls;  // Number of times the receiver waited for the flash writer
+    uint32_t writerStalls;    // Number of times the flash writer waited for the network
+    uint32_t throughputKBps;  // Average throughput in kB/s
+    uint32_t resumes;         // Number of times the download was resumed with a Range request
+};
+
+// Parameters of the firmware update command
+struct FirmwareUpdateRequest
+{
+    const char *url;       // URL of the firmware binary
+    uint32_t imageSize;    // Size of the decompressed image if known, 0 otherwise
+    const char *sha256;    // Expected SHA-256 of the image as a hexadecimal string, NULL to skip the check
+    const char *signature; // Base64 encoded signature of the image, NULL if not provided
+};
+
+const char *startFirmwareUpdate(const FirmwareUpdateRequest &request);
+FirmwareUpdateStatus getFirmwareUpdateStatus();
+const char *firmwareUpdateStateToString(FirmwareUpdateState state);
+FirmwareUpdateMetrics getFirmwareUpdateMetrics();
 
 #endif // FIRMWARE_UPDATE_H
\ No newline at end of file
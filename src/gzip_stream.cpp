@@ -0,0 +1,213 @@
+#include <esp32/rom/miniz.h>
+#include <esp_rom_crc.h>
+#include "gzip_stream.h"
+
+// Gzip header constants (RFC 1952)
+#define GZIP_ID1            0x1F
+#define GZIP_ID2            0x8B
+#define GZIP_CM_DEFLATE     8
+#define GZIP_HEADER_SIZE    10
+#define GZIP_TRAILER_SIZE   8
+#define GZIP_FLAG_HCRC      0x02
+#define GZIP_FLAG_EXTRA     0x04
+#define GZIP_FLAG_NAME      0x08
+#define GZIP_FLAG_COMMENT   0x10
+
+// Parts of the gzip member
+enum GzipState
+{
+    GZIP_STATE_HEADER,
+    GZIP_STATE_EXTRA_LENGTH,
+    GZIP_STATE_EXTRA,
+    GZIP_STATE_NAME,
+    GZIP_STATE_COMMENT,
+    GZIP_STATE_HEADER_CRC,
+    GZIP_STATE_DATA,
+    GZIP_STATE_TRAILER,
+    GZIP_STATE_DONE
+};
+
+/**
+ * @brief Checks if the data starts with the gzip magic bytes.
+ *
+ * @param data The first bytes of the data.
+ * @param length The length of the data.
+ * @return true if the data is gzip compressed, false otherwise.
+ */
+bool isGzipData(const uint8_t *data, size_t length)
+{
+    return length >= 2 && data[0] == GZIP_ID1 && data[1] == GZIP_ID2;
+}
+
+/**
+ * @brief Allocates the decoder state and prepares the stream for decompression.
+ *
+ * @param stream The stream to initialize.
+ * @return true if the stream was initialized, false if the memory could not be allocated.
+ */
+bool gzipBegin(GzipStream &stream)
+{
+    memset(&stream, 0, sizeof(stream));
+
+    stream.inflator = malloc(sizeof(tinfl_decompressor));
+    stream.window = (uint8_t *)malloc(GZIP_WINDOW_SIZE);
+    if (!stream.inflator || !stream.window)
+    {
+        gzipEnd(stream);
+        return false;
+    }
+
+    tinfl_init((tinfl_decompressor *)stream.inflator);
+    stream.state = GZIP_STATE_HEADER;
+    return true;
+}
+
+/**
+ * @brief Releases the memory allocated by gzipBegin().
+ *
+ * @param stream The stream to release.
+ */
+void gzipEnd(GzipStream &stream)
+{
+    free(stream.inflator);
+    free(stream.window);
+    stream.inflator = NULL;
+    stream.window = NULL;
+}
+
+/**
+ * @brief Parses a single byte of the gzip header.
+ *
+ * @param stream The stream being decoded.
+ * @param value The byte to parse.
+ * @return true if the byte is valid, false if the header is not supported.
+ */
+bool parseHeaderByte(GzipStream &stream, uint8_t value)
+{
+    switch (stream.state)
+    {
+    case GZIP_STATE_HEADER:
+        if ((stream.position == 0 && value != GZIP_ID1) ||
+            (stream.position == 1 && value != GZIP_ID2) ||
+            (stream.position == 2 && value != GZIP_CM_DEFLATE))
+            return false;
+        if (stream.position == 3)
+            stream.flags = value;
+        if (++stream.position < GZIP_HEADER_SIZE)
+            return true;
+        break;
+
+    case GZIP_STATE_EXTRA_LENGTH:
+        stream.extraLength |= (uint16_t)value << (8 * stream.position);
+        if (++stream.position < 2)
+            return true;
+        break;
+
+    case GZIP_STATE_EXTRA:
+        if (++stream.position < stream.extraLength)
+            return true;
+        break;
+
+    case GZIP_STATE_NAME:
+    case GZIP_STATE_COMMENT:
+        if (value != 0)
+            return true;
+        break;
+
+    case GZIP_STATE_HEADER_CRC:
+        if (++stream.position < 2)
+            return true;
+        break;
+    }
+
+    // The current field is complete, continue with the next optional field
+    stream.position = 0;
+    if (stream.state < GZIP_STATE_EXTRA_LENGTH && (stream.flags & GZIP_FLAG_EXTRA))
+        stream.state = GZIP_STATE_EXTRA_LENGTH;
+    else if (stream.state == GZIP_STATE_EXTRA_LENGTH && stream.extraLength > 0)
+        stream.state = GZIP_STATE_EXTRA;
+    else if (stream.state < GZIP_STATE_NAME && (stream.flags & GZIP_FLAG_NAME))
+        stream.state = GZIP_STATE_NAME;
+    else if (stream.state < GZIP_STATE_COMMENT && (stream.flags & GZIP_FLAG_COMMENT))
+        stream.state = GZIP_STATE_COMMENT;
+    else if (stream.state < GZIP_STATE_HEADER_CRC && (stream.flags & GZIP_FLAG_HCRC))
+        stream.state = GZIP_STATE_HEADER_CRC;
+    else
+        stream.state = GZIP_STATE_DATA;
+
+    return true;
+}
+
+/**
+ * @brief Feeds compressed data to the stream and passes the decompressed data to the callback.
+ *
+ * The data can be split into chunks of any size. The decompressed data is passed to the callback
+ * directly from the decompression window, so no additional output buffer is needed. When the end
+ * of the stream is reached, the CRC32 and size from the gzip trailer are verified.
+ *
+ * @param stream The stream initialized with gzipBegin().
+ * @param data The compressed data.
+ * @param length The length of the compressed data.
+ * @param output Callback receiving the decompressed data.
+ * @param context Context passed to the callback.
+ * @return GZIP_NEED_MORE_INPUT, GZIP_DONE when the stream is complete and valid, or GZIP_ERROR.
+ */
+GzipStatus gzipWrite(GzipStream &stream, const uint8_t *data, size_t length, GzipOutput output, void *context)
+{
+    // Parse the header
+    while (length > 0 && stream.state < GZIP_STATE_DATA)
+    {
+        if (!parseHeaderByte(stream, *data))
+            return GZIP_ERROR;
+        data++;
+        length--;
+    }
+
+    // Decompress the data
+    while (stream.state == GZIP_STATE_DATA)
+    {
+        size_t inBytes = length;
+        size_t outBytes = GZIP_WINDOW_SIZE - stream.windowOffset;
+        tinfl_status status = tinfl_decompress((tinfl_decompressor *)stream.inflator, data, &inBytes,
+                                               stream.window, stream.window + stream.windowOffset, &outBytes,
+                                               TINFL_FLAG_HAS_MORE_INPUT);
+        data += inBytes;
+        length -= inBytes;
+
+        if (outBytes > 0)
+        {
+            const uint8_t *chunk = stream.window + stream.windowOffset;
+            stream.crc = esp_rom_crc32_le(stream.crc, chunk, outBytes);
+            stream.outputSize += outBytes;
+            stream.windowOffset = (stream.windowOffset + outBytes) & (GZIP_WINDOW_SIZE - 1);
+
+            if (!output(chunk, outBytes, context))
+                return GZIP_ERROR;
+        }
+
+        if (status == TINFL_STATUS_DONE)
+            stream.state = GZIP_STATE_TRAILER;
+        else if (status < TINFL_STATUS_DONE)
+            return GZIP_ERROR;
+        else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && length == 0)
+            return GZIP_NEED_MORE_INPUT;
+    }
+
+    // Collect the trailer
+    while (length > 0 && stream.state == GZIP_STATE_TRAILER)
+    {
+        stream.trailer[stream.position++] = *data++;
+        length--;
+
+        if (stream.position == GZIP_TRAILER_SIZE)
+        {
+            uint32_t crc = stream.trailer[0] | stream.trailer[1] << 8 | stream.trailer[2] << 16 | (uint32_t)stream.trailer[3] << 24;
+            uint32_t size = stream.trailer[4] | stream.trailer[5] << 8 | stream.trailer[6] << 16 | (uint32_t)stream.trailer[7] << 24;
+            if (crc != stream.crc || size != stream.outputSize)
+                return GZIP_ERROR;
+            stream.state = GZIP_STATE_DONE;
+        }
+    }
+
+    return stream.state == GZIP_STATE_DONE ? GZIP_DONE : GZIP_NEED_MORE_INPUT;
+}
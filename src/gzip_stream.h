@@ -0,0 +1,40 @@
+#ifndef GZIP_STREAM_H
+#define GZIP_STREAM_H
+
+#include <Arduino.h>
+
+// Size of the decompression window required by the deflate format
+#define GZIP_WINDOW_SIZE 32768
+
+// Callback receiving the decompressed data. Returns false to abort the decompression
+typedef bool (*GzipOutput)(const uint8_t *data, size_t length, void *context);
+
+// Result of feeding data to the gzip stream
+enum GzipStatus
+{
+    GZIP_NEED_MORE_INPUT, // All input consumed, the stream is not finished yet
+    GZIP_DONE,            // The stream is finished and its checksum is valid
+    GZIP_ERROR            // The stream is corrupted or the output callback failed
+};
+
+// State of the streaming gzip decoder
+struct GzipStream
+{
+    void *inflator;         // Deflate decoder state (tinfl_decompressor)
+    uint8_t *window;        // Decompression window, output is passed to the callback from here
+    size_t windowOffset;    // Write position in the window
+    uint8_t state;          // Current part of the gzip member being parsed
+    uint8_t flags;          // Flags from the gzip header
+    uint16_t position;      // Position in the header field or trailer being parsed
+    uint16_t extraLength;   // Length of the extra header field
+    uint8_t trailer[8];     // CRC32 and ISIZE from the gzip trailer
+    uint32_t crc;           // CRC32 of the decompressed data
+    uint32_t outputSize;    // Size of the decompressed data
+};
+
+bool isGzipData(const uint8_t *data, size_t length);
+bool gzipBegin(GzipStream &stream);
+GzipStatus gzipWrite(GzipStream &stream, const uint8_t *data, size_t length, GzipOutput output, void *context);
+void gzipEnd(GzipStream &stream);
+
+#endif // GZIP_STREAM_H
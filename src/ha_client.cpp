@@ -1,22 +1,30 @@
+#include <LittleFS.h>
 #include <WiFi.h>
 #include "esp32_utils.h" // Required for CHIP_ID_LENGTH
 #include <ArduinoJson.h>
 
 #include "ha_client.h"
+#include "config_store.h"
 #include "constants.h"
+#include "leds.h"
+#include "leds_parser.h"
+#include "power.h"
+#include "system_clock.h"
 
 // Initialize Wi-Fi and MQTT client
 WiFiClient haClientNet;
 PubSubClient haClient(haClientNet);
 
-// Interval for publishing device status (in milliseconds)
-#define HA_STATUS_PUBLISH_INTERVAL 10 * 1000
+// Minimum interval between two status publishes (in milliseconds)
+#define HA_STATUS_MIN_INTERVAL      1000
+// Interval for publishing changes of slow counters like received messages (in milliseconds)
+#define HA_STATUS_COUNTERS_INTERVAL 60 * 1000
+// Interval for refreshing the uptime if nothing else has changed (in milliseconds)
+#define HA_STATUS_UPTIME_INTERVAL   5 * 60 * 1000
 // Initial delay before attempting to reconnect to Home Assistant MQTT Broker (in milliseconds)
-#define RECONNECT_INITIAL_DELAY    100
+#define RECONNECT_INITIAL_DELAY     100
 // Maximum delay between reconnection attempts to Home Assistant MQTT Broker (in milliseconds)
-#define RECONNECT_MAX_DELAY        10000
-// MQTT buffer size for handling larger messages
-#define MQTT_BUFFER_SIZE           512
+#define RECONNECT_MAX_DELAY         10000
 
 // Task parameters
 #define HA_TASK_STACK_SIZE (4 * 1024U)
@@ -25,29 +33,160 @@ PubSubClient haClient(haClientNet);
 
 // MQTT topics
 #define MQTT_SUB_TOPIC_ENABLE MQTT_BASE_TOPIC "/cmd/enable"
+#define MQTT_SUB_TOPIC_LIGHT  MQTT_BASE_TOPIC "/cmd/light"
 #define MQTT_PUB_TOPIC_STATUS MQTT_BASE_TOPIC "/status/device"
+#define MQTT_PUB_TOPIC_LIGHT  MQTT_BASE_TOPIC "/status/light"
 
 // Home Assistant discovery topics
 #define MQTT_DISCOVERY_SWITCH_TOPIC "homeassistant/switch/int_cz_map/%s/config"
 #define MQTT_DISCOVERY_SENSOR_TOPIC "homeassistant/sensor/int_cz_map/%s/config"
+#define MQTT_DISCOVERY_LIGHT_TOPIC  "homeassistant/light/int_cz_map/%s/config"
+
+// Home Assistant birth message topic and payload, used to republish the discovery configuration
+#define HA_BIRTH_TOPIC   "homeassistant/status"
+#define HA_BIRTH_PAYLOAD "online"
 
 // Buffer size for MQTT topics
 #define TOPIC_BUFFER_SIZE 128
+// Buffer size for the status message
+#define STATUS_BUFFER_SIZE 192
+// Buffer size for the light state message
+#define LIGHT_STATE_BUFFER_SIZE 160
+
+// Size of the buffer holding all rendered discovery payloads
+#define DISCOVERY_BUFFER_SIZE 3072
+
+// Config store key of the hash of the last published discovery configuration
+#define CONFIG_KEY_DISCOVERY_HASH      "ha.discovery"
+// File which stored the hash before the config store was used, removed at boot
+#define LEGACY_DISCOVERY_HASH_FILENAME "/ha_discovery.dat"
+
+// Snapshot of the values published in the status message
+struct HAStatus
+{
+    bool enabled;
+    uint32_t haReconnectAttempts;
+    uint32_t awsReconnectAttempts;
+    uint32_t awsMsgsReceived;
+    uint32_t uptime;
+};
+
+// Rendered discovery message
+struct DiscoveryMessage
+{
+    char topic[TOPIC_BUFFER_SIZE]; // Discovery topic of the entity
+    const char *payload;           // Pointer to the payload in discoveryBuffer
+    size_t length;                 // Length of the payload
+};
+
+// Light effect which could be selected in Home Assistant
+struct LightEffect
+{
+    const char *name;      // Name of the effect shown in Home Assistant
+    uint16_t fadeDuration; // Duration of a fade in or out (0 for solid color)
+    AmbientEffect ambient; // Effect of the ambient light rendered by the LED task
+};
+
+// Effects built into the device. The first one is used by default
+const LightEffect LIGHT_EFFECTS[] = {
+    {"Solid", 0, AMBIENT_SOLID},
+    {"Fade", CIRCLE_EFFECT_SLOW_FADE_DURATION, AMBIENT_FADE},
+    {"Circle", CIRCLE_EFFECT_SLOW_FADE_DURATION, AMBIENT_CIRCLE},
+};
+#define LIGHT_EFFECTS_COUNT (sizeof(LIGHT_EFFECTS) / sizeof(LIGHT_EFFECTS[0]))
+
+// State of the Home Assistant light entity
+struct LightState
+{
+    bool on = false;               // Is the light turned on
+    uint8_t brightness = 255;      // Brightness of the LEDs
+    CRGB color = CRGB::White;      // Color of the LEDs
+    uint8_t effect = 0;            // Index of the effect in LIGHT_EFFECTS
+};
 
 // Last time the device status was published
 uint32_t lastHAPublishTime = 0;
+// Last successfully published status and flag indicating whether it is valid
+static HAStatus lastPublishedStatus;
+static bool statusPublished = false;
 // Counter for the number of times the device was reconnecting to the Home Assistant MQTT Broker
 uint32_t haReconnectAttempts = 0;
 
 // Variables to store MQTT topics
 static char enableSubTopic[sizeof(MQTT_SUB_TOPIC_ENABLE) + CHIP_ID_LENGTH + 1];
 static char statusPubTopic[sizeof(MQTT_PUB_TOPIC_STATUS) + CHIP_ID_LENGTH + 1];
+static char lightSubTopic[sizeof(MQTT_SUB_TOPIC_LIGHT) + CHIP_ID_LENGTH + 1];
+static char lightPubTopic[sizeof(MQTT_PUB_TOPIC_LIGHT) + CHIP_ID_LENGTH + 1];
 
 // Indicates if the map is turned on (flashings allowed)
 bool mapState = true;
 
+// Current state of the light entity
+static LightState lightState;
+
+// Discovery messages rendered once at boot
+static DiscoveryMessage discoveryMessages[HA_DISCOVERY_MESSAGES_COUNT];
+static char discoveryBuffer[DISCOVERY_BUFFER_SIZE];
+static uint8_t discoveryMessagesCount = 0;
+// Hash of the rendered discovery messages and of the last published ones
+static uint32_t discoveryHash = 0;
+static uint32_t publishedDiscoveryHash = 0;
+// Set when Home Assistant announced its (re)start with the birth message
+static volatile bool discoveryPublishRequested = false;
+
 // Forward declarations
 void publishStatusHA();
+void publishLightStateHA();
+void handleLightCommand(byte *payload, unsigned int length);
+
+/**
+ * @brief Compares the payload of a message with a string without copying it.
+ *
+ * @param payload The payload of the message.
+ * @param length The length of the payload.
+ * @param text The null-terminated string to compare with.
+ * @return true if the payload equals the string, false otherwise.
+ */
+bool payloadEquals(const byte *payload, unsigned int length, const char *text)
+{
+    return length == strlen(text) && memcmp(payload, text, length) == 0;
+}
+
+/**
+ * @brief Handles the enable command received from Home Assistant.
+ *
+ * The payload is compared in place, so the command does not allocate any memory.
+ * Turning the map off puts the device into the low-power standby mode. The status is published only
+ * if the state has actually changed.
+ *
+ * @param topic The topic on which the message was received.
+ * @param payload The payload of the message ("ON" or "OFF").
+ * @param length The length of the payload.
+ */
+void handleEnableCommand(const char *topic, const byte *payload, unsigned int length)
+{
+    bool newState;
+    if (payloadEquals(payload, length, "ON"))
+        newState = true;
+    else if (payloadEquals(payload, length, "OFF"))
+        newState = false;
+    else
+    {
+        Serial.printf("Invalid message received on topic '%s': %.*s\n", topic, (int)length, (const char *)payload);
+        return;
+    }
+
+    // Do not republish the status if the state has not changed
+    if (newState == mapState)
+        return;
+
+    mapState = newState;
+    setStandby(!mapState);
+    Serial.println(mapState ? "Map turned ON" : "Map turned OFF");
+
+    // Publish the current status after the state has changed
+    publishStatusHA();
+}
 
 /**
  * @brief Handles incoming messages from the Home Assistant MQTT broker.
@@ -58,111 +197,239 @@ void publishStatusHA();
  */
 void haMessageHandler(char *topic, byte *payload, unsigned int length)
 {
-    String message;
-    for (unsigned int i = 0; i < length; i++)
+    if (strcmp(topic, enableSubTopic) == 0)
     {
-        message += (char)payload[i];
+        handleEnableCommand(topic, payload, length);
     }
-
-    if (strcmp(topic, enableSubTopic) == 0)
+    else if (strcmp(topic, lightSubTopic) == 0)
     {
-        if (message == "ON")
-        {
-            mapState = true;
-            Serial.println("Map turned ON");
-        }
-        else if (message == "OFF")
-        {
-            mapState = false;
-            Serial.println("Map turned OFF");
-        }
-        else
-        {
-            Serial.printf("Invalid message received on topic '%s': %s\n", topic, message.c_str());
-        }
-
-        // Publish the current status after receiving the enable command
-        publishStatusHA();
+        handleLightCommand(payload, length);
+    }
+    else if (strcmp(topic, HA_BIRTH_TOPIC) == 0)
+    {
+        // Home Assistant restarted: republish the discovery configuration from the task loop
+        if (payloadEquals(payload, length, HA_BIRTH_PAYLOAD))
+            discoveryPublishRequested = true;
     }
 }
 
 /**
- * @brief Publishes a JSON document to a specified MQTT topic.
+ * @brief Publishes a payload to a specified MQTT topic.
  *
- * This function serializes a given JSON document and publishes it to the specified MQTT topic.
- *
- * @param topic The MQTT topic to publish the JSON document to.
- * @param doc The JSON document to be published.
+ * @param topic The MQTT topic to publish the payload to.
+ * @param payload The payload to be published.
+ * @param length The length of the payload.
  * @param retain Flag indicating if the message should be retained by the broker.
+ * @return true if the message was published, false otherwise.
  */
-void publishJsonHA(const char *topic, const JsonDocument &doc, bool retain = true)
+bool publishHA(const char *topic, const char *payload, size_t length, bool retain = true)
 {
-    // Allocate a buffer for the JSON document and serialize it
-    char buffer[MQTT_BUFFER_SIZE];
-    size_t serializedSize = serializeJson(doc, buffer, MQTT_BUFFER_SIZE);
-
-    // Check if the buffer is large enough for the JSON document
-    if (serializedSize >= MQTT_BUFFER_SIZE)
-    {
-        Serial.printf("Failed to publish message to topic '%s': Buffer (%d bytes) too small for JSON (%d bytes)\n",
-                      topic, MQTT_BUFFER_SIZE, serializedSize);
-        lastHAPublishTime = millis(); // Update last publish time to prevent rapid publishing
-        return;
-    }
-
     // Check if MQTT client is connected
     if (!haClient.connected())
     {
         Serial.printf("Error publishing to topic '%s': Home Assistant MQTT client not connected\n", topic);
-        lastHAPublishTime = millis(); // Update last publish time to prevent rapid publishing
-        return;
+        return false;
     }
 
     // Publish the message to the specified topic
-    if (haClient.publish(topic, buffer, retain))
-        Serial.printf("Published %d bytes to topic '%s'\n", serializedSize, topic);
-    else
+    if (!haClient.publish(topic, (const uint8_t *)payload, length, retain))
+    {
         Serial.printf("Failed to publish message to topic '%s'\n", topic);
+        return false;
+    }
 
-    // Set last publish time to the current time after attempting to publish
-    lastHAPublishTime = millis();
+    Serial.printf("Published %u bytes to topic '%s'\n", (uint32_t)length, topic);
+    return true;
 }
 
 /**
- * @brief Publishes the current status to Home Assistant via MQTT.
+ * @brief Takes a snapshot of the values published in the status message.
+ *
+ * @return The current status.
  */
-void publishStatusHA()
+HAStatus readStatusHA()
 {
-    // Allocate the JSON document
-    JsonDocument doc;
+    HAStatus status;
+    status.enabled = mapState;
+    status.haReconnectAttempts = haReconnectAttempts;
+    status.awsReconnectAttempts = awsReconnectAttempts;
+    status.awsMsgsReceived = awsMsgsReceived;
+    status.uptime = clockUptimeSeconds();
+    return status;
+}
+
+/**
+ * @brief Decides whether the status has to be published.
+ *
+ * Changes of the enable state and of the reconnect counters are published as soon as
+ * HA_STATUS_MIN_INTERVAL has passed since the last publish. Changes of the received
+ * messages counter are published at most every HA_STATUS_COUNTERS_INTERVAL, and the
+ * uptime alone is refreshed every HA_STATUS_UPTIME_INTERVAL.
+ *
+ * @param current The current status.
+ * @param published The last published status.
+ * @param elapsed The time elapsed since the last publish attempt in milliseconds.
+ * @return true if the status should be published, false otherwise.
+ */
+bool isStatusPublishDue(const HAStatus &current, const HAStatus &published, uint32_t elapsed)
+{
+    if (elapsed < HA_STATUS_MIN_INTERVAL)
+        return false;
 
-    doc["enabled"] = mapState ? "ON" : "OFF";
-    doc["haReconnectAttempts"] = haReconnectAttempts;
-    doc["awsReconnectAttempts"] = awsReconnectAttempts;
-    doc["uptime"] = millis() / 1000;
-    doc["awsMsgsReceived"] = awsMsgsReceived;
+    if (current.enabled != published.enabled ||
+        current.haReconnectAttempts != published.haReconnectAttempts ||
+        current.awsReconnectAttempts != published.awsReconnectAttempts)
+        return true;
 
-    // Publish device status to the MQTT topic
-    publishJsonHA(statusPubTopic, doc);
+    if (current.awsMsgsReceived != published.awsMsgsReceived && elapsed >= HA_STATUS_COUNTERS_INTERVAL)
+        return true;
+
+    return elapsed >= HA_STATUS_UPTIME_INTERVAL;
 }
 
 /**
- * @brief Publishes the status periodically.
+ * @brief Publishes the current status to Home Assistant via MQTT.
+ */
+void publishStatusHA()
+{
+    uint32_t timeNow = clockMillis();
+    HAStatus status = readStatusHA();
+
+    // Render the status message. Field names are referenced by the discovery value templates
+    char buffer[STATUS_BUFFER_SIZE];
+    int length = snprintf(buffer, sizeof(buffer),
+                          "{\"enabled\":\"%s\",\"haReconnectAttempts\":%u,\"awsReconnectAttempts\":%u,"
+                          "\"uptime\":%u,\"awsMsgsReceived\":%u}",
+                          status.enabled ? "ON" : "OFF", status.haReconnectAttempts,
+                          status.awsReconnectAttempts, status.uptime, status.awsMsgsReceived);
+
+    // Set last publish time before attempting to publish to prevent rapid publishing on failure
+    lastHAPublishTime = timeNow;
+
+    // Publish device status to the MQTT topic and remember what was published
+    if (publishHA(statusPubTopic, buffer, length))
+    {
+        lastPublishedStatus = status;
+        statusPublished = true;
+    }
+}
+
+/**
+ * @brief Publishes the status when it has changed.
  *
- * This function checks the elapsed time since the last status publish and
- * publishes the status if the elapsed time is greater than or equal to the
- * HA_STATUS_PUBLISH_INTERVAL.
+ * This function compares the current status with the last published one and
+ * publishes it only if isStatusPublishDue() decides so. The first status after
+ * boot is published unconditionally.
  *
  * @note Variable lastHAPublishTime is updated in the publishStatusHA() function.
  */
 void periodicStatusPublishHA()
 {
 #ifdef HA_MQTT_BROKER_HOST
-    if (millis() - lastHAPublishTime >= HA_STATUS_PUBLISH_INTERVAL)
+    uint32_t timeNow = clockMillis();
+    uint32_t elapsed = timeNow - lastHAPublishTime;
+
+    if (!statusPublished)
+    {
+        if (elapsed >= HA_STATUS_MIN_INTERVAL)
+            publishStatusHA();
+        return;
+    }
+
+    if (isStatusPublishDue(readStatusHA(), lastPublishedStatus, elapsed))
         publishStatusHA();
 #endif
 }
 
+/**
+ * @brief Publishes the current state of the light entity to Home Assistant via MQTT.
+ */
+void publishLightStateHA()
+{
+    char buffer[LIGHT_STATE_BUFFER_SIZE];
+    int length = snprintf(buffer, sizeof(buffer),
+                          "{\"state\":\"%s\",\"brightness\":%u,\"color_mode\":\"rgb\","
+                          "\"color\":{\"r\":%u,\"g\":%u,\"b\":%u},\"effect\":\"%s\"}",
+                          lightState.on ? "ON" : "OFF", lightState.brightness,
+                          lightState.color.r, lightState.color.g, lightState.color.b,
+                          LIGHT_EFFECTS[lightState.effect].name);
+
+    publishHA(lightPubTopic, buffer, length);
+}
+
+/**
+ * @brief Translates the state of the light entity into the ambient light of the LEDs.
+ *
+ * The LED task renders the ambient light on the LEDs without a running command, so the
+ * light does not occupy the command queues and the commands from other sources are shown
+ * on top of it.
+ */
+void applyLightState()
+{
+    const LightEffect &effect = LIGHT_EFFECTS[lightState.effect];
+    AmbientLight light = {lightState.on, effect.ambient, effect.fadeDuration, lightState.brightness, lightState.color};
+    handleAmbientLightCommand(light, micros());
+}
+
+/**
+ * @brief Handles a command for the light entity received from Home Assistant.
+ *
+ * The command uses the JSON schema of the Home Assistant MQTT light, for example:
+ * {"state": "ON", "brightness": 128, "color": {"r": 255, "g": 0, "b": 0}, "effect": "Fade"}
+ * Omitted fields keep their previous values.
+ *
+ * @param payload The payload of the message.
+ * @param length The length of the payload.
+ */
+void handleLightCommand(byte *payload, unsigned int length)
+{
+    // Allocate the JSON document
+    JsonDocument doc;
+
+    // Parse the JSON document and check for errors
+    DeserializationError error = deserializeJson(doc, payload, length);
+    if (error)
+    {
+        Serial.printf("Light command deserializeJson() failed: %s\n", error.c_str());
+        return;
+    }
+
+    // Ignore the command if the map is turned off, but report the unchanged state back
+    if (!mapState)
+    {
+        Serial.println(F("Light command ignored: map is turned OFF"));
+        publishLightStateHA();
+        return;
+    }
+
+    const char *state = doc["state"];
+    if (state)
+        lightState.on = strcmp(state, "ON") == 0;
+
+    if (doc["brightness"].is<int>())
+        lightState.brightness = constrain(doc["brightness"].as<int>(), 0, 255);
+
+    JsonObject color = doc["color"];
+    if (color)
+        lightState.color = CRGB(color["r"] | 0, color["g"] | 0, color["b"] | 0);
+
+    const char *effect = doc["effect"];
+    if (effect)
+    {
+        for (uint8_t i = 0; i < LIGHT_EFFECTS_COUNT; i++)
+        {
+            if (strcmp(effect, LIGHT_EFFECTS[i].name) == 0)
+            {
+                lightState.effect = i;
+                break;
+            }
+        }
+    }
+
+    applyLightState();
+    publishLightStateHA();
+}
+
 /**
  * @brief Checks if the map is enabled.
  *
@@ -184,11 +451,14 @@ bool isMapOn()
  */
 void setDeviceInfo(JsonObject deviceInfo, const char *clientId)
 {
+    char deviceId[sizeof("int-cz-map-") + CHIP_ID_LENGTH];
+    snprintf(deviceId, sizeof(deviceId), "int-cz-map-%s", clientId);
+
     deviceInfo["name"] = "Interactive CZ Map";
     deviceInfo["mdl"] = HOSTNAME_PREFIX;
     deviceInfo["mf"] = "👨‍💻 SenMorgan";
-    deviceInfo["sn"] = String(clientId);
-    deviceInfo["ids"].to<JsonArray>().add("int-cz-map-" + String(clientId));
+    deviceInfo["sn"] = clientId;
+    deviceInfo["ids"].to<JsonArray>().add(deviceId);
 }
 
 /**
@@ -203,13 +473,26 @@ void setOriginInfo(JsonObject originInfo)
     originInfo["url"] = "https://github.com/SenMorgan/Interactive-CZ-Map";
 }
 
-void buildSwitchConfig(JsonDocument &doc, const char *clientId, char *topicBuffer)
+/**
+ * @brief Composes the Unique ID of an entity and the discovery topic using it.
+ *
+ * @param uniqId Buffer for the Unique ID (TOPIC_BUFFER_SIZE bytes).
+ * @param topicBuffer Buffer for the discovery topic (TOPIC_BUFFER_SIZE bytes).
+ * @param topicFormat Discovery topic format with a single %s for the Unique ID.
+ * @param clientId The client ID used as the Unique ID prefix.
+ * @param suffix The entity specific Unique ID suffix.
+ */
+void composeUniqueId(char *uniqId, char *topicBuffer, const char *topicFormat, const char *clientId, const char *suffix)
 {
-    // Create Unique ID
-    String uniqId = String(clientId) + "_enable";
+    snprintf(uniqId, TOPIC_BUFFER_SIZE, "%s_%s", clientId, suffix);
+    snprintf(topicBuffer, TOPIC_BUFFER_SIZE, topicFormat, uniqId);
+}
 
-    // Build topic for the switch configuration using the Unique ID
-    snprintf(topicBuffer, TOPIC_BUFFER_SIZE, MQTT_DISCOVERY_SWITCH_TOPIC, uniqId.c_str());
+void buildSwitchConfig(JsonDocument &doc, const char *clientId, char *topicBuffer)
+{
+    // Create Unique ID and build topic for the switch configuration using it
+    char uniqId[TOPIC_BUFFER_SIZE];
+    composeUniqueId(uniqId, topicBuffer, MQTT_DISCOVERY_SWITCH_TOPIC, clientId, "enable");
 
     // Build the switch configuration
     doc["name"] = "Enable";
@@ -224,11 +507,9 @@ void buildSwitchConfig(JsonDocument &doc, const char *clientId, char *topicBuffe
 
 void buildAwsReconAttSensorConfig(JsonDocument &doc, const char *clientId, char *topicBuffer)
 {
-    // Create Unique ID
-    String uniqId = String(clientId) + "_aws_recon_att";
-
-    // Build topic for the sensor configuration using the Unique ID
-    snprintf(topicBuffer, TOPIC_BUFFER_SIZE, MQTT_DISCOVERY_SENSOR_TOPIC, uniqId.c_str());
+    // Create Unique ID and build topic for the sensor configuration using it
+    char uniqId[TOPIC_BUFFER_SIZE];
+    composeUniqueId(uniqId, topicBuffer, MQTT_DISCOVERY_SENSOR_TOPIC, clientId, "aws_recon_att");
 
     // Build the sensor configuration
     doc["name"] = "AWS Reconnect Attempts";
@@ -242,11 +523,9 @@ void buildAwsReconAttSensorConfig(JsonDocument &doc, const char *clientId, char
 
 void buildAwsMsgsRcvdSensorConfig(JsonDocument &doc, const char *clientId, char *topicBuffer)
 {
-    // Create Unique ID
-    String uniqId = String(clientId) + "_aws_msgs_rcvd";
-
-    // Build topic for the sensor configuration using the Unique ID
-    snprintf(topicBuffer, TOPIC_BUFFER_SIZE, MQTT_DISCOVERY_SENSOR_TOPIC, uniqId.c_str());
+    // Create Unique ID and build topic for the sensor configuration using it
+    char uniqId[TOPIC_BUFFER_SIZE];
+    composeUniqueId(uniqId, topicBuffer, MQTT_DISCOVERY_SENSOR_TOPIC, clientId, "aws_msgs_rcvd");
 
     // Build the sensor configuration
     doc["name"] = "AWS Messages Received";
@@ -260,11 +539,9 @@ void buildAwsMsgsRcvdSensorConfig(JsonDocument &doc, const char *clientId, char
 
 void buildUptimeSensorConfig(JsonDocument &doc, const char *clientId, char *topicBuffer)
 {
-    // Create Unique ID
-    String uniqId = String(clientId) + "_uptime";
-
-    // Build topic for the sensor configuration using the Unique ID
-    snprintf(topicBuffer, TOPIC_BUFFER_SIZE, MQTT_DISCOVERY_SENSOR_TOPIC, uniqId.c_str());
+    // Create Unique ID and build topic for the sensor configuration using it
+    char uniqId[TOPIC_BUFFER_SIZE];
+    composeUniqueId(uniqId, topicBuffer, MQTT_DISCOVERY_SENSOR_TOPIC, clientId, "uptime");
 
     // Build the sensor configuration
     doc["name"] = "Uptime";
@@ -277,40 +554,192 @@ void buildUptimeSensorConfig(JsonDocument &doc, const char *clientId, char *topi
     setDeviceInfo(doc["dev"].to<JsonObject>(), clientId); // Add device information
 }
 
+void buildLightConfig(JsonDocument &doc, const char *clientId, char *topicBuffer)
+{
+    // Create Unique ID and build topic for the light configuration using it
+    char uniqId[TOPIC_BUFFER_SIZE];
+    composeUniqueId(uniqId, topicBuffer, MQTT_DISCOVERY_LIGHT_TOPIC, clientId, "light");
+
+    // Build the light configuration
+    doc["name"] = "Map";
+    doc["uniq_id"] = uniqId;
+    doc["schema"] = "json";
+    doc["cmd_t"] = lightSubTopic;
+    doc["stat_t"] = lightPubTopic;
+    doc["brightness"] = true;
+    doc["sup_clrm"].to<JsonArray>().add("rgb");
+    doc["effect"] = true;
+    JsonArray effects = doc["fx_list"].to<JsonArray>();
+    for (const LightEffect &effect : LIGHT_EFFECTS)
+        effects.add(effect.name);
+    doc["ic"] = "mdi:map";
+    setDeviceInfo(doc["dev"].to<JsonObject>(), clientId); // Add device information
+}
+
 /**
- * @brief Publishes the discovery configuration for Home Assistant.
+ * @brief Calculates the FNV-1a hash of a buffer.
  *
- * This function publishes the discovery configuration for both a sensor and a switch
- * to Home Assistant using MQTT. The configuration includes details such as the name,
- * state topic, unique ID, and device information.
+ * @param hash The hash of the previous data, or FNV_OFFSET_BASIS for the first buffer.
+ * @param data The data to hash.
+ * @param length The length of the data.
+ * @return The updated hash.
+ */
+uint32_t fnv1aHash(uint32_t hash, const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619UL; // FNV prime
+    }
+    return hash;
+}
+
+/**
+ * @brief Serializes the discovery configuration in the document into the discovery buffer.
+ *
+ * @param doc The JSON document containing the discovery configuration.
+ * @param topic The discovery topic of the entity.
+ * @param offset Offset of the free space in the discovery buffer, advanced by the payload length.
+ * @return true if the message was rendered, false if it does not fit into the buffers.
+ */
+bool addDiscoveryMessage(const JsonDocument &doc, const char *topic, size_t *offset)
+{
+    if (discoveryMessagesCount >= HA_DISCOVERY_MESSAGES_COUNT)
+    {
+        Serial.println(F("Error: Too many discovery messages. Consider increasing HA_DISCOVERY_MESSAGES_COUNT"));
+        return false;
+    }
+
+    // Serialize the document directly into the free space of the discovery buffer
+    size_t available = DISCOVERY_BUFFER_SIZE - *offset;
+    size_t serializedSize = serializeJson(doc, discoveryBuffer + *offset, available);
+
+    // Check if the payload fits into the discovery buffer, and the whole packet with the fixed header,
+    // the topic length and the topic into the MQTT buffer
+    if (serializedSize >= available ||
+        MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + serializedSize > HA_MQTT_BUFFER_SIZE)
+    {
+        Serial.printf("Failed to render discovery message for topic '%s' (%u bytes)\n", topic, (uint32_t)serializedSize);
+        return false;
+    }
+
+    DiscoveryMessage &message = discoveryMessages[discoveryMessagesCount++];
+    strncpy(message.topic, topic, sizeof(message.topic) - 1);
+    message.topic[sizeof(message.topic) - 1] = '\0';
+    message.payload = discoveryBuffer + *offset;
+    message.length = serializedSize;
+
+    *offset += serializedSize;
+    return true;
+}
+
+/**
+ * @brief Renders the discovery configuration for Home Assistant.
+ *
+ * All discovery messages are rendered once at boot into a static buffer, so reconnects
+ * only publish already serialized payloads. The hash of all messages is stored in
+ * discoveryHash to detect configuration changes between firmware versions.
  *
  * @param clientId The client ID used to uniquely identify the device in Home Assistant.
  */
-void publishDiscoveryConfig(const char *clientId)
+void renderDiscoveryConfig(const char *clientId)
 {
-    // Allocate a buffer for the topic
     char topicBuffer[TOPIC_BUFFER_SIZE];
+    size_t offset = 0;
+    discoveryMessagesCount = 0;
 
-    // Create and publish Switch configuration
+    // Render Switch configuration
     JsonDocument doc; // Create a JSON document
     buildSwitchConfig(doc, clientId, topicBuffer);
     setOriginInfo(doc["o"].to<JsonObject>()); // Add origin info only for the first configuration
-    publishJsonHA(topicBuffer, doc);
+    addDiscoveryMessage(doc, topicBuffer, &offset);
 
-    // Create and publish AWS Reconnect Attempts sensor configuration
+    // Render AWS Reconnect Attempts sensor configuration
     doc.clear(); // Clear previous data
     buildAwsReconAttSensorConfig(doc, clientId, topicBuffer);
-    publishJsonHA(topicBuffer, doc);
+    addDiscoveryMessage(doc, topicBuffer, &offset);
 
-    // Create and publish AWS Messages Received sensor configuration
+    // Render AWS Messages Received sensor configuration
     doc.clear(); // Clear previous data
     buildAwsMsgsRcvdSensorConfig(doc, clientId, topicBuffer);
-    publishJsonHA(topicBuffer, doc);
+    addDiscoveryMessage(doc, topicBuffer, &offset);
 
-    // Create and publish Uptime sensor configuration
+    // Render Uptime sensor configuration
     doc.clear(); // Clear previous data
     buildUptimeSensorConfig(doc, clientId, topicBuffer);
-    publishJsonHA(topicBuffer, doc);
+    addDiscoveryMessage(doc, topicBuffer, &offset);
+
+    // Render Light configuration
+    doc.clear(); // Clear previous data
+    buildLightConfig(doc, clientId, topicBuffer);
+    addDiscoveryMessage(doc, topicBuffer, &offset);
+
+    // Calculate the hash of all rendered messages
+    discoveryHash = 2166136261UL; // FNV offset basis
+    for (uint8_t i = 0; i < discoveryMessagesCount; i++)
+    {
+        discoveryHash = fnv1aHash(discoveryHash, discoveryMessages[i].topic, strlen(discoveryMessages[i].topic));
+        discoveryHash = fnv1aHash(discoveryHash, discoveryMessages[i].payload, discoveryMessages[i].length);
+    }
+
+    Serial.printf("Rendered %u discovery messages (%u bytes), hash: %08X\n", discoveryMessagesCount, (uint32_t)offset, discoveryHash);
+}
+
+/**
+ * @brief Reads the hash of the last published discovery configuration from the config store.
+ *
+ * The file used by the previous firmware versions is removed, so the configuration is
+ * published once more after the update.
+ *
+ * @return The stored hash, or 0 if no hash is stored.
+ */
+uint32_t readPublishedDiscoveryHash()
+{
+    if (LittleFS.exists(LEGACY_DISCOVERY_HASH_FILENAME))
+        LittleFS.remove(LEGACY_DISCOVERY_HASH_FILENAME);
+
+    uint32_t hash = 0;
+    configGetU32(CONFIG_KEY_DISCOVERY_HASH, hash);
+    return hash;
+}
+
+/**
+ * @brief Writes the hash of the published discovery configuration to the config store.
+ *
+ * @param hash The hash to write.
+ */
+void writePublishedDiscoveryHash(uint32_t hash)
+{
+    if (!configSetU32(CONFIG_KEY_DISCOVERY_HASH, hash) || !configStoreCommit())
+        Serial.println(F("Failed to store the discovery configuration hash"));
+}
+
+/**
+ * @brief Publishes the discovery configuration for Home Assistant.
+ *
+ * The pre-rendered discovery messages are published only if their hash differs from the
+ * hash of the last published configuration, or if forced (Home Assistant birth message).
+ * The messages are retained by the broker, so there is no need to republish them on
+ * every reconnect.
+ *
+ * @param force Publish the configuration even if it has not changed.
+ */
+void publishDiscoveryConfig(bool force)
+{
+    if (!force && discoveryHash == publishedDiscoveryHash)
+        return;
+
+    bool published = true;
+    for (uint8_t i = 0; i < discoveryMessagesCount; i++)
+        published &= publishHA(discoveryMessages[i].topic, discoveryMessages[i].payload, discoveryMessages[i].length);
+
+    // Remember the published configuration only if all messages were published
+    if (published && discoveryHash != publishedDiscoveryHash)
+    {
+        publishedDiscoveryHash = discoveryHash;
+        writePublishedDiscoveryHash(discoveryHash);
+    }
 }
 
 /**
@@ -333,7 +762,7 @@ void connectToHA(const char *clientId)
         return;
     }
 
-    uint32_t timeNow = millis();
+    uint32_t timeNow = clockMillis();
 
     // Attempt to connect only if the delay has passed
     if (!haClient.connected() && (timeNow - lastReconnectAttempt >= reconnectDelay))
@@ -349,21 +778,27 @@ void connectToHA(const char *clientId)
 
             // Subscribe to topics
             haClient.subscribe(enableSubTopic);
+            haClient.subscribe(lightSubTopic);
+            haClient.subscribe(HA_BIRTH_TOPIC);
 
-            // Publish the device status after successful connection
-            publishDiscoveryConfig(clientId);
+            // Publish the discovery configuration if it has changed and the device status after successful connection
+            publishDiscoveryConfig(false);
             publishStatusHA();
+            publishLightStateHA();
         }
         else
         {
             // Connection failed - apply exponential backoff
             Serial.printf("Connection to Home Assistant MQTT Broker failed, rc=%d\n", haClient.state());
-            Serial.printf("Retrying in %lu ms\n", reconnectDelay);
-
-            if (reconnectDelay < RECONNECT_MAX_DELAY / 2)
+            // The delay is 0 after the boot, start the backoff from the initial delay
+            if (reconnectDelay < RECONNECT_INITIAL_DELAY)
+                reconnectDelay = RECONNECT_INITIAL_DELAY;
+            else if (reconnectDelay < RECONNECT_MAX_DELAY / 2)
                 reconnectDelay *= 2;
             else
                 reconnectDelay = RECONNECT_MAX_DELAY;
+
+            Serial.printf("Retrying in %lu ms\n", reconnectDelay);
         }
     }
 }
@@ -384,11 +819,17 @@ void haClientTask(void *pvParameters)
     // Setup the Home Assistant MQTT client
     haClient.setServer(HA_MQTT_BROKER_HOST, HA_MQTT_BROKER_PORT);
     haClient.setCallback(haMessageHandler);
-    haClient.setBufferSize(MQTT_BUFFER_SIZE); // Increase buffer size to handle large auto-discovery messages
+    haClient.setBufferSize(HA_MQTT_BUFFER_SIZE); // Increase buffer size to handle large auto-discovery messages
 
     // Compose topics
     snprintf(enableSubTopic, sizeof(enableSubTopic), "%s/%s", MQTT_SUB_TOPIC_ENABLE, clientId);
     snprintf(statusPubTopic, sizeof(statusPubTopic), "%s/%s", MQTT_PUB_TOPIC_STATUS, clientId);
+    snprintf(lightSubTopic, sizeof(lightSubTopic), "%s/%s", MQTT_SUB_TOPIC_LIGHT, clientId);
+    snprintf(lightPubTopic, sizeof(lightPubTopic), "%s/%s", MQTT_PUB_TOPIC_LIGHT, clientId);
+
+    // Render the discovery configuration once and load the hash of the last published one
+    renderDiscoveryConfig(clientId);
+    publishedDiscoveryHash = readPublishedDiscoveryHash();
 
     // Attempt to connect to the Home Assistant MQTT Broker
     Serial.println(F("Connecting to Home Assistant MQTT Broker..."));
@@ -400,15 +841,19 @@ void haClientTask(void *pvParameters)
         // If the client is connected, simply return
         if (haClient.loop())
         {
+            // Republish the discovery configuration if Home Assistant has restarted
+            if (discoveryPublishRequested)
+            {
+                discoveryPublishRequested = false;
+                publishDiscoveryConfig(true);
+            }
+
             periodicStatusPublishHA();
         }
-        else
+        else if (WiFi.status() == WL_CONNECTED && WiFi.localIP() != INADDR_NONE)
         {
-            // Do not attempt to reconnect if WiFi is not connected or ESP does not have assigned IP
-            if (WiFi.status() != WL_CONNECTED || WiFi.localIP() == INADDR_NONE)
-                return;
-
-            // If the client is not connected, attempt to reconnect
+            // If the client is not connected, attempt to reconnect. Without WiFi or an assigned IP
+            // wait for the next iteration, as a task must never return
             Serial.println(F("Home Assistant MQTT client disconnected. Attempting to reconnect..."));
             connectToHA(clientId);
         }
@@ -4,6 +4,11 @@
 #include <PubSubClient.h>
 #include <WiFiClient.h>
 
+// MQTT buffer size for handling larger messages
+#define HA_MQTT_BUFFER_SIZE         768
+// Number of discovery messages
+#define HA_DISCOVERY_MESSAGES_COUNT 5
+
 void haClientTaskInit(char *clientId, size_t idLength);
 bool isMapOn();
 
@@ -2,8 +2,13 @@
 #include <freertos/task.h>
 #include <freertos/queue.h>
 #include <FastLED.h>
+#include "boot_trace.h"
+#include "command_latency.h"
 #include "constants.h"
 #include "leds.h"
+#include "logger.h"
+#include "realtime_udp.h"
+#include "system_clock.h"
 
 // Task parameters
 #define LEDS_TASK_FREQUENCY_HZ (100U)
@@ -11,6 +16,11 @@
 #define LEDS_TASK_PRIORITY     (tskIDLE_PRIORITY + 1)
 #define LEDS_TASK_CORE         1 // Core 0 is used by the WiFi
 
+// Period of a frame (in microseconds)
+#define FRAME_PERIOD_US (1000000U / LEDS_TASK_FREQUENCY_HZ)
+// Number of frames in the window of the frame statistics (1 minute)
+#define FRAME_STATS_WINDOW_FRAMES (60U * LEDS_TASK_FREQUENCY_HZ)
+
 // Defines how many commands can be queued for each LED
 #define LED_STATES_QUEUE_LENGTH 10
 
@@ -18,9 +28,31 @@
 #define CIRCLE_EFFECT_BRIGHTNESS      50
 #define PROGRESS_INDICATOR_BRIGHTNESS 50
 
+// Value of the progress overlay when it is not shown
+#define PROGRESS_OVERLAY_OFF -1
+
 // Define the array of LEDs in the circle in clockwise order
-const uint8_t CIRCLE_LEDS_ARRAY[] = {1, 2, 5, 7, 12, 21, 29, 31, 17, 25, 30, 36, 35, 42, 44, 56, 61, 65, 68,
-                                     71, 69, 64, 67, 70, 66, 60, 54, 50, 37, 24, 19, 16, 10, 9, 6, 3, 0, 4};
+constexpr uint8_t CIRCLE_LEDS_ARRAY[] = {1, 2, 5, 7, 12, 21, 29, 31, 17, 25, 30, 36, 35, 42, 44, 56, 61, 65, 68,
+                                         71, 69, 64, 67, 70, 66, 60, 54, 50, 37, 24, 19, 16, 10, 9, 6, 3, 0, 4};
+
+/**
+ * @brief Calculates a 32-bit word of the bitmap of the LEDs in the circle at compile time.
+ *
+ * @param word Index of the word, the word covers LEDs word * 32 to word * 32 + 31.
+ * @param i Index in CIRCLE_LEDS_ARRAY to start from.
+ * @return Bits of the LEDs in the circle covered by the word.
+ */
+constexpr uint32_t circleLedsMaskWord(uint8_t word, size_t i = 0)
+{
+    return i == sizeof(CIRCLE_LEDS_ARRAY)
+               ? 0
+               : (CIRCLE_LEDS_ARRAY[i] / 32 == word ? 1UL << (CIRCLE_LEDS_ARRAY[i] % 32) : 0) |
+                     circleLedsMaskWord(word, i + 1);
+}
+
+// Bitmap of the LEDs in the circle indexed by the LED, so the ambient light does not search the array
+static_assert(LEDS_COUNT <= 96, "CIRCLE_LEDS_MASK covers up to 96 LEDs");
+constexpr uint32_t CIRCLE_LEDS_MASK[] = {circleLedsMaskWord(0), circleLedsMaskWord(1), circleLedsMaskWord(2)};
 
 // Initialize array with number of LEDs
 CRGB leds[LEDS_COUNT];
@@ -52,6 +84,57 @@ LedState ledStates[LEDS_COUNT];
 // Variable to store task handle
 TaskHandle_t ledsTaskHandle = NULL;
 
+// Indicates if the LED task renders frames and the time when rendering was enabled (in microseconds),
+// guarded by renderingMux
+static bool renderingEnabled = true;
+static uint32_t renderingEnabledAt = 0;
+static portMUX_TYPE renderingMux = portMUX_INITIALIZER_UNLOCKED;
+// Time it took to render the first frame after rendering was enabled (in microseconds)
+static volatile uint32_t wakeLatencyUs = 0;
+
+// Progress rendered by the LED task instead of the LED states, PROGRESS_OVERLAY_OFF if not shown,
+// and its color, guarded by overlayMux
+static int8_t overlayProgress = PROGRESS_OVERLAY_OFF;
+static CRGB overlayColor = CRGB::Black;
+static portMUX_TYPE overlayMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Accumulated times of the frames in the current statistics window
+struct FrameTimeWindow
+{
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t sumUs;
+};
+
+// Frame statistics being collected and the last complete window, guarded by frameStatsMux
+static FrameTimeWindow computeWindow, showWindow, jitterWindow;
+static uint32_t windowFrames = 0;
+static uint32_t windowMisses = 0;
+static uint32_t totalMisses = 0;
+static FrameStats frameStats = {};
+static portMUX_TYPE frameStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// LED commands dropped because the queue of the LED was full, guarded by commandDropsMux
+static uint32_t commandDrops = 0;
+static portMUX_TYPE commandDropsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Time of the last wake up of the LED task (in microseconds), 0 after a pause of the rendering
+static uint32_t lastFrameWakeUs = 0;
+// Jitter of the wake up of the current frame (in microseconds)
+static uint32_t frameJitterUs = 0;
+// Indicates that the current frame started after its deadline
+static bool frameLate = false;
+
+// Ambient light shown by the idle LEDs, guarded by ambientMux. The batch of the command which
+// changed it is reported by the LED task with the first frame showing the change
+static AmbientLight ambientLight = {false, AMBIENT_SOLID, 0, 0, CRGB::Black};
+static uint8_t ambientBatch = 0;
+static bool ambientChanged = false;
+static portMUX_TYPE ambientMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Time when the shown ambient light changed, the fades start at it
+static uint32_t ambientStartTime = 0;
+
 // Forward declarations
 void setLed(uint8_t index, uint8_t brightness, uint16_t fadeDuration, int16_t fadeCycles, CRGB color, bool useFadeIn = true);
 
@@ -87,45 +170,203 @@ void resetLedsStates()
 }
 
 /**
- * @brief Starts the progress indication by suspending the LED task and resetting all LEDs.
+ * @brief Enables or disables rendering of the LED strip.
+ *
+ * When rendering is disabled, the LED task turns all LEDs off and blocks until
+ * rendering is enabled again, so it does not consume any CPU time.
  *
- * This function should be called before starting the progress indication to prevent concurrent access
- * to the LED strip by the LED task. Without this, the progress indication may have flickering issues.
+ * @param enabled true to render frames, false to turn the LEDs off and stop rendering.
  */
-void startProgressIndication()
+void setLedsRendering(bool enabled)
 {
-    // Pause the task to prevent concurrent access
-    vTaskSuspend(ledsTaskHandle);
+    uint32_t timeNow = micros();
+
+    portENTER_CRITICAL(&renderingMux);
+    bool changed = renderingEnabled != enabled;
+    renderingEnabled = enabled;
+    if (changed && enabled)
+        renderingEnabledAt = timeNow;
+    portEXIT_CRITICAL(&renderingMux);
+
+    // Wake up the LED task waiting for rendering to be enabled
+    if (changed && enabled && ledsTaskHandle != NULL)
+        xTaskNotifyGive(ledsTaskHandle);
+}
 
-    // Set brightness
-    FastLED.setBrightness(PROGRESS_INDICATOR_BRIGHTNESS);
+/**
+ * @brief Returns whether the LED task renders frames.
+ */
+static bool isRenderingEnabled()
+{
+    portENTER_CRITICAL(&renderingMux);
+    bool enabled = renderingEnabled;
+    portEXIT_CRITICAL(&renderingMux);
+    return enabled;
+}
 
-    // Reset all LEDs
-    resetLedsStates();
+/**
+ * @brief Returns the time from the last rendering enable request to the first rendered frame.
+ *
+ * @return The wake latency in microseconds, 0 if rendering was never re-enabled.
+ */
+uint32_t getLedsWakeLatencyUs()
+{
+    return wakeLatencyUs;
 }
 
 /**
- * @brief Stops the progress indication by resetting all LEDs and resuming the LED task.
+ * @brief Adds a time to the window.
  *
- * This function resets the states of all LEDs to their default state and resumes the LED task
- * to allow normal operation to continue.
+ * @param window The window.
+ * @param timeUs The time in microseconds.
  */
-void stopProgressIndication()
+void addFrameTime(FrameTimeWindow &window, uint32_t timeUs)
 {
-    // Reset brightness
-    FastLED.setBrightness(255);
+    window.minUs = min(window.minUs, timeUs);
+    window.maxUs = max(window.maxUs, timeUs);
+    window.sumUs += timeUs;
+}
 
-    // Reset all LEDs
-    resetLedsStates();
+/**
+ * @brief Converts the window to the reported statistics and restarts it.
+ *
+ * @param window The window.
+ * @param frames Number of frames in the window.
+ * @return The statistics of the window.
+ */
+FrameTimeStats closeFrameWindow(FrameTimeWindow &window, uint32_t frames)
+{
+    FrameTimeStats stats = {window.minUs, (uint32_t)(window.sumUs / frames), window.maxUs};
+    window = {UINT32_MAX, 0, 0};
+    return stats;
+}
+
+/**
+ * @brief Records the times of a rendered frame.
+ *
+ * A deadline is missed if the frame started late or did not finish within the frame period.
+ * After every FRAME_STATS_WINDOW_FRAMES frames the window is published by getFrameStats()
+ * and printed on the serial console.
+ *
+ * @param computeUs Time spent calculating the LED states.
+ * @param showUs Time spent sending the data to the LED strip.
+ */
+void recordFrame(uint32_t computeUs, uint32_t showUs)
+{
+    bool missed = frameLate || computeUs + showUs > FRAME_PERIOD_US;
+    frameLate = false;
+
+    portENTER_CRITICAL(&frameStatsMux);
+    if (windowFrames == 0)
+        computeWindow = showWindow = jitterWindow = {UINT32_MAX, 0, 0};
+
+    addFrameTime(computeWindow, computeUs);
+    addFrameTime(showWindow, showUs);
+    addFrameTime(jitterWindow, frameJitterUs);
+    windowFrames++;
+    if (missed)
+    {
+        windowMisses++;
+        totalMisses++;
+    }
+
+    bool windowComplete = windowFrames >= FRAME_STATS_WINDOW_FRAMES;
+    if (windowComplete)
+    {
+        frameStats.frames = windowFrames;
+        frameStats.deadlineMisses = windowMisses;
+        frameStats.totalMisses = totalMisses;
+        frameStats.compute = closeFrameWindow(computeWindow, windowFrames);
+        frameStats.show = closeFrameWindow(showWindow, windowFrames);
+        frameStats.jitter = closeFrameWindow(jitterWindow, windowFrames);
+        windowFrames = 0;
+        windowMisses = 0;
+    }
+    portEXIT_CRITICAL(&frameStatsMux);
 
-    // Resume the task to allow normal operation
-    vTaskResume(ledsTaskHandle);
+    if (windowComplete)
+    {
+        LOG_INFO("Frames: %u, missed deadlines: %u, compute %u/%u/%u us (min/avg/max)",
+                 frameStats.frames, frameStats.deadlineMisses,
+                 frameStats.compute.minUs, frameStats.compute.avgUs, frameStats.compute.maxUs);
+        LOG_INFO("Frames: show %u/%u/%u us, wake up jitter %u/%u/%u us (min/avg/max)",
+                 frameStats.show.minUs, frameStats.show.avgUs, frameStats.show.maxUs,
+                 frameStats.jitter.minUs, frameStats.jitter.avgUs, frameStats.jitter.maxUs);
+    }
 }
 
 /**
- * @brief Indicates progress by lighting up LEDs from CIRCLE_LEDS_ARRAY.
+ * @brief Waits for the next frame and measures how precisely the LED task woke up.
  *
- * This function lights up LEDs one by one based on the provided progress percentage.
+ * @param lastWakeTime The wake time used by xTaskDelayUntil().
+ * @param period The frame period in ticks.
+ */
+void waitForNextFrame(TickType_t *lastWakeTime, TickType_t period)
+{
+    // xTaskDelayUntil() does not wait if the deadline has already passed
+    frameLate = xTaskDelayUntil(lastWakeTime, period) == pdFALSE;
+
+    uint32_t timeNow = micros();
+    if (lastFrameWakeUs != 0)
+    {
+        int32_t deviation = (int32_t)(timeNow - lastFrameWakeUs) - (int32_t)FRAME_PERIOD_US;
+        frameJitterUs = deviation < 0 ? -deviation : deviation;
+    }
+    else
+        frameJitterUs = 0;
+
+    lastFrameWakeUs = timeNow;
+}
+
+/**
+ * @brief Returns the statistics of the rendered frames over the last complete window.
+ *
+ * @return The statistics, all zero before the first window is complete.
+ */
+FrameStats getFrameStats()
+{
+    portENTER_CRITICAL(&frameStatsMux);
+    FrameStats stats = frameStats;
+    portEXIT_CRITICAL(&frameStatsMux);
+
+    return stats;
+}
+
+/**
+ * @brief Starts the progress indication rendered by the LED task on top of the LED states.
+ *
+ * The LED task keeps running and shows an empty progress circle until progressIndicator()
+ * is called. The progress is shown even if rendering is disabled (standby mode).
+ */
+void startProgressIndication()
+{
+    portENTER_CRITICAL(&overlayMux);
+    overlayColor = CRGB::Black;
+    overlayProgress = 0;
+    portEXIT_CRITICAL(&overlayMux);
+
+    // Wake up the LED task if it waits for rendering to be enabled
+    if (ledsTaskHandle != NULL)
+        xTaskNotifyGive(ledsTaskHandle);
+}
+
+/**
+ * @brief Stops the progress indication.
+ *
+ * The LED task resets the states of all LEDs and continues normal operation.
+ */
+void stopProgressIndication()
+{
+    portENTER_CRITICAL(&overlayMux);
+    overlayProgress = PROGRESS_OVERLAY_OFF;
+    portEXIT_CRITICAL(&overlayMux);
+}
+
+/**
+ * @brief Sets the progress shown by the progress indication.
+ *
+ * This function does not block, the LED task lights up the LEDs from CIRCLE_LEDS_ARRAY
+ * in its next cycle. It has no effect if the progress indication was not started.
  *
  * @param progress Progress percentage (0 to 100).
  * @param color Color of the LEDs.
@@ -136,11 +377,47 @@ void progressIndicator(uint8_t progress, CRGB color)
     if (progress > 100)
         progress = 100;
 
+    portENTER_CRITICAL(&overlayMux);
+    if (overlayProgress != PROGRESS_OVERLAY_OFF)
+    {
+        overlayColor = color;
+        overlayProgress = progress;
+    }
+    portEXIT_CRITICAL(&overlayMux);
+}
+
+/**
+ * @brief Returns the progress shown by the progress indication and its color.
+ *
+ * @param color Set to the color of the LEDs.
+ * @return Progress percentage (0 to 100), PROGRESS_OVERLAY_OFF if the progress indication is not shown.
+ */
+int8_t getProgressOverlay(CRGB &color)
+{
+    portENTER_CRITICAL(&overlayMux);
+    int8_t progress = overlayProgress;
+    color = overlayColor;
+    portEXIT_CRITICAL(&overlayMux);
+
+    return progress;
+}
+
+/**
+ * @brief Renders the progress overlay by lighting up LEDs from CIRCLE_LEDS_ARRAY.
+ *
+ * @param progress Progress percentage (0 to 100).
+ * @param color Color of the LEDs.
+ */
+void renderProgressOverlay(uint8_t progress, CRGB color)
+{
+    FastLED.clear();
+
     // Calculate the number of LEDs to light up
     uint8_t totalLeds = sizeof(CIRCLE_LEDS_ARRAY) / sizeof(CIRCLE_LEDS_ARRAY[0]);
     uint8_t ledsToLight = (progress * totalLeds) / 100;
 
     // Light up LEDs based on progress
+    color.nscale8_video(PROGRESS_INDICATOR_BRIGHTNESS);
     for (uint8_t i = 0; i < ledsToLight; i++)
         leds[CIRCLE_LEDS_ARRAY[i]] = color;
 
@@ -168,6 +445,78 @@ void circleLedEffect(CRGB color, uint16_t fadeDuration, int16_t fadeCycles)
         setLed(i, CIRCLE_EFFECT_BRIGHTNESS, fadeDuration, fadeCycles, color);
 }
 
+/**
+ * @brief Sets the ambient light shown by the LEDs which do not run a command.
+ *
+ * The ambient light does not occupy the command queues, so the commands from any source
+ * are shown on top of it and the LEDs return to it when their commands complete.
+ *
+ * @param light The ambient light.
+ * @param batch Latency batch ID of the command setting the light (0 if not measured).
+ */
+void setAmbientLight(const AmbientLight &light, uint8_t batch)
+{
+    portENTER_CRITICAL(&ambientMux);
+    ambientLight = light;
+    ambientBatch = batch;
+    ambientChanged = true;
+    portEXIT_CRITICAL(&ambientMux);
+}
+
+/**
+ * @brief Returns the ambient light shown by the LEDs which do not run a command.
+ *
+ * @return The ambient light.
+ */
+AmbientLight getAmbientLight()
+{
+    portENTER_CRITICAL(&ambientMux);
+    AmbientLight light = ambientLight;
+    portEXIT_CRITICAL(&ambientMux);
+
+    return light;
+}
+
+/**
+ * @brief Calculates the color of an idle LED showing the ambient light.
+ *
+ * The fading effects start with a fade in at ambientStartTime.
+ *
+ * @param light The ambient light.
+ * @param index The index of the LED.
+ * @param currentTime The current time in milliseconds.
+ * @return The color of the LED.
+ */
+CRGB ambientLedColor(const AmbientLight &light, uint8_t index, uint32_t currentTime)
+{
+    if (!light.on)
+        return CRGB::Black;
+
+    CRGB color = light.color;
+    if (light.effect == AMBIENT_SOLID || light.fadeDuration == 0)
+    {
+        color.nscale8_video(light.brightness);
+        return color;
+    }
+
+    uint8_t brightness = light.brightness;
+    if (light.effect == AMBIENT_CIRCLE)
+    {
+        if (!(CIRCLE_LEDS_MASK[index / 32] & (1UL << (index % 32))))
+            return CRGB::Black;
+
+        // The circle effect has its own brightness, so scale the color instead
+        color.nscale8_video(brightness);
+        brightness = CIRCLE_EFFECT_BRIGHTNESS;
+    }
+
+    // Fade in and out within two fade durations
+    uint32_t phase = (currentTime - ambientStartTime) % (2U * light.fadeDuration);
+    uint32_t level = phase < light.fadeDuration ? phase : 2U * light.fadeDuration - phase;
+    color.nscale8_video(brightness * level / light.fadeDuration);
+    return color;
+}
+
 /**
  * @brief Sets the state of an LED at a specified index. If any of the parameters are out of bounds,
  * then the parameters will be ignored and a message will be printed to the serial monitor.
@@ -184,7 +533,7 @@ void setLed(uint8_t index, uint8_t brightness, uint16_t fadeDuration, int16_t fa
     // Check if index is within bounds
     if (index >= LEDS_COUNT)
     {
-        Serial.printf("Index [%d] is out of bounds [0, %d]\n", index, LEDS_COUNT - 1);
+        LOG_ERROR("Index [%d] is out of bounds [0, %d]", index, LEDS_COUNT - 1);
         return;
     }
 
@@ -195,26 +544,26 @@ void setLed(uint8_t index, uint8_t brightness, uint16_t fadeDuration, int16_t fa
     if (brightness <= 255)
         state.brightness = brightness;
     else
-        Serial.printf("Brightness [%d] is out of bounds [0, 255]\n", brightness);
+        LOG_ERROR("Brightness [%d] is out of bounds [0, 255]", brightness);
 
     // Validate and set the fade duration
     if (fadeDuration <= MAX_FADE_DURATION)
         state.fadeDuration = fadeDuration;
     else
-        Serial.printf("Fade duration [%d] is out of bounds [0, %d]\n", fadeDuration, MAX_FADE_DURATION);
+        LOG_ERROR("Fade duration [%d] is out of bounds [0, %d]", fadeDuration, MAX_FADE_DURATION);
 
     // Validate and set the fade cycles
     if ((fadeCycles > 0 && fadeCycles <= MAX_FADE_REPEATS) || fadeCycles == LOOP_INDEFINITELY)
         state.fadeCycles = fadeCycles;
     else
-        Serial.printf("Fade cycles [%d] are invalid. Must be between 1 and %d or LOOP_INDEFINITELY.\n", fadeCycles, MAX_FADE_REPEATS);
+        LOG_ERROR("Fade cycles [%d] are invalid. Must be between 1 and %d or LOOP_INDEFINITELY.", fadeCycles, MAX_FADE_REPEATS);
 
     // Set the color
     state.color = color;
 
     // Initialize fading parameters
     state.isFading = true;
-    state.startTime = millis();
+    state.startTime = clockMillis();
     state.direction = useFadeIn ? FADE_IN : FADE_OUT;
     state.useFadeIn = useFadeIn;
 }
@@ -236,7 +585,7 @@ void pushLedCommand(uint8_t index, LedCommand command)
     // Check if index is within bounds
     if (index >= LEDS_COUNT)
     {
-        Serial.printf("Index [%d] is out of bounds [0, %d]\n", index, LEDS_COUNT - 1);
+        LOG_ERROR("Index [%d] is out of bounds [0, %d]", index, LEDS_COUNT - 1);
         return;
     }
 
@@ -246,10 +595,28 @@ void pushLedCommand(uint8_t index, LedCommand command)
     // Send the command to the queue
     if (xQueueSend(state.commandQueue, &command, 0) != pdTRUE)
     {
-        Serial.printf("LED %d command queue is full\n", index);
+        portENTER_CRITICAL(&commandDropsMux);
+        commandDrops++;
+        portEXIT_CRITICAL(&commandDropsMux);
+
+        LOG_ERROR("LED %d command queue is full", index);
     }
 }
 
+/**
+ * @brief Returns the number of LED commands dropped because the queue of the LED was full.
+ *
+ * @return The number of dropped commands since boot.
+ */
+uint32_t getLedCommandDrops()
+{
+    portENTER_CRITICAL(&commandDropsMux);
+    uint32_t drops = commandDrops;
+    portEXIT_CRITICAL(&commandDropsMux);
+
+    return drops;
+}
+
 /**
  * @brief Refreshes the state of the LEDs by updating their colors and brightness based on the current time and their respective states.
  *
@@ -257,10 +624,46 @@ void pushLedCommand(uint8_t index, LedCommand command)
  * If the effect is active, it calculates the elapsed time since the effect started and adjusts the brightness accordingly.
  * If the effect has completed for the current cycle, it switches the fade direction or decreases the repeat count unless it's set to infinite.
  * Finally, it updates the LED strip to reflect the changes.
+ *
+ * @note Called by the LED task. Could be called directly only while the rendering is stopped.
  */
 void refreshLeds()
 {
-    uint32_t currentTime = millis();
+    uint32_t startedAt = micros();
+    uint32_t currentTime = clockMillis();
+    uint8_t shownBatch = 0; // Batch of the measured command started in this frame
+
+#ifdef USE_REALTIME_UDP
+    // Show the streamed frames instead of the LED states, render only new frames. The ambient
+    // light change is left pending, so it starts and completes its latency batch after the stream
+    uint32_t frameReceivedAt;
+    RealtimeFrameResult realtimeResult = takeRealtimeFrame(leds, &frameReceivedAt);
+    if (realtimeResult == REALTIME_NO_NEW_FRAME)
+        return;
+    if (realtimeResult == REALTIME_NEW_FRAME)
+    {
+        uint32_t showStartedAt = micros();
+        FastLED.show();
+        recordFrame(showStartedAt - startedAt, micros() - showStartedAt);
+        realtimeFrameShown(frameReceivedAt);
+        return;
+    }
+#endif
+
+    // Take the ambient light once for the whole frame, only the frames of the LED states show it
+    portENTER_CRITICAL(&ambientMux);
+    AmbientLight ambient = ambientLight;
+    bool ambientStarted = ambientChanged;
+    uint8_t batch = ambientBatch;
+    ambientChanged = false;
+    ambientBatch = 0;
+    portEXIT_CRITICAL(&ambientMux);
+
+    if (ambientStarted)
+    {
+        ambientStartTime = currentTime;
+        shownBatch = batch;
+    }
 
     // Iterate over all LEDs
     for (uint8_t i = 0; i < LEDS_COUNT; i++)
@@ -315,7 +718,7 @@ void refreshLeds()
                         state.fadeCycles--;
                         if (state.fadeCycles <= 0)
                         {
-                            leds[i] = CRGB::Black;
+                            leds[i] = ambientLedColor(ambient, i, currentTime);
                             state.isFading = false;
                             continue;
                         }
@@ -359,12 +762,25 @@ void refreshLeds()
             {
                 // Set new command without fading in
                 setLed(i, command.brightness, command.fadeDuration, command.fadeCycles, command.color, false);
+                if (command.batch != 0)
+                    shownBatch = command.batch;
+            }
+            else
+            {
+                // Show the ambient light while the LED has no command
+                leds[i] = ambientLedColor(ambient, i, currentTime);
             }
         }
     }
 
     // Update the LED strip after all calculations
+    uint32_t showStartedAt = micros();
     FastLED.show();
+    recordFrame(showStartedAt - startedAt, micros() - showStartedAt);
+
+    // Measure the latency of the command once it is visible
+    if (shownBatch != 0)
+        latencyCommandRendered(shownBatch);
 }
 
 /**
@@ -383,30 +799,77 @@ void ledsTask(void *pvParameters)
     // Initialize LED strip
     FastLED.addLeds<WS2812B, LEDS_PIN, GRB>(leds, LEDS_COUNT);
 
-    // Initialize LEDs command queues
-    for (uint8_t i = 0; i < LEDS_COUNT; i++)
-    {
-        ledStates[i].commandQueue = xQueueCreate(LED_STATES_QUEUE_LENGTH, sizeof(LedCommand));
-        if (ledStates[i].commandQueue == NULL)
-        {
-            Serial.printf("Failed to create commandQueue for LED %d\n", i);
-        }
-    }
-
     // Set all LEDs to off
     resetLedsStates();
     FastLED.show();
+    bootTraceMark(BOOT_STAGE_LEDS_FIRST_FRAME);
 
     Serial.println("ledsTask started");
 
+    // Progress and color of the rendered progress overlay
+    int8_t shownProgress = PROGRESS_OVERLAY_OFF;
+    CRGB shownColor = CRGB::Black;
+
     // Main task loop
     for (;;)
     {
+        // Show the progress overlay instead of the LED states, render only changes
+        CRGB color;
+        int8_t progress = getProgressOverlay(color);
+        if (progress != PROGRESS_OVERLAY_OFF)
+        {
+            if (progress != shownProgress || color != shownColor)
+            {
+                renderProgressOverlay(progress, color);
+                shownProgress = progress;
+                shownColor = color;
+            }
+            xTaskDelayUntil(&xLastWakeTime, xFrequency);
+            lastFrameWakeUs = 0; // Frames of the overlay are not measured
+            continue;
+        }
+
+        // Start from clean LED states after the progress overlay
+        if (shownProgress != PROGRESS_OVERLAY_OFF)
+        {
+            resetLedsStates();
+            shownProgress = PROGRESS_OVERLAY_OFF;
+        }
+
+        // Turn off the LEDs and wait until rendering is enabled again
+        if (!isRenderingEnabled())
+        {
+            resetLedsStates();
+            FastLED.show();
+            LOG_INFO("ledsTask rendering stopped");
+
+            while (!isRenderingEnabled() && getProgressOverlay(color) == PROGRESS_OVERLAY_OFF)
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+            xLastWakeTime = xTaskGetTickCount();
+            lastFrameWakeUs = 0;
+            frameJitterUs = 0;
+
+            // Woken up to show the progress overlay
+            if (!isRenderingEnabled())
+                continue;
+
+            // Render the first frame right away and measure how long the wake up took
+            refreshLeds();
+            portENTER_CRITICAL(&renderingMux);
+            uint32_t enabledAt = renderingEnabledAt;
+            portEXIT_CRITICAL(&renderingMux);
+            wakeLatencyUs = micros() - enabledAt;
+            LOG_INFO("ledsTask rendering resumed in %u us", wakeLatencyUs);
+            waitForNextFrame(&xLastWakeTime, xFrequency);
+            continue;
+        }
+
         // Update LED states
         refreshLeds();
 
         // Wait for the next cycle.
-        xTaskDelayUntil(&xLastWakeTime, xFrequency);
+        waitForNextFrame(&xLastWakeTime, xFrequency);
     }
 }
 
@@ -415,10 +878,23 @@ void ledsTask(void *pvParameters)
  *
  * This function creates a new task called "ledsTask" and assigns it to a specific core.
  *
+ * The command queues are created before the task, so the commands pushed before the task
+ * starts are not lost.
+ *
  * @note This function should be called once during the setup phase of the program.
  */
 void ledsTaskInit(void)
 {
+    // Initialize LEDs command queues
+    for (uint8_t i = 0; i < LEDS_COUNT; i++)
+    {
+        ledStates[i].commandQueue = xQueueCreate(LED_STATES_QUEUE_LENGTH, sizeof(LedCommand));
+        if (ledStates[i].commandQueue == NULL)
+        {
+            Serial.printf("Failed to create commandQueue for LED %d\n", i);
+        }
+    }
+
     if (xTaskCreatePinnedToCore(ledsTask,
                                 "ledsTask",
                                 LEDS_TASK_STACK_SIZE,
@@ -14,13 +14,59 @@ struct LedCommand
     uint16_t fadeDuration; // Duration of the fade effect in milliseconds
     int16_t fadeCycles;    // Number of times to perform the effect (-1 for infinite)
     CRGB color;            // Color of the LED
+    uint8_t batch;         // Batch ID for the command latency measurement (0 if not measured)
+};
+
+// Effects of the ambient light
+enum AmbientEffect
+{
+    AMBIENT_SOLID,  // All LEDs with a steady color
+    AMBIENT_FADE,   // All LEDs fading in and out
+    AMBIENT_CIRCLE, // LEDs of the circle fading in and out
+};
+
+// Ambient light shown by the LEDs which do not run a command
+struct AmbientLight
+{
+    bool on;               // Is the ambient light turned on
+    AmbientEffect effect;  // Effect of the ambient light
+    uint16_t fadeDuration; // Duration of a fade in or out in milliseconds (not used by AMBIENT_SOLID)
+    uint8_t brightness;    // Brightness level (0-255)
+    CRGB color;            // Color of the LEDs
+};
+
+// Minimum, average and maximum of a frame time over the statistics window (in microseconds)
+struct FrameTimeStats
+{
+    uint32_t minUs;
+    uint32_t avgUs;
+    uint32_t maxUs;
+};
+
+// Statistics of the rendered frames over the last complete window
+struct FrameStats
+{
+    uint32_t frames;         // Frames in the window
+    uint32_t deadlineMisses; // Frames in the window that did not finish within the frame period
+    uint32_t totalMisses;    // Missed deadlines since boot
+    FrameTimeStats compute;  // Calculation of the LED states
+    FrameTimeStats show;     // Transfer of the data to the LED strip
+    FrameTimeStats jitter;   // Deviation of the wake up interval from the frame period
 };
 
 void ledsTaskInit();
+void resetLedsStates();
+void refreshLeds();
+void setLedsRendering(bool enabled);
+uint32_t getLedsWakeLatencyUs();
+FrameStats getFrameStats();
 void startProgressIndication();
 void stopProgressIndication();
 void progressIndicator(uint8_t progress, CRGB color);
 void pushLedCommand(uint8_t index, LedCommand command);
+uint32_t getLedCommandDrops();
 void circleLedEffect(CRGB color, uint16_t fadeDuration, int16_t fadeCycles);
+void setAmbientLight(const AmbientLight &light, uint8_t batch = 0);
+AmbientLight getAmbientLight();
 
 #endif // LEDS_H
\ No newline at end of file
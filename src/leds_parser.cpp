@@ -1,6 +1,10 @@
 #include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "command_latency.h"
 #include "constants.h"
 #include "leds_parser.h"
+#include "logger.h"
 
 // Define JSON keys
 #define LEDS_KEY              "leds"     // Key for the LED configurations array
@@ -15,6 +19,9 @@
 #define LED_DURATION_KEY      "dr"       // Key for the fade effect duration
 #define LED_COUNT_KEY         "ct"       // Key for the fade effect count
 
+// Size of the record of one LED in the binary LEDs command
+#define BINARY_LED_RECORD_SIZE 8
+
 // Default values for LED configurations
 #define DEFAULT_BRIGHTNESS 255 // Default brightness value for LEDs
 #define DEFAULT_DURATION   500 // Default duration value for fade effects
@@ -48,10 +55,10 @@ bool validateBrightness(JsonVariant jsonValue, uint16_t *brightness, int16_t led
         {
             if (ledId > 0)
                 // Log an error message specific to the LED ID with the invalid brightness value
-                Serial.printf("Invalid brightness value for LED %d: %d. Must be between 0 and 255\n", ledId, value);
+                LOG_ERROR("Invalid brightness value for LED %d: %d. Must be between 0 and 255", ledId, value);
             else
                 // Log an error message for global brightness with the invalid value
-                Serial.printf("Invalid global brightness value: %d. Must be between 0 and 255\n", value);
+                LOG_ERROR("Invalid global brightness value: %d. Must be between 0 and 255", value);
             return false; // Indicate that validation failed
         }
 
@@ -63,10 +70,10 @@ bool validateBrightness(JsonVariant jsonValue, uint16_t *brightness, int16_t led
     {
         if (ledId > 0)
             // Log an error message if the brightness value for a specific LED is not an integer
-            Serial.printf("Error: LED %d brightness value is not an integer.\n", ledId);
+            LOG_ERROR("Error: LED %d brightness value is not an integer.", ledId);
         else
             // Log an error message if the global brightness value is not an integer
-            Serial.println("Error: Global brightness value is not an integer.");
+            LOG_ERROR("Error: Global brightness value is not an integer.");
         return false; // Indicate that validation failed
     }
 }
@@ -99,10 +106,10 @@ bool validateDuration(JsonVariant jsonValue, uint16_t *duration, int16_t ledId =
         {
             if (ledId > 0)
                 // Log an error message specific to the LED ID with the invalid duration value
-                Serial.printf("Invalid duration value for LED %d: %d. Must be between 0 and %d\n", ledId, value, MAX_FADE_DURATION);
+                LOG_ERROR("Invalid duration value for LED %d: %d. Must be between 0 and %d", ledId, value, MAX_FADE_DURATION);
             else
                 // Log an error message for global duration with the invalid value
-                Serial.printf("Invalid global duration value: %d. Must be between 0 and %d\n", value, MAX_FADE_DURATION);
+                LOG_ERROR("Invalid global duration value: %d. Must be between 0 and %d", value, MAX_FADE_DURATION);
             return false; // Indicate that validation failed
         }
 
@@ -114,10 +121,10 @@ bool validateDuration(JsonVariant jsonValue, uint16_t *duration, int16_t ledId =
     {
         if (ledId > 0)
             // Log an error message if the duration value for a specific LED is not an integer
-            Serial.printf("Error: LED %d duration value is not an integer.\n", ledId);
+            LOG_ERROR("Error: LED %d duration value is not an integer.", ledId);
         else
             // Log an error message if the global duration value is not an integer
-            Serial.println("Error: Global duration value is not an integer.");
+            LOG_ERROR("Error: Global duration value is not an integer.");
         return false; // Indicate that validation failed
     }
 }
@@ -150,10 +157,10 @@ bool validateCount(JsonVariant jsonValue, uint16_t *count, int16_t ledId = 0)
         {
             if (ledId > 0)
                 // Log an error message specific to the LED ID with the invalid count value
-                Serial.printf("Invalid count value for LED %d: %d. Must be between 1 and %d\n", ledId, value, MAX_FADE_REPEATS);
+                LOG_ERROR("Invalid count value for LED %d: %d. Must be between 1 and %d", ledId, value, MAX_FADE_REPEATS);
             else
                 // Log an error message for global count with the invalid value
-                Serial.printf("Invalid global count value: %d. Must be between 1 and %d\n", value, MAX_FADE_REPEATS);
+                LOG_ERROR("Invalid global count value: %d. Must be between 1 and %d", value, MAX_FADE_REPEATS);
             return false; // Indicate that validation failed
         }
 
@@ -165,10 +172,10 @@ bool validateCount(JsonVariant jsonValue, uint16_t *count, int16_t ledId = 0)
     {
         if (ledId > 0)
             // Log an error message if the count value for a specific LED is not an integer
-            Serial.printf("Error: LED %d count value is not an integer.\n", ledId);
+            LOG_ERROR("Error: LED %d count value is not an integer.", ledId);
         else
             // Log an error message if the global count value is not an integer
-            Serial.println("Error: Global count value is not an integer.");
+            LOG_ERROR("Error: Global count value is not an integer.");
         return false; // Indicate that validation failed
     }
 }
@@ -194,10 +201,10 @@ bool isValidHexColor(String &colorHex, int16_t ledId = 0)
             {
                 if (ledId > 0)
                     // Log an error message specific to the LED ID with the invalid character
-                    Serial.printf("Invalid character '%c' in color hex for LED %d.\n", c, ledId);
+                    LOG_ERROR("Invalid character '%c' in color hex for LED %d.", c, ledId);
                 else
                     // Log an error message for global color hex with the invalid character
-                    Serial.printf("Invalid character '%c' in global color hex.\n", c);
+                    LOG_ERROR("Invalid character '%c' in global color hex.", c);
                 return false; // Indicate that validation failed
             }
         }
@@ -207,10 +214,10 @@ bool isValidHexColor(String &colorHex, int16_t ledId = 0)
     {
         if (ledId > 0)
             // Log an error message if the color hex length for a specific LED is incorrect
-            Serial.printf("Invalid color hex length for LED %d: %s. Expected 6 characters.\n", ledId, colorHex.c_str());
+            LOG_ERROR("Invalid color hex length for LED %d: %s. Expected 6 characters.", ledId, colorHex.c_str());
         else
             // Log an error message if the global color hex length is incorrect
-            Serial.printf("Invalid global color hex length: %s. Expected 6 characters.\n", colorHex.c_str());
+            LOG_ERROR("Invalid global color hex length: %s. Expected 6 characters.", colorHex.c_str());
         return false; // Indicate that validation failed
     }
 }
@@ -230,7 +237,7 @@ bool validateColorPalette(JsonVariant jsonValue, JsonArray &colors)
     // Check if the JSON variant is an array
     if (!jsonValue.is<JsonArray>())
     {
-        Serial.println("Error: Color palette is not an array.");
+        LOG_ERROR("Error: Color palette is not an array.");
         return false;
     }
 
@@ -240,7 +247,7 @@ bool validateColorPalette(JsonVariant jsonValue, JsonArray &colors)
     // Check if the color palette is empty
     if (colors.size() == 0)
     {
-        Serial.println("Error: Color palette is empty.");
+        LOG_ERROR("Error: Color palette is empty.");
         return false;
     }
 
@@ -250,7 +257,7 @@ bool validateColorPalette(JsonVariant jsonValue, JsonArray &colors)
         // Check if the color value is a string
         if (!colors[i].is<String>())
         {
-            Serial.printf("Error: Invalid color value at index %d.\n", i);
+            LOG_ERROR("Error: Invalid color value at index %u.", (uint32_t)i);
             return false;
         }
 
@@ -317,8 +324,8 @@ bool getLedColor(JsonObject &ledConfig, JsonArray &colors, CRGB *color, uint16_t
 
         if (colorIndex < 0 || colorIndex >= colors.size())
         {
-            Serial.printf("Error: Invalid color palette index %d for LED %d. Must be between 0 and %d\n",
-                          colorIndex, ledId, colors.size() - 1);
+            LOG_ERROR("Error: Invalid color palette index %d for LED %d. Must be between 0 and %d",
+                      colorIndex, ledId, (int)colors.size() - 1);
             return false;
         }
 
@@ -332,7 +339,7 @@ bool getLedColor(JsonObject &ledConfig, JsonArray &colors, CRGB *color, uint16_t
         // Use default color at index 0
         if (colors.size() == 0)
         {
-            Serial.printf("Error: Color palette is empty. Cannot set default color for LED %d.\n", ledId);
+            LOG_ERROR("Error: Color palette is empty. Cannot set default color for LED %d.", ledId);
             return false;
         }
 
@@ -352,9 +359,11 @@ bool getLedColor(JsonObject &ledConfig, JsonArray &colors, CRGB *color, uint16_t
  * @param globalDuration The global duration value to be used if not overridden.
  * @param globalCount The global count value to be used if not overridden.
  * @param colors The array of color palettes.
+ * @param apply true to set the LED, false to only validate the configuration.
+ * @return true if the configuration is valid, false if it was skipped.
  */
-void parseAndSetSingleLed(uint16_t arrayIndex, JsonObject &ledConfig, int16_t globalBrightness,
-                          uint16_t globalDuration, uint16_t globalCount, JsonArray &colors)
+bool parseAndSetSingleLed(uint16_t arrayIndex, JsonObject &ledConfig, int16_t globalBrightness,
+                          uint16_t globalDuration, uint16_t globalCount, JsonArray &colors, bool apply)
 {
     // Get LED ID if present, else use array index +1
     int16_t ledId = 0; // Use 0 as default LED ID to detect if it was set
@@ -363,8 +372,8 @@ void parseAndSetSingleLed(uint16_t arrayIndex, JsonObject &ledConfig, int16_t gl
         ledId = ledConfig[LED_ID_KEY].as<int>();
         if (ledId < 1 || ledId > LEDS_COUNT)
         {
-            Serial.printf("Error: invalid LED ID: %d\n", ledId);
-            return; // Skip invalid LED configurations
+            LOG_ERROR("Error: invalid LED ID: %d", ledId);
+            return false; // Skip invalid LED configurations
         }
     }
 
@@ -374,60 +383,85 @@ void parseAndSetSingleLed(uint16_t arrayIndex, JsonObject &ledConfig, int16_t gl
     // Determine the color to use
     CRGB ledColor = CRGB::Black; // Default color
     if (!getLedColor(ledConfig, colors, &ledColor, ledId))
-        return; // Skip invalid LED configurations
+        return false; // Skip invalid LED configurations
 
     // Get brightness value, override global if specified
     uint16_t brightness = globalBrightness;
     if (!ledConfig[LED_BRIGHTNESS_KEY].isNull() &&
         !validateBrightness(ledConfig[LED_BRIGHTNESS_KEY], &brightness, ledId))
-        return; // Skip invalid LED configurations
+        return false; // Skip invalid LED configurations
 
     // Get duration, override global if specified
     uint16_t duration = globalDuration;
     if (!ledConfig[LED_DURATION_KEY].isNull() &&
         !validateDuration(ledConfig[LED_DURATION_KEY], &duration, ledId))
-        return; // Skip invalid LED configurations
+        return false; // Skip invalid LED configurations
 
     // Get count, override global if specified
     uint16_t count = globalCount;
     if (!ledConfig[LED_COUNT_KEY].isNull() &&
         !validateCount(ledConfig[LED_COUNT_KEY], &count))
-        return; // Skip invalid LED configurations
+        return false; // Skip invalid LED configurations
+
+    if (!apply)
+        return true;
 
     // Set the LED with the extracted parameters. The LED ID is 1-based, so we subtract 1
-    LedCommand command = {(uint8_t)brightness, duration, (int16_t)count, ledColor};
+    LedCommand command = {(uint8_t)brightness, duration, (int16_t)count, ledColor, getLatencyBatch()};
     pushLedCommand(ledId - 1, command);
 
     // Optional: Log the LED configuration for debugging
     // Serial.printf("LED %d - Brightness: %d, Duration: %d, Count: %d, Color: (%d, %d, %d)\n",
     //               ledId, brightness, duration, count, ledColor.r, ledColor.g, ledColor.b);
+    return true;
 }
 
 /**
  * @brief Parses the LEDs array from the JSON document and applies configurations.
  *
+ * The invalid LED configurations are skipped, the valid ones are still applied.
+ *
  * @param doc The JSON document containing LED configurations.
  * @param globalBrightness The global brightness value to be used if not overridden.
  * @param globalDuration The global duration value to be used if not overridden.
  * @param globalCount The global count value to be used if not overridden.
  * @param colors The array of color palettes.
+ * @param apply true to set the LEDs, false to only validate the configurations.
+ * @return true if all the configurations are valid, false otherwise.
  */
-void parseLedsArray(JsonDocument &doc, int16_t globalBrightness, int16_t globalDuration,
-                    uint16_t globalCount, JsonArray &colors)
+bool parseLedsArray(JsonDocument &doc, int16_t globalBrightness, int16_t globalDuration,
+                    uint16_t globalCount, JsonArray &colors, bool apply)
 {
+    if (!doc[LEDS_KEY].is<JsonArray>())
+    {
+        LOG_ERROR("Error: '%s' must be an array of LED configurations", LEDS_KEY);
+        return false;
+    }
+
     JsonArray leds = doc[LEDS_KEY].as<JsonArray>();
     if (leds.size() == 0)
     {
-        Serial.println("No LED configurations provided");
-        return;
+        LOG_WARN("No LED configurations provided");
+        return true;
     }
 
     // Iterate through each LED configuration
+    bool valid = true;
     for (size_t i = 0; i < leds.size(); ++i)
     {
+        if (!leds[i].is<JsonObject>())
+        {
+            LOG_ERROR("Error: LED configuration %u is not an object", (uint32_t)i);
+            valid = false;
+            continue;
+        }
+
         JsonObject ledConfig = leds[i].as<JsonObject>();
-        parseAndSetSingleLed(i, ledConfig, globalBrightness, globalDuration, globalCount, colors);
+        if (!parseAndSetSingleLed(i, ledConfig, globalBrightness, globalDuration, globalCount, colors, apply))
+            valid = false;
     }
+
+    return valid;
 }
 
 /**
@@ -436,29 +470,242 @@ void parseLedsArray(JsonDocument &doc, int16_t globalBrightness, int16_t globalD
  * This function orchestrates the parsing process by extracting the global settings and individual LED configurations.
  *
  * @param doc The JSON document containing LED configurations.
+ * @param apply true to set the LEDs, false to only validate the command.
+ * @return true if the command is valid, false if it or some of its LED configurations are invalid.
  */
-void setLedsFromJsonDoc(JsonDocument &doc)
+bool setLedsFromJsonDoc(JsonDocument &doc, bool apply)
 {
     // Get the global brightness value or use the default if not specified
     uint16_t globalBrightness = DEFAULT_BRIGHTNESS;
     if (!doc[BRIGHTNESS_KEY].isNull() && !validateBrightness(doc[BRIGHTNESS_KEY], &globalBrightness))
-        return; // Exit if brightness is not properly defined
+        return false; // Exit if brightness is not properly defined
 
     // Get the global duration value or use the default if not specified
     uint16_t globalDuration = DEFAULT_DURATION;
     if (!doc[DURATION_KEY].isNull() && !validateDuration(doc[DURATION_KEY], &globalDuration))
-        return; // Exit if duration is not properly defined
+        return false; // Exit if duration is not properly defined
 
     // Get the global count value or use the default if not specified
     uint16_t globalCount = DEFAULT_COUNT;
     if (!doc[COUNT_KEY].isNull() && !validateCount(doc[COUNT_KEY], &globalCount))
-        return; // Exit if count is not properly defined
+        return false; // Exit if count is not properly defined
 
     // Get the color palette or initialize an empty array
     JsonArray colors;
     if (!doc[COLOR_PALETTE_KEY].isNull() && !validateColorPalette(doc[COLOR_PALETTE_KEY], colors))
-        return; // Exit if colors are not properly defined
+        return false; // Exit if colors are not properly defined
 
     // Parse and apply LED configurations
-    parseLedsArray(doc, globalBrightness, globalDuration, globalCount, colors);
+    return parseLedsArray(doc, globalBrightness, globalDuration, globalCount, colors, apply);
+}
+
+/**
+ * @brief Parses the LEDs command in the binary format and sets the LEDs accordingly.
+ *
+ * The command is a sequence of records of BINARY_LED_RECORD_SIZE bytes, one per LED:
+ * LED ID (1-based), red, green, blue, brightness, fade duration in milliseconds (2 bytes,
+ * little endian) and fade count. The values are validated like in the JSON format, invalid
+ * records are skipped and the valid ones are still applied.
+ *
+ * @param data The command.
+ * @param length The length of the command.
+ * @param apply true to set the LEDs, false to only validate the command.
+ * @return true if the command is valid, false if its length or some of its records are invalid.
+ */
+bool setLedsFromBinary(const uint8_t *data, size_t length, bool apply)
+{
+    if (length == 0 || length % BINARY_LED_RECORD_SIZE != 0)
+    {
+        LOG_ERROR("Invalid binary LEDs command length: %u. Must be a multiple of %d", (uint32_t)length, BINARY_LED_RECORD_SIZE);
+        return false;
+    }
+
+    bool valid = true;
+    for (size_t offset = 0; offset < length; offset += BINARY_LED_RECORD_SIZE)
+    {
+        const uint8_t *record = data + offset;
+        uint8_t ledId = record[0];
+        uint16_t duration = record[5] | (record[6] << 8);
+        uint8_t count = record[7];
+
+        if (ledId < 1 || ledId > LEDS_COUNT)
+        {
+            LOG_ERROR("Error: invalid LED ID: %d", ledId);
+            valid = false;
+            continue;
+        }
+
+        if (duration > MAX_FADE_DURATION)
+        {
+            LOG_ERROR("Invalid duration value for LED %d: %d. Must be between 0 and %d", ledId, duration, MAX_FADE_DURATION);
+            valid = false;
+            continue;
+        }
+
+        if (count < 1 || count > MAX_FADE_REPEATS)
+        {
+            LOG_ERROR("Invalid count value for LED %d: %d. Must be between 1 and %d", ledId, count, MAX_FADE_REPEATS);
+            valid = false;
+            continue;
+        }
+
+        if (!apply)
+            continue;
+
+        LedCommand command = {record[4], duration, (int16_t)count, CRGB(record[1], record[2], record[3]), getLatencyBatch()};
+        pushLedCommand(ledId - 1, command);
+    }
+
+    return valid;
+}
+
+/**
+ * @brief Returns the mutex serializing the LEDs commands from the different sources.
+ *
+ * The LED commands of one LEDs command must be queued without commands of another source in
+ * between, so they are tagged with the latency batch of their command.
+ *
+ * @return The mutex.
+ */
+SemaphoreHandle_t getLedsCommandMutex()
+{
+    // Created on the first use, the initialization of local statics is thread-safe
+    static SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+    return mutex;
+}
+
+/**
+ * @brief Takes the LEDs command mutex.
+ *
+ * A source stuck with the mutex must not block the other sources forever, their commands are
+ * dropped instead.
+ *
+ * @param wait Maximum wait for the mutex (in ticks).
+ * @return true if the mutex was taken, false if the command should be dropped.
+ */
+bool takeLedsCommandMutex(TickType_t wait)
+{
+    if (xSemaphoreTake(getLedsCommandMutex(), wait) == pdTRUE)
+        return true;
+
+    LOG_ERROR("LEDs command dropped: the LEDs command mutex is busy");
+    return false;
+}
+
+/**
+ * @brief Sets the LEDs from a received JSON LEDs command and measures its latency.
+ *
+ * @param doc The JSON document containing LED configurations.
+ * @param receivedAtUs Time when the command was received (micros()).
+ * @param wait Maximum wait for the LEDs command mutex (in ticks).
+ * @return The result of the command.
+ */
+LedsCommandResult runLedsCommand(JsonDocument &doc, uint32_t receivedAtUs, TickType_t wait)
+{
+    if (!takeLedsCommandMutex(wait))
+        return LEDS_COMMAND_DROPPED;
+
+    uint8_t batch = latencyCommandParsed(receivedAtUs);
+    bool valid = setLedsFromJsonDoc(doc);
+    latencyCommandEnqueued(batch);
+
+    xSemaphoreGive(getLedsCommandMutex());
+    return valid ? LEDS_COMMAND_ACCEPTED : LEDS_COMMAND_INVALID;
+}
+
+/**
+ * @brief Sets the LEDs from a received binary LEDs command and measures its latency.
+ *
+ * @param data The command, see setLedsFromBinary() for the format.
+ * @param length The length of the command.
+ * @param receivedAtUs Time when the command was received (micros()).
+ * @param wait Maximum wait for the LEDs command mutex (in ticks).
+ * @return The result of the command.
+ */
+LedsCommandResult runBinaryLedsCommand(const uint8_t *data, size_t length, uint32_t receivedAtUs, TickType_t wait)
+{
+    if (!takeLedsCommandMutex(wait))
+        return LEDS_COMMAND_DROPPED;
+
+    uint8_t batch = latencyCommandParsed(receivedAtUs);
+    bool valid = setLedsFromBinary(data, length);
+    latencyCommandEnqueued(batch);
+
+    xSemaphoreGive(getLedsCommandMutex());
+    return valid ? LEDS_COMMAND_ACCEPTED : LEDS_COMMAND_INVALID;
+}
+
+/**
+ * @brief Sets the LEDs from a received JSON LEDs command, waiting at most LEDS_COMMAND_MUTEX_TIMEOUT
+ * for the other sources.
+ *
+ * This is the common entry of the LEDs commands from MQTT and the trace replay.
+ *
+ * @param doc The JSON document containing LED configurations.
+ * @param receivedAtUs Time when the command was received (micros()).
+ * @return true if the command was applied, false if it is invalid or was dropped.
+ */
+bool handleLedsCommand(JsonDocument &doc, uint32_t receivedAtUs)
+{
+    return runLedsCommand(doc, receivedAtUs, pdMS_TO_TICKS(LEDS_COMMAND_MUTEX_TIMEOUT)) == LEDS_COMMAND_ACCEPTED;
+}
+
+/**
+ * @brief Sets the LEDs from a received binary LEDs command, waiting at most LEDS_COMMAND_MUTEX_TIMEOUT
+ * for the other sources.
+ *
+ * @param data The command, see setLedsFromBinary() for the format.
+ * @param length The length of the command.
+ * @param receivedAtUs Time when the command was received (micros()).
+ * @return true if the command was applied, false if it is invalid or was dropped.
+ */
+bool handleBinaryLedsCommand(const uint8_t *data, size_t length, uint32_t receivedAtUs)
+{
+    return runBinaryLedsCommand(data, length, receivedAtUs, pdMS_TO_TICKS(LEDS_COMMAND_MUTEX_TIMEOUT)) ==
+           LEDS_COMMAND_ACCEPTED;
+}
+
+/**
+ * @brief Sets the LEDs from a received JSON LEDs command without waiting for the other sources.
+ *
+ * @param doc The JSON document containing LED configurations.
+ * @param receivedAtUs Time when the command was received (micros()).
+ * @return The result of the command, LEDS_COMMAND_DROPPED if another source holds the LEDs command mutex.
+ */
+LedsCommandResult tryLedsCommand(JsonDocument &doc, uint32_t receivedAtUs)
+{
+    return runLedsCommand(doc, receivedAtUs, 0);
+}
+
+/**
+ * @brief Sets the LEDs from a received binary LEDs command without waiting for the other sources.
+ *
+ * @param data The command, see setLedsFromBinary() for the format.
+ * @param length The length of the command.
+ * @param receivedAtUs Time when the command was received (micros()).
+ * @return The result of the command, LEDS_COMMAND_DROPPED if another source holds the LEDs command mutex.
+ */
+LedsCommandResult tryBinaryLedsCommand(const uint8_t *data, size_t length, uint32_t receivedAtUs)
+{
+    return runBinaryLedsCommand(data, length, receivedAtUs, 0);
+}
+
+/**
+ * @brief Sets the ambient light from a received light command and measures its latency.
+ *
+ * @param light The ambient light, see setAmbientLight().
+ * @param receivedAtUs Time when the command was received (micros()).
+ * @return true if the light was set, false if the command was dropped.
+ */
+bool handleAmbientLightCommand(const AmbientLight &light, uint32_t receivedAtUs)
+{
+    if (!takeLedsCommandMutex(pdMS_TO_TICKS(LEDS_COMMAND_MUTEX_TIMEOUT)))
+        return false;
+
+    uint8_t batch = latencyCommandParsed(receivedAtUs);
+    setAmbientLight(light, batch);
+    latencyCommandEnqueued(batch);
+
+    xSemaphoreGive(getLedsCommandMutex());
+    return true;
 }
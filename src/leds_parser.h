@@ -4,11 +4,83 @@
 #include <ArduinoJson.h>
 #include "leds.h"
 
+// Maximum wait for the LEDs command mutex (in milliseconds), the command is dropped after it
+#define LEDS_COMMAND_MUTEX_TIMEOUT 100
+
+// Result of a LEDs command
+enum LedsCommandResult
+{
+    LEDS_COMMAND_ACCEPTED, // The command was applied, or only validated
+    LEDS_COMMAND_INVALID,  // The command or some of its LED configurations are invalid
+    LEDS_COMMAND_DROPPED   // Another source held the LEDs command mutex
+};
+
 /**
  * @brief Parses the LED configurations from a JSON document and sets the LEDs accordingly.
  *
  * @param doc The JSON document containing LED configurations.
+ * @param apply true to set the LEDs, false to only validate the command.
+ * @return true if the command is valid, false if it or some of its LED configurations are invalid.
+ */
+bool setLedsFromJsonDoc(JsonDocument &doc, bool apply = true);
+
+/**
+ * @brief Parses the LEDs command in the binary format and sets the LEDs accordingly.
+ *
+ * @param data The command.
+ * @param length The length of the command.
+ * @param apply true to set the LEDs, false to only validate the command.
+ * @return true if the command is valid, false if its length or some of its records are invalid.
+ */
+bool setLedsFromBinary(const uint8_t *data, size_t length, bool apply = true);
+
+/**
+ * @brief Sets the LEDs from a received LEDs command and measures its latency.
+ *
+ * @param doc The JSON document containing LED configurations.
+ * @param receivedAtUs Time when the command was received (micros()).
+ * @return true if the command was applied, false if it is invalid or was dropped.
+ */
+bool handleLedsCommand(JsonDocument &doc, uint32_t receivedAtUs);
+
+/**
+ * @brief Sets the LEDs from a received binary LEDs command and measures its latency.
+ *
+ * @param data The command.
+ * @param length The length of the command.
+ * @param receivedAtUs Time when the command was received (micros()).
+ * @return true if the command was applied, false if it is invalid or was dropped.
+ */
+bool handleBinaryLedsCommand(const uint8_t *data, size_t length, uint32_t receivedAtUs);
+
+/**
+ * @brief Sets the LEDs from a received LEDs command without waiting for the other sources.
+ *
+ * For the sources running in the network task, which must not stall the other connections.
+ *
+ * @param doc The JSON document containing LED configurations.
+ * @param receivedAtUs Time when the command was received (micros()).
+ * @return The result of the command, LEDS_COMMAND_DROPPED if another source holds the LEDs command mutex.
+ */
+LedsCommandResult tryLedsCommand(JsonDocument &doc, uint32_t receivedAtUs);
+
+/**
+ * @brief Sets the LEDs from a received binary LEDs command without waiting for the other sources.
+ *
+ * @param data The command.
+ * @param length The length of the command.
+ * @param receivedAtUs Time when the command was received (micros()).
+ * @return The result of the command, LEDS_COMMAND_DROPPED if another source holds the LEDs command mutex.
+ */
+LedsCommandResult tryBinaryLedsCommand(const uint8_t *data, size_t length, uint32_t receivedAtUs);
+
+/**
+ * @brief Sets the ambient light from a received light command and measures its latency.
+ *
+ * @param light The ambient light.
+ * @param receivedAtUs Time when the command was received (micros()).
+ * @return true if the light was set, false if the command was dropped.
  */
-void setLedsFromJsonDoc(JsonDocument &doc);
+bool handleAmbientLightCommand(const AmbientLight &light, uint32_t receivedAtUs);
 
 #endif // LEDS_PARSER_H
\ No newline at end of file
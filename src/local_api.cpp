@@ -0,0 +1,324 @@
+#include "local_api.h"
+
+#ifdef USE_LOCAL_API
+
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include "ha_client.h"
+#include "leds_parser.h"
+#include "logger.h"
+#include "system_clock.h"
+
+// Interval of disconnecting the closed and the excess clients (in milliseconds)
+#define LOCAL_API_CLEANUP_INTERVAL 1000
+
+// Message arriving in several TCP segments, collected in the buffer of its request or client
+struct LocalMessage
+{
+    size_t length;                       // Length of the message
+    size_t received;                     // Number of bytes received so far
+    uint8_t data[LOCAL_API_MAX_MESSAGE]; // The message
+};
+
+static AsyncWebServer localServer(LOCAL_API_PORT);
+static AsyncWebSocket localSocket(LOCAL_API_WS_PATH);
+
+// Counters updated by the network task and read by the loop task, guarded by statsMux
+static LocalApiStats localApiStats = {};
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool localApiStarted = false;
+static uint32_t lastCleanupTime = 0;
+
+/**
+ * @brief Counts a message as accepted, rejected or dropped.
+ *
+ * @param result The result of the LEDs command, LEDS_COMMAND_INVALID for a rejected message.
+ */
+void countLocalMessage(LedsCommandResult result)
+{
+    portENTER_CRITICAL(&statsMux);
+    if (result == LEDS_COMMAND_ACCEPTED)
+        localApiStats.messages++;
+    else if (result == LEDS_COMMAND_DROPPED)
+        localApiStats.dropped++;
+    else
+        localApiStats.rejected++;
+    portEXIT_CRITICAL(&statsMux);
+}
+
+/**
+ * @brief Passes a complete message to the LEDs command pipeline.
+ *
+ * Text messages use the JSON schema of the MQTT LEDs command, binary messages the compact
+ * format of setLedsFromBinary(). Commands are only validated while the map is turned off, so the
+ * clients learn about their invalid commands at any time.
+ *
+ * This runs in the network task, so a command is dropped rather than waiting while another source
+ * holds the LEDs command mutex.
+ *
+ * @param data The message.
+ * @param length The length of the message.
+ * @param binary true for a binary message, false for a JSON message.
+ * @param receivedAt Time when the message was received (micros()).
+ * @return The result of the command.
+ */
+LedsCommandResult handleLocalMessage(const uint8_t *data, size_t length, bool binary, uint32_t receivedAt)
+{
+    if (binary)
+    {
+        if (isMapOn())
+            return tryBinaryLedsCommand(data, length, receivedAt);
+        return setLedsFromBinary(data, length, false) ? LEDS_COMMAND_ACCEPTED : LEDS_COMMAND_INVALID;
+    }
+
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, data, length);
+    if (error)
+    {
+        LOG_ERROR("Local API: deserializeJson() failed: %s", error.c_str());
+        return LEDS_COMMAND_INVALID;
+    }
+
+    if (isMapOn())
+        return tryLedsCommand(doc, receivedAt);
+    return setLedsFromJsonDoc(doc, false) ? LEDS_COMMAND_ACCEPTED : LEDS_COMMAND_INVALID;
+}
+
+/**
+ * @brief Collects a chunk of a message arriving in several TCP segments.
+ *
+ * The buffer is allocated with the first chunk and reused by the next messages, the chunks of
+ * a message must arrive in order.
+ *
+ * @param buffer The buffer of the request or the client, NULL until the first chunk.
+ * @param data The chunk.
+ * @param length The length of the chunk.
+ * @param index The offset of the chunk in the message.
+ * @param total The length of the message, at most LOCAL_API_MAX_MESSAGE.
+ * @return The message if the chunk was stored, NULL if the buffer could not be allocated or
+ * the chunk does not continue the message.
+ */
+LocalMessage *collectLocalChunk(void *&buffer, const uint8_t *data, size_t length, size_t index, size_t total)
+{
+    LocalMessage *message = (LocalMessage *)buffer;
+    if (index == 0)
+    {
+        if (message == NULL)
+        {
+            message = (LocalMessage *)malloc(sizeof(LocalMessage));
+            buffer = message;
+        }
+        if (message == NULL)
+        {
+            LOG_ERROR("Local API: failed to allocate the message buffer");
+            return NULL;
+        }
+
+        message->length = total;
+        message->received = 0;
+    }
+
+    if (message == NULL || total != message->length || index != message->received || index + length > total)
+        return NULL;
+
+    memcpy(message->data + index, data, length);
+    message->received += length;
+    return message;
+}
+
+/**
+ * @brief Handles the events of the WebSocket endpoint.
+ *
+ * Every message must be a single frame carrying one LEDs command. A frame arriving in several
+ * TCP segments is collected in the buffer of its client. Nothing is sent back, so clients could
+ * stream many small commands without waiting for a reply.
+ *
+ * @param server The WebSocket endpoint.
+ * @param client The client of the event.
+ * @param type The type of the event.
+ * @param arg The frame information for data events.
+ * @param data The data of the frame.
+ * @param length The length of the data.
+ */
+void onLocalSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type,
+                        void *arg, uint8_t *data, size_t length)
+{
+    switch (type)
+    {
+    case WS_EVT_CONNECT:
+        LOG_INFO("Local API: WebSocket client %u connected", client->id());
+        break;
+
+    case WS_EVT_DISCONNECT:
+        LOG_INFO("Local API: WebSocket client %u disconnected", client->id());
+
+        // The library does not free the buffer of the client
+        free(client->_tempObject);
+        client->_tempObject = NULL;
+        break;
+
+    case WS_EVT_DATA:
+    {
+        uint32_t receivedAt = micros(); // Start of the LEDs command latency measurement
+
+        AwsFrameInfo *info = (AwsFrameInfo *)arg;
+        bool binary = info->opcode == WS_BINARY;
+
+        // Continuation frames of a fragmented message, which is rejected with its first frame
+        if (info->opcode == WS_CONTINUATION)
+            break;
+
+        if (!info->final || info->len > LOCAL_API_MAX_MESSAGE)
+        {
+            // Report only the first chunk of a rejected message
+            if (info->index == 0)
+            {
+                LOG_WARN("Local API: fragmented or too long message rejected (%u bytes)", (uint32_t)info->len);
+                countLocalMessage(LEDS_COMMAND_INVALID);
+            }
+            break;
+        }
+
+        // The whole frame arrived in one TCP segment
+        if (info->index == 0 && info->len == length)
+        {
+            countLocalMessage(handleLocalMessage(data, length, binary, receivedAt));
+            break;
+        }
+
+        LocalMessage *message = collectLocalChunk(client->_tempObject, data, length, info->index, info->len);
+        if (message == NULL)
+        {
+            if (info->index == 0)
+                countLocalMessage(LEDS_COMMAND_INVALID);
+            break;
+        }
+
+        if (message->received == message->length)
+            countLocalMessage(handleLocalMessage(message->data, message->length, binary, receivedAt));
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Collects the body of an HTTP LEDs command.
+ *
+ * The body arrives in chunks of the TCP segments. They are collected in the buffer of the
+ * request, which the library frees with the request. Bodies longer than LOCAL_API_MAX_MESSAGE
+ * are not collected.
+ *
+ * @param request The request.
+ * @param data The chunk of the body.
+ * @param length The length of the chunk.
+ * @param index The offset of the chunk in the body.
+ * @param total The length of the body.
+ */
+void onLocalLedsBody(AsyncWebServerRequest *request, uint8_t *data, size_t length, size_t index, size_t total)
+{
+    if (total <= LOCAL_API_MAX_MESSAGE)
+        collectLocalChunk(request->_tempObject, data, length, index, total);
+}
+
+/**
+ * @brief Handles an HTTP LEDs command once its whole body was received.
+ *
+ * The JSON schema is used unless the content type is application/octet-stream.
+ *
+ * @param request The request.
+ */
+void onLocalLedsRequest(AsyncWebServerRequest *request)
+{
+    uint32_t receivedAt = micros();
+
+    if (request->contentLength() == 0)
+    {
+        request->send(400);
+        return;
+    }
+
+    if (request->contentLength() > LOCAL_API_MAX_MESSAGE)
+    {
+        countLocalMessage(LEDS_COMMAND_INVALID);
+        request->send(413);
+        return;
+    }
+
+    // The buffer could not be allocated or the body was not received completely
+    LocalMessage *message = (LocalMessage *)request->_tempObject;
+    if (message == NULL || message->received != request->contentLength())
+    {
+        countLocalMessage(LEDS_COMMAND_INVALID);
+        request->send(message == NULL ? 503 : 400);
+        return;
+    }
+
+    bool binary = request->contentType() == "application/octet-stream";
+    LedsCommandResult result = handleLocalMessage(message->data, message->length, binary, receivedAt);
+    countLocalMessage(result);
+    if (result == LEDS_COMMAND_ACCEPTED)
+        request->send(204);
+    else
+        request->send(result == LEDS_COMMAND_DROPPED ? 503 : 400);
+}
+
+/**
+ * @brief Starts the local server with the WebSocket and the HTTP endpoints of the LEDs commands.
+ *
+ * The LEDs commands use the same schema and the same pipeline as the MQTT commands, but avoid
+ * the round trip to the cloud for the clients in the local network:
+ * - WebSocket "/ws": one command per text (JSON) or binary message;
+ * - HTTP POST "/api/leds": one command per request, answered with 204, 400 or 503 if another
+ *   source holds the LEDs.
+ *
+ * @note This function should be called once after the WiFi manager is initialized, as the config
+ * portal uses the same port.
+ */
+void initLocalApi()
+{
+    localSocket.onEvent(onLocalSocketEvent);
+    localServer.addHandler(&localSocket);
+
+    localServer.on(LOCAL_API_LEDS_PATH, HTTP_POST, onLocalLedsRequest, NULL, onLocalLedsBody);
+
+    localServer.begin();
+    localApiStarted = true;
+
+    Serial.printf("Local API listening on port %d\n", LOCAL_API_PORT);
+}
+
+/**
+ * @brief Disconnects the closed and the excess WebSocket clients.
+ *
+ * @note This function should be called in the main loop.
+ */
+void handleLocalApi()
+{
+    uint32_t timeNow = clockMillis();
+    if (!localApiStarted || timeNow - lastCleanupTime < LOCAL_API_CLEANUP_INTERVAL)
+        return;
+
+    lastCleanupTime = timeNow;
+    localSocket.cleanupClients(LOCAL_API_MAX_CLIENTS);
+}
+
+/**
+ * @brief Returns the counters of the local API.
+ *
+ * @return The counters.
+ */
+LocalApiStats getLocalApiStats()
+{
+    portENTER_CRITICAL(&statsMux);
+    LocalApiStats stats = localApiStats;
+    portEXIT_CRITICAL(&statsMux);
+
+    stats.clients = localSocket.count();
+    return stats;
+}
+
+#endif // USE_LOCAL_API
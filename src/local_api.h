@@ -0,0 +1,34 @@
+#ifndef LOCAL_API_H
+#define LOCAL_API_H
+
+#include <Arduino.h>
+#include "constants.h"
+
+#ifdef USE_LOCAL_API
+
+// Port of the local server, the config portal uses the same port only before the server starts
+#define LOCAL_API_PORT        80
+// WebSocket endpoint and HTTP endpoint of the LEDs commands
+#define LOCAL_API_WS_PATH     "/ws"
+#define LOCAL_API_LEDS_PATH   "/api/leds"
+// Maximum number of WebSocket clients, the oldest clients are disconnected above it
+#define LOCAL_API_MAX_CLIENTS 4
+// Largest accepted message (in bytes), larger messages should use MQTT
+#define LOCAL_API_MAX_MESSAGE 4096
+
+// Counters of the local API
+struct LocalApiStats
+{
+    uint32_t clients;  // WebSocket clients connected
+    uint32_t messages; // LEDs commands accepted since boot
+    uint32_t rejected; // Messages rejected since boot (fragmented, too long or invalid)
+    uint32_t dropped;  // LEDs commands dropped since boot because another source held the LEDs
+};
+
+void initLocalApi();
+void handleLocalApi();
+LocalApiStats getLocalApiStats();
+
+#endif // USE_LOCAL_API
+
+#endif // LOCAL_API_H
@@ -0,0 +1,413 @@
+#include <stdarg.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "logger.h"
+
+// Task parameters
+#define LOGGER_TASK_STACK_SIZE (3 * 1024U)
+#define LOGGER_TASK_PRIORITY   (tskIDLE_PRIORITY + 1)
+#define LOGGER_TASK_CORE       0 // Keep the formatting away from the LED task on core 1
+
+// Interval of printing the buffered messages (in milliseconds)
+#define LOG_DRAIN_INTERVAL_MS 20
+
+// Number of messages held by the ring buffer
+#define LOG_BUFFER_ENTRIES 64
+// Maximum number of arguments of a message
+#define LOG_MAX_ARGS       6
+// Maximum length of a formatted message, fits the strings and the text around them
+#define LOG_LINE_SIZE      (LOG_STRINGS_SIZE + 128)
+
+// Longest conversion specification of a format, including the values of '*' written into it
+#define LOG_SPEC_SIZE 32
+
+// Rate limiter: burst of messages accepted at once and messages accepted per second after the burst
+#define LOG_RATE_BURST      32
+#define LOG_RATE_PER_SECOND 20
+
+// Types of the captured arguments, each one is passed to the format with its own type
+enum LogArgType : uint8_t
+{
+    LOG_ARG_NONE,     // Not captured, the conversion is not supported
+    LOG_ARG_INT,      // int: %d, %i, %c and the values of '*'
+    LOG_ARG_UNSIGNED, // unsigned int: %u, %o, %x, %X
+    LOG_ARG_POINTER,  // void *: %p
+    LOG_ARG_STRING    // Offset of the copy in strings: %s
+};
+
+// Message waiting in the ring buffer for formatting
+struct LogEntry
+{
+    const char *format;                // Format string, must be a literal
+    uint32_t timeMs;                   // Time when the message was logged
+    uint8_t level;                     // LogLevel of the message
+    LogArgType argTypes[LOG_MAX_ARGS]; // Types of the arguments
+    uintptr_t args[LOG_MAX_ARGS];      // Arguments, string arguments hold the offset in strings
+    char strings[LOG_STRINGS_SIZE];    // Copies of the string arguments
+};
+
+// Ring buffer of the messages, head and tail are free-running counters
+static LogEntry ring[LOG_BUFFER_ENTRIES];
+static uint32_t ringHead = 0;
+static uint32_t ringTail = 0;
+
+// Spinlock protecting the ring buffer, the rate limiter and the counters. It is held only
+// to copy a prepared entry, never while formatting or printing
+static portMUX_TYPE logMux = portMUX_INITIALIZER_UNLOCKED;
+
+static LogLevel logLevel = LOG_LEVEL_INFO;
+static LogStats logStats = {};
+
+// State of the rate limiter
+static uint32_t rateTokens = LOG_RATE_BURST;
+static uint32_t rateRefilledAt = 0;
+
+/**
+ * @brief Sets the most detailed level of the messages to log.
+ *
+ * @param level The level.
+ */
+void setLogLevel(LogLevel level)
+{
+    logLevel = level;
+}
+
+/**
+ * @brief Takes a token from the rate limiter. Must be called with logMux held.
+ *
+ * @param timeNow The current time in milliseconds.
+ * @return true if the message could be logged, false if it should be dropped.
+ */
+bool takeRateToken(uint32_t timeNow)
+{
+    const uint32_t refillPeriod = 1000 / LOG_RATE_PER_SECOND;
+    uint32_t refills = (timeNow - rateRefilledAt) / refillPeriod;
+    if (refills > 0)
+    {
+        rateTokens = min(rateTokens + refills, (uint32_t)LOG_RATE_BURST);
+        rateRefilledAt += refills * refillPeriod;
+    }
+
+    if (rateTokens == 0)
+        return false;
+
+    rateTokens--;
+    return true;
+}
+
+/**
+ * @brief Copies the arguments of the message into the entry.
+ *
+ * The format is scanned for the conversions. Strings are copied into the entry, as they
+ * might not exist anymore when the message is formatted. At most the precision of the
+ * conversion is read from a string, so "%.*s" could be used for data without a terminator.
+ * The type of every argument is stored with it, as it is read from the arguments. Length
+ * modifiers are ignored, floating point and 64-bit values are rejected at compile time by
+ * the LOG_* macros.
+ *
+ * @param entry The entry to fill.
+ * @param format The format string.
+ * @param args The arguments.
+ */
+void captureLogArgs(LogEntry &entry, const char *format, va_list args)
+{
+    uint8_t argCount = 0;
+    size_t stringsUsed = 0;
+
+    for (const char *p = format; *p != '\0' && argCount < LOG_MAX_ARGS; p++)
+    {
+        if (*p != '%')
+            continue;
+
+        // Skip flags, width, precision and length modifiers, remember the precision for strings
+        p++;
+        bool isPrecision = false;
+        int precision = -1;
+        while (*p != '\0' && strchr("-+ #0123456789.*hlzjt", *p) != NULL)
+        {
+            if (*p == '.')
+            {
+                isPrecision = true;
+                precision = 0;
+            }
+            else if (*p == '*' && argCount < LOG_MAX_ARGS)
+            {
+                int value = va_arg(args, int);
+                entry.args[argCount] = (uintptr_t)value;
+                entry.argTypes[argCount] = LOG_ARG_INT;
+                if (isPrecision)
+                    precision = value;
+                argCount++;
+            }
+            else if (isPrecision && isdigit(*p))
+                precision = precision * 10 + (*p - '0');
+            p++;
+        }
+
+        if (*p == '\0')
+            break;
+        if (*p == '%' || argCount >= LOG_MAX_ARGS)
+            continue;
+
+        if (*p == 's')
+        {
+            const char *value = va_arg(args, const char *);
+            if (value == NULL)
+                value = "(null)";
+
+            // Strings with precision do not have to be null-terminated
+            size_t length = strnlen(value, precision >= 0 ? (size_t)precision : LOG_STRINGS_SIZE);
+            size_t available = LOG_STRINGS_SIZE - stringsUsed;
+            entry.args[argCount] = stringsUsed;
+            entry.argTypes[argCount] = LOG_ARG_STRING;
+            if (available > 0)
+            {
+                length = min(length, available - 1);
+                memcpy(entry.strings + stringsUsed, value, length);
+                entry.strings[stringsUsed + length] = '\0';
+                stringsUsed += length + 1;
+            }
+            else
+                entry.args[argCount] = LOG_STRINGS_SIZE - 1; // Points to the terminator of the last string
+        }
+        else if (*p == 'p')
+        {
+            entry.args[argCount] = (uintptr_t)va_arg(args, void *);
+            entry.argTypes[argCount] = LOG_ARG_POINTER;
+        }
+        else if (strchr("dic", *p) != NULL)
+        {
+            entry.args[argCount] = (uintptr_t)va_arg(args, int);
+            entry.argTypes[argCount] = LOG_ARG_INT;
+        }
+        else if (strchr("uoxX", *p) != NULL)
+        {
+            entry.args[argCount] = va_arg(args, unsigned int);
+            entry.argTypes[argCount] = LOG_ARG_UNSIGNED;
+        }
+        else
+        {
+            // The argument is read to keep the following ones in place, but not printed
+            (void)va_arg(args, unsigned int);
+            entry.argTypes[argCount] = LOG_ARG_NONE;
+        }
+
+        argCount++;
+    }
+}
+
+/**
+ * @brief Records a message to be printed by the drain task.
+ *
+ * The caller only copies the format pointer and the arguments into the ring buffer, so logging
+ * does not wait for the serial port. Messages are dropped and counted if the ring buffer is full
+ * or the rate limit is exceeded. Use the LOG_* macros instead of calling this function directly.
+ *
+ * @param level The level of the message.
+ * @param format The format string, must be a string literal.
+ * @param ... The arguments of the format.
+ */
+void logMessage(LogLevel level, const char *format, ...)
+{
+    if (level > logLevel)
+        return;
+
+    LogEntry entry;
+    entry.format = format;
+    entry.timeMs = millis();
+    entry.level = level;
+    memset(entry.argTypes, LOG_ARG_NONE, sizeof(entry.argTypes));
+    memset(entry.args, 0, sizeof(entry.args));
+    entry.strings[LOG_STRINGS_SIZE - 1] = '\0';
+
+    va_list args;
+    va_start(args, format);
+    captureLogArgs(entry, format, args);
+    va_end(args);
+
+    portENTER_CRITICAL(&logMux);
+    if (!takeRateToken(entry.timeMs))
+        logStats.droppedRateLimited++;
+    else if (ringHead - ringTail >= LOG_BUFFER_ENTRIES)
+        logStats.droppedFull++;
+    else
+        ring[ringHead++ % LOG_BUFFER_ENTRIES] = entry;
+    portEXIT_CRITICAL(&logMux);
+}
+
+/**
+ * @brief Returns the counters of the logger.
+ *
+ * @return The counters.
+ */
+LogStats getLogStats()
+{
+    portENTER_CRITICAL(&logMux);
+    LogStats stats = logStats;
+    portEXIT_CRITICAL(&logMux);
+
+    return stats;
+}
+
+/**
+ * @brief Formats one conversion with the captured argument of its type.
+ *
+ * @param entry The message.
+ * @param spec The conversion specification without length modifiers.
+ * @param index The index of the argument.
+ * @param buffer Receives the formatted text.
+ * @param size The size of the buffer.
+ * @return The number of characters written to the buffer.
+ */
+size_t formatLogArg(const LogEntry &entry, const char *spec, uint8_t index, char *buffer, size_t size)
+{
+    int written;
+    switch (entry.argTypes[index])
+    {
+    case LOG_ARG_INT:
+        written = snprintf(buffer, size, spec, (int)entry.args[index]);
+        break;
+    case LOG_ARG_UNSIGNED:
+        written = snprintf(buffer, size, spec, (unsigned int)entry.args[index]);
+        break;
+    case LOG_ARG_POINTER:
+        written = snprintf(buffer, size, spec, (void *)entry.args[index]);
+        break;
+    case LOG_ARG_STRING:
+        written = snprintf(buffer, size, spec, entry.strings + entry.args[index]);
+        break;
+    default:
+        // Unsupported conversions are printed as they are
+        written = snprintf(buffer, size, "%s", spec);
+        break;
+    }
+
+    return written > 0 ? min((size_t)written, size - 1) : 0;
+}
+
+/**
+ * @brief Formats and prints the message.
+ *
+ * The format is processed one conversion at a time, so every argument is passed to snprintf()
+ * with the type it was captured with. The values of '*' are written into the specification.
+ *
+ * @param entry The message.
+ */
+void printLogEntry(const LogEntry &entry)
+{
+    static const char levelChars[] = {'E', 'W', 'I', 'D'};
+
+    char line[LOG_LINE_SIZE];
+    size_t used = 0;
+    uint8_t argIndex = 0;
+
+    for (const char *p = entry.format; *p != '\0' && used < sizeof(line) - 1;)
+    {
+        if (*p != '%')
+        {
+            line[used++] = *p++;
+            continue;
+        }
+
+        // Copy the specification without the length modifiers, they are not needed for the captured types
+        char spec[LOG_SPEC_SIZE];
+        size_t specLength = 0;
+        spec[specLength++] = *p++;
+        while (*p != '\0' && strchr("-+ #0123456789.*hlzjt", *p) != NULL)
+        {
+            if (*p == '*')
+            {
+                if (argIndex < LOG_MAX_ARGS)
+                    specLength += snprintf(spec + specLength, sizeof(spec) - specLength, "%d", (int)entry.args[argIndex++]);
+            }
+            else if (strchr("hlzjt", *p) == NULL)
+                spec[specLength++] = *p;
+            specLength = min(specLength, sizeof(spec) - 2);
+            p++;
+        }
+
+        if (*p == '\0')
+            break;
+        if (*p == '%')
+        {
+            line[used++] = *p++;
+            continue;
+        }
+
+        spec[specLength++] = *p++;
+        spec[specLength] = '\0';
+
+        // Arguments after the first LOG_MAX_ARGS were not captured
+        if (argIndex < LOG_MAX_ARGS)
+            used += formatLogArg(entry, spec, argIndex++, line + used, sizeof(line) - used);
+    }
+    line[used] = '\0';
+
+    Serial.printf("[%lu] %c: %s\n", (unsigned long)entry.timeMs, levelChars[entry.level], line);
+}
+
+/**
+ * @brief Task printing the buffered messages.
+ *
+ * @param pvParameters Pointer to the parameters passed to the task (not used).
+ */
+void loggerTask(void *pvParameters)
+{
+    LogStats reportedStats = {};
+
+    for (;;)
+    {
+        for (;;)
+        {
+            LogEntry entry;
+
+            portENTER_CRITICAL(&logMux);
+            bool available = ringTail != ringHead;
+            if (available)
+                entry = ring[ringTail++ % LOG_BUFFER_ENTRIES];
+            portEXIT_CRITICAL(&logMux);
+
+            if (!available)
+                break;
+
+            printLogEntry(entry);
+
+            portENTER_CRITICAL(&logMux);
+            logStats.logged++;
+            portEXIT_CRITICAL(&logMux);
+        }
+
+        // Report the dropped messages
+        LogStats stats = getLogStats();
+        if (stats.droppedFull != reportedStats.droppedFull || stats.droppedRateLimited != reportedStats.droppedRateLimited)
+        {
+            Serial.printf("[%lu] W: %u log messages dropped (buffer full: %u, rate limited: %u)\n", millis(),
+                          (stats.droppedFull - reportedStats.droppedFull) + (stats.droppedRateLimited - reportedStats.droppedRateLimited),
+                          stats.droppedFull - reportedStats.droppedFull, stats.droppedRateLimited - reportedStats.droppedRateLimited);
+            reportedStats = stats;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+    }
+}
+
+/**
+ * @brief Initializes the logger task.
+ *
+ * Messages logged before this call are kept in the ring buffer and printed once the task runs.
+ *
+ * @note This function should be called once during the setup phase of the program.
+ */
+void loggerInit()
+{
+    if (xTaskCreatePinnedToCore(loggerTask,
+                                "loggerTask",
+                                LOGGER_TASK_STACK_SIZE,
+                                NULL,
+                                LOGGER_TASK_PRIORITY,
+                                NULL,
+                                LOGGER_TASK_CORE) != pdPASS)
+    {
+        Serial.println("Failed to create loggerTask");
+    }
+}
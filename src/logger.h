@@ -0,0 +1,66 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <type_traits>
+
+// Space for the copies of the string arguments of a message (in bytes). It fits the longest
+// call site: the topic and the first 128 bytes of the payload logged by messageHandler()
+#define LOG_STRINGS_SIZE 192
+
+// Log levels, messages above the level set by setLogLevel() are discarded
+enum LogLevel : uint8_t
+{
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG
+};
+
+// Counters of the logger
+struct LogStats
+{
+    uint32_t logged;             // Messages printed by the drain task
+    uint32_t droppedFull;        // Messages dropped because the ring buffer was full
+    uint32_t droppedRateLimited; // Messages dropped by the rate limiter
+};
+
+// Checks the types of the arguments of a message: integers up to 32 bits, characters and pointers
+template <typename... Args>
+struct LogArgsCheck;
+
+template <>
+struct LogArgsCheck<>
+{
+};
+
+template <typename Arg, typename... Args>
+struct LogArgsCheck<Arg, Args...> : LogArgsCheck<Args...>
+{
+    static_assert(!std::is_floating_point<Arg>::value, "Floating point values could not be logged by the LOG_* macros");
+    static_assert(std::is_pointer<Arg>::value || ((std::is_integral<Arg>::value || std::is_enum<Arg>::value) && sizeof(Arg) <= sizeof(uint32_t)),
+                  "Only integers up to 32 bits, characters and pointers could be logged by the LOG_* macros");
+};
+
+// Never called, only used in sizeof() to check the arguments at compile time without evaluating them
+template <typename... Args>
+LogArgsCheck<Args...> checkLogArgs(Args... args);
+
+/**
+ * Logging macros for the hot paths. The message is formatted and printed later by the drain task.
+ * The format must be a string literal without a trailing newline. Supported conversions are
+ * the integer ones up to 32 bits, %c, %p and %s (strings are copied, together they must fit
+ * LOG_STRINGS_SIZE or the last ones are truncated). Other arguments fail at compile time.
+ */
+#define LOG_MESSAGE(level, format, ...) ((void)sizeof(checkLogArgs(__VA_ARGS__)), logMessage(level, format, ##__VA_ARGS__))
+#define LOG_ERROR(format, ...)          LOG_MESSAGE(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...)           LOG_MESSAGE(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...)           LOG_MESSAGE(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...)          LOG_MESSAGE(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+
+void loggerInit();
+void setLogLevel(LogLevel level);
+void logMessage(LogLevel level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+LogStats getLogStats();
+
+#endif // LOGGER_H
@@ -3,7 +3,14 @@
 
 #include "constants.h"
 #include "aws_iot.h"
+#include "benchmark.h"
+#include "boot_trace.h"
+#include "command_trace.h"
 #include "leds.h"
+#include "local_api.h"
+#include "logger.h"
+#include "power.h"
+#include "realtime_udp.h"
 #include "wifi_manager.h"
 
 #ifdef USE_HOME_ASSISTANT
@@ -12,7 +19,10 @@
 
 void setup()
 {
+    bootTraceMark(BOOT_STAGE_SETUP_START);
     initSerial();
+    loggerInit();
+    bootTraceMark(BOOT_STAGE_SERIAL);
 
     char chipID[CHIP_ID_LENGTH];
     getEsp32ChipID(chipID, sizeof(chipID));
@@ -21,7 +31,26 @@ void setup()
 
     // Initialize modules
     ledsTaskInit();
+    bootTraceMark(BOOT_STAGE_LEDS_INIT);
+    initPowerManagement();
+    bootTraceMark(BOOT_STAGE_POWER);
     initWiFiManager(chipID);
+    bootTraceMark(BOOT_STAGE_WIFI_MANAGER);
+
+    // Start the local control of the LEDs once the config portal released the HTTP port
+#ifdef USE_LOCAL_API
+    initLocalApi();
+#endif
+
+    // Receive the frames streamed over UDP
+#ifdef USE_REALTIME_UDP
+    realtimeUdpInit();
+#endif
+
+    // Start the recorded commands of this boot with a marker
+#ifdef ENABLE_COMMAND_TRACE
+    initCommandTrace();
+#endif
 
     // Initialize AWS IoT with the Thing Name if defined, otherwise use the Chip ID
 #ifdef THINGNAME
@@ -29,17 +58,33 @@ void setup()
 #else
     initAWS(chipID, sizeof(chipID));
 #endif
+    bootTraceMark(BOOT_STAGE_AWS_INIT);
 
     // Initialize map control via Home Assistant if defined
 #ifdef USE_HOME_ASSISTANT
     haClientTaskInit(chipID, sizeof(chipID));
+    bootTraceMark(BOOT_STAGE_HA_INIT);
+#endif
+
+    bootTraceMark(BOOT_STAGE_SETUP_DONE);
+
+    // Measure the hot paths and print the results on the serial console
+#ifdef RUN_BENCHMARKS
+    runBenchmarks();
 #endif
 }
 
 void loop()
 {
-    handleWiFi();               // Maintain WiFi connection
-    maintainAWSConnection();    // Maintain the MQTT connection
-    periodicStatusPublishAWS(); // Publish the device status periodically
-    yield();                    // Allow the ESP32 to perform background tasks
+    handleWiFi();                       // Maintain WiFi connection
+    maintainAWSConnection();            // Maintain the MQTT connection
+    periodicStatusPublishAWS();         // Publish the device status periodically
+    periodicFirmwareUpdatePublishAWS(); // Publish the firmware update progress and result
+#ifdef USE_LOCAL_API
+    handleLocalApi(); // Disconnect the closed and the excess WebSocket clients
+#endif
+#ifdef ENABLE_COMMAND_TRACE
+    handleCommandTrace(); // Write the recorded commands to the flash and run the replay
+#endif
+    yield();                            // Allow the ESP32 to perform background tasks
 }
\ No newline at end of file
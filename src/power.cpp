@@ -0,0 +1,189 @@
+#include <esp_wifi.h>
+#include "leds.h"
+#include "power.h"
+#include "system_clock.h"
+
+#ifdef CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+// CPU frequencies used while rendering and in the standby mode (in MHz)
+#define ACTIVE_CPU_FREQ_MHZ  240
+#define STANDBY_CPU_FREQ_MHZ 80
+
+#ifdef CONFIG_PM_ENABLE
+// Lock keeping the CPU at the maximum frequency while rendering
+static esp_pm_lock_handle_t cpuFreqLock = NULL;
+#endif
+
+// Spinlock protecting the mode and the statistics updated from multiple tasks
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Indicates if the device is in the standby mode, changed under statsMux
+static volatile bool standby = false;
+// Time of the last standby mode change (in microseconds)
+static uint64_t lastModeChangeUs = 0;
+
+// Accumulated statistics, 64-bit so the times do not wrap after 49 days like the milliseconds
+static uint32_t standbyEntries = 0;
+static uint64_t standbyTimeUs = 0;
+static uint64_t activeTimeUs = 0;
+
+/**
+ * @brief Adds the time spent in the current mode to the statistics. Must be called with statsMux held.
+ *
+ * @param timeNowUs The current time in microseconds.
+ */
+void accountModeTime(uint64_t timeNowUs)
+{
+    uint64_t elapsed = timeNowUs - lastModeChangeUs;
+    if (standby)
+        standbyTimeUs += elapsed;
+    else
+        activeTimeUs += elapsed;
+    lastModeChangeUs = timeNowUs;
+}
+
+/**
+ * @brief Initializes the power management.
+ *
+ * If dynamic frequency scaling is enabled in the SDK configuration, the CPU is allowed to
+ * scale between STANDBY_CPU_FREQ_MHZ and ACTIVE_CPU_FREQ_MHZ, and a lock keeping the maximum
+ * frequency is held while rendering. Otherwise the frequency is switched directly.
+ *
+ * @note This function should be called once during the setup phase of the program.
+ */
+void initPowerManagement()
+{
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_config_esp32_t config = {};
+    config.max_freq_mhz = ACTIVE_CPU_FREQ_MHZ;
+    config.min_freq_mhz = STANDBY_CPU_FREQ_MHZ;
+    config.light_sleep_enable = false;
+
+    if (esp_pm_configure(&config) != ESP_OK ||
+        esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "rendering", &cpuFreqLock) != ESP_OK)
+    {
+        Serial.println(F("Failed to configure power management"));
+        cpuFreqLock = NULL;
+        return;
+    }
+
+    esp_pm_lock_acquire(cpuFreqLock);
+#endif
+
+    portENTER_CRITICAL(&statsMux);
+    lastModeChangeUs = clockMicros64();
+    portEXIT_CRITICAL(&statsMux);
+}
+
+/**
+ * @brief Sets the CPU frequency for the active or the standby mode.
+ *
+ * @param active true to run at the full frequency, false to allow the lower frequency.
+ */
+void setCpuActive(bool active)
+{
+#ifdef CONFIG_PM_ENABLE
+    if (cpuFreqLock != NULL)
+    {
+        if (active)
+            esp_pm_lock_acquire(cpuFreqLock);
+        else
+            esp_pm_lock_release(cpuFreqLock);
+        return;
+    }
+#endif
+
+    setCpuFrequencyMhz(active ? ACTIVE_CPU_FREQ_MHZ : STANDBY_CPU_FREQ_MHZ);
+}
+
+/**
+ * @brief Enters or leaves the low-power standby mode.
+ *
+ * In the standby mode the LED rendering is stopped, Wi-Fi uses the maximum modem sleep
+ * and the CPU runs at a lower frequency. Leaving the standby mode raises the CPU frequency
+ * first and then wakes up the LED task, which renders the next frame immediately.
+ *
+ * The mode is changed under statsMux, so only one of concurrent requests for the same mode
+ * applies it.
+ *
+ * @param enable true to enter the standby mode, false to leave it.
+ */
+void setStandby(bool enable)
+{
+    uint64_t timeNowUs = clockMicros64();
+
+    portENTER_CRITICAL(&statsMux);
+    bool changed = standby != enable;
+    if (changed)
+    {
+        accountModeTime(timeNowUs);
+        standby = enable;
+        if (enable)
+            standbyEntries++;
+    }
+    portEXIT_CRITICAL(&statsMux);
+
+    if (!changed)
+        return;
+
+    if (enable)
+    {
+        setLedsRendering(false);
+        esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+        setCpuActive(false);
+        Serial.println(F("Entered standby mode"));
+    }
+    else
+    {
+        setCpuActive(true);
+        esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+        setLedsRendering(true);
+        Serial.println(F("Left standby mode"));
+    }
+}
+
+/**
+ * @brief Checks if the device is in the standby mode.
+ *
+ * @return true if the device is in the standby mode, false otherwise.
+ */
+bool isInStandby()
+{
+    return standby;
+}
+
+/**
+ * @brief Returns the statistics of the standby mode.
+ *
+ * The estimated current is the time-weighted average of ACTIVE_CURRENT_MA and
+ * STANDBY_CURRENT_MA over the time since the power management was initialized.
+ *
+ * @return The current statistics.
+ */
+PowerStats getPowerStats()
+{
+    uint64_t timeNowUs = clockMicros64();
+
+    portENTER_CRITICAL(&statsMux);
+    accountModeTime(timeNowUs);
+    uint32_t entries = standbyEntries;
+    uint64_t standbyUs = standbyTimeUs;
+    uint64_t activeUs = activeTimeUs;
+    portEXIT_CRITICAL(&statsMux);
+
+    PowerStats stats;
+    stats.standbyEntries = entries;
+    stats.standbyTimeMs = standbyUs / 1000;
+    stats.activeTimeMs = activeUs / 1000;
+    stats.lastWakeLatencyUs = getLedsWakeLatencyUs();
+
+    uint64_t totalTimeUs = standbyUs + activeUs;
+    if (totalTimeUs > 0)
+        stats.estimatedCurrentMa = (activeUs * ACTIVE_CURRENT_MA + standbyUs * STANDBY_CURRENT_MA) / totalTimeUs;
+    else
+        stats.estimatedCurrentMa = ACTIVE_CURRENT_MA;
+
+    return stats;
+}
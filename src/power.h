@@ -0,0 +1,25 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+
+// Estimated current draw of the controller (without LEDs) used for the power statistics (in mA)
+#define ACTIVE_CURRENT_MA  95 // 240 MHz, rendering, Wi-Fi minimum modem sleep
+#define STANDBY_CURRENT_MA 30 // 80 MHz, no rendering, Wi-Fi maximum modem sleep
+
+// Statistics of the standby mode
+struct PowerStats
+{
+    uint32_t standbyEntries;     // Number of times the device entered the standby mode
+    uint64_t standbyTimeMs;      // Total time spent in the standby mode
+    uint64_t activeTimeMs;       // Total time spent rendering
+    uint32_t lastWakeLatencyUs;  // Time from the wake request to the first rendered frame
+    uint16_t estimatedCurrentMa; // Estimated average current draw of the controller
+};
+
+void initPowerManagement();
+void setStandby(bool standby);
+bool isInStandby();
+PowerStats getPowerStats();
+
+#endif // POWER_H
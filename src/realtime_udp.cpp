@@ -0,0 +1,483 @@
+#include "realtime_udp.h"
+
+#ifdef USE_REALTIME_UDP
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+#include <WiFi.h>
+#include "logger.h"
+#include "system_clock.h"
+#include "wifi_manager.h"
+
+// Task parameters
+#define REALTIME_TASK_STACK_SIZE (3 * 1024U)
+#define REALTIME_TASK_PRIORITY   (tskIDLE_PRIORITY + 2) // Above the loop task doing TLS
+#define REALTIME_TASK_CORE       0                      // Keep the network away from the LED task
+
+// Largest UDP payload read, longer packets are truncated and rejected
+#define REALTIME_MAX_PACKET_SIZE 1472
+// Range of the E1.31 sequence numbers considered as late, see ANSI E1.31 6.7.2
+#define E131_LATE_WINDOW         20
+
+// DDP header: flags, sequence, data type, ID, offset (4 bytes), length (2 bytes), optional timecode
+#define DDP_HEADER_SIZE          10
+#define DDP_TIMECODE_SIZE        4
+#define DDP_FLAG_VERSION_MASK    0xC0
+#define DDP_FLAG_VERSION_1       0x40
+#define DDP_FLAG_TIMECODE        0x10
+#define DDP_FLAG_REPLY           0x04
+#define DDP_FLAG_QUERY           0x02
+#define DDP_FLAG_PUSH            0x01
+#define DDP_ID_DISPLAY           1
+
+// Offsets and values of the E1.31 data packet fields
+#define E131_HEADER_SIZE         126 // Up to and including the DMX start code
+#define E131_ROOT_VECTOR_OFFSET  18
+#define E131_ROOT_VECTOR_DATA    0x00000004
+#define E131_FRAME_VECTOR_OFFSET 40
+#define E131_FRAME_VECTOR_DATA   0x00000002
+#define E131_SEQUENCE_OFFSET     111
+#define E131_OPTIONS_OFFSET      112
+#define E131_OPTION_PREVIEW      0x80
+#define E131_OPTION_TERMINATED   0x40
+#define E131_UNIVERSE_OFFSET     113
+#define E131_DMP_VECTOR_OFFSET   117
+#define E131_DMP_VECTOR_SET      0x02
+#define E131_COUNT_OFFSET        123
+#define E131_START_CODE_OFFSET   125
+
+// ACN packet identifier at the start of the E1.31 root layer
+static const uint8_t e131PacketId[] = {0x00, 0x10, 0x00, 0x00, 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0x00, 0x00, 0x00};
+
+// Buffers of the receiver task, no memory is allocated while receiving
+static uint8_t packet[REALTIME_MAX_PACKET_SIZE];
+static uint8_t ddpFrame[REALTIME_FRAME_SIZE];
+static uint8_t e131Frame[REALTIME_FRAME_SIZE];
+
+// Last sequence numbers, 0 before the first packet
+static uint8_t lastDdpSequence = 0;
+static uint8_t lastE131Sequence = 0;
+static bool e131SequenceValid = false;
+
+// Frame handed over to the LED task and the counters, guarded by frameMux
+static uint8_t readyFrame[REALTIME_FRAME_SIZE];
+static bool frameReady = false;
+static uint32_t frameReceivedAt = 0;
+static uint32_t lastFrameTime = 0;
+static bool streamActive = false;
+static bool streamTerminated = false;
+static RealtimeStats realtimeStats = {};
+static uint64_t latencySumUs = 0;
+static portMUX_TYPE frameMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Set by the WiFi link listener to join the E1.31 multicast group from the receiver task
+static volatile bool joinMulticast = false;
+
+// Ports requested by realtimeUdpInit() and the ports bound by the receiver task (0 until bound)
+static uint16_t requestedDdpPort = REALTIME_DDP_PORT;
+static uint16_t requestedE131Port = REALTIME_E131_PORT;
+static volatile uint16_t boundDdpPort = 0;
+static volatile uint16_t boundE131Port = 0;
+
+/**
+ * @brief Reads a big-endian 16-bit value.
+ *
+ * @param data The data.
+ * @return The value.
+ */
+uint16_t readUint16(const uint8_t *data)
+{
+    return (data[0] << 8) | data[1];
+}
+
+/**
+ * @brief Reads a big-endian 32-bit value.
+ *
+ * @param data The data.
+ * @return The value.
+ */
+uint32_t readUint32(const uint8_t *data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+/**
+ * @brief Counts a rejected packet.
+ *
+ * @param late true if the packet was late, false if it was invalid.
+ */
+void countDroppedPacket(bool late)
+{
+    portENTER_CRITICAL(&frameMux);
+    if (late)
+        realtimeStats.late++;
+    else
+        realtimeStats.invalid++;
+    portEXIT_CRITICAL(&frameMux);
+}
+
+/**
+ * @brief Hands the complete frame over to the LED task.
+ *
+ * A frame that was not shown yet is replaced, so the LED task always shows the latest frame.
+ *
+ * @param frame The frame.
+ * @param receivedAt Time when the last packet of the frame was received (micros()).
+ */
+void publishFrame(const uint8_t *frame, uint32_t receivedAt)
+{
+    portENTER_CRITICAL(&frameMux);
+    memcpy(readyFrame, frame, REALTIME_FRAME_SIZE);
+    if (frameReady)
+        realtimeStats.replaced++;
+    frameReady = true;
+    frameReceivedAt = receivedAt;
+    lastFrameTime = clockMillis();
+    streamTerminated = false;
+    realtimeStats.frames++;
+    portEXIT_CRITICAL(&frameMux);
+}
+
+/**
+ * @brief Decodes a DDP packet.
+ *
+ * The pixel data are copied at their offset into the DDP frame, which is handed over to the
+ * LED task when a packet with the push flag arrives. Packets with a sequence number older than
+ * the last one are dropped, the sequence number 0 disables the check.
+ *
+ * @param data The packet.
+ * @param length The length of the packet.
+ * @param receivedAt Time when the packet was received (micros()).
+ */
+void decodeDdpPacket(const uint8_t *data, size_t length, uint32_t receivedAt)
+{
+    if (length < DDP_HEADER_SIZE || (data[0] & DDP_FLAG_VERSION_MASK) != DDP_FLAG_VERSION_1)
+    {
+        countDroppedPacket(false);
+        return;
+    }
+
+    // Queries and replies of the discovery are not supported, and only the display is addressed
+    if ((data[0] & (DDP_FLAG_QUERY | DDP_FLAG_REPLY)) || data[3] != DDP_ID_DISPLAY)
+        return;
+
+    size_t headerSize = DDP_HEADER_SIZE + ((data[0] & DDP_FLAG_TIMECODE) ? DDP_TIMECODE_SIZE : 0);
+    uint32_t offset = readUint32(data + 4);
+    uint16_t dataLength = readUint16(data + 8);
+    if (headerSize + dataLength > length)
+    {
+        countDroppedPacket(false);
+        return;
+    }
+
+    // The 4-bit sequence number wraps from 15 to 1
+    uint8_t sequence = data[1] & 0x0F;
+    if (sequence != 0 && lastDdpSequence != 0)
+    {
+        int8_t difference = (sequence - lastDdpSequence + 15) % 15;
+        if (difference == 0 || difference > 7)
+        {
+            countDroppedPacket(true);
+            return;
+        }
+    }
+    lastDdpSequence = sequence;
+
+    // Channels outside of the LEDs are ignored
+    if (offset < REALTIME_FRAME_SIZE)
+        memcpy(ddpFrame + offset, data + headerSize, min((uint32_t)dataLength, REALTIME_FRAME_SIZE - offset));
+
+    if (data[0] & DDP_FLAG_PUSH)
+        publishFrame(ddpFrame, receivedAt);
+}
+
+/**
+ * @brief Decodes an E1.31 (sACN) data packet of E131_UNIVERSE.
+ *
+ * The universe carries the whole frame, starting with the first channel. Packets with a sequence
+ * number in the late window behind the last one are dropped, as required by the standard.
+ *
+ * @param data The packet.
+ * @param length The length of the packet.
+ * @param receivedAt Time when the packet was received (micros()).
+ */
+void decodeE131Packet(const uint8_t *data, size_t length, uint32_t receivedAt)
+{
+    if (length < E131_HEADER_SIZE ||
+        memcmp(data, e131PacketId, sizeof(e131PacketId)) != 0 ||
+        readUint32(data + E131_ROOT_VECTOR_OFFSET) != E131_ROOT_VECTOR_DATA ||
+        readUint32(data + E131_FRAME_VECTOR_OFFSET) != E131_FRAME_VECTOR_DATA ||
+        data[E131_DMP_VECTOR_OFFSET] != E131_DMP_VECTOR_SET)
+    {
+        countDroppedPacket(false);
+        return;
+    }
+
+    // Other universes, preview data and other start codes than the DMX data are not shown
+    uint8_t options = data[E131_OPTIONS_OFFSET];
+    if (readUint16(data + E131_UNIVERSE_OFFSET) != E131_UNIVERSE || (options & E131_OPTION_PREVIEW) ||
+        data[E131_START_CODE_OFFSET] != 0)
+        return;
+
+    uint8_t sequence = data[E131_SEQUENCE_OFFSET];
+    int8_t difference = sequence - lastE131Sequence;
+    if (e131SequenceValid && difference <= 0 && difference > -E131_LATE_WINDOW)
+    {
+        countDroppedPacket(true);
+        return;
+    }
+    lastE131Sequence = sequence;
+    e131SequenceValid = true;
+
+    // The sender ends the stream, return to the LED states right away
+    if (options & E131_OPTION_TERMINATED)
+    {
+        portENTER_CRITICAL(&frameMux);
+        streamTerminated = true;
+        portEXIT_CRITICAL(&frameMux);
+        e131SequenceValid = false;
+        return;
+    }
+
+    // The property count includes the start code
+    size_t channels = readUint16(data + E131_COUNT_OFFSET);
+    channels = channels > 0 ? min(channels - 1, length - E131_HEADER_SIZE) : 0;
+    memcpy(e131Frame, data + E131_HEADER_SIZE, min(channels, (size_t)REALTIME_FRAME_SIZE));
+
+    publishFrame(e131Frame, receivedAt);
+}
+
+/**
+ * @brief Opens a UDP socket listening on the port.
+ *
+ * @param port The port, 0 to let the stack choose a free one.
+ * @param boundPort Receives the port the socket is bound to.
+ * @return The socket, -1 on failure.
+ */
+int openUdpSocket(uint16_t port, uint16_t *boundPort)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+        return -1;
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    socklen_t addressLength = sizeof(address);
+    if (bind(sock, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        getsockname(sock, (struct sockaddr *)&address, &addressLength) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+
+    *boundPort = ntohs(address.sin_port);
+    return sock;
+}
+
+/**
+ * @brief Joins the multicast group of E131_UNIVERSE (239.255.<universe high>.<universe low>).
+ *
+ * @param sock The E1.31 socket.
+ */
+void joinE131Multicast(int sock)
+{
+    struct ip_mreq request = {};
+    request.imr_multiaddr.s_addr = htonl(0xEFFF0000 | E131_UNIVERSE);
+    request.imr_interface.s_addr = htonl(INADDR_ANY);
+
+    if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) < 0)
+        LOG_WARN("Realtime: failed to join the E1.31 multicast group");
+}
+
+/**
+ * @brief Requests joining the E1.31 multicast group after the WiFi link was restored.
+ *
+ * @param linkUp true if the link is up, false if it was lost.
+ */
+void onRealtimeLinkChange(bool linkUp)
+{
+    if (linkUp)
+        joinMulticast = true;
+}
+
+/**
+ * @brief Task receiving the DDP and E1.31 packets.
+ *
+ * @param pvParameters Pointer to the parameters passed to the task (not used).
+ */
+void realtimeTask(void *pvParameters)
+{
+    uint16_t ddpPort, e131Port;
+    int ddpSocket = openUdpSocket(requestedDdpPort, &ddpPort);
+    int e131Socket = openUdpSocket(requestedE131Port, &e131Port);
+    if (ddpSocket < 0 || e131Socket < 0)
+    {
+        Serial.println(F("Realtime: failed to open the UDP sockets"));
+        vTaskDelete(NULL);
+        return;
+    }
+
+    boundDdpPort = ddpPort;
+    boundE131Port = e131Port;
+    Serial.printf("Realtime: listening for DDP on port %u and E1.31 universe %d on port %u\n",
+                  ddpPort, E131_UNIVERSE, e131Port);
+
+    for (;;)
+    {
+        if (joinMulticast)
+        {
+            joinMulticast = false;
+            joinE131Multicast(e131Socket);
+        }
+
+        fd_set sockets;
+        FD_ZERO(&sockets);
+        FD_SET(ddpSocket, &sockets);
+        FD_SET(e131Socket, &sockets);
+
+        // Wake up periodically to join the multicast group after reconnections
+        struct timeval timeout = {1, 0};
+        if (select(max(ddpSocket, e131Socket) + 1, &sockets, NULL, NULL, &timeout) <= 0)
+            continue;
+
+        if (FD_ISSET(ddpSocket, &sockets))
+        {
+            int length = recv(ddpSocket, packet, sizeof(packet), 0);
+            if (length > 0)
+                decodeDdpPacket(packet, length, micros());
+        }
+
+        if (FD_ISSET(e131Socket, &sockets))
+        {
+            int length = recv(e131Socket, packet, sizeof(packet), 0);
+            if (length > 0)
+                decodeE131Packet(packet, length, micros());
+        }
+    }
+}
+
+/**
+ * @brief Starts the receiver of the realtime frames.
+ *
+ * PCs could stream whole frames with DDP (port 4048 by default) or E1.31 (port 5568 by
+ * default, universe E131_UNIVERSE, 3 channels per LED). While frames arrive, the LED task shows
+ * them instead of the LED states, REALTIME_TIMEOUT_MS after the last frame it returns to the
+ * LED states.
+ *
+ * @param ddpPort The DDP port, 0 for a free port chosen by the stack (see getRealtimePorts()).
+ * @param e131Port The E1.31 port, 0 for a free port chosen by the stack.
+ *
+ * @note This function should be called once during the setup phase of the program.
+ */
+void realtimeUdpInit(uint16_t ddpPort, uint16_t e131Port)
+{
+    requestedDdpPort = ddpPort;
+    requestedE131Port = e131Port;
+
+    addWiFiLinkListener(onRealtimeLinkChange);
+    if (WiFi.status() == WL_CONNECTED)
+        joinMulticast = true;
+
+    if (xTaskCreatePinnedToCore(realtimeTask,
+                                "realtimeTask",
+                                REALTIME_TASK_STACK_SIZE,
+                                NULL,
+                                REALTIME_TASK_PRIORITY,
+                                NULL,
+                                REALTIME_TASK_CORE) != pdPASS)
+    {
+        Serial.println("Failed to create realtimeTask");
+    }
+}
+
+/**
+ * @brief Returns the ports the receiver listens on.
+ *
+ * @param ddpPort Receives the DDP port.
+ * @param e131Port Receives the E1.31 port.
+ * @return true if the sockets are open, false if the receiver task has not opened them yet.
+ */
+bool getRealtimePorts(uint16_t *ddpPort, uint16_t *e131Port)
+{
+    *ddpPort = boundDdpPort;
+    *e131Port = boundE131Port;
+    return *ddpPort != 0 && *e131Port != 0;
+}
+
+/**
+ * @brief Copies the latest streamed frame for the LED task.
+ *
+ * @param target The LEDs to fill, LEDS_COUNT entries.
+ * @param receivedAtUs Receives the time when the frame was received (micros()).
+ * @return REALTIME_INACTIVE if no stream is shown, REALTIME_NEW_FRAME if a new frame was
+ * copied, REALTIME_NO_NEW_FRAME otherwise.
+ *
+ * @note Called by the LED task for every frame.
+ */
+RealtimeFrameResult takeRealtimeFrame(CRGB *target, uint32_t *receivedAtUs)
+{
+    RealtimeFrameResult result;
+    bool wasActive = streamActive;
+
+    portENTER_CRITICAL(&frameMux);
+    streamActive = !streamTerminated && lastFrameTime != 0 && clockMillis() - lastFrameTime < REALTIME_TIMEOUT_MS;
+    realtimeStats.active = streamActive;
+    if (!streamActive)
+    {
+        frameReady = false;
+        result = REALTIME_INACTIVE;
+    }
+    else if (frameReady)
+    {
+        memcpy((uint8_t *)target, readyFrame, REALTIME_FRAME_SIZE);
+        *receivedAtUs = frameReceivedAt;
+        frameReady = false;
+        result = REALTIME_NEW_FRAME;
+    }
+    else
+        result = REALTIME_NO_NEW_FRAME;
+    portEXIT_CRITICAL(&frameMux);
+
+    if (streamActive != wasActive)
+        LOG_INFO("Realtime stream %s", streamActive ? "started" : "ended, showing the LED states");
+
+    return result;
+}
+
+/**
+ * @brief Records the latency of a streamed frame after it was shown.
+ *
+ * @param receivedAtUs Time when the frame was received (micros()).
+ */
+void realtimeFrameShown(uint32_t receivedAtUs)
+{
+    uint32_t latencyUs = micros() - receivedAtUs;
+
+    portENTER_CRITICAL(&frameMux);
+    realtimeStats.shown++;
+    latencySumUs += latencyUs;
+    if (latencyUs > realtimeStats.latencyMaxUs)
+        realtimeStats.latencyMaxUs = latencyUs;
+    portEXIT_CRITICAL(&frameMux);
+}
+
+/**
+ * @brief Returns the counters of the realtime receiver.
+ *
+ * @return The counters.
+ */
+RealtimeStats getRealtimeStats()
+{
+    portENTER_CRITICAL(&frameMux);
+    RealtimeStats stats = realtimeStats;
+    stats.latencyAvgUs = stats.shown > 0 ? latencySumUs / stats.shown : 0;
+    portEXIT_CRITICAL(&frameMux);
+
+    return stats;
+}
+
+#endif // USE_REALTIME_UDP
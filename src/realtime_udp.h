@@ -0,0 +1,52 @@
+#ifndef REALTIME_UDP_H
+#define REALTIME_UDP_H
+
+#include <Arduino.h>
+#include "constants.h"
+#include "crgb.h"
+
+#ifdef USE_REALTIME_UDP
+
+// Default UDP ports of the protocols
+#define REALTIME_DDP_PORT  4048
+#define REALTIME_E131_PORT 5568
+
+// E1.31 universe carrying the LEDs, its multicast group is joined when the WiFi is connected
+#define E131_UNIVERSE 1
+
+// Time without frames after which the LED states are rendered again (in milliseconds)
+#define REALTIME_TIMEOUT_MS 2500
+
+// Size of a frame (in bytes)
+#define REALTIME_FRAME_SIZE (LEDS_COUNT * 3)
+
+// Result of taking the streamed frame by the LED task
+enum RealtimeFrameResult
+{
+    REALTIME_INACTIVE,     // No stream, the LED states are rendered
+    REALTIME_NO_NEW_FRAME, // Stream active, but no frame arrived since the last one
+    REALTIME_NEW_FRAME     // Stream active and a new frame was copied
+};
+
+// Counters of the realtime receiver
+struct RealtimeStats
+{
+    bool active;           // Whether a stream is shown instead of the LED states
+    uint32_t frames;       // Complete frames received
+    uint32_t shown;        // Frames shown on the LED strip
+    uint32_t replaced;     // Frames replaced by a newer one before they were shown
+    uint32_t late;         // Packets dropped because their sequence number was older than the last one
+    uint32_t invalid;      // Packets that are not valid DDP or E1.31 data
+    uint32_t latencyAvgUs; // Average time from the reception of a frame to the end of its output
+    uint32_t latencyMaxUs; // Largest time from the reception of a frame to the end of its output
+};
+
+void realtimeUdpInit(uint16_t ddpPort = REALTIME_DDP_PORT, uint16_t e131Port = REALTIME_E131_PORT);
+bool getRealtimePorts(uint16_t *ddpPort, uint16_t *e131Port);
+RealtimeFrameResult takeRealtimeFrame(CRGB *target, uint32_t *receivedAtUs);
+void realtimeFrameShown(uint32_t receivedAtUs);
+RealtimeStats getRealtimeStats();
+
+#endif // USE_REALTIME_UDP
+
+#endif // REALTIME_UDP_H
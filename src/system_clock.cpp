@@ -0,0 +1,76 @@
+#include <esp_timer.h>
+#include "system_clock.h"
+
+/**
+ * @brief Returns the time of the high resolution timer.
+ *
+ * @return The time since boot in microseconds.
+ */
+uint64_t espTimerClock()
+{
+    return esp_timer_get_time();
+}
+
+// Current source of the time
+static volatile ClockSource clockSource = espTimerClock;
+
+/**
+ * @brief Replaces the source of the time used by the time-dependent behavior of the modules.
+ *
+ * A simulated source makes the fades, the backoffs and the periodic publishes run faster than
+ * real time or start close to the rollover of the 32-bit millisecond time. Durations measured
+ * for the statistics still use the hardware timers.
+ *
+ * @param source The new source, NULL restores the high resolution timer.
+ */
+void setClockSource(ClockSource source)
+{
+    clockSource = source != NULL ? source : espTimerClock;
+}
+
+/**
+ * @brief Returns the monotonic time that does not roll over.
+ *
+ * @return The time since boot in microseconds.
+ */
+uint64_t clockMicros64()
+{
+    return clockSource();
+}
+
+/**
+ * @brief Returns the time in milliseconds, the replacement of millis().
+ *
+ * The value rolls over after about 49 days. Intervals must be computed as the unsigned
+ * difference of two values (timeNow - since), deadlines compared with clockReached().
+ *
+ * @return The time since boot in milliseconds, truncated to 32 bits.
+ */
+uint32_t clockMillis()
+{
+    return (uint32_t)(clockSource() / 1000);
+}
+
+/**
+ * @brief Returns the uptime that does not roll over after 49 days.
+ *
+ * @return The time since boot in seconds.
+ */
+uint32_t clockUptimeSeconds()
+{
+    return (uint32_t)(clockSource() / 1000000);
+}
+
+/**
+ * @brief Checks whether the deadline has passed, also across the rollover of the time.
+ *
+ * The deadline must be less than about 24 days away from the current time.
+ *
+ * @param timeNow The current time in milliseconds.
+ * @param deadline The deadline in milliseconds.
+ * @return true if the deadline is reached, false otherwise.
+ */
+bool clockReached(uint32_t timeNow, uint32_t deadline)
+{
+    return (int32_t)(timeNow - deadline) >= 0;
+}
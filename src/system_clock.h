@@ -0,0 +1,15 @@
+#ifndef SYSTEM_CLOCK_H
+#define SYSTEM_CLOCK_H
+
+#include <Arduino.h>
+
+// Source of the monotonic time in microseconds since boot
+typedef uint64_t (*ClockSource)();
+
+void setClockSource(ClockSource source);
+uint64_t clockMicros64();
+uint32_t clockMillis();
+uint32_t clockUptimeSeconds();
+bool clockReached(uint32_t timeNow, uint32_t deadline);
+
+#endif // SYSTEM_CLOCK_H
@@ -0,0 +1,273 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_freertos_hooks.h>
+#include <esp_timer.h>
+#include "task_monitor.h"
+#include "logger.h"
+
+// Free stack of a task below which a warning is logged (in bytes)
+#define TASK_STACK_WARNING_BYTES 512
+
+// Longest gap between two runs of the idle hook of a core still counted as idle time (in microseconds).
+// The idle task waits for an interrupt after the hooks, so an idle core runs them at least every tick
+#define IDLE_HOOK_MAX_GAP_US (portTICK_PERIOD_MS * 1000 + 200)
+
+// Number of cores measured by the idle hooks
+#define TASK_MONITOR_CORES 2
+
+// The CPU usage requires the run time counters of FreeRTOS, which are disabled in the stock Arduino core
+#if configUSE_TRACE_FACILITY == 1 && configGENERATE_RUN_TIME_STATS == 1
+#define TASK_MONITOR_RUN_TIME_STATS 1
+#else
+#define TASK_MONITOR_RUN_TIME_STATS 0
+#endif
+
+// Idle time of a core measured by its idle hook
+struct IdleCounter
+{
+    int64_t lastHookUs; // Time of the previous run of the hook, 0 before the first one
+    uint64_t idleUs;    // Idle time since the hook was registered
+};
+
+// Idle counters of the cores, written by the idle hooks and guarded by idleMux
+static IdleCounter idleCounters[TASK_MONITOR_CORES];
+static portMUX_TYPE idleMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Whether the idle hooks were registered by the first sample
+static bool idleHooksRegistered = false;
+// Idle times of the cores and the time at the previous sample
+static uint64_t previousIdleUs[TASK_MONITOR_CORES];
+static int64_t previousSampleUs = 0;
+
+#if TASK_MONITOR_RUN_TIME_STATS
+// Run time counter of a task at the previous sample
+struct TaskCounter
+{
+    TaskHandle_t handle;
+    uint32_t runTime;
+};
+
+static TaskStatus_t taskStatus[TASK_MONITOR_MAX_TASKS];
+static TaskCounter previousCounters[TASK_MONITOR_MAX_TASKS];
+static uint8_t previousCount = 0;
+static uint32_t previousTotalRunTime = 0;
+#else
+// Tasks looked up by name when the task list of FreeRTOS is not available
+static const char *const monitoredTaskNames[] = {
+    "loopTask", "ledsTask", "haClientTask", "loggerTask", "realtimeTask", "otaTask",
+    "otaReceiverTask", "async_tcp", "wifi", "tiT", "sys_evt", "esp_timer"};
+#endif
+
+/**
+ * @brief Adds the time since the previous run of the idle hook to the idle time of the core.
+ *
+ * Gaps longer than IDLE_HOOK_MAX_GAP_US mean that other tasks ran on the core, they are counted
+ * as busy. Bursts of tasks shorter than that are counted as idle.
+ *
+ * @param cpu The core running the hook.
+ */
+void recordIdleHook(uint8_t cpu)
+{
+    int64_t timeNow = esp_timer_get_time();
+
+    portENTER_CRITICAL(&idleMux);
+    IdleCounter &counter = idleCounters[cpu];
+    int64_t gap = timeNow - counter.lastHookUs;
+    if (counter.lastHookUs != 0 && gap <= IDLE_HOOK_MAX_GAP_US)
+        counter.idleUs += gap;
+    counter.lastHookUs = timeNow;
+    portEXIT_CRITICAL(&idleMux);
+}
+
+/**
+ * @brief Idle hook of core 0.
+ *
+ * @return true to let the idle task wait for the next interrupt.
+ */
+bool idleHookCore0()
+{
+    recordIdleHook(0);
+    return true;
+}
+
+/**
+ * @brief Idle hook of core 1.
+ *
+ * @return true to let the idle task wait for the next interrupt.
+ */
+bool idleHookCore1()
+{
+    recordIdleHook(1);
+    return true;
+}
+
+/**
+ * @brief Computes the load of the cores from the idle time since the previous sample.
+ *
+ * The hooks are registered by the first call, which reports no load. The load does not need
+ * the run time counters of FreeRTOS.
+ *
+ * @param usage The sample.
+ */
+void sampleCoreLoad(SystemUsage &usage)
+{
+    static const esp_freertos_idle_cb_t idleHooks[TASK_MONITOR_CORES] = {idleHookCore0, idleHookCore1};
+
+    int64_t timeNow = esp_timer_get_time();
+    uint64_t idleUs[TASK_MONITOR_CORES];
+
+    portENTER_CRITICAL(&idleMux);
+    for (uint8_t cpu = 0; cpu < TASK_MONITOR_CORES; cpu++)
+        idleUs[cpu] = idleCounters[cpu].idleUs;
+    portEXIT_CRITICAL(&idleMux);
+
+    if (!idleHooksRegistered)
+    {
+        idleHooksRegistered = true;
+        for (uint8_t cpu = 0; cpu < portNUM_PROCESSORS && cpu < TASK_MONITOR_CORES; cpu++)
+        {
+            if (esp_register_freertos_idle_hook_for_cpu(idleHooks[cpu], cpu) != ESP_OK)
+                LOG_ERROR("Failed to register the idle hook of core %u", cpu);
+        }
+    }
+    else if (timeNow > previousSampleUs)
+    {
+        uint64_t interval = timeNow - previousSampleUs;
+        for (uint8_t cpu = 0; cpu < TASK_MONITOR_CORES; cpu++)
+        {
+            uint64_t busy = interval - min(idleUs[cpu] - previousIdleUs[cpu], interval);
+            usage.coreLoad[cpu] = (busy * 100 + interval / 2) / interval;
+        }
+        usage.cpuAvailable = true;
+    }
+
+    for (uint8_t cpu = 0; cpu < TASK_MONITOR_CORES; cpu++)
+        previousIdleUs[cpu] = idleUs[cpu];
+    previousSampleUs = timeNow;
+}
+
+/**
+ * @brief Adds the task to the sample and warns if the task is close to overflowing its stack.
+ *
+ * @param usage The sample.
+ * @param name The name of the task.
+ * @param stackFreeBytes The smallest amount of free stack of the task.
+ * @param cpuPercent The share of the core time of the task.
+ * @param core The core the task is pinned to, -1 if not pinned or not known.
+ */
+void addTaskUsage(SystemUsage &usage, const char *name, uint32_t stackFreeBytes, uint8_t cpuPercent, int8_t core)
+{
+    if (usage.taskCount >= TASK_MONITOR_MAX_TASKS)
+        return;
+
+    TaskUsage &task = usage.tasks[usage.taskCount++];
+    strlcpy(task.name, name, sizeof(task.name));
+    task.stackFreeBytes = stackFreeBytes;
+    task.cpuPercent = cpuPercent;
+    task.core = core;
+
+    if (stackFreeBytes < TASK_STACK_WARNING_BYTES)
+        LOG_WARN("Task %s has only %u bytes of free stack", name, stackFreeBytes);
+}
+
+#if TASK_MONITOR_RUN_TIME_STATS
+/**
+ * @brief Returns the run time counter of the task at the previous sample.
+ *
+ * @param handle The handle of the task.
+ * @return The counter, 0 if the task was created after the previous sample.
+ */
+uint32_t getPreviousRunTime(TaskHandle_t handle)
+{
+    for (uint8_t i = 0; i < previousCount; i++)
+    {
+        if (previousCounters[i].handle == handle)
+            return previousCounters[i].runTime;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Adds the stacks and the CPU usage of all tasks to the sample.
+ *
+ * The shares are computed from the difference of the run time counters since the previous
+ * sample. Every core runs for the whole interval, so a task fully using one core has 100 %.
+ *
+ * @param usage The sample.
+ */
+void sampleTasks(SystemUsage &usage)
+{
+    uint32_t totalRunTime;
+    UBaseType_t count = uxTaskGetSystemState(taskStatus, TASK_MONITOR_MAX_TASKS, &totalRunTime);
+    if (count == 0)
+    {
+        LOG_WARN("Too many tasks to monitor, increase TASK_MONITOR_MAX_TASKS");
+        return;
+    }
+
+    uint32_t interval = totalRunTime - previousTotalRunTime;
+    bool sharesAvailable = previousTotalRunTime != 0 && interval != 0;
+
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        const TaskStatus_t &status = taskStatus[i];
+        uint32_t busy = status.ulRunTimeCounter - getPreviousRunTime(status.xHandle);
+        uint8_t cpuPercent = sharesAvailable ? min((uint64_t)busy * 100 / interval, (uint64_t)100) : 0;
+
+#if configTASKLIST_INCLUDE_COREID
+        int8_t core = status.xCoreID < portNUM_PROCESSORS ? status.xCoreID : -1;
+#else
+        int8_t core = -1;
+#endif
+        addTaskUsage(usage, status.pcTaskName, status.usStackHighWaterMark, cpuPercent, core);
+
+        previousCounters[i].handle = status.xHandle;
+        previousCounters[i].runTime = status.ulRunTimeCounter;
+    }
+
+    previousCount = count;
+    previousTotalRunTime = totalRunTime;
+}
+#else
+/**
+ * @brief Adds the stacks of the known tasks to the sample.
+ *
+ * Without the run time counters only the stack high-water marks are available.
+ *
+ * @param usage The sample.
+ */
+void sampleTasks(SystemUsage &usage)
+{
+    for (const char *name : monitoredTaskNames)
+    {
+        TaskHandle_t handle = xTaskGetHandle(name);
+        if (handle != NULL)
+            addTaskUsage(usage, name, uxTaskGetStackHighWaterMark(handle), 0, -1);
+    }
+}
+#endif
+
+/**
+ * @brief Samples the heap, the stacks and the CPU usage of the tasks.
+ *
+ * The CPU usage covers the time since the previous call, so the function should be called
+ * periodically. The stack sizes on the ESP32 are in bytes. The first sample reports no CPU usage.
+ * The load of the cores is measured by the idle hooks, the shares of the tasks need
+ * configGENERATE_RUN_TIME_STATS and are 0 without it.
+ *
+ * @param usage Receives the sample.
+ */
+void sampleSystemUsage(SystemUsage &usage)
+{
+    usage.freeHeap = ESP.getFreeHeap();
+    usage.minFreeHeap = ESP.getMinFreeHeap();
+    usage.largestFreeBlock = ESP.getMaxAllocHeap();
+    usage.cpuAvailable = false;
+    usage.coreLoad[0] = 0;
+    usage.coreLoad[1] = 0;
+    usage.taskCount = 0;
+
+    sampleCoreLoad(usage);
+    sampleTasks(usage);
+}
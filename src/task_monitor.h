@@ -0,0 +1,34 @@
+#ifndef TASK_MONITOR_H
+#define TASK_MONITOR_H
+
+#include <Arduino.h>
+
+// Maximum number of tasks reported in one sample
+#define TASK_MONITOR_MAX_TASKS 24
+// Maximum length of a task name, including the terminator
+#define TASK_MONITOR_NAME_SIZE 16
+
+// Usage of one task
+struct TaskUsage
+{
+    char name[TASK_MONITOR_NAME_SIZE]; // Name of the task
+    uint32_t stackFreeBytes;           // Smallest amount of free stack since the task was created
+    uint8_t cpuPercent;                // Share of the core time since the previous sample, 0 without FreeRTOS run time stats
+    int8_t core;                       // Core the task is pinned to, -1 if not pinned or not known
+};
+
+// Usage of the system since the previous sample
+struct SystemUsage
+{
+    uint32_t freeHeap;                       // Free heap (in bytes)
+    uint32_t minFreeHeap;                    // Smallest free heap since boot (in bytes)
+    uint32_t largestFreeBlock;               // Largest block that could be allocated (in bytes)
+    bool cpuAvailable;                       // Whether the load of the cores was measured (not in the first sample)
+    uint8_t coreLoad[2];                     // Busy time of each core (in percent)
+    uint8_t taskCount;                       // Number of tasks in the sample
+    TaskUsage tasks[TASK_MONITOR_MAX_TASKS]; // Usage of the tasks
+};
+
+void sampleSystemUsage(SystemUsage &usage);
+
+#endif // TASK_MONITOR_H
@@ -6,11 +6,14 @@
  */
 
 #include <LittleFS.h>
-#include <WiFiMulti.h>
+#include <WiFi.h>
+#include "boot_trace.h"
+#include "config_store.h"
 #include "constants.h"
 #include "custom_html.h"
 #include "drd.h"
 #include "leds.h"
+#include "system_clock.h"
 #include "wifi_manager.h"
 
 // Configure AsyncWiFiManager
@@ -19,7 +22,13 @@
 #define USE_STATIC_IP_CONFIG_IN_CP false
 #include <ESPAsync_WiFiManager.h> //https://github.com/khoih-prog/ESPAsync_WiFiManager
 
-#define CONFIG_FILENAME F("/wifi_cred.dat")
+// Files used by the previous firmware versions, migrated to the config store
+#define LEGACY_CONFIG_FILENAME       F("/wifi_cred.dat")
+#define LEGACY_FAST_CONNECT_FILENAME F("/wifi_fast.dat")
+
+// Keys of the records in the config store
+#define CONFIG_KEY_WIFI_CREDENTIALS "wifi.creds"
+#define CONFIG_KEY_WIFI_FAST        "wifi.fast"
 
 #define MIN_AP_PASSWORD_SIZE 8
 
@@ -29,10 +38,15 @@
 #define HTTP_PORT            80
 #define NUM_WIFI_CREDENTIALS 2
 
-#define WIFI_MULTI_1ST_CONNECT_WAITING_MS 800L
-#define WIFI_MULTI_CONNECT_WAITING_MS     500L
+// How long to wait for the scan results and for the connection after the scan
+#define WIFI_SCAN_TIMEOUT_MS    10000L
+#define WIFI_CONNECT_TIMEOUT_MS 10000L
+
+// Marks the lease age kept in the RTC memory as valid
+#define WIFI_LEASE_AGE_MAGIC 0x1EA5E0A6
 
-#define WIFI_CHECK_INTERVAL 1000L
+// Maximum number of WiFi link listeners
+#define WIFI_MAX_LINK_LISTENERS 4
 
 typedef struct
 {
@@ -46,6 +60,7 @@ typedef struct
     String wifi_pw;
 } WiFi_Credentials_String;
 
+// Layout of the legacy credentials file, only the credentials are kept in the config store
 typedef struct
 {
     WiFi_Credentials WiFi_Creds[NUM_WIFI_CREDENTIALS];
@@ -54,7 +69,64 @@ typedef struct
 
 WM_Config WM_config;
 
-WiFiMulti wifiMulti;
+// Access point and DHCP lease of the last successful connection, used to skip scanning and DHCP
+typedef struct
+{
+    char wifi_ssid[SSID_MAX_LEN];
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t localIP;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+} WiFi_FastConnect;
+
+WiFi_FastConnect fastConnectConfig;
+bool fastConnectLoaded = false;
+
+// Age of the cached lease. It is kept in the RTC memory, which is not initialized on reset, so
+// it survives software resets. After a power loss the age is unknown and the lease is not used
+typedef struct
+{
+    uint32_t magic;
+    uint32_t localIP; // Lease the age belongs to
+    uint32_t ageMs;   // Age of the lease at the last call of handleWiFi()
+} WiFi_LeaseAge;
+
+RTC_NOINIT_ATTR static WiFi_LeaseAge rtcLeaseAge;
+bool leaseAgeKnown = false;    // The time when the cached lease was obtained is known
+uint32_t leaseObtainedAt = 0;  // Time when the cached lease was obtained by DHCP
+bool usingCachedLease = false; // The established link uses the cached lease as a static IP
+
+// Statistics of the WiFi connections
+WiFiConnectStats wifiConnectStats;
+
+// States of the WiFi supervisor
+enum WiFiState
+{
+    WIFI_STATE_IDLE,            // Not started yet
+    WIFI_STATE_FAST_CONNECTING, // Connecting to the cached access point
+    WIFI_STATE_SCANNING,        // Waiting for the scan results
+    WIFI_STATE_CONNECTING,      // Connecting to the network found by the scan
+    WIFI_STATE_CONNECTED,       // Connected and got IP address
+    WIFI_STATE_BACKOFF          // Waiting before the next connection attempt
+};
+
+WiFiState wifiState = WIFI_STATE_IDLE;
+uint32_t wifiStateSince = 0;    // Time of the last state change
+uint32_t connectStartedAt = 0;  // Time when the link was lost or the supervisor started
+uint8_t failedAttempts = 0;     // Number of failed connection attempts in a row
+uint32_t backoffDelay = 0;      // Delay before the next connection attempt
+
+// Events recorded by the WiFi event handler and processed by the supervisor
+static volatile bool gotIpEvent = false;
+static volatile bool disconnectedEvent = false;
+static volatile uint8_t disconnectReason = 0;
+
+// Listeners notified about the link changes
+WiFiLinkListener linkListeners[WIFI_MAX_LINK_LISTENERS];
+uint8_t linkListenersCount = 0;
+
 FS *filesystem;
 
 // SSID and PW for your Router
@@ -64,62 +136,450 @@ String Router_Pass;
 // Indicates whether ESP has WiFi credentials saved from previous session, or double reset detected
 bool initialConfig; // = false;
 
-void connectMultiWiFi()
+int calcChecksum(uint8_t *address, uint16_t sizeToCalc);
+void wifiConnectFailed();
+
+/**
+ * @brief Loads the parameters of the last successful connection from the config store.
+ *
+ * The age of the lease is restored from the RTC memory if it belongs to the loaded lease.
+ *
+ * @return true if valid parameters were loaded, false otherwise.
+ */
+bool loadFastConnectData()
 {
-    // Indicate connecting to WiFi
-    circleLedEffect(CRGB::Blue, CIRCLE_EFFECT_SLOW_FADE_DURATION, LOOP_INDEFINITELY);
+    memset((void *)&fastConnectConfig, 0, sizeof(fastConnectConfig));
+    leaseAgeKnown = false;
 
-    LOGERROR(F("ConnectMultiWiFi with :"));
+    if (configGetBlob(CONFIG_KEY_WIFI_FAST, &fastConnectConfig, sizeof(fastConnectConfig)) != sizeof(fastConnectConfig))
+    {
+        memset((void *)&fastConnectConfig, 0, sizeof(fastConnectConfig));
+        return false;
+    }
 
-    if ((Router_SSID != "") && (Router_Pass != ""))
+    if (rtcLeaseAge.magic == WIFI_LEASE_AGE_MAGIC && rtcLeaseAge.localIP == fastConnectConfig.localIP)
     {
-        LOGERROR3(F("* Flash-stored Router_SSID = "), Router_SSID, F(", Router_Pass = "), Router_Pass);
-        LOGERROR3(F("* Add SSID = "), Router_SSID, F(", PW = "), Router_Pass);
-        wifiMulti.addAP(Router_SSID.c_str(), Router_Pass.c_str());
+        leaseObtainedAt = clockMillis() - rtcLeaseAge.ageMs;
+        leaseAgeKnown = true;
     }
 
+    return true;
+}
+
+/**
+ * @brief Records that the cached lease was just obtained by DHCP.
+ */
+void resetLeaseAge()
+{
+    leaseObtainedAt = clockMillis();
+    leaseAgeKnown = true;
+    rtcLeaseAge.magic = WIFI_LEASE_AGE_MAGIC;
+    rtcLeaseAge.localIP = fastConnectConfig.localIP;
+    rtcLeaseAge.ageMs = 0;
+}
+
+/**
+ * @brief Updates the age of the lease in the RTC memory, so it is known after a software reset.
+ */
+void updateLeaseAge()
+{
+    if (leaseAgeKnown)
+        rtcLeaseAge.ageMs = clockMillis() - leaseObtainedAt;
+}
+
+/**
+ * @brief Checks if the cached lease can still be used as a static IP.
+ *
+ * @return true if the age of the lease is known and below WIFI_LEASE_MAX_AGE_MS.
+ */
+bool isLeaseFresh()
+{
+    return leaseAgeKnown && clockMillis() - leaseObtainedAt < (uint32_t)WIFI_LEASE_MAX_AGE_MS;
+}
+
+/**
+ * @brief Saves the access point and IP configuration of the current connection.
+ *
+ * Called after DHCP, so the age of the cached lease starts over. The data are written only if
+ * they differ from the stored ones to avoid unnecessary flash writes.
+ */
+void saveFastConnectData()
+{
+    WiFi_FastConnect config;
+    memset((void *)&config, 0, sizeof(config));
+
+    strncpy(config.wifi_ssid, WiFi.SSID().c_str(), sizeof(config.wifi_ssid) - 1);
+    memcpy(config.bssid, WiFi.BSSID(), sizeof(config.bssid));
+    config.channel = WiFi.channel();
+    config.localIP = WiFi.localIP();
+    config.gateway = WiFi.gatewayIP();
+    config.subnet = WiFi.subnetMask();
+    config.dns = WiFi.dnsIP(0);
+
+    if (fastConnectLoaded && memcmp(&config, &fastConnectConfig, sizeof(config)) == 0)
+    {
+        resetLeaseAge();
+        return;
+    }
+
+    if (configSetBlob(CONFIG_KEY_WIFI_FAST, &config, sizeof(config)) && configStoreCommit())
+    {
+        fastConnectConfig = config;
+        fastConnectLoaded = true;
+        resetLeaseAge();
+        Serial.println(F("WiFi fast connect data saved"));
+    }
+}
+
+/**
+ * @brief Removes the parameters of the last successful connection, so the next connection scans.
+ */
+void clearFastConnectData()
+{
+    fastConnectLoaded = false;
+    leaseAgeKnown = false;
+    rtcLeaseAge.magic = 0;
+    if (configRemove(CONFIG_KEY_WIFI_FAST))
+        configStoreCommit();
+}
+
+/**
+ * @brief Returns the stored password for the given SSID.
+ *
+ * @param ssid The SSID of the network.
+ * @return The password, or NULL if the network is not known.
+ */
+const char *findWiFiPassword(const char *ssid)
+{
+    if (Router_SSID == ssid && Router_Pass != "")
+        return Router_Pass.c_str();
+
     for (uint8_t i = 0; i < NUM_WIFI_CREDENTIALS; i++)
     {
-        // Don't permit NULL SSID and password len < MIN_AP_PASSWORD_SIZE (8)
-        if ((String(WM_config.WiFi_Creds[i].wifi_ssid) != "") && (strlen(WM_config.WiFi_Creds[i].wifi_pw) >= MIN_AP_PASSWORD_SIZE))
-        {
-            LOGERROR3(F("* Additional SSID = "), WM_config.WiFi_Creds[i].wifi_ssid, F(", PW = "), WM_config.WiFi_Creds[i].wifi_pw);
-        }
+        if (strcmp(WM_config.WiFi_Creds[i].wifi_ssid, ssid) == 0 && strlen(WM_config.WiFi_Creds[i].wifi_pw) >= MIN_AP_PASSWORD_SIZE)
+            return WM_config.WiFi_Creds[i].wifi_pw;
     }
 
-    LOGERROR(F("Connecting MultiWifi..."));
+    return NULL;
+}
 
-    int i = 0;
+/**
+ * @brief Updates the connection statistics after a successful connection.
+ *
+ * @param startedAt Time when the connection attempt started (in milliseconds).
+ * @param fastPath true if connected using the cached access point and IP configuration.
+ */
+void recordWiFiConnection(uint32_t startedAt, bool fastPath)
+{
+    uint32_t timeNow = clockMillis();
+
+    wifiConnectStats.lastConnectMs = timeNow - startedAt;
+    wifiConnectStats.lastFastPath = fastPath;
+    if (fastPath)
+        wifiConnectStats.fastConnects++;
+    else
+        wifiConnectStats.scanConnects++;
 
-    uint8_t status = wifiMulti.run();
-    delay(WIFI_MULTI_1ST_CONNECT_WAITING_MS);
+    // The first connection since boot
+    if (wifiConnectStats.bootToConnectedMs == 0)
+        wifiConnectStats.bootToConnectedMs = timeNow;
+
+    Serial.printf("WiFi connected using %s in %u ms, boot to connected: %u ms\n",
+                  fastPath ? "fast path" : "scan", wifiConnectStats.lastConnectMs, wifiConnectStats.bootToConnectedMs);
+}
+
+/**
+ * @brief Returns the statistics of the WiFi connections.
+ *
+ * @return The statistics.
+ */
+const WiFiConnectStats &getWiFiConnectStats()
+{
+    return wifiConnectStats;
+}
+
+/**
+ * @brief Changes the state of the WiFi supervisor.
+ *
+ * @param state The new state.
+ */
+void setWiFiState(WiFiState state)
+{
+    wifiState = state;
+    wifiStateSince = clockMillis();
+}
 
-    while ((i++ < 20) && (status != WL_CONNECTED))
+/**
+ * @brief Notifies the link listeners about the link change.
+ *
+ * @param linkUp true if the link is up, false if it was lost.
+ */
+void notifyWiFiLinkListeners(bool linkUp)
+{
+    for (uint8_t i = 0; i < linkListenersCount; i++)
+        linkListeners[i](linkUp);
+}
+
+/**
+ * @brief Registers a listener called from the loop task when the WiFi link goes up or down.
+ *
+ * If the link is already up, the listener is called immediately.
+ *
+ * @param listener The listener to register.
+ * @return true if the listener was registered, false if there is no free slot.
+ */
+bool addWiFiLinkListener(WiFiLinkListener listener)
+{
+    if (linkListenersCount >= WIFI_MAX_LINK_LISTENERS)
     {
-        status = WiFi.status();
+        Serial.println(F("Too many WiFi link listeners"));
+        return false;
+    }
 
-        if (status == WL_CONNECTED)
-            break;
-        else
-            delay(WIFI_MULTI_CONNECT_WAITING_MS);
+    linkListeners[linkListenersCount++] = listener;
+
+    if (wifiState == WIFI_STATE_CONNECTED)
+        listener(true);
+
+    return true;
+}
+
+/**
+ * @brief Handles the WiFi events. Runs in the WiFi event task, so it only records the events.
+ *
+ * @param event The event ID.
+ * @param info The event information.
+ */
+void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+{
+    switch (event)
+    {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        gotIpEvent = true;
+        break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        disconnectReason = info.wifi_sta_disconnected.reason;
+        disconnectedEvent = true;
+        break;
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+        disconnectedEvent = true;
+        break;
+    default:
+        break;
     }
+}
 
-    if (status == WL_CONNECTED)
+/**
+ * @brief Starts a scan of the networks without waiting for its result.
+ */
+void startWiFiScan()
+{
+    // A scan could not run while the station is connecting
+    WiFi.disconnect();
+
+    // The connection after the scan obtains a new lease
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+
+    // Entered before the scan starts, so its failure is not handled as a failed fast connection again
+    setWiFiState(WIFI_STATE_SCANNING);
+
+    if (WiFi.scanNetworks(true) == WIFI_SCAN_FAILED)
     {
-        // Indicate WiFi connected with purple color (waiting for AWS connection)
-        circleLedEffect(CRGB::Purple, CIRCLE_EFFECT_FAST_FADE_DURATION, LOOP_INDEFINITELY);
+        Serial.println(F("WiFi scan could not be started"));
+        wifiConnectFailed();
+    }
+}
+
+/**
+ * @brief Starts connecting to the access point of the last successful connection.
+ *
+ * The cached BSSID and channel let the station join without a scan and the cached lease is
+ * configured as a static IP, so DHCP is skipped too. The lease is only used while it is
+ * younger than WIFI_LEASE_MAX_AGE_MS, otherwise the connection scans and obtains a new one.
+ *
+ * @return true if the connection was started, false if there is no usable cached access point.
+ */
+bool beginFastConnect()
+{
+    if (!fastConnectLoaded)
+        return false;
 
-        LOGERROR1(F("WiFi connected after time: "), i);
-        LOGERROR3(F("SSID:"), WiFi.SSID(), F(",RSSI="), WiFi.RSSI());
-        LOGERROR3(F("Channel:"), WiFi.channel(), F(",IP address:"), WiFi.localIP());
+    if (!isLeaseFresh())
+    {
+        Serial.println(F("WiFi cached lease is stale or of unknown age"));
+        return false;
     }
-    else
+
+    const char *password = findWiFiPassword(fastConnectConfig.wifi_ssid);
+    if (password == NULL)
+    {
+        clearFastConnectData();
+        return false;
+    }
+
+    Serial.printf("WiFi fast connect to %s, channel %u\n", fastConnectConfig.wifi_ssid, fastConnectConfig.channel);
+
+    WiFi.config(IPAddress(fastConnectConfig.localIP), IPAddress(fastConnectConfig.gateway),
+                IPAddress(fastConnectConfig.subnet), IPAddress(fastConnectConfig.dns));
+    WiFi.begin(fastConnectConfig.wifi_ssid, password, fastConnectConfig.channel, fastConnectConfig.bssid);
+
+    setWiFiState(WIFI_STATE_FAST_CONNECTING);
+    return true;
+}
+
+/**
+ * @brief Connects to the known network with the strongest signal from the scan results.
+ *
+ * @param networksCount Number of networks found by the scan.
+ */
+void connectToBestNetwork(int16_t networksCount)
+{
+    int16_t best = -1;
+    for (int16_t i = 0; i < networksCount; i++)
+    {
+        if (findWiFiPassword(WiFi.SSID(i).c_str()) != NULL && (best < 0 || WiFi.RSSI(i) > WiFi.RSSI(best)))
+            best = i;
+    }
+
+    if (best < 0)
+    {
+        Serial.printf("WiFi scan found %d networks, none of them is known\n", networksCount);
+        WiFi.scanDelete();
+        wifiConnectFailed();
+        return;
+    }
+
+    String ssid = WiFi.SSID(best);
+    uint8_t bssid[6];
+    memcpy(bssid, WiFi.BSSID(best), sizeof(bssid));
+    int32_t channel = WiFi.channel(best);
+    Serial.printf("WiFi connecting to %s, channel %d, RSSI %d\n", ssid.c_str(), channel, WiFi.RSSI(best));
+    WiFi.scanDelete();
+
+    WiFi.begin(ssid.c_str(), findWiFiPassword(ssid.c_str()), channel, bssid);
+    setWiFiState(WIFI_STATE_CONNECTING);
+}
+
+/**
+ * @brief Starts a connection attempt, using the fast path if possible.
+ */
+void startWiFiConnect()
+{
+    if (!beginFastConnect())
+        startWiFiScan();
+}
+
+/**
+ * @brief Handles a failed connection attempt.
+ *
+ * A failed fast connection falls back to the scan right away. Other failures wait with
+ * a graded backoff from WIFI_BACKOFF_INITIAL_MS up to WIFI_BACKOFF_MAX_MS.
+ */
+void wifiConnectFailed()
+{
+    if (wifiState == WIFI_STATE_FAST_CONNECTING)
     {
-        LOGERROR(F("WiFi not connected"));
+        Serial.println(F("WiFi fast connect failed, falling back to scanning"));
 
-        // Restart after unsuccessful connection
-        ESP.restart();
+        // Forget the cached access point, the scan enables DHCP again
+        clearFastConnectData();
+        startWiFiScan();
+        return;
     }
+
+    failedAttempts++;
+    uint8_t shift = min(failedAttempts - 1, 16);
+    backoffDelay = min((uint32_t)WIFI_BACKOFF_INITIAL_MS << shift, (uint32_t)WIFI_BACKOFF_MAX_MS);
+
+    Serial.printf("WiFi not connected (attempt %u), retrying in %u ms\n", failedAttempts, backoffDelay);
+    WiFi.disconnect();
+    setWiFiState(WIFI_STATE_BACKOFF);
+}
+
+/**
+ * @brief Handles the established connection.
+ *
+ * A fast connection keeps the cached lease as a static IP. DHCP is not started on the
+ * established link, as it would clear the address of the open connections until the new
+ * lease arrives. Once the lease is older than WIFI_LEASE_MAX_AGE_MS, the supervisor renews
+ * it by a planned reconnection through the scan, see renewStaleLease().
+ */
+void wifiConnected()
+{
+    bool fastPath = wifiState == WIFI_STATE_FAST_CONNECTING;
+    usingCachedLease = fastPath;
+
+    recordWiFiConnection(connectStartedAt, fastPath);
+    bootTraceMark(BOOT_STAGE_WIFI_CONNECTED);
+    if (!fastPath)
+        saveFastConnectData();
+
+    failedAttempts = 0;
+    setWiFiState(WIFI_STATE_CONNECTED);
+
+    LOGERROR3(F("SSID:"), WiFi.SSID(), F(",RSSI="), WiFi.RSSI());
+    LOGERROR3(F("Channel:"), WiFi.channel(), F(",IP address:"), WiFi.localIP());
+
+    notifyWiFiLinkListeners(true);
+}
+
+/**
+ * @brief Reconnects through the scan and DHCP once the cached lease used by the link is stale.
+ *
+ * The router could give the address to another device after the lease expired, so the link
+ * must not keep it longer than WIFI_LEASE_MAX_AGE_MS. The listeners see the planned
+ * reconnection as a lost link.
+ */
+void renewStaleLease()
+{
+    if (!usingCachedLease || isLeaseFresh())
+        return;
+
+    Serial.println(F("WiFi cached lease is stale, reconnecting to renew it"));
+    usingCachedLease = false;
+    connectStartedAt = clockMillis();
+    notifyWiFiLinkListeners(false);
+
+    // The stale lease makes the connection skip the fast path
+    startWiFiConnect();
+}
+
+/**
+ * @brief Indicates the WiFi link state with the LEDs.
+ *
+ * @param linkUp true if the link is up, false if it was lost.
+ */
+void indicateWiFiLink(bool linkUp)
+{
+    if (linkUp)
+        // Indicate WiFi connected with purple color (waiting for AWS connection)
+        circleLedEffect(CRGB::Purple, CIRCLE_EFFECT_FAST_FADE_DURATION, LOOP_INDEFINITELY);
+    else
+        // Indicate connecting to WiFi
+        circleLedEffect(CRGB::Blue, CIRCLE_EFFECT_SLOW_FADE_DURATION, LOOP_INDEFINITELY);
+}
+
+/**
+ * @brief Starts the WiFi supervisor maintaining the connection in the background.
+ */
+void startWiFiSupervisor()
+{
+    // The supervisor handles reconnection itself
+    WiFi.setAutoReconnect(false);
+    WiFi.onEvent(onWiFiEvent);
+
+    addWiFiLinkListener(indicateWiFiLink);
+
+    connectStartedAt = clockMillis();
+
+    if (WiFi.status() == WL_CONNECTED)
+    {
+        wifiConnected();
+        return;
+    }
+
+    indicateWiFiLink(false);
+    startWiFiConnect();
 }
 
 int calcChecksum(uint8_t *address, uint16_t sizeToCalc)
@@ -134,55 +594,77 @@ int calcChecksum(uint8_t *address, uint16_t sizeToCalc)
     return checkSum;
 }
 
-bool loadConfigData()
+/**
+ * @brief Moves the credentials from the file of the previous firmware versions to the config store.
+ *
+ * @return true if the credentials were migrated, false if there is no valid legacy file.
+ */
+bool migrateLegacyConfigData()
 {
-    File file = LittleFS.open(CONFIG_FILENAME, "r");
+    // The fast connect data are only a cache, they are collected again on the next connection
+    if (LittleFS.exists(LEGACY_FAST_CONNECT_FILENAME))
+        LittleFS.remove(LEGACY_FAST_CONNECT_FILENAME);
+
+    if (!LittleFS.exists(LEGACY_CONFIG_FILENAME))
+        return false;
+
+    File file = LittleFS.open(LEGACY_CONFIG_FILENAME, "r");
     LOGERROR(F("LoadWiFiCfgFile "));
 
-    memset((void *)&WM_config, 0, sizeof(WM_config));
+    if (!file)
+    {
+        LOGERROR(F("failed"));
+        return false;
+    }
 
-    if (file)
+    size_t size = file.readBytes((char *)&WM_config, sizeof(WM_config));
+    file.close();
+    LOGERROR(F("OK"));
+
+    if (size != sizeof(WM_config) ||
+        WM_config.checksum != calcChecksum((uint8_t *)&WM_config, sizeof(WM_config) - sizeof(WM_config.checksum)))
     {
-        file.readBytes((char *)&WM_config, sizeof(WM_config));
+        LOGERROR(F("WM_config checksum wrong"));
+        memset((void *)&WM_config, 0, sizeof(WM_config));
+        return false;
+    }
 
-        file.close();
-        LOGERROR(F("OK"));
+    // Remove the legacy file only after the credentials are safely stored
+    if (configSetBlob(CONFIG_KEY_WIFI_CREDENTIALS, WM_config.WiFi_Creds, sizeof(WM_config.WiFi_Creds)) && configStoreCommit())
+    {
+        LittleFS.remove(LEGACY_CONFIG_FILENAME);
+        Serial.println(F("WiFi credentials migrated to the config store"));
+    }
 
-        if (WM_config.checksum != calcChecksum((uint8_t *)&WM_config, sizeof(WM_config) - sizeof(WM_config.checksum)))
-        {
-            LOGERROR(F("WM_config checksum wrong"));
+    return true;
+}
 
-            return false;
-        }
+/**
+ * @brief Loads the WiFi credentials from the config store.
+ *
+ * @return true if the credentials were loaded, false otherwise.
+ */
+bool loadConfigData()
+{
+    memset((void *)&WM_config, 0, sizeof(WM_config));
 
+    if (configGetBlob(CONFIG_KEY_WIFI_CREDENTIALS, WM_config.WiFi_Creds, sizeof(WM_config.WiFi_Creds)) == sizeof(WM_config.WiFi_Creds))
         return true;
-    }
-    else
-    {
-        LOGERROR(F("failed"));
 
-        return false;
-    }
+    return migrateLegacyConfigData();
 }
 
+/**
+ * @brief Saves the WiFi credentials to the config store.
+ */
 void saveConfigData()
 {
-    File file = LittleFS.open(CONFIG_FILENAME, "w");
     LOGERROR(F("SaveWiFiCfgFile "));
 
-    if (file)
-    {
-        WM_config.checksum = calcChecksum((uint8_t *)&WM_config, sizeof(WM_config) - sizeof(WM_config.checksum));
-
-        file.write((uint8_t *)&WM_config, sizeof(WM_config));
-
-        file.close();
+    if (configSetBlob(CONFIG_KEY_WIFI_CREDENTIALS, WM_config.WiFi_Creds, sizeof(WM_config.WiFi_Creds)) && configStoreCommit())
         LOGERROR(F("OK"));
-    }
     else
-    {
         LOGERROR(F("failed"));
-    }
 }
 
 /**
@@ -212,14 +694,21 @@ void initWiFiManager(const char *chipID)
     }
 
     Serial.println(F("LittleFS initialized"));
+    bootTraceMark(BOOT_STAGE_FILESYSTEM);
+
+    // Load the configuration records into RAM
+    configStoreBegin();
 
     // Initialize Double Reset Detection for starting Config Portal if DRD
-    drdTaskInit(DRD_TIMEOUT);
+    drdInit(DRD_TIMEOUT);
+    bootTraceMark(BOOT_STAGE_DRD);
 
     unsigned long startedAt = millis();
 
     // Compose hostname from chipID and set it
-    const char *hostname = (String(HOSTNAME_PREFIX) + "_" + String(chipID)).c_str();
+    // The String must outlive the WiFi Manager, which keeps the pointer
+    String hostnameString = String(HOSTNAME_PREFIX) + "_" + String(chipID);
+    const char *hostname = hostnameString.c_str();
     WiFi.setHostname(hostname);
     Serial.printf("Hostname: %s\n", hostname);
 
@@ -248,7 +737,6 @@ void initWiFiManager(const char *chipID)
     if ((Router_SSID != "") && (Router_Pass != ""))
     {
         LOGERROR3(F("* Add SSID = "), Router_SSID, F(", PW = "), Router_Pass);
-        wifiMulti.addAP(Router_SSID.c_str(), Router_Pass.c_str());
 
         ESPAsync_wifiManager.setConfigPortalTimeout(120); // If no access point name has been previously entered disable timeout.
         Serial.println(F("Got ESP Self-Stored Credentials. Timeout 120s for Config Portal"));
@@ -318,7 +806,6 @@ void initWiFiManager(const char *chipID)
             if ((String(WM_config.WiFi_Creds[i].wifi_ssid) != "") && (strlen(WM_config.WiFi_Creds[i].wifi_pw) >= MIN_AP_PASSWORD_SIZE))
             {
                 LOGERROR3(F("* Add SSID = "), WM_config.WiFi_Creds[i].wifi_ssid, F(", PW = "), WM_config.WiFi_Creds[i].wifi_pw);
-                wifiMulti.addAP(WM_config.WiFi_Creds[i].wifi_ssid, WM_config.WiFi_Creds[i].wifi_pw);
             }
         }
 
@@ -330,27 +817,20 @@ void initWiFiManager(const char *chipID)
 
     if (!initialConfig)
     {
-        // Load stored data, the addAP ready for MultiWiFi reconnection
+        // Load stored data, the credentials are used by the WiFi supervisor
         if (!configDataLoaded)
             loadConfigData();
 
-        // Loop through WiFi creds and add them to WiFiMulti
+        // Loop through WiFi creds and print them
         for (uint8_t i = 0; i < NUM_WIFI_CREDENTIALS; i++)
         {
             // Don't permit NULL SSID and password len < MIN_AP_PASSWORD_SIZE (8)
             if ((String(WM_config.WiFi_Creds[i].wifi_ssid) != "") && (strlen(WM_config.WiFi_Creds[i].wifi_pw) >= MIN_AP_PASSWORD_SIZE))
             {
                 LOGERROR3(F("* Add SSID = "), WM_config.WiFi_Creds[i].wifi_ssid, F(", PW = "), WM_config.WiFi_Creds[i].wifi_pw);
-                wifiMulti.addAP(WM_config.WiFi_Creds[i].wifi_ssid, WM_config.WiFi_Creds[i].wifi_pw);
             }
         }
 
-        if (WiFi.status() != WL_CONNECTED)
-        {
-            Serial.println(F("ConnectMultiWiFi in setup"));
-
-            connectMultiWiFi();
-        }
     }
     else
     {
@@ -360,9 +840,6 @@ void initWiFiManager(const char *chipID)
 
         if (WiFi.status() == WL_CONNECTED)
         {
-            // Indicate WiFi connected with purple color (waiting for AWS connection)
-            circleLedEffect(CRGB::Purple, CIRCLE_EFFECT_FAST_FADE_DURATION, LOOP_INDEFINITELY);
-
             Serial.print(F("connected. Local IP: "));
             Serial.println(WiFi.localIP());
         }
@@ -371,30 +848,89 @@ void initWiFiManager(const char *chipID)
             Serial.println(ESPAsync_wifiManager.getStatus(WiFi.status()));
         }
     }
+
+    bootTraceMark(BOOT_STAGE_CONFIG);
+
+    // Load the access point and IP configuration of the last connection
+    fastConnectLoaded = loadFastConnectData();
+
+    // Connect in the background, the connection is maintained by handleWiFi()
+    startWiFiSupervisor();
 }
 
 /**
- * @brief Handles WiFi connection status and attempts reconnection if disconnected.
+ * @brief Runs the WiFi supervisor state machine.
  *
- * This function checks the WiFi connection status at regular intervals defined by WIFI_CHECK_INTERVAL.
- * If the WiFi is disconnected, it attempts to reconnect.
- * It also updates the double reset detector loop to recognize when the timeout expires or a reset is detected.
+ * The function never blocks. It processes the events recorded by the WiFi event handler,
+ * checks the timeouts of the running connection attempt and starts the next attempt after
+ * the backoff delay. Link changes are passed to the listeners registered with addWiFiLinkListener().
  *
  * @note This function should be called periodically within the main loop to ensure continuous WiFi connectivity.
  */
 void handleWiFi()
 {
-    static uint32_t lastWiFiCheck = 0;
-    uint32_t timeNow = millis();
+    if (disconnectedEvent)
+    {
+        disconnectedEvent = false;
 
-    // Check WiFi every WIFI_CHECK_INTERVAL seconds.
-    if (timeNow - lastWiFiCheck > WIFI_CHECK_INTERVAL)
+        // Failed connection attempts are handled by the timeouts, as disconnect events are also
+        // generated by the supervisor itself
+        if (wifiState == WIFI_STATE_CONNECTED)
+        {
+            Serial.printf("WiFi link lost, reason: %u\n", disconnectReason);
+            connectStartedAt = clockMillis();
+            notifyWiFiLinkListeners(false);
+            startWiFiConnect();
+        }
+    }
+
+    if (gotIpEvent)
+    {
+        gotIpEvent = false;
+
+        if (wifiState != WIFI_STATE_CONNECTED && WiFi.status() == WL_CONNECTED)
+            wifiConnected();
+    }
+
+    updateLeaseAge();
+
+    uint32_t elapsed = clockMillis() - wifiStateSince;
+
+    switch (wifiState)
+    {
+    case WIFI_STATE_FAST_CONNECTING:
+        if (elapsed >= WIFI_FAST_CONNECT_TIMEOUT_MS)
+            wifiConnectFailed();
+        break;
+
+    case WIFI_STATE_SCANNING:
     {
-        if ((WiFi.status() != WL_CONNECTED))
+        int16_t networksCount = WiFi.scanComplete();
+        if (networksCount >= 0)
+            connectToBestNetwork(networksCount);
+        else if (networksCount != WIFI_SCAN_RUNNING || elapsed >= WIFI_SCAN_TIMEOUT_MS)
         {
-            Serial.println(F("\nWiFi lost. Call connectMultiWiFi in loop"));
-            connectMultiWiFi();
+            WiFi.scanDelete();
+            wifiConnectFailed();
         }
-        lastWiFiCheck = timeNow;
+        break;
+    }
+
+    case WIFI_STATE_CONNECTING:
+        if (elapsed >= WIFI_CONNECT_TIMEOUT_MS)
+            wifiConnectFailed();
+        break;
+
+    case WIFI_STATE_BACKOFF:
+        if (elapsed >= backoffDelay)
+            startWiFiConnect();
+        break;
+
+    case WIFI_STATE_CONNECTED:
+        renewStaleLease();
+        break;
+
+    default:
+        break;
     }
 }
\ No newline at end of file
@@ -1,7 +1,36 @@
 #ifndef WIFI_MANAGER_H
 #define WIFI_MANAGER_H
 
+#include <Arduino.h>
+
+// How long to wait for the connection using the cached access point and IP configuration
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000L
+
+// How long the cached DHCP lease is used as a static IP after it was obtained. The fast path does
+// not renew the lease, so it must stay below the shortest lease time of common routers. A link
+// using the cached lease reconnects through DHCP once it is older
+#define WIFI_LEASE_MAX_AGE_MS 3600000L
+
+// Delay before the next connection attempt, doubled after every failed attempt
+#define WIFI_BACKOFF_INITIAL_MS 1000L
+#define WIFI_BACKOFF_MAX_MS     60000L
+
+// Statistics of the WiFi connections
+struct WiFiConnectStats
+{
+    uint32_t bootToConnectedMs; // Time from boot to the first connection
+    uint32_t lastConnectMs;     // Duration of the last connection attempt
+    bool lastFastPath;          // Last connection used the cached access point and IP configuration
+    uint32_t fastConnects;      // Number of connections using the fast path
+    uint32_t scanConnects;      // Number of connections using the full scan
+};
+
+// Listener called from the loop task when the WiFi link goes up (true) or down (false)
+typedef void (*WiFiLinkListener)(bool linkUp);
+
 void initWiFiManager(const char *chipID);
 void handleWiFi();
+bool addWiFiLinkListener(WiFiLinkListener listener);
+const WiFiConnectStats &getWiFiConnectStats();
 
 #endif // WIFI_MANAGER_H
\ No newline at end of file
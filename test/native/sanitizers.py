@@ -0,0 +1,18 @@
+# Builds the native tests with the sanitizers.
+# AddressSanitizer and UndefinedBehaviorSanitizer are used by default, set NATIVE_SANITIZER=thread
+# to look for data races with ThreadSanitizer or NATIVE_SANITIZER=none to build without them.
+import os
+
+Import("env")
+
+sanitizer = os.environ.get("NATIVE_SANITIZER", "address")
+if sanitizer == "thread":
+    flags = ["-fsanitize=thread"]
+elif sanitizer == "address":
+    flags = ["-fsanitize=address,undefined", "-fno-sanitize-recover=undefined"]
+else:
+    flags = []
+
+if flags:
+    flags += ["-g", "-fno-omit-frame-pointer"]
+    env.Append(CCFLAGS=flags, LINKFLAGS=flags)
@@ -0,0 +1,23 @@
+/**
+ * @file Client.h
+ * @brief Host shim of the Arduino network client interface.
+ */
+
+#ifndef SHIM_CLIENT_H
+#define SHIM_CLIENT_H
+
+#include <Arduino.h>
+
+class Client : public Stream
+{
+public:
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char *host, uint16_t port) = 0;
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+    virtual int read(uint8_t *buffer, size_t size) = 0;
+    using Stream::read;
+    virtual operator bool() = 0;
+};
+
+#endif // SHIM_CLIENT_H
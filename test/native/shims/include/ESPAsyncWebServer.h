@@ -0,0 +1,184 @@
+/**
+ * @file ESPAsyncWebServer.h
+ * @brief Host shim of ESPAsyncWebServer with in-process clients.
+ *
+ * The servers and WebSocket endpoints are reachable by their port and path through
+ * shimHttpPost() and shimWebSocketSend(), which call the handlers in the calling thread
+ * like the async_tcp task calls them.
+ */
+
+#ifndef SHIM_ESPASYNCWEBSERVER_H
+#define SHIM_ESPASYNCWEBSERVER_H
+
+#include <Arduino.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef enum
+{
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+typedef enum
+{
+    WS_CONTINUATION,
+    WS_TEXT,
+    WS_BINARY,
+    WS_DISCONNECT = 0x08,
+    WS_PING,
+    WS_PONG
+} AwsFrameType;
+
+typedef enum
+{
+    WS_EVT_CONNECT,
+    WS_EVT_DISCONNECT,
+    WS_EVT_PONG,
+    WS_EVT_ERROR,
+    WS_EVT_DATA
+} AwsEventType;
+
+typedef struct
+{
+    uint8_t message_opcode;
+    uint32_t num;
+    uint8_t final;
+    uint8_t masked;
+    uint8_t opcode;
+    uint64_t len;
+    uint8_t mask[4];
+    uint64_t index;
+} AwsFrameInfo;
+
+class AsyncWebServerRequest
+{
+public:
+    AsyncWebServerRequest(const String &contentType, size_t contentLength)
+        : type(contentType), length(contentLength) {}
+    ~AsyncWebServerRequest() { free(_tempObject); }
+    AsyncWebServerRequest(const AsyncWebServerRequest &) = delete;
+    AsyncWebServerRequest &operator=(const AsyncWebServerRequest &) = delete;
+
+    void send(int code);
+    void send(int code, const String &contentType, const String &content = String()) { send(code); }
+    const String &contentType() const { return type; }
+    size_t contentLength() const { return length; }
+    int responseCode() const { return code; }
+
+    // Data of the handlers, freed with the request like by the library
+    void *_tempObject = nullptr;
+
+private:
+    String type;
+    size_t length;
+    int code = 0;
+};
+
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data,
+                           size_t length, bool final)>
+    ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, uint8_t *data, size_t length, size_t index, size_t total)>
+    ArBodyHandlerFunction;
+
+class AsyncWebHandler
+{
+public:
+    virtual ~AsyncWebHandler() {}
+};
+
+class AsyncWebSocket;
+
+class AsyncWebSocketClient
+{
+public:
+    AsyncWebSocketClient(uint32_t id) : clientId(id) {}
+    uint32_t id() const { return clientId; }
+
+    // Data of the handlers, not freed by the library
+    void *_tempObject = nullptr;
+
+private:
+    uint32_t clientId;
+};
+
+typedef std::function<void(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg,
+                           uint8_t *data, size_t length)>
+    AwsEventHandler;
+
+class AsyncWebSocket : public AsyncWebHandler
+{
+public:
+    explicit AsyncWebSocket(const String &url);
+    ~AsyncWebSocket();
+
+    void onEvent(AwsEventHandler handler) { eventHandler = handler; }
+    void cleanupClients(uint16_t maxClients = 8);
+    size_t count() const { return clients.size(); }
+    const char *url() const { return path.c_str(); }
+
+    // In-process clients
+    uint32_t shimConnect();
+    void shimDisconnect(uint32_t clientId);
+    void shimFrame(uint32_t clientId, const uint8_t *data, size_t length, AwsFrameInfo &info);
+
+private:
+    std::string path;
+    AwsEventHandler eventHandler;
+    std::vector<AsyncWebSocketClient *> clients;
+    uint32_t nextId = 1;
+};
+
+class AsyncWebServer
+{
+public:
+    explicit AsyncWebServer(uint16_t port);
+    ~AsyncWebServer();
+
+    void begin() { started = true; }
+    void end() { started = false; }
+    void addHandler(AsyncWebHandler *handler);
+    void on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+            ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr);
+    void on(const char *uri, ArRequestHandlerFunction onRequest) { on(uri, HTTP_ANY, onRequest); }
+    void onNotFound(ArRequestHandlerFunction onRequest) {}
+
+    uint16_t shimPort() const { return port; }
+    bool shimStarted() const { return started; }
+    int shimRequest(const char *uri, WebRequestMethod method, const char *contentType, const uint8_t *body,
+                    size_t length, size_t chunkSize);
+    AsyncWebSocket *shimWebSocket(const char *url);
+
+private:
+    struct Route
+    {
+        std::string uri;
+        WebRequestMethodComposite method;
+        ArRequestHandlerFunction onRequest;
+        ArBodyHandlerFunction onBody;
+    };
+
+    uint16_t port;
+    bool started = false;
+    std::vector<Route> routes;
+    std::vector<AsyncWebSocket *> sockets;
+};
+
+// Sends a POST request to the started server on the port, the body arrives in chunks of chunkSize
+// bytes like TCP segments. Returns the response code, 404 without a route, 0 without a response.
+int shimHttpPost(uint16_t port, const char *uri, const char *contentType, const uint8_t *body, size_t length,
+                 size_t chunkSize = 1436);
+// Returns the WebSocket endpoint of the started server on the port
+AsyncWebSocket *shimWebSocket(uint16_t port, const char *url);
+
+#endif // SHIM_ESPASYNCWEBSERVER_H
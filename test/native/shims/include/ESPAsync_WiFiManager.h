@@ -0,0 +1,46 @@
+/**
+ * @file ESPAsync_WiFiManager.h
+ * @brief Host shim of ESPAsync_WiFiManager, the config portal returns the preset credentials.
+ */
+
+#ifndef SHIM_ESPASYNC_WIFIMANAGER_H
+#define SHIM_ESPASYNC_WIFIMANAGER_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <WiFi.h>
+
+// The debug output of the library is disabled
+#define LOGERROR(x)                 do { (void)(x); } while (0)
+#define LOGERROR1(x, y)             do { (void)(x); (void)(y); } while (0)
+#define LOGERROR2(x, y, z)          do { (void)(x); (void)(y); (void)(z); } while (0)
+#define LOGERROR3(x, y, z, w)       do { (void)(x); (void)(y); (void)(z); (void)(w); } while (0)
+
+class AsyncDNSServer
+{
+};
+
+class ESPAsync_WiFiManager
+{
+public:
+    ESPAsync_WiFiManager(AsyncWebServer *server, AsyncDNSServer *dns, const char *hostname = "") {}
+
+    void setConfigPortalChannel(int32_t channel) {}
+    void setCustomHeadElement(const char *element) {}
+    void setConfigPortalTimeout(unsigned long seconds) {}
+    void setCredentials(const char *ssid, const char *password, const char *ssid1, const char *password1);
+    bool startConfigPortal(const char *apName, const char *apPassword = NULL);
+    String WiFi_SSID();
+    String WiFi_Pass();
+    String getSSID(uint8_t index);
+    String getPW(uint8_t index);
+    const char *getStatus(int status);
+};
+
+// Credentials entered in the config portal by the simulated user
+void shimPortalSetCredentials(const char *ssid, const char *password, const char *ssid1 = "",
+                              const char *password1 = "");
+// Number of started config portals
+uint32_t shimPortalStarts();
+
+#endif // SHIM_ESPASYNC_WIFIMANAGER_H
@@ -0,0 +1,66 @@
+/**
+ * @file FS.h
+ * @brief Host shim of the Arduino file system API, the files are stored in a host directory.
+ */
+
+#ifndef SHIM_FS_H
+#define SHIM_FS_H
+
+#include <Arduino.h>
+#include <memory>
+
+struct ShimFile;
+
+class File : public Stream
+{
+public:
+    File() {}
+    explicit File(std::shared_ptr<ShimFile> file) : file(file) {}
+
+    operator bool() const;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t read(uint8_t *buffer, size_t size) { return readBytes(buffer, size); }
+    size_t readBytes(uint8_t *buffer, size_t length) override;
+    using Stream::readBytes;
+    void flush() override;
+    bool seek(uint32_t position);
+    size_t position() const;
+    size_t size() const;
+    const char *name() const;
+    void close();
+
+private:
+    std::shared_ptr<ShimFile> file;
+};
+
+class FS
+{
+public:
+    File open(const char *path, const char *mode = "r", bool create = false);
+    File open(const String &path, const char *mode = "r", bool create = false) { return open(path.c_str(), mode, create); }
+    bool exists(const char *path);
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool remove(const char *path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char *from, const char *to);
+    bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+    bool mkdir(const char *path);
+};
+
+/**
+ * Controls of the simulated flash. The power cut lets the next writes store only the given
+ * number of bytes, then every write, remove and rename fails like on a device losing power
+ * until shimFsRestorePower() is called ("the reboot").
+ */
+void shimFsFormat();
+void shimFsPowerCutAfter(size_t bytes);
+void shimFsRestorePower();
+bool shimFsPowerCut();
+// Path of the file on the host, to corrupt it directly
+String shimFsHostPath(const char *path);
+
+#endif // SHIM_FS_H
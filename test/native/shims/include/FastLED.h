@@ -0,0 +1,56 @@
+/**
+ * @file FastLED.h
+ * @brief Host shim of FastLED, show() keeps a copy of the shown frame for the tests.
+ */
+
+#ifndef SHIM_FASTLED_H
+#define SHIM_FASTLED_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <mutex>
+#include "crgb.h"
+
+enum EOrder
+{
+    RGB = 0012,
+    GRB = 0102,
+};
+
+class WS2812B
+{
+};
+
+class CFastLED
+{
+public:
+    template <typename Chipset, uint8_t DataPin, EOrder Order>
+    CFastLED &addLeds(CRGB *data, int count)
+    {
+        leds = data;
+        ledsCount = count;
+        return *this;
+    }
+
+    void clear(bool write = false);
+    void show();
+    void setBrightness(uint8_t value) { brightness = value; }
+
+    // The LED of the last frame sent to the strip, the number of sent frames and the time of the last one
+    CRGB shownLed(int index);
+    uint32_t shownFrames() const { return framesShown; }
+    uint64_t lastShowUs() const { return lastShow; }
+
+private:
+    CRGB *leds = nullptr;
+    int ledsCount = 0;
+    uint8_t brightness = 255;
+    std::mutex frameMutex;
+    CRGB frame[256] = {};
+    std::atomic<uint32_t> framesShown{0};
+    std::atomic<uint64_t> lastShow{0};
+};
+
+extern CFastLED FastLED;
+
+#endif // SHIM_FASTLED_H
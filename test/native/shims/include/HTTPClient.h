@@ -0,0 +1,84 @@
+/**
+ * @file HTTPClient.h
+ * @brief Host shim of the ESP32 HTTPClient with an in-memory HTTP server.
+ *
+ * The server serves the files added with shimHttpServe(), supports Range and If-Range
+ * with the ETag of the file and could lose the connection at the planned offsets.
+ */
+
+#ifndef SHIM_HTTPCLIENT_H
+#define SHIM_HTTPCLIENT_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_NOT_CONNECTED      (-4)
+#define HTTPC_ERROR_CONNECTION_LOST    (-5)
+#define HTTPC_ERROR_READ_TIMEOUT       (-11)
+
+typedef enum
+{
+    HTTP_CODE_OK = 200,
+    HTTP_CODE_NO_CONTENT = 204,
+    HTTP_CODE_PARTIAL_CONTENT = 206,
+    HTTP_CODE_NOT_MODIFIED = 304,
+    HTTP_CODE_BAD_REQUEST = 400,
+    HTTP_CODE_NOT_FOUND = 404,
+    HTTP_CODE_INTERNAL_SERVER_ERROR = 500,
+} t_http_codes;
+
+class HTTPClient
+{
+public:
+    bool begin(String url);
+    bool begin(String url, const char *caCert) { return begin(url); }
+    void end();
+    void setTimeout(uint16_t timeout) {}
+    void setReuse(bool reuse) {}
+    void addHeader(const String &name, const String &value, bool first = false, bool replace = true);
+    void collectHeaders(const char *headerKeys[], const size_t headerKeysCount);
+    String header(const char *name);
+    int GET();
+    int getSize() { return size; }
+    WiFiClient *getStreamPtr() { return &client; }
+    WiFiClient &getStream() { return client; }
+    bool connected() { return client.connected(); }
+    static String errorToString(int error);
+
+private:
+    std::string url;
+    std::map<std::string, std::string> requestHeaders;
+    std::vector<std::string> collected;
+    std::map<std::string, std::string> responseHeaders;
+    WiFiClient client;
+    int size = -1;
+};
+
+// A request received by the server
+struct ShimHttpRequest
+{
+    std::string url;
+    std::string range;
+    std::string ifRange;
+    int status;
+};
+
+void shimHttpReset();
+void shimHttpServe(const char *url, const std::vector<uint8_t> &body, const char *etag = "\"v1\"");
+void shimHttpSetRangeSupport(bool supported);
+// The next connections are lost after sending these many bytes of the body, one offset per connection
+void shimHttpLoseConnectionsAt(const std::vector<size_t> &offsets);
+// The next requests fail to connect
+void shimHttpRefuseConnections(uint32_t count);
+// Simulated network time of every read from a response
+void shimHttpSetReadDelayUs(uint32_t delayUs);
+std::vector<ShimHttpRequest> shimHttpRequests();
+// Number of body bytes sent by the server
+size_t shimHttpSentBytes();
+
+#endif // SHIM_HTTPCLIENT_H
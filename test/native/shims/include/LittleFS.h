@@ -0,0 +1,24 @@
+/**
+ * @file LittleFS.h
+ * @brief Host shim of LittleFS.
+ */
+
+#ifndef SHIM_LITTLEFS_H
+#define SHIM_LITTLEFS_H
+
+#include "FS.h"
+
+class LittleFSFS : public FS
+{
+public:
+    bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+               const char *partitionLabel = "spiffs");
+    bool format();
+    void end() {}
+    size_t totalBytes() { return 1408 * 1024; }
+    size_t usedBytes();
+};
+
+extern LittleFSFS LittleFS;
+
+#endif // SHIM_LITTLEFS_H
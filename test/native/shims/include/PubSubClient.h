@@ -0,0 +1,111 @@
+/**
+ * @file PubSubClient.h
+ * @brief Host shim of PubSubClient with an in-memory broker.
+ *
+ * Every client records its publishes and subscriptions. Messages queued with shimDeliver()
+ * are passed to the callback by loop(), in the task running the client like the real library.
+ * The publish size check is the one of PubSubClient 2.8.
+ */
+
+#ifndef SHIM_PUBSUBCLIENT_H
+#define SHIM_PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Client.h"
+
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_MAX_HEADER_SIZE 5
+
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED              0
+#define MQTT_CONNECT_BAD_PROTOCOL   1
+#define MQTT_CONNECT_BAD_CLIENT_ID  2
+#define MQTT_CONNECT_UNAVAILABLE    3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED   5
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char *, uint8_t *, unsigned int)> callback
+
+struct ShimMqttMessage
+{
+    std::string topic;
+    std::string payload;
+    bool retained;
+};
+
+class PubSubClient : public Print
+{
+public:
+    using Print::write;
+
+    PubSubClient() {}
+    PubSubClient(Client &client) {}
+
+    PubSubClient &setServer(const char *host, uint16_t port);
+    PubSubClient &setServer(IPAddress ip, uint16_t port);
+    PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE);
+    PubSubClient &setClient(Client &client) { return *this; }
+    PubSubClient &setKeepAlive(uint16_t keepAlive) { return *this; }
+    PubSubClient &setSocketTimeout(uint16_t timeout) { return *this; }
+    bool setBufferSize(uint16_t size);
+    uint16_t getBufferSize();
+
+    bool connect(const char *id);
+    bool connect(const char *id, const char *user, const char *pass);
+    bool connect(const char *id, const char *user, const char *pass, const char *willTopic, uint8_t willQos,
+                 bool willRetain, const char *willMessage);
+    void disconnect();
+
+    bool publish(const char *topic, const char *payload);
+    bool publish(const char *topic, const char *payload, bool retained);
+    bool publish(const char *topic, const uint8_t *payload, unsigned int length);
+    bool publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained);
+    bool beginPublish(const char *topic, unsigned int length, bool retained);
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int endPublish();
+
+    bool subscribe(const char *topic, uint8_t qos = 0);
+    bool unsubscribe(const char *topic);
+    bool loop();
+    bool connected();
+    int state();
+
+    // Controls and records of the in-memory broker
+    void shimSetBrokerAvailable(bool available);
+    void shimDropConnection();
+    void shimDeliver(const char *topic, const uint8_t *payload, size_t length);
+    void shimDeliver(const char *topic, const char *payload);
+    std::vector<ShimMqttMessage> shimPublished();
+    std::vector<std::string> shimSubscriptions();
+    uint32_t shimConnects();
+    // Number of loop() calls, a loop of the task started after the last one has completed
+    uint32_t shimLoops();
+    void shimClear();
+    const char *shimHost() const { return host.c_str(); }
+
+private:
+    std::recursive_mutex mutex;
+    std::string host;
+    uint16_t port = 0;
+    MQTT_CALLBACK_SIGNATURE;
+    uint16_t bufferSize = MQTT_MAX_PACKET_SIZE;
+    bool isConnected = false;
+    bool brokerAvailable = true;
+    int clientState = MQTT_DISCONNECTED;
+    uint32_t connects = 0;
+    uint32_t loops = 0;
+    std::vector<ShimMqttMessage> published;
+    std::vector<std::string> subscriptions;
+    std::vector<ShimMqttMessage> inbox;
+    ShimMqttMessage streamed;
+    unsigned int streamedLength = 0;
+};
+
+#endif // SHIM_PUBSUBCLIENT_H
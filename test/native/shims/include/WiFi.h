@@ -0,0 +1,158 @@
+/**
+ * @file WiFi.h
+ * @brief Host shim of the ESP32 WiFi station with a scripted fake driver.
+ *
+ * The fake driver knows a list of access points. Connections, DHCP leases and scans complete
+ * after their simulated durations when shimWiFiPoll() is called, which also delivers the
+ * events to the handlers registered with WiFi.onEvent(), like the WiFi event task.
+ */
+
+#ifndef SHIM_WIFI_H
+#define SHIM_WIFI_H
+
+#include <Arduino.h>
+#include <functional>
+#include "WiFiClient.h"
+
+typedef enum
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+    WL_NO_SHIELD = 255,
+} wl_status_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED  (-2)
+
+typedef enum
+{
+    WIFI_OFF,
+    WIFI_STA,
+    WIFI_AP,
+    WIFI_AP_STA,
+} wifi_mode_t;
+
+typedef enum
+{
+    ARDUINO_EVENT_WIFI_READY = 0,
+    ARDUINO_EVENT_WIFI_SCAN_DONE,
+    ARDUINO_EVENT_WIFI_STA_START,
+    ARDUINO_EVENT_WIFI_STA_STOP,
+    ARDUINO_EVENT_WIFI_STA_CONNECTED,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+    ARDUINO_EVENT_WIFI_STA_AUTHMODE_CHANGE,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP6,
+    ARDUINO_EVENT_WIFI_STA_LOST_IP,
+} arduino_event_id_t;
+
+typedef arduino_event_id_t WiFiEvent_t;
+
+// Disconnection reasons of the ESP32 WiFi driver
+#define WIFI_REASON_AUTH_EXPIRE      2
+#define WIFI_REASON_ASSOC_LEAVE      8
+#define WIFI_REASON_BEACON_TIMEOUT   200
+#define WIFI_REASON_NO_AP_FOUND      201
+#define WIFI_REASON_AUTH_FAIL        202
+#define WIFI_REASON_CONNECTION_FAIL  205
+
+typedef union
+{
+    struct
+    {
+        uint8_t ssid[32];
+        uint8_t ssid_len;
+        uint8_t bssid[6];
+        uint8_t reason;
+    } wifi_sta_disconnected;
+    struct
+    {
+        uint32_t ip;
+    } got_ip;
+} arduino_event_info_t;
+
+typedef arduino_event_info_t WiFiEventInfo_t;
+typedef std::function<void(WiFiEvent_t event, WiFiEventInfo_t info)> WiFiEventFuncCb;
+typedef int wifi_event_id_t;
+
+class WiFiClass
+{
+public:
+    wl_status_t begin(const char *ssid, const char *password = NULL, int32_t channel = 0,
+                      const uint8_t *bssid = NULL, bool connect = true);
+    bool config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1 = (uint32_t)0,
+                IPAddress dns2 = (uint32_t)0);
+    bool disconnect(bool wifiOff = false, bool eraseAp = false);
+    bool reconnect();
+    bool mode(wifi_mode_t mode);
+    wifi_mode_t getMode();
+    bool setAutoReconnect(bool autoReconnect);
+    bool getAutoReconnect();
+    bool setHostname(const char *hostname);
+    const char *getHostname();
+    wifi_event_id_t onEvent(WiFiEventFuncCb callback, arduino_event_id_t event = ARDUINO_EVENT_WIFI_READY);
+    void removeEvent(wifi_event_id_t id);
+
+    wl_status_t status();
+    bool isConnected() { return status() == WL_CONNECTED; }
+    String SSID();
+    String psk();
+    uint8_t *BSSID();
+    int32_t channel();
+    int8_t RSSI();
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    IPAddress subnetMask();
+    IPAddress dnsIP(uint8_t index = 0);
+    String macAddress();
+    uint8_t *macAddress(uint8_t *mac);
+
+    int16_t scanNetworks(bool async = false, bool showHidden = false);
+    int16_t scanComplete();
+    void scanDelete();
+    String SSID(uint8_t index);
+    uint8_t *BSSID(uint8_t index);
+    int32_t channel(uint8_t index);
+    int32_t RSSI(uint8_t index);
+};
+
+extern WiFiClass WiFi;
+
+// Counters of the fake driver
+struct ShimWiFiCounters
+{
+    uint32_t begins;        // Connection attempts
+    uint32_t scans;         // Started scans
+    uint32_t dhcpStarts;    // Leases requested from the DHCP server
+    uint32_t staticConfigs; // Connections with a static IP
+};
+
+// Forgets the access points and the state, the handlers are kept
+void shimWiFiReset();
+// Adds an access point, its DHCP server offers the lease
+void shimWiFiAddAccessPoint(const char *ssid, const char *password, const uint8_t bssid[6], int32_t channel,
+                            int8_t rssi, IPAddress leaseIP, IPAddress gateway);
+// Moves the access point to another channel, enables or disables it
+void shimWiFiSetAccessPoint(const char *ssid, int32_t channel, bool available);
+// Changes the address offered by the DHCP server of the access point
+void shimWiFiSetLease(const char *ssid, IPAddress leaseIP);
+// Durations of the connection, DHCP and scan in milliseconds, a scan of 0 never completes
+void shimWiFiSetTimings(uint32_t connectMs, uint32_t dhcpMs, uint32_t scanMs);
+// Makes scanNetworks() fail to start
+void shimWiFiFailScans(bool fail);
+// Loses the link with the reason, like a beacon timeout
+void shimWiFiDropLink(uint8_t reason);
+// Queues an event for the next shimWiFiPoll() without changing the state of the driver
+void shimWiFiQueueEvent(WiFiEvent_t event, uint8_t reason = 0);
+// Completes the operations due at the current simulated time and delivers the events
+void shimWiFiPoll();
+ShimWiFiCounters shimWiFiCounters();
+// Returns whether the station uses a static IP, false while DHCP is running or bound
+bool shimWiFiStaticIP();
+
+#endif // SHIM_WIFI_H
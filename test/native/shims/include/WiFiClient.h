@@ -0,0 +1,53 @@
+/**
+ * @file WiFiClient.h
+ * @brief Host shim of the TCP client, serving the response loaded by the fake HTTP server.
+ */
+
+#ifndef SHIM_WIFICLIENT_H
+#define SHIM_WIFICLIENT_H
+
+#include <memory>
+#include <vector>
+#include "Client.h"
+
+// Data received by a client, shared with the fake server that produced it
+struct ShimConnection
+{
+    std::vector<uint8_t> data;
+    size_t position = 0;
+    size_t closeAt = SIZE_MAX; // The connection is lost after this many bytes
+    uint32_t readDelayUs = 0;  // Simulated network time of every read
+    bool open = false;
+};
+
+class WiFiClient : public Client
+{
+public:
+    WiFiClient() : connection(std::make_shared<ShimConnection>()) {}
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char *host, uint16_t port) override;
+    uint8_t connected() override;
+    void stop() override;
+    operator bool() override { return connected(); }
+
+    int available() override;
+    int read() override;
+    int read(uint8_t *buffer, size_t size) override;
+    int peek() override;
+    size_t readBytes(uint8_t *buffer, size_t length) override;
+    using Stream::readBytes;
+    size_t write(const uint8_t *buffer, size_t size) override { return connection->open ? size : 0; }
+    using Print::write;
+
+    void setInsecure() {}
+    void setNoDelay(bool) {}
+
+    // Starts a new connection receiving the data
+    void shimLoad(std::vector<uint8_t> data, size_t closeAt, uint32_t readDelayUs);
+
+protected:
+    std::shared_ptr<ShimConnection> connection;
+};
+
+#endif // SHIM_WIFICLIENT_H
@@ -0,0 +1,23 @@
+/**
+ * @file WiFiClientSecure.h
+ * @brief Host shim of the TLS client, the credentials are only kept.
+ */
+
+#ifndef SHIM_WIFICLIENTSECURE_H
+#define SHIM_WIFICLIENTSECURE_H
+
+#include <WiFi.h>
+
+class WiFiClientSecure : public WiFiClient
+{
+public:
+    void setCACert(const char *certificate) { caCert = certificate; }
+    void setCertificate(const char *certificate) { clientCert = certificate; }
+    void setPrivateKey(const char *key) { privateKey = key; }
+
+    const char *caCert = nullptr;
+    const char *clientCert = nullptr;
+    const char *privateKey = nullptr;
+};
+
+#endif // SHIM_WIFICLIENTSECURE_H
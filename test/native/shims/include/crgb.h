@@ -0,0 +1,90 @@
+/**
+ * @file crgb.h
+ * @brief Host shim of the FastLED RGB color, with the same scaling math as FastLED.
+ */
+
+#ifndef SHIM_CRGB_H
+#define SHIM_CRGB_H
+
+#include <stdint.h>
+
+/**
+ * @brief Scales the value keeping nonzero values nonzero, like scale8_video() of FastLED.
+ */
+inline uint8_t scale8_video(uint8_t value, uint8_t scale)
+{
+    return (((int)value * (int)scale) >> 8) + ((value && scale) ? 1 : 0);
+}
+
+struct CRGB
+{
+    union
+    {
+        struct
+        {
+            uint8_t r;
+            uint8_t g;
+            uint8_t b;
+        };
+        uint8_t raw[3];
+    };
+
+    typedef enum
+    {
+        Black = 0x000000,
+        Blue = 0x0000FF,
+        Cyan = 0x00FFFF,
+        Green = 0x008000,
+        Orange = 0xFFA500,
+        Purple = 0x800080,
+        Red = 0xFF0000,
+        White = 0xFFFFFF,
+        Yellow = 0xFFFF00,
+    } HTMLColorCode;
+
+    CRGB() = default;
+    constexpr CRGB(uint8_t red, uint8_t green, uint8_t blue) : r(red), g(green), b(blue) {}
+    constexpr CRGB(uint32_t colorCode) : r((colorCode >> 16) & 0xFF), g((colorCode >> 8) & 0xFF), b(colorCode & 0xFF) {}
+    constexpr CRGB(HTMLColorCode colorCode) : CRGB((uint32_t)colorCode) {}
+
+    CRGB &operator=(uint32_t colorCode)
+    {
+        r = (colorCode >> 16) & 0xFF;
+        g = (colorCode >> 8) & 0xFF;
+        b = colorCode & 0xFF;
+        return *this;
+    }
+
+    uint8_t &operator[](uint8_t index) { return raw[index]; }
+    const uint8_t &operator[](uint8_t index) const { return raw[index]; }
+
+    CRGB &nscale8_video(uint8_t scale)
+    {
+        r = scale8_video(r, scale);
+        g = scale8_video(g, scale);
+        b = scale8_video(b, scale);
+        return *this;
+    }
+
+    CRGB &nscale8(uint8_t scale)
+    {
+        r = ((uint16_t)r * (1 + scale)) >> 8;
+        g = ((uint16_t)g * (1 + scale)) >> 8;
+        b = ((uint16_t)b * (1 + scale)) >> 8;
+        return *this;
+    }
+
+    explicit operator bool() const { return r || g || b; }
+};
+
+inline bool operator==(const CRGB &lhs, const CRGB &rhs)
+{
+    return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b;
+}
+
+inline bool operator!=(const CRGB &lhs, const CRGB &rhs)
+{
+    return !(lhs == rhs);
+}
+
+#endif // SHIM_CRGB_H
@@ -0,0 +1,43 @@
+/**
+ * @file miniz.h
+ * @brief Host shim of the tinfl decoder in the ESP32 ROM, implemented with zlib raw inflate.
+ */
+
+#ifndef SHIM_MINIZ_H
+#define SHIM_MINIZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#define TINFL_FLAG_PARSE_ZLIB_HEADER             1
+#define TINFL_FLAG_HAS_MORE_INPUT                2
+#define TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF 4
+#define TINFL_FLAG_COMPUTE_ADLER32               8
+
+typedef enum
+{
+    TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS = -4,
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+// The zlib state is allocated inside the decoder, so freeing the decoder releases everything
+#define TINFL_SHIM_ARENA_SIZE (64 * 1024)
+
+typedef struct
+{
+    z_stream stream;
+    size_t arenaUsed;
+    uint8_t arena[TINFL_SHIM_ARENA_SIZE];
+} tinfl_decompressor;
+
+void tinfl_init(tinfl_decompressor *decompressor);
+tinfl_status tinfl_decompress(tinfl_decompressor *decompressor, const uint8_t *inputNext, size_t *inputSize,
+                              uint8_t *outputStart, uint8_t *outputNext, size_t *outputSize, uint32_t flags);
+
+#endif // SHIM_MINIZ_H
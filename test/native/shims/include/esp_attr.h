@@ -0,0 +1,15 @@
+/**
+ * @file esp_attr.h
+ * @brief Host shim of the memory placement attributes, the host has a single memory.
+ */
+
+#ifndef SHIM_ESP_ATTR_H
+#define SHIM_ESP_ATTR_H
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+// The variable keeps its value over the simulated restarts like in the RTC memory
+#define RTC_NOINIT_ATTR
+
+#endif // SHIM_ESP_ATTR_H
@@ -0,0 +1,21 @@
+/**
+ * @file esp_freertos_hooks.h
+ * @brief Host shim of the FreeRTOS idle hooks, the idle tasks are simulated threads.
+ */
+
+#ifndef SHIM_ESP_FREERTOS_HOOKS_H
+#define SHIM_ESP_FREERTOS_HOOKS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef bool (*esp_freertos_idle_cb_t)(void);
+
+esp_err_t esp_register_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t callback, uint32_t cpu);
+void esp_deregister_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t callback, uint32_t cpu);
+
+// Runs the idle hooks of the core, as the idle task does when nothing else runs on it
+void shimRunIdleHooks(uint32_t cpu);
+
+#endif // SHIM_ESP_FREERTOS_HOOKS_H
@@ -0,0 +1,19 @@
+/**
+ * @file esp_ota_ops.h
+ * @brief Host shim of the OTA partition selection.
+ */
+
+#ifndef SHIM_ESP_OTA_OPS_H
+#define SHIM_ESP_OTA_OPS_H
+
+#include "esp_partition.h"
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *startFrom);
+const esp_partition_t *esp_ota_get_running_partition();
+// Fails with ESP_ERR_OTA_VALIDATE_FAILED unless the partition starts with an app image
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
+
+// Returns the partition set as the boot partition, NULL if none was set
+const esp_partition_t *shimOtaBootPartition();
+
+#endif // SHIM_ESP_OTA_OPS_H
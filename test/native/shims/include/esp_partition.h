@@ -0,0 +1,60 @@
+/**
+ * @file esp_partition.h
+ * @brief Host shim of the flash partitions, the OTA partition is kept in memory.
+ */
+
+#ifndef SHIM_ESP_PARTITION_H
+#define SHIM_ESP_PARTITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum
+{
+    ESP_PARTITION_SUBTYPE_APP_OTA_0 = 0x10,
+    ESP_PARTITION_SUBTYPE_APP_OTA_1 = 0x11,
+} esp_partition_subtype_t;
+
+typedef struct
+{
+    void *flash_chip;
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+    bool encrypted;
+} esp_partition_t;
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *destination, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *source, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+// Counters of the flash operations on the OTA partition
+struct ShimFlashCounters
+{
+    uint32_t writes;
+    uint32_t erases;
+    uint64_t writeTimeUs; // Simulated flash time spent in the writes and erases
+};
+
+// Fills the partition with erased flash and resets the counters
+void shimFlashReset();
+// Simulated duration of writing a page and erasing a sector, in microseconds
+void shimFlashSetTimings(uint32_t writePerKbUs, uint32_t eraseSectorUs);
+// Makes the writes at or after the offset fail
+void shimFlashFailWritesFrom(size_t offset);
+// Sequence of (offset, length) of the writes, to check their order
+std::vector<std::pair<size_t, size_t>> shimFlashWrites();
+const uint8_t *shimFlashData();
+ShimFlashCounters shimFlashCounters();
+
+#endif // SHIM_ESP_PARTITION_H
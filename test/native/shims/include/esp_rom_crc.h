@@ -0,0 +1,17 @@
+/**
+ * @file esp_rom_crc.h
+ * @brief Host shim of the CRC32 in the ESP32 ROM, the same CRC as zlib.
+ */
+
+#ifndef SHIM_ESP_ROM_CRC_H
+#define SHIM_ESP_ROM_CRC_H
+
+#include <stdint.h>
+#include <zlib.h>
+
+static inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buffer, uint32_t length)
+{
+    return crc32(crc, buffer, length);
+}
+
+#endif // SHIM_ESP_ROM_CRC_H
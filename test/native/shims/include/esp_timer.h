@@ -0,0 +1,43 @@
+#ifndef SHIM_ESP_TIMER_H
+#define SHIM_ESP_TIMER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum
+{
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR
+} esp_timer_dispatch_t;
+
+typedef struct
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+int64_t esp_timer_get_time();
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+
+/**
+ * Control of the simulated time by the tests. The time starts at 0 when the process starts.
+ */
+
+// Runs the simulated time faster than the real time, delays and timeouts are shortened accordingly.
+// Scale 0 stops the time, it then moves only by shimAdvanceTime() and the delays wait for it
+void shimSetTimeScale(uint32_t scale);
+// Moves the simulated time forward, expired delays and timeouts end right away
+void shimAdvanceTime(uint64_t us);
+// Sleeps for the simulated time
+void shimSleepUs(uint64_t us);
+
+#endif // SHIM_ESP_TIMER_H
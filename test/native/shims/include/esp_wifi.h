@@ -0,0 +1,21 @@
+/**
+ * @file esp_wifi.h
+ * @brief Host shim of the WiFi power save settings.
+ */
+
+#ifndef SHIM_ESP_WIFI_H
+#define SHIM_ESP_WIFI_H
+
+#include "esp_err.h"
+
+typedef enum
+{
+    WIFI_PS_NONE,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *type);
+
+#endif // SHIM_ESP_WIFI_H
@@ -0,0 +1,73 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host shim of the ESP-IDF FreeRTOS API used by the firmware.
+ *
+ * Tasks are threads, queues and semaphores are guarded by a mutex and a condition variable,
+ * a tick is one millisecond of the simulated time (see shimSetTimeScale()).
+ */
+
+#ifndef SHIM_FREERTOS_H
+#define SHIM_FREERTOS_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE  ((BaseType_t)1)
+#define pdFAIL  pdFALSE
+#define pdPASS  pdTRUE
+
+#define portMAX_DELAY      ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1)
+#define portNUM_PROCESSORS 2
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms))
+#define pdTICKS_TO_MS(t)   ((uint32_t)(t))
+
+#define tskIDLE_PRIORITY     ((UBaseType_t)0)
+#define configMAX_PRIORITIES 25
+#define tskNO_AFFINITY       0x7FFFFFFF
+
+// Like the stock Arduino core, without the run time counters of the tasks
+#define configUSE_TRACE_FACILITY       0
+#define configGENERATE_RUN_TIME_STATS  0
+#define configTASKLIST_INCLUDE_COREID  0
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+
+// Spinlock of the critical sections, recursive on the same thread like on the ESP32
+typedef struct
+{
+    std::atomic<const void *> owner;
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+void vPortEnterCritical(portMUX_TYPE *mux);
+void vPortExitCritical(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(mux)     vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)      vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)  vPortExitCritical(mux)
+#define taskENTER_CRITICAL(mux)     vPortEnterCritical(mux)
+#define taskEXIT_CRITICAL(mux)      vPortExitCritical(mux)
+
+void vPortYield();
+BaseType_t xPortGetCoreID();
+
+#define portYIELD()              vPortYield()
+#define taskYIELD()              vPortYield()
+#define portYIELD_FROM_ISR(...)  ((void)0)
+
+#endif // SHIM_FREERTOS_H
@@ -0,0 +1,18 @@
+#ifndef SHIM_FREERTOS_SEMPHR_H
+#define SHIM_FREERTOS_SEMPHR_H
+
+#include "queue.h"
+
+// Semaphores are queues of items without data, like in FreeRTOS
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount);
+
+#define xSemaphoreTake(semaphore, ticksToWait) xQueueReceive(semaphore, NULL, ticksToWait)
+#define xSemaphoreGive(semaphore)              xQueueSend(semaphore, NULL, 0)
+#define vSemaphoreDelete(semaphore)            vQueueDelete(semaphore)
+#define uxSemaphoreGetCount(semaphore)         uxQueueMessagesWaiting(semaphore)
+
+#endif // SHIM_FREERTOS_SEMPHR_H
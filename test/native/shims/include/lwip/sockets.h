@@ -0,0 +1,22 @@
+/**
+ * @file sockets.h
+ * @brief Host shim of the lwIP sockets, the host BSD sockets have the same API.
+ */
+
+#ifndef SHIM_LWIP_SOCKETS_H
+#define SHIM_LWIP_SOCKETS_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// The Arduino core replaces the lwIP macro by its IPAddress constant
+#undef INADDR_NONE
+
+// Waits like select() of the host, in short slices so shimStopTasks() ends a task waiting for packets
+int shimSelect(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+#define select shimSelect
+
+#endif // SHIM_LWIP_SOCKETS_H
@@ -0,0 +1,27 @@
+/**
+ * @file sha256.h
+ * @brief Host shim of the mbedTLS SHA-256.
+ */
+
+#ifndef SHIM_MBEDTLS_SHA256_H
+#define SHIM_MBEDTLS_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t state[8];
+    uint64_t total;
+    uint8_t buffer[64];
+    int is224;
+} mbedtls_sha256_context;
+
+void mbedtls_sha256_init(mbedtls_sha256_context *context);
+void mbedtls_sha256_free(mbedtls_sha256_context *context);
+int mbedtls_sha256_starts(mbedtls_sha256_context *context, int is224);
+int mbedtls_sha256_update(mbedtls_sha256_context *context, const unsigned char *input, size_t length);
+int mbedtls_sha256_finish(mbedtls_sha256_context *context, unsigned char output[32]);
+int mbedtls_sha256(const unsigned char *input, size_t length, unsigned char output[32], int is224);
+
+#endif // SHIM_MBEDTLS_SHA256_H
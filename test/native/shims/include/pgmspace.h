@@ -0,0 +1,26 @@
+/**
+ * @file pgmspace.h
+ * @brief Host shim of the program memory helpers, the data is in the ordinary memory.
+ */
+
+#ifndef SHIM_PGMSPACE_H
+#define SHIM_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(text) (text)
+
+#define pgm_read_byte(address)  (*(const uint8_t *)(address))
+#define pgm_read_word(address)  (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+
+#define strlen_P  strlen
+#define strcpy_P  strcpy
+#define strncpy_P strncpy
+#define strcmp_P  strcmp
+#define memcpy_P  memcpy
+
+#endif // SHIM_PGMSPACE_H
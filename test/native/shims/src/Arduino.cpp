@@ -0,0 +1,252 @@
+/**
+ * @file Arduino.cpp
+ * @brief Host implementation of the Arduino core shim.
+ */
+
+#include <Arduino.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "shim_internal.h"
+
+const IPAddress INADDR_NONE(0, 0, 0, 0);
+HardwareSerial Serial;
+EspClass ESP;
+
+static std::mutex serialMutex;
+static bool serialCaptured = false;
+static String serialOutput;
+
+static std::atomic<uint32_t> freeHeap{200 * 1024};
+static std::atomic<uint32_t> minFreeHeap{180 * 1024};
+static std::atomic<uint32_t> maxAllocHeap{110 * 1024};
+static std::atomic<uint32_t> restartCount{0};
+static std::atomic<uint32_t> cpuFrequencyMhz{240};
+static esp_reset_reason_t resetReason = ESP_RST_POWERON;
+
+unsigned long millis()
+{
+    return (unsigned long)(uint32_t)(shimTimeUs() / 1000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)(uint32_t)shimTimeUs();
+}
+
+void delay(uint32_t ms)
+{
+    shimSleepUs((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    shimSleepUs(us);
+}
+
+void yield()
+{
+    shimCheckStop();
+    std::this_thread::yield();
+}
+
+#if !defined(__GLIBC_PREREQ) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *destination, const char *source, size_t size)
+{
+    size_t length = strlen(source);
+    if (size > 0)
+    {
+        size_t copied = length < size - 1 ? length : size - 1;
+        memcpy(destination, source, copied);
+        destination[copied] = '\0';
+    }
+    return length;
+}
+#endif
+
+String IPAddress::toString() const
+{
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(text);
+}
+
+bool IPAddress::fromString(const char *text)
+{
+    unsigned int parts[4];
+    char end;
+    if (sscanf(text, "%u.%u.%u.%u%c", &parts[0], &parts[1], &parts[2], &parts[3], &end) != 4)
+        return false;
+
+    for (unsigned int part : parts)
+    {
+        if (part > 255)
+            return false;
+    }
+
+    *this = IPAddress(parts[0], parts[1], parts[2], parts[3]);
+    return true;
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0)
+        return 0;
+
+    if ((size_t)length < sizeof(buffer))
+        return write((const uint8_t *)buffer, length);
+
+    // Long messages are formatted again into a large enough buffer
+    char *large = (char *)malloc(length + 1);
+    va_start(args, format);
+    vsnprintf(large, length + 1, format, args);
+    va_end(args);
+    size_t written = write((const uint8_t *)large, length);
+    free(large);
+    return written;
+}
+
+size_t Stream::readBytes(uint8_t *buffer, size_t length)
+{
+    size_t count = 0;
+    uint64_t start = shimTimeUs();
+    while (count < length)
+    {
+        int value = read();
+        if (value >= 0)
+        {
+            buffer[count++] = (uint8_t)value;
+            continue;
+        }
+
+        if (shimTimeUs() - start >= (uint64_t)timeout * 1000)
+            break;
+        shimSleepUs(1000);
+    }
+    return count;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    std::lock_guard<std::mutex> lock(serialMutex);
+    if (serialCaptured)
+        serialOutput.concat((const char *)buffer, size);
+    else
+        fwrite(buffer, 1, size, stdout);
+    return size;
+}
+
+void shimSerialCapture(bool capture)
+{
+    std::lock_guard<std::mutex> lock(serialMutex);
+    serialCaptured = capture;
+}
+
+String shimSerialTakeOutput()
+{
+    std::lock_guard<std::mutex> lock(serialMutex);
+    String output = static_cast<String &&>(serialOutput);
+    serialOutput = "";
+    return output;
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    return freeHeap;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+    return minFreeHeap;
+}
+
+uint32_t EspClass::getMaxAllocHeap()
+{
+    return maxAllocHeap;
+}
+
+uint64_t EspClass::getEfuseMac()
+{
+    return 0x563412cdab24ULL;
+}
+
+uint32_t EspClass::getCpuFreqMHz()
+{
+    return cpuFrequencyMhz;
+}
+
+void EspClass::restart()
+{
+    restartCount++;
+    throw ShimTaskExit();
+}
+
+void shimSetHeap(uint32_t free, uint32_t minFree, uint32_t maxAlloc)
+{
+    freeHeap = free;
+    minFreeHeap = minFree;
+    maxAllocHeap = maxAlloc;
+}
+
+uint32_t shimRestartCount()
+{
+    return restartCount;
+}
+
+esp_reset_reason_t esp_reset_reason()
+{
+    return resetReason;
+}
+
+void shimSetResetReason(esp_reset_reason_t reason)
+{
+    resetReason = reason;
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz)
+{
+    if (mhz != 80 && mhz != 160 && mhz != 240 && mhz != 40 && mhz != 20 && mhz != 10)
+        return false;
+
+    cpuFrequencyMhz = mhz;
+    return true;
+}
+
+uint32_t getCpuFrequencyMhz()
+{
+    return cpuFrequencyMhz;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_OTA_VALIDATE_FAILED:
+        return "ESP_ERR_OTA_VALIDATE_FAILED";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
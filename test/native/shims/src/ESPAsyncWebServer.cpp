@@ -0,0 +1,174 @@
+/**
+ * @file ESPAsyncWebServer.cpp
+ * @brief Host implementation of the ESPAsyncWebServer shim.
+ */
+
+#include <ESPAsyncWebServer.h>
+#include <mutex>
+
+static std::mutex serversMutex;
+
+/**
+ * @brief Returns the registered servers, created on the first use because the firmware
+ * constructs its servers during the static initialization.
+ */
+static std::vector<AsyncWebServer *> &getServers()
+{
+    static std::vector<AsyncWebServer *> servers;
+    return servers;
+}
+
+void AsyncWebServerRequest::send(int responseCode)
+{
+    // Only the first response is sent
+    if (code == 0)
+        code = responseCode;
+}
+
+AsyncWebSocket::AsyncWebSocket(const String &url) : path(url.c_str()) {}
+
+AsyncWebSocket::~AsyncWebSocket()
+{
+    for (AsyncWebSocketClient *client : clients)
+        delete client;
+}
+
+void AsyncWebSocket::cleanupClients(uint16_t maxClients)
+{
+    // The oldest clients are disconnected
+    while (clients.size() > maxClients)
+        shimDisconnect(clients.front()->id());
+}
+
+uint32_t AsyncWebSocket::shimConnect()
+{
+    AsyncWebSocketClient *client = new AsyncWebSocketClient(nextId++);
+    clients.push_back(client);
+    if (eventHandler)
+        eventHandler(this, client, WS_EVT_CONNECT, NULL, NULL, 0);
+    return client->id();
+}
+
+void AsyncWebSocket::shimDisconnect(uint32_t clientId)
+{
+    for (size_t i = 0; i < clients.size(); i++)
+    {
+        AsyncWebSocketClient *client = clients[i];
+        if (client->id() == clientId)
+        {
+            clients.erase(clients.begin() + i);
+            if (eventHandler)
+                eventHandler(this, client, WS_EVT_DISCONNECT, NULL, NULL, 0);
+            delete client;
+            return;
+        }
+    }
+}
+
+void AsyncWebSocket::shimFrame(uint32_t clientId, const uint8_t *data, size_t length, AwsFrameInfo &info)
+{
+    for (AsyncWebSocketClient *client : clients)
+    {
+        if (client->id() == clientId)
+        {
+            // The library passes a mutable copy of the frame
+            std::vector<uint8_t> frame(data, data + length);
+            if (eventHandler)
+                eventHandler(this, client, WS_EVT_DATA, &info, frame.data(), length);
+            return;
+        }
+    }
+}
+
+AsyncWebServer::AsyncWebServer(uint16_t serverPort) : port(serverPort)
+{
+    std::lock_guard<std::mutex> lock(serversMutex);
+    getServers().push_back(this);
+}
+
+AsyncWebServer::~AsyncWebServer()
+{
+    std::lock_guard<std::mutex> lock(serversMutex);
+    std::vector<AsyncWebServer *> &servers = getServers();
+    for (size_t i = 0; i < servers.size(); i++)
+    {
+        if (servers[i] == this)
+        {
+            servers.erase(servers.begin() + i);
+            break;
+        }
+    }
+}
+
+void AsyncWebServer::addHandler(AsyncWebHandler *handler)
+{
+    AsyncWebSocket *socket = dynamic_cast<AsyncWebSocket *>(handler);
+    if (socket != nullptr)
+        sockets.push_back(socket);
+}
+
+void AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                        ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody)
+{
+    routes.push_back({uri, method, onRequest, onBody});
+}
+
+int AsyncWebServer::shimRequest(const char *uri, WebRequestMethod method, const char *contentType,
+                                const uint8_t *body, size_t length, size_t chunkSize)
+{
+    for (const Route &route : routes)
+    {
+        if (route.uri != uri || (route.method & method) == 0)
+            continue;
+
+        AsyncWebServerRequest request(contentType, length);
+        std::vector<uint8_t> chunk;
+        for (size_t index = 0; index < length && route.onBody; index += chunkSize)
+        {
+            size_t chunkLength = std::min(chunkSize, length - index);
+            chunk.assign(body + index, body + index + chunkLength);
+            route.onBody(&request, chunk.data(), chunkLength, index, length);
+        }
+        if (route.onRequest)
+            route.onRequest(&request);
+        return request.responseCode();
+    }
+    return 404;
+}
+
+AsyncWebSocket *AsyncWebServer::shimWebSocket(const char *url)
+{
+    for (AsyncWebSocket *socket : sockets)
+    {
+        if (strcmp(socket->url(), url) == 0)
+            return socket;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Returns the started server listening on the port.
+ */
+static AsyncWebServer *findServer(uint16_t port)
+{
+    std::lock_guard<std::mutex> lock(serversMutex);
+    for (AsyncWebServer *server : getServers())
+    {
+        if (server->shimPort() == port && server->shimStarted())
+            return server;
+    }
+    return nullptr;
+}
+
+int shimHttpPost(uint16_t port, const char *uri, const char *contentType, const uint8_t *body, size_t length,
+                 size_t chunkSize)
+{
+    AsyncWebServer *server = findServer(port);
+    return server ? server->shimRequest(uri, HTTP_POST, contentType, body, length, chunkSize) : 0;
+}
+
+AsyncWebSocket *shimWebSocket(uint16_t port, const char *url)
+{
+    AsyncWebServer *server = findServer(port);
+    return server ? server->shimWebSocket(url) : nullptr;
+}
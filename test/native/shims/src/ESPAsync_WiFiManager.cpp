@@ -0,0 +1,71 @@
+/**
+ * @file ESPAsync_WiFiManager.cpp
+ * @brief Host implementation of the ESPAsync_WiFiManager shim.
+ */
+
+#include <ESPAsync_WiFiManager.h>
+
+static String portalSsid[2];
+static String portalPassword[2];
+static uint32_t portalStarts = 0;
+
+void shimPortalSetCredentials(const char *ssid, const char *password, const char *ssid1, const char *password1)
+{
+    portalSsid[0] = ssid;
+    portalPassword[0] = password;
+    portalSsid[1] = ssid1;
+    portalPassword[1] = password1;
+}
+
+uint32_t shimPortalStarts()
+{
+    return portalStarts;
+}
+
+void ESPAsync_WiFiManager::setCredentials(const char *ssid, const char *password, const char *ssid1,
+                                          const char *password1)
+{
+}
+
+bool ESPAsync_WiFiManager::startConfigPortal(const char *apName, const char *apPassword)
+{
+    portalStarts++;
+    return false;
+}
+
+String ESPAsync_WiFiManager::WiFi_SSID()
+{
+    return String();
+}
+
+String ESPAsync_WiFiManager::WiFi_Pass()
+{
+    return String();
+}
+
+String ESPAsync_WiFiManager::getSSID(uint8_t index)
+{
+    return index < 2 ? portalSsid[index] : String();
+}
+
+String ESPAsync_WiFiManager::getPW(uint8_t index)
+{
+    return index < 2 ? portalPassword[index] : String();
+}
+
+const char *ESPAsync_WiFiManager::getStatus(int status)
+{
+    switch (status)
+    {
+    case WL_CONNECTED:
+        return "WL_CONNECTED";
+    case WL_NO_SSID_AVAIL:
+        return "WL_NO_SSID_AVAIL";
+    case WL_CONNECT_FAILED:
+        return "WL_CONNECT_FAILED";
+    case WL_DISCONNECTED:
+        return "WL_DISCONNECTED";
+    default:
+        return "WL_IDLE_STATUS";
+    }
+}
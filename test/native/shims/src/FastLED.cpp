@@ -0,0 +1,32 @@
+/**
+ * @file FastLED.cpp
+ * @brief Host implementation of the FastLED shim.
+ */
+
+#include <FastLED.h>
+#include "shim_internal.h"
+
+CFastLED FastLED;
+
+void CFastLED::clear(bool write)
+{
+    for (int i = 0; i < ledsCount; i++)
+        leds[i] = CRGB::Black;
+    if (write)
+        show();
+}
+
+void CFastLED::show()
+{
+    std::lock_guard<std::mutex> lock(frameMutex);
+    for (int i = 0; i < ledsCount && i < 256; i++)
+        frame[i] = leds[i];
+    lastShow = shimTimeUs();
+    framesShown++;
+}
+
+CRGB CFastLED::shownLed(int index)
+{
+    std::lock_guard<std::mutex> lock(frameMutex);
+    return index >= 0 && index < 256 ? frame[index] : CRGB(CRGB::Black);
+}
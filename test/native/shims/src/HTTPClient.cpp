@@ -0,0 +1,191 @@
+/**
+ * @file HTTPClient.cpp
+ * @brief Host implementation of the HTTPClient shim and its in-memory server.
+ */
+
+#include <HTTPClient.h>
+#include <deque>
+#include <mutex>
+#include <strings.h>
+
+struct ShimHttpFile
+{
+    std::vector<uint8_t> body;
+    std::string etag;
+};
+
+static std::mutex serverMutex;
+static std::map<std::string, ShimHttpFile> files;
+static std::deque<size_t> lossOffsets;
+static std::vector<ShimHttpRequest> requests;
+static bool rangeSupported = true;
+static uint32_t refusedConnections = 0;
+static uint32_t readDelayUs = 0;
+static size_t sentBytes = 0;
+
+void shimHttpReset()
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    files.clear();
+    lossOffsets.clear();
+    requests.clear();
+    rangeSupported = true;
+    refusedConnections = 0;
+    readDelayUs = 0;
+    sentBytes = 0;
+}
+
+void shimHttpServe(const char *url, const std::vector<uint8_t> &body, const char *etag)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    files[url] = {body, etag};
+}
+
+void shimHttpSetRangeSupport(bool supported)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    rangeSupported = supported;
+}
+
+void shimHttpLoseConnectionsAt(const std::vector<size_t> &offsets)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    lossOffsets.assign(offsets.begin(), offsets.end());
+}
+
+void shimHttpRefuseConnections(uint32_t count)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    refusedConnections = count;
+}
+
+void shimHttpSetReadDelayUs(uint32_t delayUs)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    readDelayUs = delayUs;
+}
+
+std::vector<ShimHttpRequest> shimHttpRequests()
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    return requests;
+}
+
+size_t shimHttpSentBytes()
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    return sentBytes;
+}
+
+bool HTTPClient::begin(String beginUrl)
+{
+    url = beginUrl.c_str();
+    requestHeaders.clear();
+    responseHeaders.clear();
+    size = -1;
+    return true;
+}
+
+void HTTPClient::end()
+{
+    client.stop();
+    requestHeaders.clear();
+}
+
+void HTTPClient::addHeader(const String &name, const String &value, bool first, bool replace)
+{
+    requestHeaders[name.c_str()] = value.c_str();
+}
+
+void HTTPClient::collectHeaders(const char *headerKeys[], const size_t headerKeysCount)
+{
+    collected.assign(headerKeys, headerKeys + headerKeysCount);
+}
+
+String HTTPClient::header(const char *name)
+{
+    for (const std::string &key : collected)
+    {
+        if (strcasecmp(key.c_str(), name) == 0)
+        {
+            auto found = responseHeaders.find(key);
+            return found != responseHeaders.end() ? String(found->second.c_str()) : String();
+        }
+    }
+    return String();
+}
+
+int HTTPClient::GET()
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    ShimHttpRequest request = {url, requestHeaders["Range"], requestHeaders["If-Range"], 0};
+    responseHeaders.clear();
+
+    if (refusedConnections > 0)
+    {
+        refusedConnections--;
+        request.status = HTTPC_ERROR_CONNECTION_REFUSED;
+        requests.push_back(request);
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+
+    auto found = files.find(url);
+    if (found == files.end())
+    {
+        request.status = HTTP_CODE_NOT_FOUND;
+        requests.push_back(request);
+        client.shimLoad({}, SIZE_MAX, 0);
+        size = 0;
+        return HTTP_CODE_NOT_FOUND;
+    }
+
+    const ShimHttpFile &file = found->second;
+    size_t offset = 0;
+    int status = HTTP_CODE_OK;
+    unsigned long first;
+    if (rangeSupported && sscanf(request.range.c_str(), "bytes=%lu-", &first) == 1 &&
+        (request.ifRange.empty() || request.ifRange == file.etag) && first < file.body.size())
+    {
+        offset = first;
+        status = HTTP_CODE_PARTIAL_CONTENT;
+        char contentRange[64];
+        snprintf(contentRange, sizeof(contentRange), "bytes %lu-%lu/%lu", first,
+                 (unsigned long)file.body.size() - 1, (unsigned long)file.body.size());
+        responseHeaders["Content-Range"] = contentRange;
+    }
+    responseHeaders["ETag"] = file.etag;
+
+    std::vector<uint8_t> body(file.body.begin() + offset, file.body.end());
+    size_t lossAt = SIZE_MAX;
+    if (!lossOffsets.empty())
+    {
+        lossAt = lossOffsets.front();
+        lossOffsets.pop_front();
+    }
+    sentBytes += std::min(lossAt, body.size());
+
+    size = body.size();
+    client.shimLoad(std::move(body), lossAt, readDelayUs);
+    request.status = status;
+    requests.push_back(request);
+    return status;
+}
+
+String HTTPClient::errorToString(int error)
+{
+    switch (error)
+    {
+    case HTTPC_ERROR_CONNECTION_REFUSED:
+        return F("connection refused");
+    case HTTPC_ERROR_SEND_HEADER_FAILED:
+        return F("send header failed");
+    case HTTPC_ERROR_NOT_CONNECTED:
+        return F("not connected");
+    case HTTPC_ERROR_CONNECTION_LOST:
+        return F("connection lost");
+    case HTTPC_ERROR_READ_TIMEOUT:
+        return F("read Timeout");
+    default:
+        return String();
+    }
+}
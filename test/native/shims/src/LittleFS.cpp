@@ -0,0 +1,267 @@
+/**
+ * @file LittleFS.cpp
+ * @brief Host implementation of the file system shim with simulated power cuts.
+ */
+
+#include <LittleFS.h>
+#include <filesystem>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+
+LittleFSFS LittleFS;
+
+struct ShimFile
+{
+    std::string name;
+    FILE *stream = NULL;
+    bool writable = false;
+};
+
+static std::mutex fsMutex;
+static std::string rootPath;
+static bool powerCutArmed = false;
+static bool powerLost = false;
+static size_t writeBudget = 0;
+
+/**
+ * @brief Returns the host directory of the file system, created on the first use.
+ */
+static const std::string &getRoot()
+{
+    if (rootPath.empty())
+    {
+        char path[] = "/tmp/shim_littlefs_XXXXXX";
+        rootPath = mkdtemp(path);
+    }
+    return rootPath;
+}
+
+String shimFsHostPath(const char *path)
+{
+    std::lock_guard<std::mutex> lock(fsMutex);
+    return String((getRoot() + path).c_str());
+}
+
+/**
+ * @brief Returns whether a mutating operation could run, false after the power was cut.
+ */
+static bool hasPower()
+{
+    return !powerLost;
+}
+
+/**
+ * @brief Takes bytes from the write budget of the armed power cut.
+ *
+ * @param length The number of bytes to write.
+ * @return The number of bytes that could be written.
+ */
+static size_t takeWriteBudget(size_t length)
+{
+    if (powerLost)
+        return 0;
+    if (!powerCutArmed)
+        return length;
+
+    if (length >= writeBudget)
+    {
+        length = writeBudget;
+        writeBudget = 0;
+        powerLost = true;
+        return length;
+    }
+
+    writeBudget -= length;
+    return length;
+}
+
+void shimFsFormat()
+{
+    std::lock_guard<std::mutex> lock(fsMutex);
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(getRoot(), error))
+        std::filesystem::remove_all(entry.path(), error);
+}
+
+void shimFsPowerCutAfter(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(fsMutex);
+    powerCutArmed = true;
+    powerLost = false;
+    writeBudget = bytes;
+}
+
+void shimFsRestorePower()
+{
+    std::lock_guard<std::mutex> lock(fsMutex);
+    powerCutArmed = false;
+    powerLost = false;
+}
+
+bool shimFsPowerCut()
+{
+    std::lock_guard<std::mutex> lock(fsMutex);
+    return powerLost;
+}
+
+File::operator bool() const
+{
+    return file && file->stream != NULL;
+}
+
+size_t File::write(const uint8_t *buffer, size_t size)
+{
+    if (!*this || !file->writable)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(fsMutex);
+    size_t allowed = takeWriteBudget(size);
+    size_t written = fwrite(buffer, 1, allowed, file->stream);
+    fflush(file->stream);
+    return written;
+}
+
+int File::available()
+{
+    if (!*this)
+        return 0;
+    return (int)(size() - position());
+}
+
+int File::read()
+{
+    uint8_t value;
+    return readBytes(&value, 1) == 1 ? value : -1;
+}
+
+int File::peek()
+{
+    if (!*this)
+        return -1;
+    int value = fgetc(file->stream);
+    if (value != EOF)
+        ungetc(value, file->stream);
+    return value == EOF ? -1 : value;
+}
+
+size_t File::readBytes(uint8_t *buffer, size_t length)
+{
+    if (!*this)
+        return 0;
+    return fread(buffer, 1, length, file->stream);
+}
+
+void File::flush()
+{
+    if (*this)
+        fflush(file->stream);
+}
+
+bool File::seek(uint32_t position)
+{
+    return *this && fseek(file->stream, position, SEEK_SET) == 0;
+}
+
+size_t File::position() const
+{
+    return *this ? ftell(file->stream) : 0;
+}
+
+size_t File::size() const
+{
+    if (!*this)
+        return 0;
+
+    long current = ftell(file->stream);
+    fseek(file->stream, 0, SEEK_END);
+    long end = ftell(file->stream);
+    fseek(file->stream, current, SEEK_SET);
+    return end;
+}
+
+const char *File::name() const
+{
+    return file ? file->name.c_str() : "";
+}
+
+void File::close()
+{
+    if (*this)
+    {
+        fclose(file->stream);
+        file->stream = NULL;
+    }
+    file.reset();
+}
+
+File FS::open(const char *path, const char *mode, bool create)
+{
+    std::lock_guard<std::mutex> lock(fsMutex);
+    bool writing = mode[0] != 'r' || strchr(mode, '+') != NULL;
+    if (writing && !hasPower())
+        return File();
+
+    FILE *stream = fopen((getRoot() + path).c_str(), mode[0] == 'r' ? (writing ? "r+b" : "rb")
+                                                     : mode[0] == 'w' ? "w+b"
+                                                                      : "a+b");
+    if (stream == NULL)
+        return File();
+
+    auto file = std::make_shared<ShimFile>();
+    file->name = path;
+    file->stream = stream;
+    file->writable = writing;
+    return File(file);
+}
+
+bool FS::exists(const char *path)
+{
+    std::lock_guard<std::mutex> lock(fsMutex);
+    return std::filesystem::exists(getRoot() + path);
+}
+
+bool FS::remove(const char *path)
+{
+    std::lock_guard<std::mutex> lock(fsMutex);
+    return hasPower() && ::remove((getRoot() + path).c_str()) == 0;
+}
+
+bool FS::rename(const char *from, const char *to)
+{
+    // Atomic like the rename of LittleFS: the target is either the old or the new file
+    std::lock_guard<std::mutex> lock(fsMutex);
+    return hasPower() && ::rename((getRoot() + from).c_str(), (getRoot() + to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char *path)
+{
+    std::lock_guard<std::mutex> lock(fsMutex);
+    std::error_code error;
+    return hasPower() && std::filesystem::create_directories(getRoot() + path, error);
+}
+
+bool LittleFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles, const char *partitionLabel)
+{
+    std::lock_guard<std::mutex> lock(fsMutex);
+    return !getRoot().empty();
+}
+
+bool LittleFSFS::format()
+{
+    shimFsFormat();
+    return true;
+}
+
+size_t LittleFSFS::usedBytes()
+{
+    std::lock_guard<std::mutex> lock(fsMutex);
+    size_t used = 0;
+    std::error_code error;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(getRoot(), error))
+    {
+        if (entry.is_regular_file())
+            used += entry.file_size();
+    }
+    return used;
+}
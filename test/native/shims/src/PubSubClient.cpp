@@ -0,0 +1,249 @@
+/**
+ * @file PubSubClient.cpp
+ * @brief Host implementation of the PubSubClient shim.
+ */
+
+#include <PubSubClient.h>
+#include <string.h>
+
+PubSubClient &PubSubClient::setServer(const char *serverHost, uint16_t serverPort)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    host = serverHost;
+    port = serverPort;
+    return *this;
+}
+
+PubSubClient &PubSubClient::setServer(IPAddress ip, uint16_t serverPort)
+{
+    return setServer(ip.toString().c_str(), serverPort);
+}
+
+PubSubClient &PubSubClient::setCallback(std::function<void(char *, uint8_t *, unsigned int)> messageCallback)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    callback = messageCallback;
+    return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (size == 0)
+        return false;
+    bufferSize = size;
+    return true;
+}
+
+uint16_t PubSubClient::getBufferSize()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return bufferSize;
+}
+
+bool PubSubClient::connect(const char *id)
+{
+    return connect(id, NULL, NULL, NULL, 0, false, NULL);
+}
+
+bool PubSubClient::connect(const char *id, const char *user, const char *pass)
+{
+    return connect(id, user, pass, NULL, 0, false, NULL);
+}
+
+bool PubSubClient::connect(const char *id, const char *user, const char *pass, const char *willTopic,
+                           uint8_t willQos, bool willRetain, const char *willMessage)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (!brokerAvailable)
+    {
+        clientState = MQTT_CONNECT_FAILED;
+        return false;
+    }
+
+    connects++;
+    isConnected = true;
+    clientState = MQTT_CONNECTED;
+    subscriptions.clear();
+    return true;
+}
+
+void PubSubClient::disconnect()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    isConnected = false;
+    clientState = MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload)
+{
+    return publish(topic, (const uint8_t *)payload, payload ? strnlen(payload, bufferSize) : 0, false);
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload, bool retained)
+{
+    return publish(topic, (const uint8_t *)payload, payload ? strnlen(payload, bufferSize) : 0, retained);
+}
+
+bool PubSubClient::publish(const char *topic, const uint8_t *payload, unsigned int length)
+{
+    return publish(topic, payload, length, false);
+}
+
+bool PubSubClient::publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (!isConnected)
+        return false;
+
+    // The whole packet must fit into the buffer
+    if (bufferSize < MQTT_MAX_HEADER_SIZE + 2 + strnlen(topic, bufferSize) + length)
+        return false;
+
+    published.push_back({topic, std::string((const char *)payload, length), retained});
+    return true;
+}
+
+bool PubSubClient::beginPublish(const char *topic, unsigned int length, bool retained)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (!isConnected)
+        return false;
+
+    streamed = {topic, std::string(), retained};
+    streamedLength = length;
+    return true;
+}
+
+size_t PubSubClient::write(const uint8_t *buffer, size_t size)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (!isConnected)
+        return 0;
+
+    streamed.payload.append((const char *)buffer, size);
+    return size;
+}
+
+int PubSubClient::endPublish()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (!isConnected || streamed.payload.size() != streamedLength)
+        return 0;
+
+    published.push_back(streamed);
+    return 1;
+}
+
+bool PubSubClient::subscribe(const char *topic, uint8_t qos)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (!isConnected)
+        return false;
+
+    subscriptions.push_back(topic);
+    return true;
+}
+
+bool PubSubClient::unsubscribe(const char *topic)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    for (size_t i = 0; i < subscriptions.size(); i++)
+    {
+        if (subscriptions[i] == topic)
+        {
+            subscriptions.erase(subscriptions.begin() + i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PubSubClient::loop()
+{
+    std::vector<ShimMqttMessage> messages;
+    std::function<void(char *, uint8_t *, unsigned int)> messageCallback;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        loops++;
+        if (!isConnected)
+            return false;
+
+        messages.swap(inbox);
+        messageCallback = callback;
+    }
+
+    for (ShimMqttMessage &message : messages)
+    {
+        if (messageCallback)
+            messageCallback((char *)message.topic.c_str(), (uint8_t *)message.payload.data(), message.payload.size());
+    }
+    return connected();
+}
+
+bool PubSubClient::connected()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return isConnected;
+}
+
+int PubSubClient::state()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return clientState;
+}
+
+void PubSubClient::shimSetBrokerAvailable(bool available)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    brokerAvailable = available;
+}
+
+void PubSubClient::shimDropConnection()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    isConnected = false;
+    clientState = MQTT_CONNECTION_LOST;
+}
+
+void PubSubClient::shimDeliver(const char *topic, const uint8_t *payload, size_t length)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    inbox.push_back({topic, std::string((const char *)payload, length), false});
+}
+
+void PubSubClient::shimDeliver(const char *topic, const char *payload)
+{
+    shimDeliver(topic, (const uint8_t *)payload, strlen(payload));
+}
+
+std::vector<ShimMqttMessage> PubSubClient::shimPublished()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return published;
+}
+
+std::vector<std::string> PubSubClient::shimSubscriptions()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return subscriptions;
+}
+
+uint32_t PubSubClient::shimConnects()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return connects;
+}
+
+uint32_t PubSubClient::shimLoops()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return loops;
+}
+
+void PubSubClient::shimClear()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    published.clear();
+    inbox.clear();
+}
@@ -0,0 +1,379 @@
+/**
+ * @file WString.cpp
+ * @brief Host implementation of the Arduino String.
+ */
+
+#include <WString.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+String::String(const char *cstr)
+{
+    if (cstr != nullptr)
+        copy(cstr, strlen(cstr));
+}
+
+String::String(const char *cstr, unsigned int length)
+{
+    if (cstr != nullptr)
+        copy(cstr, length);
+}
+
+String::String(const String &str)
+{
+    *this = str;
+}
+
+String::String(String &&str)
+{
+    *this = static_cast<String &&>(str);
+}
+
+String::String(char c)
+{
+    copy(&c, 1);
+}
+
+/**
+ * @brief Formats an unsigned value in the base.
+ */
+static void formatUnsigned(char *buffer, unsigned long long value, unsigned char base)
+{
+    char digits[66];
+    int position = 0;
+    do
+    {
+        unsigned digit = value % base;
+        digits[position++] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+        value /= base;
+    } while (value != 0);
+
+    while (position > 0)
+        *buffer++ = digits[--position];
+    *buffer = '\0';
+}
+
+/**
+ * @brief Formats a signed value in the base, negative values only in base 10.
+ */
+static void formatSigned(char *buffer, long long value, unsigned char base)
+{
+    if (value < 0 && base == 10)
+    {
+        *buffer++ = '-';
+        formatUnsigned(buffer, (unsigned long long)(-(value + 1)) + 1, base);
+    }
+    else
+        formatUnsigned(buffer, (unsigned long long)value, base);
+}
+
+String::String(unsigned char value, unsigned char base) : String((unsigned long long)value, base) {}
+String::String(int value, unsigned char base) : String((long long)value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long long)value, base) {}
+String::String(long value, unsigned char base) : String((long long)value, base) {}
+String::String(unsigned long value, unsigned char base) : String((unsigned long long)value, base) {}
+
+String::String(long long value, unsigned char base)
+{
+    char buffer[68];
+    formatSigned(buffer, value, base);
+    copy(buffer, strlen(buffer));
+}
+
+String::String(unsigned long long value, unsigned char base)
+{
+    char buffer[68];
+    formatUnsigned(buffer, value, base);
+    copy(buffer, strlen(buffer));
+}
+
+String::String(float value, unsigned int decimalPlaces) : String((double)value, decimalPlaces) {}
+
+String::String(double value, unsigned int decimalPlaces)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", (int)decimalPlaces, value);
+    copy(buffer, strlen(buffer));
+}
+
+String::~String()
+{
+    free(buffer);
+}
+
+void String::invalidate()
+{
+    free(buffer);
+    buffer = nullptr;
+    capacity = 0;
+    len = 0;
+}
+
+bool String::reserve(unsigned int size)
+{
+    if (buffer != nullptr && capacity >= size)
+        return true;
+
+    char *newBuffer = (char *)realloc(buffer, size + 1);
+    if (newBuffer == nullptr)
+        return false;
+
+    if (buffer == nullptr)
+        newBuffer[0] = '\0';
+    buffer = newBuffer;
+    capacity = size;
+    return true;
+}
+
+bool String::copy(const char *cstr, unsigned int length)
+{
+    if (!reserve(length))
+    {
+        invalidate();
+        return false;
+    }
+
+    memmove(buffer, cstr, length);
+    buffer[length] = '\0';
+    len = length;
+    return true;
+}
+
+String &String::operator=(const String &rhs)
+{
+    if (this == &rhs)
+        return *this;
+
+    if (rhs.buffer != nullptr)
+        copy(rhs.buffer, rhs.len);
+    else
+        invalidate();
+    return *this;
+}
+
+String &String::operator=(String &&rhs)
+{
+    if (this != &rhs)
+    {
+        free(buffer);
+        buffer = rhs.buffer;
+        capacity = rhs.capacity;
+        len = rhs.len;
+        rhs.buffer = nullptr;
+        rhs.capacity = 0;
+        rhs.len = 0;
+    }
+    return *this;
+}
+
+String &String::operator=(const char *cstr)
+{
+    if (cstr != nullptr)
+        copy(cstr, strlen(cstr));
+    else
+        invalidate();
+    return *this;
+}
+
+bool String::concat(const char *cstr)
+{
+    return cstr != nullptr && concat(cstr, strlen(cstr));
+}
+
+bool String::concat(const char *cstr, unsigned int length)
+{
+    if (cstr == nullptr)
+        return false;
+    if (length == 0)
+        return true;
+
+    // The source could be a part of this string
+    if (buffer != nullptr && cstr >= buffer && cstr < buffer + len)
+    {
+        String part(cstr, length);
+        return concat(part.c_str(), length);
+    }
+
+    if (!reserve(len + length))
+        return false;
+
+    memcpy(buffer + len, cstr, length);
+    len += length;
+    buffer[len] = '\0';
+    return true;
+}
+
+int String::compareTo(const String &str) const
+{
+    return strcmp(c_str(), str.c_str());
+}
+
+bool String::equals(const char *cstr) const
+{
+    return strcmp(c_str(), cstr != nullptr ? cstr : "") == 0;
+}
+
+bool String::equalsIgnoreCase(const String &str) const
+{
+    return len == str.len && strcasecmp(c_str(), str.c_str()) == 0;
+}
+
+bool String::startsWith(const String &prefix) const
+{
+    return prefix.len <= len && strncmp(c_str(), prefix.c_str(), prefix.len) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+    return suffix.len <= len && strcmp(c_str() + len - suffix.len, suffix.c_str()) == 0;
+}
+
+char &String::operator[](unsigned int index)
+{
+    static char dummy;
+    if (index >= len)
+    {
+        dummy = 0;
+        return dummy;
+    }
+    return buffer[index];
+}
+
+int String::indexOf(char c, unsigned int fromIndex) const
+{
+    if (fromIndex >= len)
+        return -1;
+    const char *found = strchr(c_str() + fromIndex, c);
+    return found != nullptr ? found - c_str() : -1;
+}
+
+int String::indexOf(const String &str, unsigned int fromIndex) const
+{
+    if (fromIndex >= len)
+        return -1;
+    const char *found = strstr(c_str() + fromIndex, str.c_str());
+    return found != nullptr ? found - c_str() : -1;
+}
+
+int String::lastIndexOf(char c) const
+{
+    const char *found = strrchr(c_str(), c);
+    return found != nullptr ? found - c_str() : -1;
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const
+{
+    if (beginIndex > endIndex)
+    {
+        unsigned int temp = endIndex;
+        endIndex = beginIndex;
+        beginIndex = temp;
+    }
+    if (beginIndex >= len)
+        return String();
+    if (endIndex > len)
+        endIndex = len;
+    return String(c_str() + beginIndex, endIndex - beginIndex);
+}
+
+void String::replace(const String &find, const String &replace)
+{
+    if (len == 0 || find.len == 0)
+        return;
+
+    String result;
+    unsigned int position = 0;
+    for (int found = indexOf(find); found >= 0; found = indexOf(find, position))
+    {
+        result.concat(c_str() + position, found - position);
+        result.concat(replace);
+        position = found + find.len;
+    }
+    result.concat(c_str() + position, len - position);
+    *this = static_cast<String &&>(result);
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+    if (index >= len)
+        return;
+    if (count > len - index)
+        count = len - index;
+
+    memmove(buffer + index, buffer + index + count, len - index - count + 1);
+    len -= count;
+}
+
+void String::toLowerCase()
+{
+    for (unsigned int i = 0; i < len; i++)
+        buffer[i] = tolower((unsigned char)buffer[i]);
+}
+
+void String::toUpperCase()
+{
+    for (unsigned int i = 0; i < len; i++)
+        buffer[i] = toupper((unsigned char)buffer[i]);
+}
+
+void String::trim()
+{
+    if (len == 0)
+        return;
+
+    unsigned int first = 0;
+    while (first < len && isspace((unsigned char)buffer[first]))
+        first++;
+    unsigned int last = len;
+    while (last > first && isspace((unsigned char)buffer[last - 1]))
+        last--;
+
+    memmove(buffer, buffer + first, last - first);
+    len = last - first;
+    buffer[len] = '\0';
+}
+
+long String::toInt() const
+{
+    return atol(c_str());
+}
+
+float String::toFloat() const
+{
+    return (float)atof(c_str());
+}
+
+double String::toDouble() const
+{
+    return atof(c_str());
+}
+
+String operator+(const String &lhs, const String &rhs)
+{
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const String &lhs, const char *rhs)
+{
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const char *lhs, const String &rhs)
+{
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const String &lhs, char rhs)
+{
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
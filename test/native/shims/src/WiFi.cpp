@@ -0,0 +1,536 @@
+/**
+ * @file WiFi.cpp
+ * @brief Host implementation of the fake WiFi driver.
+ */
+
+#include <WiFi.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "shim_internal.h"
+
+WiFiClass WiFi;
+
+struct ShimAccessPoint
+{
+    std::string ssid;
+    std::string password;
+    uint8_t bssid[6];
+    int32_t channel;
+    int8_t rssi;
+    uint32_t leaseIP;
+    uint32_t gateway;
+    bool available;
+};
+
+struct ShimEvent
+{
+    WiFiEvent_t event;
+    WiFiEventInfo_t info;
+};
+
+// State of the fake driver, guarded by driverMutex, the events are delivered without it
+static std::recursive_mutex driverMutex;
+static std::vector<ShimAccessPoint> accessPoints;
+static std::vector<WiFiEventFuncCb> handlers;
+static std::vector<ShimEvent> pendingEvents;
+
+static uint32_t connectDurationMs = 200;
+static uint32_t dhcpDurationMs = 500;
+static uint32_t scanDurationMs = 2000;
+static bool scansFail = false;
+static ShimWiFiCounters counters = {};
+
+static wl_status_t linkStatus = WL_IDLE_STATUS;
+static int connectedIndex = -1;      // Access point of the link
+static int connectingIndex = -1;     // Access point of the running attempt, -1 if not found
+static bool connecting = false;
+static uint64_t connectDoneAt = 0;
+static bool dhcpRunning = false;
+static uint64_t dhcpDoneAt = 0;
+static bool staticConfig = false;
+static uint32_t staticIP = 0, staticGateway = 0, staticSubnet = 0, staticDns = 0;
+static uint32_t localAddress = 0, gatewayAddress = 0, subnetAddress = 0, dnsAddress = 0;
+static bool autoReconnect = true;
+static std::string hostname = "esp32";
+static uint8_t connectedBssid[6];
+
+static int16_t scanState = WIFI_SCAN_FAILED;
+static uint64_t scanDoneAt = 0;
+static std::vector<ShimAccessPoint> scanResults;
+
+static const uint8_t macAddressBytes[6] = {0x24, 0xab, 0xcd, 0x12, 0x34, 0x56};
+
+/**
+ * @brief Returns the current simulated time in milliseconds.
+ */
+static uint64_t nowMs()
+{
+    return shimTimeUs() / 1000;
+}
+
+/**
+ * @brief Queues an event for the handlers.
+ */
+static void queueEvent(WiFiEvent_t event, uint8_t reason = 0)
+{
+    ShimEvent queued = {};
+    queued.event = event;
+    if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED)
+        queued.info.wifi_sta_disconnected.reason = reason;
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP)
+        queued.info.got_ip.ip = localAddress;
+    pendingEvents.push_back(queued);
+}
+
+/**
+ * @brief Ends the link or the running attempt.
+ */
+static void endLink(uint8_t reason)
+{
+    bool hadLink = linkStatus == WL_CONNECTED;
+    connecting = false;
+    dhcpRunning = false;
+    connectedIndex = -1;
+    localAddress = 0;
+    linkStatus = WL_DISCONNECTED;
+    if (hadLink)
+        queueEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, reason);
+}
+
+/**
+ * @brief Binds the address, the static one or the lease of the DHCP server.
+ */
+static void bindAddress()
+{
+    const ShimAccessPoint &accessPoint = accessPoints[connectedIndex];
+    if (staticConfig)
+    {
+        localAddress = staticIP;
+        gatewayAddress = staticGateway;
+        subnetAddress = staticSubnet;
+        dnsAddress = staticDns;
+    }
+    else
+    {
+        localAddress = accessPoint.leaseIP;
+        gatewayAddress = accessPoint.gateway;
+        subnetAddress = IPAddress(255, 255, 255, 0);
+        dnsAddress = accessPoint.gateway;
+    }
+    queueEvent(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+}
+
+/**
+ * @brief Starts the DHCP client on the established link.
+ */
+static void startDhcp()
+{
+    counters.dhcpStarts++;
+    localAddress = 0;
+    dhcpRunning = true;
+    dhcpDoneAt = nowMs() + dhcpDurationMs;
+}
+
+/**
+ * @brief Completes the operations due at the current time.
+ */
+static void advanceDriver()
+{
+    uint64_t timeNow = nowMs();
+
+    if (connecting && timeNow >= connectDoneAt)
+    {
+        connecting = false;
+        if (connectingIndex < 0)
+        {
+            linkStatus = WL_NO_SSID_AVAIL;
+            pendingEvents.push_back({ARDUINO_EVENT_WIFI_STA_DISCONNECTED, {}});
+            pendingEvents.back().info.wifi_sta_disconnected.reason = WIFI_REASON_NO_AP_FOUND;
+        }
+        else
+        {
+            connectedIndex = connectingIndex;
+            memcpy(connectedBssid, accessPoints[connectedIndex].bssid, sizeof(connectedBssid));
+            queueEvent(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+            if (staticConfig)
+            {
+                counters.staticConfigs++;
+                linkStatus = WL_CONNECTED;
+                bindAddress();
+            }
+            else
+                startDhcp();
+        }
+    }
+
+    if (dhcpRunning && timeNow >= dhcpDoneAt && connectedIndex >= 0)
+    {
+        dhcpRunning = false;
+        linkStatus = WL_CONNECTED;
+        bindAddress();
+    }
+
+    if (scanState == WIFI_SCAN_RUNNING && scanDurationMs > 0 && timeNow >= scanDoneAt)
+    {
+        scanResults.clear();
+        for (const ShimAccessPoint &accessPoint : accessPoints)
+        {
+            if (accessPoint.available)
+                scanResults.push_back(accessPoint);
+        }
+        scanState = scanResults.size();
+        queueEvent(ARDUINO_EVENT_WIFI_SCAN_DONE);
+    }
+
+    // The link is lost when the access point goes away
+    if (connectedIndex >= 0 && !accessPoints[connectedIndex].available)
+        endLink(WIFI_REASON_BEACON_TIMEOUT);
+}
+
+void shimWiFiPoll()
+{
+    std::vector<ShimEvent> events;
+    std::vector<WiFiEventFuncCb> callbacks;
+    {
+        std::lock_guard<std::recursive_mutex> lock(driverMutex);
+        advanceDriver();
+        events.swap(pendingEvents);
+        callbacks = handlers;
+    }
+
+    for (const ShimEvent &event : events)
+    {
+        for (const WiFiEventFuncCb &callback : callbacks)
+        {
+            if (callback)
+                callback(event.event, event.info);
+        }
+    }
+}
+
+void shimWiFiReset()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    accessPoints.clear();
+    pendingEvents.clear();
+    scanResults.clear();
+    connectDurationMs = 200;
+    dhcpDurationMs = 500;
+    scanDurationMs = 2000;
+    scansFail = false;
+    counters = {};
+    linkStatus = WL_IDLE_STATUS;
+    connectedIndex = -1;
+    connectingIndex = -1;
+    connecting = false;
+    dhcpRunning = false;
+    staticConfig = false;
+    localAddress = 0;
+    scanState = WIFI_SCAN_FAILED;
+}
+
+void shimWiFiAddAccessPoint(const char *ssid, const char *password, const uint8_t bssid[6], int32_t channel,
+                            int8_t rssi, IPAddress leaseIP, IPAddress gateway)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    ShimAccessPoint accessPoint = {ssid, password, {}, channel, rssi, leaseIP, gateway, true};
+    memcpy(accessPoint.bssid, bssid, sizeof(accessPoint.bssid));
+    accessPoints.push_back(accessPoint);
+}
+
+void shimWiFiSetAccessPoint(const char *ssid, int32_t channel, bool available)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    for (ShimAccessPoint &accessPoint : accessPoints)
+    {
+        if (accessPoint.ssid == ssid)
+        {
+            accessPoint.channel = channel;
+            accessPoint.available = available;
+        }
+    }
+}
+
+void shimWiFiSetLease(const char *ssid, IPAddress leaseIP)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    for (ShimAccessPoint &accessPoint : accessPoints)
+    {
+        if (accessPoint.ssid == ssid)
+            accessPoint.leaseIP = leaseIP;
+    }
+}
+
+void shimWiFiSetTimings(uint32_t connectMs, uint32_t dhcpMs, uint32_t scanMs)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    connectDurationMs = connectMs;
+    dhcpDurationMs = dhcpMs;
+    scanDurationMs = scanMs;
+}
+
+void shimWiFiFailScans(bool fail)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    scansFail = fail;
+}
+
+void shimWiFiDropLink(uint8_t reason)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    endLink(reason);
+}
+
+void shimWiFiQueueEvent(WiFiEvent_t event, uint8_t reason)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    queueEvent(event, reason);
+}
+
+ShimWiFiCounters shimWiFiCounters()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return counters;
+}
+
+bool shimWiFiStaticIP()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return staticConfig;
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *password, int32_t channel, const uint8_t *bssid,
+                             bool connect)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    endLink(WIFI_REASON_ASSOC_LEAVE);
+    counters.begins++;
+
+    // The attempt fails if the access point is not on the given channel or BSSID
+    connectingIndex = -1;
+    for (size_t i = 0; i < accessPoints.size(); i++)
+    {
+        const ShimAccessPoint &accessPoint = accessPoints[i];
+        if (accessPoint.available && accessPoint.ssid == ssid &&
+            accessPoint.password == (password ? password : "") &&
+            (channel == 0 || channel == accessPoint.channel) &&
+            (bssid == NULL || memcmp(bssid, accessPoint.bssid, 6) == 0))
+        {
+            connectingIndex = i;
+            break;
+        }
+    }
+
+    connecting = true;
+    connectDoneAt = nowMs() + connectDurationMs;
+    linkStatus = WL_DISCONNECTED;
+    return linkStatus;
+}
+
+bool WiFiClass::config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    if ((uint32_t)localIP == 0)
+    {
+        // DHCP is started again, also on an established link
+        bool wasStatic = staticConfig;
+        staticConfig = false;
+        if (wasStatic && connectedIndex >= 0)
+            startDhcp();
+        return true;
+    }
+
+    staticConfig = true;
+    staticIP = localIP;
+    staticGateway = gateway;
+    staticSubnet = subnet;
+    staticDns = dns1;
+    return true;
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    endLink(WIFI_REASON_ASSOC_LEAVE);
+    linkStatus = WL_IDLE_STATUS;
+    return true;
+}
+
+bool WiFiClass::reconnect()
+{
+    return false;
+}
+
+bool WiFiClass::mode(wifi_mode_t mode)
+{
+    return true;
+}
+
+wifi_mode_t WiFiClass::getMode()
+{
+    return WIFI_STA;
+}
+
+bool WiFiClass::setAutoReconnect(bool enabled)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    autoReconnect = enabled;
+    return true;
+}
+
+bool WiFiClass::getAutoReconnect()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return autoReconnect;
+}
+
+bool WiFiClass::setHostname(const char *name)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    hostname = name;
+    return true;
+}
+
+const char *WiFiClass::getHostname()
+{
+    return hostname.c_str();
+}
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventFuncCb callback, arduino_event_id_t event)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    handlers.push_back(callback);
+    return handlers.size();
+}
+
+void WiFiClass::removeEvent(wifi_event_id_t id)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    if (id > 0 && (size_t)id <= handlers.size())
+        handlers[id - 1] = nullptr;
+}
+
+wl_status_t WiFiClass::status()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return linkStatus;
+}
+
+String WiFiClass::SSID()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return connectedIndex >= 0 ? String(accessPoints[connectedIndex].ssid.c_str()) : String();
+}
+
+String WiFiClass::psk()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return connectedIndex >= 0 ? String(accessPoints[connectedIndex].password.c_str()) : String();
+}
+
+uint8_t *WiFiClass::BSSID()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return connectedIndex >= 0 ? connectedBssid : NULL;
+}
+
+int32_t WiFiClass::channel()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return connectedIndex >= 0 ? accessPoints[connectedIndex].channel : 0;
+}
+
+int8_t WiFiClass::RSSI()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return connectedIndex >= 0 ? accessPoints[connectedIndex].rssi : 0;
+}
+
+IPAddress WiFiClass::localIP()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return localAddress;
+}
+
+IPAddress WiFiClass::gatewayIP()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return gatewayAddress;
+}
+
+IPAddress WiFiClass::subnetMask()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return subnetAddress;
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t index)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return index == 0 ? dnsAddress : 0;
+}
+
+String WiFiClass::macAddress()
+{
+    char text[18];
+    snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X", macAddressBytes[0], macAddressBytes[1],
+             macAddressBytes[2], macAddressBytes[3], macAddressBytes[4], macAddressBytes[5]);
+    return String(text);
+}
+
+uint8_t *WiFiClass::macAddress(uint8_t *mac)
+{
+    memcpy(mac, macAddressBytes, sizeof(macAddressBytes));
+    return mac;
+}
+
+int16_t WiFiClass::scanNetworks(bool async, bool showHidden)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    if (scansFail || connecting)
+        return WIFI_SCAN_FAILED;
+
+    counters.scans++;
+    scanResults.clear();
+    scanState = WIFI_SCAN_RUNNING;
+    scanDoneAt = nowMs() + scanDurationMs;
+    return WIFI_SCAN_RUNNING;
+}
+
+int16_t WiFiClass::scanComplete()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return scanState;
+}
+
+void WiFiClass::scanDelete()
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    scanResults.clear();
+    scanState = WIFI_SCAN_FAILED;
+}
+
+String WiFiClass::SSID(uint8_t index)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return index < scanResults.size() ? String(scanResults[index].ssid.c_str()) : String();
+}
+
+uint8_t *WiFiClass::BSSID(uint8_t index)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return index < scanResults.size() ? scanResults[index].bssid : NULL;
+}
+
+int32_t WiFiClass::channel(uint8_t index)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return index < scanResults.size() ? scanResults[index].channel : 0;
+}
+
+int32_t WiFiClass::RSSI(uint8_t index)
+{
+    std::lock_guard<std::recursive_mutex> lock(driverMutex);
+    return index < scanResults.size() ? scanResults[index].rssi : 0;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file WiFiClient.cpp
+ * @brief Host implementation of the TCP client shim.
+ */
+
+#include <WiFiClient.h>
+#include "shim_internal.h"
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+    connection->open = true;
+    return 1;
+}
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+    connection->open = true;
+    return 1;
+}
+
+uint8_t WiFiClient::connected()
+{
+    // A lost connection is noticed when all data before the loss is read
+    return connection->open && connection->position < connection->closeAt;
+}
+
+void WiFiClient::stop()
+{
+    connection->open = false;
+}
+
+int WiFiClient::available()
+{
+    if (!connection->open)
+        return 0;
+
+    size_t end = std::min(connection->data.size(), connection->closeAt);
+    return connection->position < end ? (int)(end - connection->position) : 0;
+}
+
+int WiFiClient::read()
+{
+    uint8_t value;
+    return read(&value, 1) == 1 ? value : -1;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size)
+{
+    size_t length = std::min(size, (size_t)available());
+    if (length == 0)
+        return connected() ? 0 : -1;
+
+    memcpy(buffer, connection->data.data() + connection->position, length);
+    connection->position += length;
+    return (int)length;
+}
+
+int WiFiClient::peek()
+{
+    return available() > 0 ? connection->data[connection->position] : -1;
+}
+
+size_t WiFiClient::readBytes(uint8_t *buffer, size_t length)
+{
+    if (connection->readDelayUs > 0)
+        shimSleepUs(connection->readDelayUs);
+
+    int count = read(buffer, length);
+    return count > 0 ? count : 0;
+}
+
+void WiFiClient::shimLoad(std::vector<uint8_t> data, size_t closeAt, uint32_t readDelayUs)
+{
+    connection = std::make_shared<ShimConnection>();
+    connection->data = std::move(data);
+    connection->closeAt = closeAt;
+    connection->readDelayUs = readDelayUs;
+    connection->open = true;
+}
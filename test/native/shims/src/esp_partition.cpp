@@ -0,0 +1,161 @@
+/**
+ * @file esp_partition.cpp
+ * @brief Host implementation of the flash partitions and the OTA selection.
+ */
+
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+#include <mutex>
+#include <string.h>
+#include "shim_internal.h"
+
+// App partitions of the min_spiffs.csv layout
+static const esp_partition_t otaPartitions[2] = {
+    {NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, 0x1E0000, "app0", false},
+    {NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x1F0000, 0x1E0000, "app1", false},
+};
+
+#define FLASH_SECTOR_SIZE 4096
+#define APP_IMAGE_MAGIC   0xE9
+
+static std::mutex flashMutex;
+static std::vector<uint8_t> flash(otaPartitions[1].size, 0xFF);
+static std::vector<std::pair<size_t, size_t>> writes;
+static ShimFlashCounters counters = {};
+static uint32_t writePerKbUs = 0;
+static uint32_t eraseSectorUs = 0;
+static size_t failWritesFrom = SIZE_MAX;
+static const esp_partition_t *bootPartition = NULL;
+
+void shimFlashReset()
+{
+    std::lock_guard<std::mutex> lock(flashMutex);
+    std::fill(flash.begin(), flash.end(), 0xFF);
+    writes.clear();
+    counters = {};
+    failWritesFrom = SIZE_MAX;
+    bootPartition = NULL;
+}
+
+void shimFlashSetTimings(uint32_t writeUs, uint32_t eraseUs)
+{
+    std::lock_guard<std::mutex> lock(flashMutex);
+    writePerKbUs = writeUs;
+    eraseSectorUs = eraseUs;
+}
+
+void shimFlashFailWritesFrom(size_t offset)
+{
+    std::lock_guard<std::mutex> lock(flashMutex);
+    failWritesFrom = offset;
+}
+
+std::vector<std::pair<size_t, size_t>> shimFlashWrites()
+{
+    std::lock_guard<std::mutex> lock(flashMutex);
+    return writes;
+}
+
+const uint8_t *shimFlashData()
+{
+    return flash.data();
+}
+
+ShimFlashCounters shimFlashCounters()
+{
+    std::lock_guard<std::mutex> lock(flashMutex);
+    return counters;
+}
+
+/**
+ * @brief Returns whether the range is inside the simulated OTA partition.
+ */
+static bool isValidRange(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    return partition == &otaPartitions[1] && offset + size <= partition->size;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *destination, size_t size)
+{
+    if (!isValidRange(partition, offset, size))
+        return ESP_ERR_INVALID_ARG;
+
+    std::lock_guard<std::mutex> lock(flashMutex);
+    memcpy(destination, flash.data() + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *source, size_t size)
+{
+    if (!isValidRange(partition, offset, size))
+        return ESP_ERR_INVALID_ARG;
+
+    uint64_t durationUs;
+    {
+        std::lock_guard<std::mutex> lock(flashMutex);
+        if (offset + size > failWritesFrom)
+            return ESP_FAIL;
+
+        // NOR flash only clears bits, the sector must be erased before
+        const uint8_t *data = (const uint8_t *)source;
+        for (size_t i = 0; i < size; i++)
+            flash[offset + i] &= data[i];
+
+        writes.push_back({offset, size});
+        counters.writes++;
+        durationUs = (uint64_t)writePerKbUs * size / 1024;
+        counters.writeTimeUs += durationUs;
+    }
+
+    if (durationUs > 0)
+        shimSleepUs(durationUs);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    if (!isValidRange(partition, offset, size) || offset % FLASH_SECTOR_SIZE != 0 || size % FLASH_SECTOR_SIZE != 0)
+        return ESP_ERR_INVALID_ARG;
+
+    uint64_t durationUs;
+    {
+        std::lock_guard<std::mutex> lock(flashMutex);
+        std::fill(flash.begin() + offset, flash.begin() + offset + size, 0xFF);
+        counters.erases++;
+        durationUs = (uint64_t)eraseSectorUs * (size / FLASH_SECTOR_SIZE);
+        counters.writeTimeUs += durationUs;
+    }
+
+    if (durationUs > 0)
+        shimSleepUs(durationUs);
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *startFrom)
+{
+    return &otaPartitions[1];
+}
+
+const esp_partition_t *esp_ota_get_running_partition()
+{
+    return &otaPartitions[0];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    if (partition != &otaPartitions[0] && partition != &otaPartitions[1])
+        return ESP_ERR_INVALID_ARG;
+
+    std::lock_guard<std::mutex> lock(flashMutex);
+    if (partition == &otaPartitions[1] && flash[0] != APP_IMAGE_MAGIC)
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+
+    bootPartition = partition;
+    return ESP_OK;
+}
+
+const esp_partition_t *shimOtaBootPartition()
+{
+    std::lock_guard<std::mutex> lock(flashMutex);
+    return bootPartition;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file esp_system.cpp
+ * @brief Host implementation of the WiFi power save settings and the idle hooks.
+ */
+
+#include <esp_freertos_hooks.h>
+#include <esp_wifi.h>
+#include <mutex>
+#include <vector>
+
+static wifi_ps_type_t powerSave = WIFI_PS_MIN_MODEM;
+static std::mutex hooksMutex;
+static std::vector<esp_freertos_idle_cb_t> idleHooks[2];
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    powerSave = type;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *type)
+{
+    *type = powerSave;
+    return ESP_OK;
+}
+
+esp_err_t esp_register_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t callback, uint32_t cpu)
+{
+    if (cpu >= 2)
+        return ESP_ERR_INVALID_ARG;
+
+    std::lock_guard<std::mutex> lock(hooksMutex);
+    if (idleHooks[cpu].size() >= 8)
+        return ESP_ERR_NO_MEM;
+    idleHooks[cpu].push_back(callback);
+    return ESP_OK;
+}
+
+void esp_deregister_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t callback, uint32_t cpu)
+{
+    if (cpu >= 2)
+        return;
+
+    std::lock_guard<std::mutex> lock(hooksMutex);
+    for (size_t i = 0; i < idleHooks[cpu].size(); i++)
+    {
+        if (idleHooks[cpu][i] == callback)
+        {
+            idleHooks[cpu].erase(idleHooks[cpu].begin() + i);
+            return;
+        }
+    }
+}
+
+void shimRunIdleHooks(uint32_t cpu)
+{
+    std::vector<esp_freertos_idle_cb_t> hooks;
+    {
+        std::lock_guard<std::mutex> lock(hooksMutex);
+        hooks = idleHooks[cpu];
+    }
+
+    for (esp_freertos_idle_cb_t hook : hooks)
+        hook();
+}
@@ -0,0 +1,173 @@
+/**
+ * @file esp_timer.cpp
+ * @brief Simulated time and the one-shot timers of the high resolution timer API.
+ */
+
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "shim_internal.h"
+
+struct esp_timer
+{
+    esp_timer_create_args_t args;
+    bool armed;
+    uint64_t expiresAtUs;
+};
+
+// The simulated time runs timeScale times faster than the real time since realBase, it stands still if timeScale is 0
+static std::mutex clockMutex;
+static std::chrono::steady_clock::time_point realBase = std::chrono::steady_clock::now();
+static uint64_t simulatedBaseUs = 0;
+static uint32_t timeScale = 1;
+
+// Timers dispatched by the esp_timer task
+static std::mutex timersMutex;
+static std::condition_variable timersCondition;
+static std::vector<esp_timer *> timers;
+static TaskHandle_t timerTask = NULL;
+
+uint64_t shimTimeUs()
+{
+    std::lock_guard<std::mutex> lock(clockMutex);
+    uint64_t realUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - realBase).count();
+    return simulatedBaseUs + realUs * timeScale;
+}
+
+uint64_t shimToRealUs(uint64_t us)
+{
+    std::lock_guard<std::mutex> lock(clockMutex);
+    return timeScale > 0 ? us / timeScale : us;
+}
+
+void shimSetTimeScale(uint32_t scale)
+{
+    uint64_t timeNow = shimTimeUs();
+
+    std::lock_guard<std::mutex> lock(clockMutex);
+    realBase = std::chrono::steady_clock::now();
+    simulatedBaseUs = timeNow;
+    timeScale = scale;
+}
+
+void shimAdvanceTime(uint64_t us)
+{
+    std::lock_guard<std::mutex> lock(clockMutex);
+    simulatedBaseUs += us;
+}
+
+void shimSleepUs(uint64_t us)
+{
+    shimCheckStop();
+    if (us == UINT64_MAX)
+    {
+        for (;;)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            shimCheckStop();
+        }
+    }
+
+    uint64_t wakeAtUs = shimTimeUs() + us;
+    for (uint64_t timeNow = shimTimeUs(); timeNow < wakeAtUs; timeNow = shimTimeUs())
+    {
+        // Short real time slices, so shimAdvanceTime() and shimStopTasks() are noticed
+        uint64_t sliceUs = std::min<uint64_t>(shimToRealUs(wakeAtUs - timeNow) + 1, 500);
+        std::this_thread::sleep_for(std::chrono::microseconds(sliceUs));
+        shimCheckStop();
+    }
+}
+
+int64_t esp_timer_get_time()
+{
+    return (int64_t)shimTimeUs();
+}
+
+/**
+ * @brief Task calling the callbacks of the expired timers, like the esp_timer task.
+ */
+static void timerTaskFunction(void *)
+{
+    std::unique_lock<std::mutex> lock(timersMutex);
+    for (;;)
+    {
+        uint64_t timeNow = shimTimeUs();
+        esp_timer *expired = NULL;
+        for (esp_timer *timer : timers)
+        {
+            if (timer->armed && timer->expiresAtUs <= timeNow)
+            {
+                expired = timer;
+                break;
+            }
+        }
+
+        if (expired == NULL)
+        {
+            shimWait(lock, timersCondition, 1000, [] { return false; });
+            continue;
+        }
+
+        expired->armed = false;
+        lock.unlock();
+        expired->args.callback(expired->args.arg);
+        lock.lock();
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    if (args == NULL || args->callback == NULL || handle == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_timer *timer = new esp_timer();
+    timer->args = *args;
+    timer->armed = false;
+
+    std::lock_guard<std::mutex> lock(timersMutex);
+    timers.push_back(timer);
+    if (timerTask == NULL || !shimTaskRunning("esp_timer"))
+        xTaskCreatePinnedToCore(timerTaskFunction, "esp_timer", 4096, NULL, 22, &timerTask, 0);
+
+    *handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+    std::lock_guard<std::mutex> lock(timersMutex);
+    if (timer->armed)
+        return ESP_ERR_INVALID_STATE;
+
+    timer->armed = true;
+    timer->expiresAtUs = shimTimeUs() + timeoutUs;
+    timersCondition.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::mutex> lock(timersMutex);
+    if (!timer->armed)
+        return ESP_ERR_INVALID_STATE;
+
+    timer->armed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::mutex> lock(timersMutex);
+    for (size_t i = 0; i < timers.size(); i++)
+    {
+        if (timers[i] == timer)
+        {
+            timers.erase(timers.begin() + i);
+            delete timer;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
@@ -0,0 +1,405 @@
+/**
+ * @file freertos.cpp
+ * @brief Host implementation of the FreeRTOS tasks, queues, semaphores and notifications.
+ */
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "shim_internal.h"
+
+struct tskTaskControlBlock
+{
+    std::string name;
+    TaskFunction_t function;
+    void *parameters;
+    uint32_t stackDepth;
+    BaseType_t core;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> deleteRequested{false};
+    std::mutex mutex;
+    std::condition_variable condition;
+    uint32_t notifyValue = 0;
+};
+
+struct QueueDefinition
+{
+    size_t itemSize;
+    size_t length;
+    std::vector<uint8_t> storage; // Ring of items, preallocated so queueing does not allocate
+    size_t head = 0;
+    size_t count = 0;
+    std::mutex mutex;
+    std::condition_variable condition;
+};
+
+// All tasks ever created, never freed as the firmware keeps the handles. The list is never
+// destroyed either, so the control blocks stay reachable until the exit
+static std::mutex tasksMutex;
+static std::vector<tskTaskControlBlock *> &tasks = *new std::vector<tskTaskControlBlock *>();
+static std::atomic<bool> stopping{false};
+
+// Task of the calling thread, the main thread is the Arduino loop task
+static thread_local tskTaskControlBlock *currentTask = NULL;
+static tskTaskControlBlock mainTask;
+static tskTaskControlBlock idleTasks[portNUM_PROCESSORS];
+
+void shimCheckStop()
+{
+    if (currentTask != NULL && (stopping || currentTask->deleteRequested))
+        throw ShimTaskExit();
+}
+
+bool shimInTask()
+{
+    return currentTask != NULL;
+}
+
+/**
+ * @brief Returns the control block of the calling thread.
+ */
+static tskTaskControlBlock *getCurrentTask()
+{
+    if (currentTask != NULL)
+        return currentTask;
+
+    if (mainTask.name.empty())
+    {
+        mainTask.name = "loopTask";
+        mainTask.stackDepth = 8192;
+        mainTask.core = 1;
+        mainTask.running = true;
+    }
+    return &mainTask;
+}
+
+/**
+ * @brief Runs the function of the task in its thread.
+ */
+static void runTask(tskTaskControlBlock *task)
+{
+    currentTask = task;
+    try
+    {
+        task->function(task->parameters);
+
+        // FreeRTOS stops in prvTaskExitError() when a task function returns
+        fprintf(stderr, "Task '%s' returned from its function\n", task->name.c_str());
+        abort();
+    }
+    catch (const ShimTaskExit &)
+    {
+    }
+    task->running = false;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t coreId)
+{
+    tskTaskControlBlock *task = new tskTaskControlBlock();
+    task->name = name;
+    task->function = function;
+    task->parameters = parameters;
+    task->stackDepth = stackDepth;
+    task->core = coreId == tskNO_AFFINITY ? -1 : coreId;
+    task->running = true;
+
+    // The handle must be set before the task runs, as in FreeRTOS with a higher priority task
+    if (createdTask != NULL)
+        *createdTask = task;
+
+    std::lock_guard<std::mutex> lock(tasksMutex);
+    tasks.push_back(task);
+    task->thread = std::thread(runTask, task);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters,
+                       UBaseType_t priority, TaskHandle_t *createdTask)
+{
+    return xTaskCreatePinnedToCore(function, name, stackDepth, parameters, priority, createdTask, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == currentTask)
+        throw ShimTaskExit();
+
+    // Another task ends at its next blocking call
+    task->deleteRequested = true;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    shimSleepUs(shimTicksToUs(ticks));
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *previousWakeTime, TickType_t timeIncrement)
+{
+    TickType_t wakeTime = *previousWakeTime + timeIncrement;
+    *previousWakeTime = wakeTime;
+
+    int32_t remaining = (int32_t)(wakeTime - xTaskGetTickCount());
+    if (remaining <= 0)
+    {
+        shimCheckStop();
+        return pdFALSE;
+    }
+
+    // Wake up at the tick boundary
+    uint64_t wakeTimeUs = (shimTimeUs() / 1000 + remaining) * 1000;
+    shimSleepUs(wakeTimeUs - shimTimeUs());
+    return pdTRUE;
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return (TickType_t)(shimTimeUs() / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return getCurrentTask();
+}
+
+TaskHandle_t xTaskGetHandle(const char *name)
+{
+    std::lock_guard<std::mutex> lock(tasksMutex);
+    for (tskTaskControlBlock *task : tasks)
+    {
+        if (task->running && task->name == name)
+            return task;
+    }
+
+    return strcmp(name, "loopTask") == 0 ? getCurrentTask() : NULL;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu)
+{
+    return cpu < portNUM_PROCESSORS ? &idleTasks[cpu] : NULL;
+}
+
+char *pcTaskGetName(TaskHandle_t task)
+{
+    if (task == NULL)
+        task = getCurrentTask();
+    return (char *)task->name.c_str();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    if (task == NULL)
+        task = getCurrentTask();
+
+    // The stack usage of a host thread is not comparable, report half of the stack as used
+    return task->stackDepth / 2;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifyValue++;
+    }
+    task->condition.notify_all();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+    tskTaskControlBlock *task = getCurrentTask();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    shimWait(lock, task->condition, shimTicksToUs(ticksToWait), [task] { return task->notifyValue != 0; });
+
+    uint32_t value = task->notifyValue;
+    if (value != 0)
+        task->notifyValue = clearCountOnExit ? 0 : value - 1;
+    return value;
+}
+
+BaseType_t xPortGetCoreID()
+{
+    BaseType_t core = getCurrentTask()->core;
+    return core < 0 ? 0 : core;
+}
+
+void vPortYield()
+{
+    shimCheckStop();
+    std::this_thread::yield();
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    const void *self = getCurrentTask();
+    if (mux->owner.load() == self)
+    {
+        mux->count++;
+        return;
+    }
+
+    const void *unlocked = NULL;
+    while (!mux->owner.compare_exchange_weak(unlocked, self))
+    {
+        unlocked = NULL;
+        std::this_thread::yield();
+    }
+    mux->count = 1;
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    if (--mux->count == 0)
+        mux->owner.store(NULL);
+}
+
+void shimStopTasks()
+{
+    stopping = true;
+
+    // Tasks could create other tasks while stopping
+    for (;;)
+    {
+        std::vector<tskTaskControlBlock *> running;
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            for (tskTaskControlBlock *task : tasks)
+            {
+                if (task->thread.joinable())
+                    running.push_back(task);
+            }
+        }
+        if (running.empty())
+            break;
+
+        for (tskTaskControlBlock *task : running)
+        {
+            task->condition.notify_all();
+            task->thread.join();
+        }
+    }
+
+    stopping = false;
+}
+
+bool shimTaskRunning(const char *name)
+{
+    std::lock_guard<std::mutex> lock(tasksMutex);
+    for (tskTaskControlBlock *task : tasks)
+    {
+        if (task->running && task->name == name)
+            return true;
+    }
+    return false;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    QueueDefinition *queue = new QueueDefinition();
+    queue->itemSize = itemSize;
+    queue->length = length;
+    queue->storage.resize((size_t)length * itemSize);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!shimWait(lock, queue->condition, shimTicksToUs(ticksToWait),
+                  [queue] { return queue->count < queue->length; }))
+        return pdFALSE;
+
+    size_t tail = (queue->head + queue->count) % queue->length;
+    if (queue->itemSize > 0)
+        memcpy(&queue->storage[tail * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+
+    // Notified under the lock, so the woken task could delete the queue, like after a give of a semaphore
+    queue->condition.notify_all();
+    return pdTRUE;
+}
+
+/**
+ * @brief Waits for an item and copies it, optionally removing it from the queue.
+ */
+static BaseType_t takeItem(QueueHandle_t queue, void *buffer, TickType_t ticksToWait, bool remove)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!shimWait(lock, queue->condition, shimTicksToUs(ticksToWait), [queue] { return queue->count > 0; }))
+        return pdFALSE;
+
+    if (queue->itemSize > 0 && buffer != NULL)
+        memcpy(buffer, &queue->storage[queue->head * queue->itemSize], queue->itemSize);
+
+    if (remove)
+    {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        queue->condition.notify_all();
+    }
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticksToWait)
+{
+    return takeItem(queue, buffer, ticksToWait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *buffer, TickType_t ticksToWait)
+{
+    return takeItem(queue, buffer, ticksToWait, false);
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->head = 0;
+    queue->count = 0;
+    queue->condition.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->length - queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    // A mutex is created given
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount)
+{
+    QueueHandle_t semaphore = xQueueCreate(maxCount, 0);
+    semaphore->count = initialCount;
+    return semaphore;
+}
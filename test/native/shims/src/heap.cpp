@@ -0,0 +1,69 @@
+/**
+ * @file heap.cpp
+ * @brief Counting of the host heap allocations, used by the tests to measure the heap churn.
+ *
+ * With a sanitizer the allocator hooks of the sanitizer count the allocations, otherwise the
+ * glibc allocation functions are wrapped. Other C libraries are not counted.
+ */
+
+#include <Arduino.h>
+#include <stdlib.h>
+
+// Allocations of the calling thread, a thread local of the executable does not allocate
+static thread_local uint64_t threadAllocations = 0;
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+// Declared by sanitizer/allocator_interface.h, which is not installed with every compiler
+extern "C" int __sanitizer_install_malloc_and_free_hooks(void (*mallocHook)(const volatile void *, size_t),
+                                                         void (*freeHook)(const volatile void *));
+
+static void countMalloc(const volatile void *ptr, size_t size)
+{
+    threadAllocations++;
+}
+
+static void ignoreFree(const volatile void *ptr)
+{
+}
+
+static int hooksInstalled = __sanitizer_install_malloc_and_free_hooks(countMalloc, ignoreFree);
+
+#elif defined(__GLIBC__)
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void __libc_free(void *ptr);
+
+    void *malloc(size_t size)
+    {
+        threadAllocations++;
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        threadAllocations++;
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *ptr, size_t size)
+    {
+        threadAllocations++;
+        return __libc_realloc(ptr, size);
+    }
+
+    void free(void *ptr)
+    {
+        __libc_free(ptr);
+    }
+}
+
+#endif
+
+uint64_t shimThreadAllocations()
+{
+    return threadAllocations;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file lwip.cpp
+ * @brief Host implementation of the lwIP sockets shim.
+ */
+
+#include <lwip/sockets.h>
+#include "shim_internal.h"
+
+#undef select
+
+// Longest real time waited by the host select() between two checks of shimStopTasks() (in microseconds)
+#define SELECT_SLICE_US 10000
+
+int shimSelect(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+{
+    uint64_t timeoutUs = timeout ? timeout->tv_sec * 1000000ULL + timeout->tv_usec : UINT64_MAX;
+    fd_set read, write, except;
+
+    for (uint64_t waitedUs = 0;; waitedUs += SELECT_SLICE_US)
+    {
+        shimCheckStop();
+
+        // The host select() overwrites the sets, every slice waits for all the requested sockets
+        if (readfds)
+            read = *readfds;
+        if (writefds)
+            write = *writefds;
+        if (exceptfds)
+            except = *exceptfds;
+
+        uint64_t sliceUs = std::min<uint64_t>(SELECT_SLICE_US, timeoutUs - waitedUs);
+        struct timeval slice = {(time_t)(sliceUs / 1000000), (suseconds_t)(sliceUs % 1000000)};
+        int result = ::select(nfds, readfds ? &read : NULL, writefds ? &write : NULL, exceptfds ? &except : NULL, &slice);
+        if (result != 0 || waitedUs + sliceUs >= timeoutUs)
+        {
+            if (readfds)
+                *readfds = read;
+            if (writefds)
+                *writefds = write;
+            if (exceptfds)
+                *exceptfds = except;
+            return result;
+        }
+    }
+}
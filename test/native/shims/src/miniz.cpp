@@ -0,0 +1,67 @@
+/**
+ * @file miniz.cpp
+ * @brief Host implementation of the tinfl shim.
+ */
+
+#include <esp32/rom/miniz.h>
+#include <string.h>
+
+/**
+ * @brief Allocates the zlib memory from the arena of the decoder.
+ */
+static voidpf arenaAlloc(voidpf opaque, uInt items, uInt size)
+{
+    tinfl_decompressor *decompressor = (tinfl_decompressor *)opaque;
+    size_t length = ((size_t)items * size + 15) & ~(size_t)15;
+    if (decompressor->arenaUsed + length > sizeof(decompressor->arena))
+        return Z_NULL;
+
+    void *memory = decompressor->arena + decompressor->arenaUsed;
+    decompressor->arenaUsed += length;
+    return memory;
+}
+
+/**
+ * @brief The arena is released with the decoder.
+ */
+static void arenaFree(voidpf opaque, voidpf address)
+{
+}
+
+void tinfl_init(tinfl_decompressor *decompressor)
+{
+    memset(&decompressor->stream, 0, sizeof(decompressor->stream));
+    decompressor->arenaUsed = 0;
+    decompressor->stream.zalloc = arenaAlloc;
+    decompressor->stream.zfree = arenaFree;
+    decompressor->stream.opaque = decompressor;
+    inflateInit2(&decompressor->stream, -MAX_WBITS);
+}
+
+tinfl_status tinfl_decompress(tinfl_decompressor *decompressor, const uint8_t *inputNext, size_t *inputSize,
+                              uint8_t *outputStart, uint8_t *outputNext, size_t *outputSize, uint32_t flags)
+{
+    z_stream &stream = decompressor->stream;
+    stream.next_in = (Bytef *)inputNext;
+    stream.avail_in = *inputSize;
+    stream.next_out = outputNext;
+    stream.avail_out = *outputSize;
+
+    int result = inflate(&stream, Z_NO_FLUSH);
+    *inputSize -= stream.avail_in;
+    *outputSize -= stream.avail_out;
+
+    switch (result)
+    {
+    case Z_STREAM_END:
+        return TINFL_STATUS_DONE;
+    case Z_OK:
+    case Z_BUF_ERROR:
+        if (stream.avail_out == 0)
+            return TINFL_STATUS_HAS_MORE_OUTPUT;
+        return (flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT
+                                                    : TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS;
+    default:
+        return TINFL_STATUS_FAILED;
+    }
+}
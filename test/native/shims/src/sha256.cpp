@@ -0,0 +1,149 @@
+/**
+ * @file sha256.cpp
+ * @brief Host implementation of SHA-256 (FIPS 180-4), only SHA-256 and not SHA-224.
+ */
+
+#include <mbedtls/sha256.h>
+#include <string.h>
+
+static const uint32_t roundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotateRight(uint32_t value, int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+/**
+ * @brief Processes one 64-byte block.
+ */
+static void processBlock(mbedtls_sha256_context *context, const uint8_t *block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)block[i * 4] << 24 | block[i * 4 + 1] << 16 | block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = context->state[0], b = context->state[1], c = context->state[2], d = context->state[3];
+    uint32_t e = context->state[4], f = context->state[5], g = context->state[6], h = context->state[7];
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+        uint32_t choice = (e & f) ^ (~e & g);
+        uint32_t temp1 = h + s1 + choice + roundConstants[i] + w[i];
+        uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+        uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t temp2 = s0 + majority;
+        h = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+
+    context->state[0] += a;
+    context->state[1] += b;
+    context->state[2] += c;
+    context->state[3] += d;
+    context->state[4] += e;
+    context->state[5] += f;
+    context->state[6] += g;
+    context->state[7] += h;
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *context)
+{
+    memset(context, 0, sizeof(*context));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *context)
+{
+    if (context != NULL)
+        memset(context, 0, sizeof(*context));
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context *context, int is224)
+{
+    static const uint32_t initialState[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                             0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    if (is224)
+        return -1;
+
+    memcpy(context->state, initialState, sizeof(initialState));
+    context->total = 0;
+    context->is224 = 0;
+    return 0;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context *context, const unsigned char *input, size_t length)
+{
+    size_t used = context->total % 64;
+    context->total += length;
+
+    if (used > 0)
+    {
+        size_t fill = 64 - used < length ? 64 - used : length;
+        memcpy(context->buffer + used, input, fill);
+        input += fill;
+        length -= fill;
+        if (used + fill < 64)
+            return 0;
+        processBlock(context, context->buffer);
+    }
+
+    for (; length >= 64; input += 64, length -= 64)
+        processBlock(context, input);
+
+    memcpy(context->buffer, input, length);
+    return 0;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context *context, unsigned char output[32])
+{
+    uint64_t bits = context->total * 8;
+    uint8_t padding[72] = {0x80};
+    size_t used = context->total % 64;
+    size_t paddingLength = used < 56 ? 56 - used : 120 - used;
+    for (int i = 0; i < 8; i++)
+        padding[paddingLength + i] = bits >> (56 - i * 8);
+    mbedtls_sha256_update(context, padding, paddingLength + 8);
+
+    for (int i = 0; i < 8; i++)
+    {
+        output[i * 4] = context->state[i] >> 24;
+        output[i * 4 + 1] = context->state[i] >> 16;
+        output[i * 4 + 2] = context->state[i] >> 8;
+        output[i * 4 + 3] = context->state[i];
+    }
+    return 0;
+}
+
+int mbedtls_sha256(const unsigned char *input, size_t length, unsigned char output[32], int is224)
+{
+    mbedtls_sha256_context context;
+    mbedtls_sha256_init(&context);
+    int result = mbedtls_sha256_starts(&context, is224);
+    if (result == 0)
+    {
+        mbedtls_sha256_update(&context, input, length);
+        mbedtls_sha256_finish(&context, output);
+    }
+    mbedtls_sha256_free(&context);
+    return result;
+}
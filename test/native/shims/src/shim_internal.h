@@ -0,0 +1,70 @@
+/**
+ * @file shim_internal.h
+ * @brief Helpers shared by the shims: simulated time and blocking waits of the tasks.
+ */
+
+#ifndef SHIM_INTERNAL_H
+#define SHIM_INTERNAL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+
+// Thrown in a task to end it: by vTaskDelete(NULL), ESP.restart() and shimStopTasks()
+struct ShimTaskExit
+{
+};
+
+uint64_t shimTimeUs();
+// Converts the simulated duration to the real one
+uint64_t shimToRealUs(uint64_t us);
+
+// Ends the current task if shimStopTasks() was called, no effect outside the tasks
+void shimCheckStop();
+// Returns whether the caller is one of the simulated tasks
+bool shimInTask();
+
+/**
+ * @brief Waits on the condition until the predicate is true or the simulated timeout passes.
+ *
+ * @param lock The locked mutex of the condition.
+ * @param condition The condition notified when the predicate could change.
+ * @param timeoutUs The timeout in microseconds of the simulated time, UINT64_MAX to wait forever.
+ * @param predicate The predicate.
+ * @return The value of the predicate.
+ */
+template <typename Predicate>
+bool shimWait(std::unique_lock<std::mutex> &lock, std::condition_variable &condition, uint64_t timeoutUs,
+              Predicate predicate)
+{
+    uint64_t start = shimTimeUs();
+    while (!predicate())
+    {
+        // Short real time slices, so shimAdvanceTime() and shimStopTasks() are noticed
+        uint64_t sliceUs = 500;
+        if (timeoutUs != UINT64_MAX)
+        {
+            uint64_t elapsed = shimTimeUs() - start;
+            if (elapsed >= timeoutUs)
+                return false;
+            sliceUs = std::min(sliceUs, shimToRealUs(timeoutUs - elapsed) + 1);
+        }
+
+        condition.wait_for(lock, std::chrono::microseconds(sliceUs));
+
+        lock.unlock();
+        shimCheckStop();
+        lock.lock();
+    }
+
+    return true;
+}
+
+// Converts the FreeRTOS ticks to the simulated microseconds
+inline uint64_t shimTicksToUs(uint32_t ticks)
+{
+    return ticks == 0xffffffffUL ? UINT64_MAX : (uint64_t)ticks * 1000;
+}
+
+#endif // SHIM_INTERNAL_H
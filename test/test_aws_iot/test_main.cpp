@@ -0,0 +1,146 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the status messages published after the boot against the in-memory MQTT broker.
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <unity.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "aws_iot.h"
+#include "boot_trace.h"
+#include "system_clock.h"
+
+#define CLIENT_ID         "AABBCC"
+#define STATUS_TOPIC      "int-cz-map/status/device/" CLIENT_ID
+#define DIAGNOSTICS_TOPIC "int-cz-map/status/diagnostics/" CLIENT_ID
+
+extern PubSubClient client;
+
+static std::atomic<uint64_t> virtualTimeUs{1000000};
+
+static uint64_t virtualClock()
+{
+    return virtualTimeUs;
+}
+
+/**
+ * @brief Returns the messages published to the topic since the last shimClear().
+ */
+static std::vector<ShimMqttMessage> publishedTo(const char *topic)
+{
+    std::vector<ShimMqttMessage> messages;
+    for (const ShimMqttMessage &message : client.shimPublished())
+    {
+        if (message.topic == topic)
+            messages.push_back(message);
+    }
+    return messages;
+}
+
+/**
+ * @brief Returns the published messages with the boot trace.
+ */
+static std::vector<ShimMqttMessage> bootTraceMessages()
+{
+    std::vector<ShimMqttMessage> messages;
+    for (const ShimMqttMessage &message : client.shimPublished())
+    {
+        if (message.payload.find("\"boot_us\"") != std::string::npos)
+            messages.push_back(message);
+    }
+    return messages;
+}
+
+/**
+ * @brief Connects the station using the fake WiFi driver.
+ */
+static void connectWiFi()
+{
+    const uint8_t bssid[6] = {0x10, 0x20, 0x30, 0x40, 0x50, 0x60};
+    shimWiFiAddAccessPoint("home", "secret", bssid, 6, -50, IPAddress(192, 168, 1, 50), IPAddress(192, 168, 1, 1));
+    WiFi.begin("home", "secret");
+    while (!WiFi.isConnected())
+    {
+        shimAdvanceTime(100000);
+        shimWiFiPoll();
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_boot_trace_is_published_once_beside_the_status()
+{
+    // Every stage of the boot is reached before the first connection
+    for (uint8_t stage = 0; stage < BOOT_STAGE_AWS_CONNECTED; stage++)
+        bootTraceMark((BootStage)stage);
+
+    char clientId[] = CLIENT_ID;
+    initAWS(clientId, sizeof(clientId) - 1);
+
+    // The status does not carry the trace, so it fits the buffer
+    std::vector<ShimMqttMessage> status = publishedTo(STATUS_TOPIC);
+    TEST_ASSERT_EQUAL(1, status.size());
+    TEST_ASSERT_LESS_THAN(AWS_PUBLISH_BUFFER_SIZE, status[0].payload.size());
+
+    // The trace is a separate message with all the stages
+    std::vector<ShimMqttMessage> trace = bootTraceMessages();
+    TEST_ASSERT_EQUAL(1, trace.size());
+    TEST_ASSERT_EQUAL_STRING(DIAGNOSTICS_TOPIC, trace[0].topic.c_str());
+
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, trace[0].payload.c_str(), trace[0].payload.size()));
+    JsonObject boot = doc["boot_us"];
+    TEST_ASSERT_EQUAL(BOOT_STAGE_COUNT, boot.size());
+    TEST_ASSERT_TRUE(boot["setup_start"].is<uint32_t>());
+    TEST_ASSERT_TRUE(boot["aws_connected"].is<uint32_t>());
+}
+
+void test_status_keeps_publishing_after_the_boot()
+{
+    for (int interval = 0; interval < 3; interval++)
+    {
+        client.shimClear();
+        virtualTimeUs += AWS_STATUS_PUBLISH_INTERVAL * 1000ULL;
+        maintainAWSConnection();
+        periodicStatusPublishAWS();
+
+        TEST_ASSERT_EQUAL(1, publishedTo(STATUS_TOPIC).size());
+        TEST_ASSERT_EQUAL(0, bootTraceMessages().size());
+    }
+}
+
+void test_boot_trace_is_not_repeated_after_reconnect()
+{
+    client.shimClear();
+    client.shimDropConnection();
+    virtualTimeUs += AWS_STATUS_PUBLISH_INTERVAL * 1000ULL;
+    maintainAWSConnection();
+
+    TEST_ASSERT_TRUE(client.connected());
+    TEST_ASSERT_EQUAL(1, publishedTo(STATUS_TOPIC).size());
+    TEST_ASSERT_EQUAL(0, bootTraceMessages().size());
+}
+
+int main()
+{
+    setClockSource(virtualClock);
+    connectWiFi();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_boot_trace_is_published_once_beside_the_status);
+    RUN_TEST(test_status_keeps_publishing_after_the_boot);
+    RUN_TEST(test_boot_trace_is_not_repeated_after_reconnect);
+    shimStopTasks();
+    return UNITY_END();
+}
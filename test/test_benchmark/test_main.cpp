@@ -0,0 +1,124 @@
+/**
+ * @file test_main.cpp
+ * @brief Runs the benchmark suite on the host and checks its results.
+ *
+ * The CSV lines are printed as on the device, so the host results of the hot paths could be
+ * compared between commits with: pio test -e native -f test_benchmark -v | grep BENCH
+ */
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <unity.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "leds.h"
+
+// Result line of a case
+struct BenchmarkResult
+{
+    std::string name;
+    uint32_t param, runs, minUs, p50Us, p90Us, p99Us, maxUs, meanUs;
+};
+
+static std::string output;
+static std::vector<BenchmarkResult> results;
+
+/**
+ * @brief Parses the "BENCH," lines of the output.
+ */
+static void parseResults()
+{
+    std::istringstream lines(output);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        if (line.rfind("BENCH,", 0) != 0)
+            continue;
+
+        BenchmarkResult result;
+        char name[32];
+        if (sscanf(line.c_str(), "BENCH,%31[^,],%u,%u,%u,%u,%u,%u,%u,%u", name, &result.param, &result.runs,
+                   &result.minUs, &result.p50Us, &result.p90Us, &result.p99Us, &result.maxUs, &result.meanUs) == 9)
+        {
+            result.name = name;
+            results.push_back(result);
+        }
+    }
+}
+
+/**
+ * @brief Returns the number of results of the case.
+ */
+static size_t countResults(const char *name)
+{
+    size_t count = 0;
+    for (const BenchmarkResult &result : results)
+        count += result.name == name;
+    return count;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_every_case_reports_results()
+{
+    TEST_ASSERT_TRUE(output.find("BENCH_START,") != std::string::npos);
+    TEST_ASSERT_TRUE(output.find("BENCH_END") != std::string::npos);
+
+    TEST_ASSERT_EQUAL(1, countResults("parse_minimal"));
+    TEST_ASSERT_EQUAL(1, countResults("parse_full"));
+    TEST_ASSERT_EQUAL(1, countResults("deserialize_full"));
+    TEST_ASSERT_EQUAL(4, countResults("frame"));
+    TEST_ASSERT_EQUAL(1, countResults("status_json"));
+    TEST_ASSERT_EQUAL(1, countResults("log_call"));
+    TEST_ASSERT_EQUAL(1, countResults("progress_indicator"));
+}
+
+void test_percentiles_are_ordered()
+{
+    for (const BenchmarkResult &result : results)
+    {
+        TEST_ASSERT_EQUAL(BENCHMARK_RUNS, result.runs);
+        TEST_ASSERT_LESS_OR_EQUAL(result.p50Us, result.minUs);
+        TEST_ASSERT_LESS_OR_EQUAL(result.p90Us, result.p50Us);
+        TEST_ASSERT_LESS_OR_EQUAL(result.p99Us, result.p90Us);
+        TEST_ASSERT_LESS_OR_EQUAL(result.maxUs, result.p99Us);
+        TEST_ASSERT_LESS_OR_EQUAL(result.maxUs, result.meanUs);
+        TEST_ASSERT_GREATER_OR_EQUAL(result.minUs, result.meanUs);
+    }
+}
+
+void test_rendering_resumes_after_the_benchmarks()
+{
+    uint32_t frames = FastLED.shownFrames();
+    delay(200);
+    TEST_ASSERT_GREATER_THAN(frames, FastLED.shownFrames());
+}
+
+int main()
+{
+    ledsTaskInit();
+
+    shimSerialCapture(true);
+    runBenchmarks();
+    output = shimSerialTakeOutput().c_str();
+    shimSerialCapture(false);
+
+    // The results of the host run
+    fputs(output.c_str(), stdout);
+    parseResults();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_every_case_reports_results);
+    RUN_TEST(test_percentiles_are_ordered);
+    RUN_TEST(test_rendering_resumes_after_the_benchmarks);
+    shimStopTasks();
+    return UNITY_END();
+}
@@ -0,0 +1,227 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the latency histograms and their percentiles with commands timed by a stopped clock.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "command_latency.h"
+
+// Current time of the stopped simulated clock (in microseconds)
+static uint64_t timeNowUs = 0;
+
+/**
+ * @brief Moves the stopped clock forward.
+ */
+static void advance(uint32_t us)
+{
+    shimAdvanceTime(us);
+    timeNowUs += us;
+}
+
+/**
+ * @brief Times one LEDs command through all the stages.
+ *
+ * @return The batch ID of the command.
+ */
+static uint8_t runCommand(uint32_t parseUs, uint32_t enqueueUs, uint32_t renderUs)
+{
+    uint32_t receivedAt = micros();
+    advance(parseUs);
+    uint8_t batch = latencyCommandParsed(receivedAt);
+    advance(enqueueUs);
+    latencyCommandEnqueued(batch);
+    advance(renderUs);
+    latencyCommandRendered(batch);
+    return batch;
+}
+
+/**
+ * @brief Returns the samples added to the histogram of the stage since the snapshot.
+ */
+static LatencyHistogram samplesSince(LatencyStage stage, const LatencyHistogram &snapshot)
+{
+    LatencyHistogram histogram;
+    getLatencyHistogram(stage, histogram);
+    for (uint8_t i = 0; i < LATENCY_BUCKETS_COUNT; i++)
+        histogram.buckets[i] -= snapshot.buckets[i];
+    histogram.count -= snapshot.count;
+    return histogram;
+}
+
+/**
+ * @brief Returns the index of the bucket collecting the latency.
+ */
+static uint8_t bucketOf(uint32_t latencyUs)
+{
+    uint8_t bucket = 0;
+    while (latencyUs > latencyBucketLimitUs(bucket))
+        bucket++;
+    return bucket;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_samples_on_the_bucket_limits()
+{
+    LatencyHistogram before;
+    getLatencyHistogram(LATENCY_TOTAL, before);
+
+    // Every limit belongs to its bucket, one microsecond more to the next one
+    for (uint8_t bucket = 0; bucket < LATENCY_BUCKETS_COUNT - 1; bucket++)
+    {
+        uint32_t limit = latencyBucketLimitUs(bucket);
+        runCommand(0, 0, limit);
+        runCommand(0, 0, limit + 1);
+    }
+
+    LatencyHistogram samples = samplesSince(LATENCY_TOTAL, before);
+    TEST_ASSERT_EQUAL(2 * (LATENCY_BUCKETS_COUNT - 1), samples.count);
+    TEST_ASSERT_EQUAL(1, samples.buckets[0]);
+    for (uint8_t bucket = 1; bucket < LATENCY_BUCKETS_COUNT - 1; bucket++)
+        TEST_ASSERT_EQUAL(2, samples.buckets[bucket]);
+    TEST_ASSERT_EQUAL(1, samples.buckets[LATENCY_BUCKETS_COUNT - 1]);
+}
+
+void test_stages_are_measured_separately()
+{
+    LatencyHistogram parse, enqueue, render, total;
+    getLatencyHistogram(LATENCY_PARSE, parse);
+    getLatencyHistogram(LATENCY_ENQUEUE, enqueue);
+    getLatencyHistogram(LATENCY_RENDER, render);
+    getLatencyHistogram(LATENCY_TOTAL, total);
+
+    runCommand(150, 3000, 40000);
+
+    TEST_ASSERT_EQUAL(1, samplesSince(LATENCY_PARSE, parse).buckets[bucketOf(150)]);
+    TEST_ASSERT_EQUAL(1, samplesSince(LATENCY_ENQUEUE, enqueue).buckets[bucketOf(3000)]);
+    TEST_ASSERT_EQUAL(1, samplesSince(LATENCY_RENDER, render).buckets[bucketOf(40000)]);
+    TEST_ASSERT_EQUAL(1, samplesSince(LATENCY_TOTAL, total).buckets[bucketOf(43150)]);
+}
+
+void test_percentiles_match_the_exact_ones()
+{
+    LatencyHistogram histogram = {};
+    std::vector<uint32_t> latencies;
+    std::mt19937 random(44);
+    std::lognormal_distribution<double> distribution(8.5, 1.2);
+
+    for (uint32_t i = 0; i < 5000; i++)
+    {
+        uint32_t latencyUs = std::min(distribution(random), 3e6);
+        latencies.push_back(latencyUs);
+        histogram.buckets[bucketOf(latencyUs)]++;
+        histogram.count++;
+        histogram.maxUs = std::max(histogram.maxUs, latencyUs);
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    // The estimate is the upper limit of the bucket holding the exact nearest-rank percentile
+    const uint8_t percentiles[] = {1, 50, 90, 99, 100};
+    for (uint8_t percentile : percentiles)
+    {
+        uint32_t exact = latencies[(latencies.size() * percentile + 99) / 100 - 1];
+        uint32_t estimate = latencyPercentileUs(histogram, percentile);
+        TEST_ASSERT_GREATER_OR_EQUAL(exact, estimate);
+        TEST_ASSERT_EQUAL(std::min(latencyBucketLimitUs(bucketOf(exact)), histogram.maxUs), estimate);
+    }
+    TEST_ASSERT_EQUAL(latencies.back(), latencyPercentileUs(histogram, 100));
+}
+
+void test_percentiles_of_few_samples()
+{
+    LatencyHistogram histogram = {};
+    TEST_ASSERT_EQUAL(0, latencyPercentileUs(histogram, 50));
+
+    // A single sample is never reported above itself
+    histogram.buckets[bucketOf(7000)]++;
+    histogram.count = 1;
+    histogram.maxUs = 7000;
+    TEST_ASSERT_EQUAL(7000, latencyPercentileUs(histogram, 0));
+    TEST_ASSERT_EQUAL(7000, latencyPercentileUs(histogram, 99));
+
+    // The samples of the last bucket are reported as the largest one
+    histogram.buckets[LATENCY_BUCKETS_COUNT - 1]++;
+    histogram.count = 2;
+    histogram.maxUs = 4000000;
+    TEST_ASSERT_EQUAL(10000, latencyPercentileUs(histogram, 50));
+    TEST_ASSERT_EQUAL(4000000, latencyPercentileUs(histogram, 51));
+}
+
+void test_render_before_the_last_enqueue()
+{
+    LatencyHistogram render, total;
+    getLatencyHistogram(LATENCY_RENDER, render);
+    getLatencyHistogram(LATENCY_TOTAL, total);
+
+    // The LED task shows the first LED while the rest of the command is still being queued
+    uint32_t receivedAt = micros();
+    advance(300);
+    uint8_t batch = latencyCommandParsed(receivedAt);
+    advance(1000);
+    latencyCommandRendered(batch);
+    advance(1000);
+    latencyCommandEnqueued(batch);
+
+    TEST_ASSERT_EQUAL(1, samplesSince(LATENCY_RENDER, render).buckets[0]);
+    TEST_ASSERT_EQUAL(1, samplesSince(LATENCY_TOTAL, total).buckets[bucketOf(1300)]);
+}
+
+void test_latency_across_the_rollover_of_micros()
+{
+    LatencyHistogram total;
+    getLatencyHistogram(LATENCY_TOTAL, total);
+
+    // Stop 250 us before the 32-bit microseconds roll over
+    advance(UINT32_MAX - (uint32_t)(timeNowUs % (1ULL << 32)) - 250);
+    TEST_ASSERT_EQUAL(UINT32_MAX - 250, (uint32_t)micros());
+
+    runCommand(100, 100, 600);
+    TEST_ASSERT_LESS_THAN(1000, (uint32_t)micros());
+    TEST_ASSERT_EQUAL(1, samplesSince(LATENCY_TOTAL, total).buckets[bucketOf(800)]);
+}
+
+void test_overwritten_commands_are_dropped()
+{
+    LatencyHistogram total;
+    getLatencyHistogram(LATENCY_TOTAL, total);
+
+    // More commands are parsed than tracked at once, the oldest one is never shown
+    uint8_t oldest = latencyCommandParsed(micros());
+    latencyCommandEnqueued(oldest);
+    for (uint8_t i = 0; i < 4; i++)
+        runCommand(100, 100, 100);
+
+    advance(500000);
+    latencyCommandRendered(oldest);
+
+    LatencyHistogram samples = samplesSince(LATENCY_TOTAL, total);
+    TEST_ASSERT_EQUAL(4, samples.count);
+    TEST_ASSERT_EQUAL(4, samples.buckets[bucketOf(300)]);
+}
+
+int main()
+{
+    shimSetTimeScale(0);
+    timeNowUs = micros();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_samples_on_the_bucket_limits);
+    RUN_TEST(test_stages_are_measured_separately);
+    RUN_TEST(test_percentiles_match_the_exact_ones);
+    RUN_TEST(test_percentiles_of_few_samples);
+    RUN_TEST(test_render_before_the_last_enqueue);
+    RUN_TEST(test_latency_across_the_rollover_of_micros);
+    RUN_TEST(test_overwritten_commands_are_dropped);
+    shimStopTasks();
+    return UNITY_END();
+}
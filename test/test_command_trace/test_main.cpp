@@ -0,0 +1,163 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the command trace recorded across simulated reboots and its replay schedule.
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <atomic>
+#include <string>
+#include "command_trace.h"
+#include "leds.h"
+#include "system_clock.h"
+
+// Minimal LEDs command, the same as test/example_leds_minimal_payload.json
+#define LEDS_PAYLOAD "{\"leds\":[{\"id\":64,\"cl\":\"FFFF00\"}]}"
+
+static std::atomic<uint64_t> virtualTimeUs{0};
+
+static uint64_t virtualClock()
+{
+    return virtualTimeUs;
+}
+
+/**
+ * @brief Sets the time since the simulated boot.
+ */
+static void setTimeMs(uint32_t ms)
+{
+    virtualTimeUs = (uint64_t)ms * 1000;
+}
+
+/**
+ * @brief Simulates a reboot, the time starts again from the given value.
+ */
+static void reboot(uint32_t timeMs)
+{
+    setTimeMs(timeMs);
+    initCommandTrace();
+}
+
+/**
+ * @brief Records an LEDs command received at the time.
+ */
+static void recordAt(uint32_t timeMs)
+{
+    setTimeMs(timeMs);
+    traceRecordCommand(TRACE_TOPIC_LEDS, (const uint8_t *)LEDS_PAYLOAD, strlen(LEDS_PAYLOAD));
+}
+
+/**
+ * @brief Writes the buffered records to the flash.
+ */
+static void flushAt(uint32_t timeMs)
+{
+    setTimeMs(timeMs);
+    handleCommandTrace();
+}
+
+/**
+ * @brief Runs the replay until the time and returns the number of replayed commands.
+ */
+static uint32_t replayedAt(uint32_t timeMs)
+{
+    setTimeMs(timeMs);
+    handleCommandTrace();
+    return getTraceStats().replayed;
+}
+
+void setUp()
+{
+    shimFsFormat();
+    clearCommandTrace();
+}
+
+void tearDown()
+{
+}
+
+void test_every_boot_restarts_the_schedule()
+{
+    reboot(100);
+    recordAt(1000);
+    recordAt(2000);
+    flushAt(2000 + TRACE_FLUSH_INTERVAL_MS);
+
+    // The time of the second boot starts below the times of the first one
+    reboot(100);
+    recordAt(600);
+    recordAt(800);
+    flushAt(800 + TRACE_FLUSH_INTERVAL_MS);
+
+    // The replay starts at 10 s, the first boot is replayed from its marker at 100 ms
+    setTimeMs(10000);
+    TEST_ASSERT_TRUE(startTraceReplay(100));
+    TEST_ASSERT_EQUAL(0, replayedAt(10899));
+    TEST_ASSERT_EQUAL(1, replayedAt(10900));
+    TEST_ASSERT_EQUAL(1, replayedAt(11899));
+    TEST_ASSERT_EQUAL(2, replayedAt(11900));
+
+    // The second boot continues after the last command of the first one
+    TEST_ASSERT_EQUAL(2, replayedAt(12399));
+    TEST_ASSERT_EQUAL(3, replayedAt(12400));
+    TEST_ASSERT_TRUE(getTraceStats().replaying);
+    TEST_ASSERT_EQUAL(4, replayedAt(12600));
+
+    TraceStats stats = getTraceStats();
+    TEST_ASSERT_FALSE(stats.replaying);
+    TEST_ASSERT_EQUAL(2, stats.boots);
+    TEST_ASSERT_EQUAL(0, stats.skipped);
+    TEST_ASSERT_EQUAL(0, stats.invalid);
+    TEST_ASSERT_EQUAL(0, stats.lagMaxMs);
+}
+
+void test_time_warped_replay_keeps_the_boots_apart()
+{
+    reboot(0);
+    recordAt(1000);
+    flushAt(1000 + TRACE_FLUSH_INTERVAL_MS);
+    reboot(0);
+    recordAt(400);
+    flushAt(400 + TRACE_FLUSH_INTERVAL_MS);
+
+    // Twice the speed halves the offsets within each boot
+    setTimeMs(5000);
+    TEST_ASSERT_TRUE(startTraceReplay(200));
+    TEST_ASSERT_EQUAL(0, replayedAt(5499));
+    TEST_ASSERT_EQUAL(1, replayedAt(5500));
+    TEST_ASSERT_EQUAL(1, replayedAt(5699));
+    TEST_ASSERT_EQUAL(2, replayedAt(5700));
+    TEST_ASSERT_EQUAL(2, getTraceStats().boots);
+}
+
+void test_records_lost_with_the_reboot_are_not_replayed()
+{
+    reboot(0);
+    recordAt(1000);
+
+    // The buffered record was not written before the reboot
+    reboot(0);
+    recordAt(3000);
+    flushAt(3000 + TRACE_FLUSH_INTERVAL_MS);
+
+    setTimeMs(10000);
+    TEST_ASSERT_TRUE(startTraceReplay(0));
+    TEST_ASSERT_EQUAL(1, replayedAt(10000));
+    TEST_ASSERT_FALSE(getTraceStats().replaying);
+    TEST_ASSERT_EQUAL(1, getTraceStats().boots);
+}
+
+int main()
+{
+    setClockSource(virtualClock);
+    LittleFS.begin(true);
+    ledsTaskInit();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_every_boot_restarts_the_schedule);
+    RUN_TEST(test_time_warped_replay_keeps_the_boots_apart);
+    RUN_TEST(test_records_lost_with_the_reboot_are_not_replayed);
+    shimStopTasks();
+    return UNITY_END();
+}
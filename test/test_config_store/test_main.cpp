@@ -0,0 +1,232 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the config store commits with simulated power cuts and corrupted store files.
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "config_store.h"
+
+/**
+ * @brief Sets the records of the given generation, every record changes between generations.
+ */
+static void setGeneration(uint32_t generation)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "generation %u", generation);
+    uint8_t blob[200];
+    memset(blob, generation, sizeof(blob));
+
+    TEST_ASSERT_TRUE(configSetU32("test.u32", generation));
+    TEST_ASSERT_TRUE(configSetI32("test.i32", -(int32_t)generation));
+    TEST_ASSERT_TRUE(configSetString("test.string", text));
+    TEST_ASSERT_TRUE(configSetBlob("test.blob", blob, sizeof(blob)));
+}
+
+/**
+ * @brief Returns the generation of the loaded records, fails if the records are mixed or missing.
+ */
+static uint32_t loadedGeneration()
+{
+    uint32_t generation = 0;
+    int32_t negated = 0;
+    char text[32], expectedText[32];
+    uint8_t blob[200];
+
+    TEST_ASSERT_TRUE(configGetU32("test.u32", generation));
+    TEST_ASSERT_TRUE(configGetI32("test.i32", negated));
+    TEST_ASSERT_EQUAL(-(int32_t)generation, negated);
+
+    TEST_ASSERT_TRUE(configGetString("test.string", text, sizeof(text)));
+    snprintf(expectedText, sizeof(expectedText), "generation %u", generation);
+    TEST_ASSERT_EQUAL_STRING(expectedText, text);
+
+    TEST_ASSERT_EQUAL(sizeof(blob), configGetBlob("test.blob", blob, sizeof(blob)));
+    for (uint8_t value : blob)
+        TEST_ASSERT_EQUAL((uint8_t)generation, value);
+
+    return generation;
+}
+
+/**
+ * @brief Reads the store file from the host directory of the file system.
+ */
+static std::vector<uint8_t> readStoreFile()
+{
+    std::ifstream file(shimFsHostPath(CONFIG_STORE_FILENAME).c_str(), std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+/**
+ * @brief Replaces the store file in the host directory of the file system.
+ */
+static void writeStoreFile(const std::vector<uint8_t> &content)
+{
+    std::ofstream file(shimFsHostPath(CONFIG_STORE_FILENAME).c_str(), std::ios::binary | std::ios::trunc);
+    file.write((const char *)content.data(), content.size());
+}
+
+void setUp()
+{
+    shimFsRestorePower();
+    shimFsFormat();
+    configStoreBegin();
+}
+
+void tearDown()
+{
+}
+
+void test_records_survive_the_reboot()
+{
+    setGeneration(1);
+    TEST_ASSERT_TRUE(configStoreCommit());
+
+    TEST_ASSERT_TRUE(configStoreBegin());
+    TEST_ASSERT_EQUAL(1, loadedGeneration());
+
+    // Nothing is written when the values do not change
+    std::string path = shimFsHostPath(CONFIG_STORE_FILENAME).c_str();
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(path);
+    setGeneration(1);
+    TEST_ASSERT_TRUE(configStoreCommit());
+    TEST_ASSERT_TRUE(modified == std::filesystem::last_write_time(path));
+}
+
+void test_power_cut_at_every_byte_keeps_one_generation()
+{
+    setGeneration(1);
+    TEST_ASSERT_TRUE(configStoreCommit());
+    size_t fileSize = readStoreFile().size();
+    TEST_ASSERT_GREATER_THAN(0, fileSize);
+
+    // The power is lost after every possible number of written bytes of the next commit
+    uint32_t oldLoads = 0, newLoads = 0;
+    for (size_t budget = 0; budget <= fileSize + 1; budget++)
+    {
+        setGeneration(2);
+        shimFsPowerCutAfter(budget);
+        bool committed = configStoreCommit();
+
+        // The reboot
+        shimFsRestorePower();
+        TEST_ASSERT_TRUE(configStoreBegin());
+        TEST_ASSERT_FALSE(LittleFS.exists(CONFIG_STORE_TMP_FILENAME));
+
+        uint32_t generation = loadedGeneration();
+        TEST_ASSERT_EQUAL(committed ? 2 : 1, generation);
+        (generation == 1 ? oldLoads : newLoads)++;
+
+        // Start the next round from the first generation again
+        if (generation == 2)
+        {
+            setGeneration(1);
+            TEST_ASSERT_TRUE(configStoreCommit());
+        }
+    }
+
+    // The commit needs the whole file plus the rename
+    TEST_ASSERT_EQUAL(fileSize + 1, oldLoads);
+    TEST_ASSERT_EQUAL(1, newLoads);
+}
+
+void test_leftover_temporary_file_is_discarded()
+{
+    setGeneration(2);
+    TEST_ASSERT_TRUE(configStoreCommit());
+    std::vector<uint8_t> newContent = readStoreFile();
+    setGeneration(1);
+    TEST_ASSERT_TRUE(configStoreCommit());
+
+    // A commit interrupted between the write and the rename leaves a complete temporary file
+    std::ofstream tmp(shimFsHostPath(CONFIG_STORE_TMP_FILENAME).c_str(), std::ios::binary);
+    tmp.write((const char *)newContent.data(), newContent.size());
+    tmp.close();
+
+    TEST_ASSERT_TRUE(configStoreBegin());
+    TEST_ASSERT_FALSE(LittleFS.exists(CONFIG_STORE_TMP_FILENAME));
+    TEST_ASSERT_EQUAL(1, loadedGeneration());
+}
+
+void test_corrupted_byte_is_detected()
+{
+    setGeneration(3);
+    TEST_ASSERT_TRUE(configStoreCommit());
+    std::vector<uint8_t> original = readStoreFile();
+
+    // Any changed byte rejects the whole store instead of loading damaged records
+    for (size_t offset = 0; offset < original.size(); offset++)
+    {
+        std::vector<uint8_t> corrupted = original;
+        corrupted[offset] ^= 0x5A;
+        writeStoreFile(corrupted);
+
+        TEST_ASSERT_FALSE(configStoreBegin());
+        uint32_t value;
+        TEST_ASSERT_FALSE(configGetU32("test.u32", value));
+    }
+
+    // The store could be written again
+    setGeneration(4);
+    TEST_ASSERT_TRUE(configStoreCommit());
+    TEST_ASSERT_TRUE(configStoreBegin());
+    TEST_ASSERT_EQUAL(4, loadedGeneration());
+}
+
+void test_truncated_store_is_detected()
+{
+    setGeneration(5);
+    TEST_ASSERT_TRUE(configStoreCommit());
+    std::vector<uint8_t> original = readStoreFile();
+
+    for (size_t length = 0; length < original.size(); length++)
+    {
+        writeStoreFile(std::vector<uint8_t>(original.begin(), original.begin() + length));
+        TEST_ASSERT_FALSE(configStoreBegin());
+    }
+}
+
+void test_full_store_rejects_new_records()
+{
+    char key[CONFIG_KEY_MAX_LENGTH + 1];
+    for (uint32_t i = 0; i < CONFIG_MAX_RECORDS; i++)
+    {
+        snprintf(key, sizeof(key), "key.%u", i);
+        TEST_ASSERT_TRUE(configSetU32(key, i));
+    }
+
+    // A rejected record leaves no partial record behind, existing records could still change
+    uint32_t value;
+    TEST_ASSERT_FALSE(configSetU32("key.extra", 1));
+    TEST_ASSERT_FALSE(configGetU32("key.extra", value));
+    TEST_ASSERT_TRUE(configSetU32("key.0", 100));
+    TEST_ASSERT_TRUE(configStoreCommit());
+
+    TEST_ASSERT_TRUE(configStoreBegin());
+    for (uint32_t i = 0; i < CONFIG_MAX_RECORDS; i++)
+    {
+        snprintf(key, sizeof(key), "key.%u", i);
+        TEST_ASSERT_TRUE(configGetU32(key, value));
+        TEST_ASSERT_EQUAL(i == 0 ? 100 : i, value);
+    }
+}
+
+int main()
+{
+    LittleFS.begin(true);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_records_survive_the_reboot);
+    RUN_TEST(test_power_cut_at_every_byte_keeps_one_generation);
+    RUN_TEST(test_leftover_temporary_file_is_discarded);
+    RUN_TEST(test_corrupted_byte_is_detected);
+    RUN_TEST(test_truncated_store_is_detected);
+    RUN_TEST(test_full_store_rejects_new_records);
+    shimStopTasks();
+    return UNITY_END();
+}
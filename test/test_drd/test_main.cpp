@@ -0,0 +1,108 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the double reset detection with simulated reset reasons and reboots.
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <filesystem>
+#include "drd.h"
+
+// Timeout of the detection used by the tests (in milliseconds)
+#define TEST_DRD_TIMEOUT_MS 2000
+
+/**
+ * @brief Simulates a reboot with the reset reason, the RTC memory keeps its content.
+ *
+ * @return Whether the boot detected a double reset.
+ */
+static bool reboot(esp_reset_reason_t reason)
+{
+    shimSetResetReason(reason);
+    drdInit(TEST_DRD_TIMEOUT_MS);
+    return isDoubleResetDetected();
+}
+
+/**
+ * @brief Lets the simulated time pass and gives the esp_timer task time to run the expired timers.
+ */
+static void wait(uint32_t ms)
+{
+    shimAdvanceTime((uint64_t)ms * 1000);
+    delay(20);
+}
+
+void setUp()
+{
+    // Every test starts after a boot which cleared the flag
+    reboot(ESP_RST_SW);
+}
+
+void tearDown()
+{
+}
+
+void test_second_reset_within_timeout_is_detected()
+{
+    TEST_ASSERT_FALSE(reboot(ESP_RST_POWERON));
+    wait(TEST_DRD_TIMEOUT_MS / 2);
+    TEST_ASSERT_TRUE(reboot(ESP_RST_EXT));
+
+    // The detection consumes the flag, the third reset starts over
+    TEST_ASSERT_FALSE(reboot(ESP_RST_EXT));
+    TEST_ASSERT_TRUE(reboot(ESP_RST_POWERON));
+}
+
+void test_reset_after_timeout_is_not_detected()
+{
+    TEST_ASSERT_FALSE(reboot(ESP_RST_POWERON));
+    wait(TEST_DRD_TIMEOUT_MS + 100);
+    TEST_ASSERT_FALSE(reboot(ESP_RST_EXT));
+
+    // The timer of the previous boot does not clear the flag of the new one
+    wait(TEST_DRD_TIMEOUT_MS / 2);
+    TEST_ASSERT_TRUE(reboot(ESP_RST_EXT));
+}
+
+void test_other_reset_reasons_are_never_detected()
+{
+    const esp_reset_reason_t reasons[] = {ESP_RST_UNKNOWN, ESP_RST_SW,        ESP_RST_PANIC,     ESP_RST_INT_WDT,
+                                          ESP_RST_TASK_WDT, ESP_RST_WDT,      ESP_RST_DEEPSLEEP, ESP_RST_BROWNOUT,
+                                          ESP_RST_SDIO};
+
+    for (esp_reset_reason_t reason : reasons)
+    {
+        // The flag is set by a power-on, the other reset comes within the timeout and clears it
+        TEST_ASSERT_FALSE(reboot(ESP_RST_POWERON));
+        TEST_ASSERT_FALSE(reboot(reason));
+        TEST_ASSERT_FALSE(reboot(ESP_RST_EXT));
+        wait(TEST_DRD_TIMEOUT_MS + 100);
+    }
+}
+
+void test_detection_does_not_touch_the_flash()
+{
+    shimFsFormat();
+
+    TEST_ASSERT_FALSE(reboot(ESP_RST_POWERON));
+    TEST_ASSERT_TRUE(reboot(ESP_RST_EXT));
+    TEST_ASSERT_FALSE(reboot(ESP_RST_POWERON));
+    wait(TEST_DRD_TIMEOUT_MS + 100);
+
+    String root = shimFsHostPath("/");
+    TEST_ASSERT_TRUE(std::filesystem::is_empty(root.c_str()));
+}
+
+int main()
+{
+    LittleFS.begin(true);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_second_reset_within_timeout_is_detected);
+    RUN_TEST(test_reset_after_timeout_is_not_detected);
+    RUN_TEST(test_other_reset_reasons_are_never_detected);
+    RUN_TEST(test_detection_does_not_touch_the_flash);
+    shimStopTasks();
+    return UNITY_END();
+}
@@ -0,0 +1,636 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the firmware update against the in-memory HTTP server and OTA partition.
+ */
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <LittleFS.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+#include <unity.h>
+#include <zlib.h>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "firmware_update.h"
+
+#define FIRMWARE_URL            "http://updates.local/firmware.bin"
+#define COMPRESSED_FIRMWARE_URL "http://updates.local/firmware.bin.gz"
+
+// Size of the test image and the magic byte of an ESP32 app image
+#define IMAGE_SIZE       (256 * 1024U)
+#define APP_IMAGE_MAGIC  0xE9
+
+// Number of downloads interrupted at random offsets
+#define RANDOM_LOSS_TRIALS 5
+
+// Real time to wait for an update to finish (in milliseconds)
+#define UPDATE_TIMEOUT_MS 60000
+
+typedef void (*PublishResult)(bool success, const char *message);
+void performFirmwareUpdate(const FirmwareUpdateRequest &request, PublishResult publishResult);
+
+// Result reported by the update run in the test task
+struct UpdateResult
+{
+    bool reported;
+    bool success;
+    std::string message;
+    FirmwareUpdateMetrics metrics; // Metrics available when the result was published
+};
+
+static std::mutex resultMutex;
+static UpdateResult result;
+static FirmwareUpdateRequest testRequest;
+
+/**
+ * @brief Records the result published by the update.
+ */
+static void recordResult(bool success, const char *message)
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    result = {true, success, message, getFirmwareUpdateMetrics()};
+}
+
+/**
+ * @brief Runs the update in a task, like the OTA task without its status.
+ */
+static void testUpdateTask(void *pvParameters)
+{
+    performFirmwareUpdate(testRequest, recordResult);
+
+    // The update returns only if it failed
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Runs an update of the URL and waits until it fails or reboots the device.
+ *
+ * @param url The URL of the firmware.
+ * @param sha256 The expected SHA-256 of the image, NULL to skip the check.
+ * @param imageSize Size of the decompressed image, 0 if not known.
+ * @return The published result.
+ */
+static UpdateResult runUpdate(const char *url, const char *sha256 = NULL, uint32_t imageSize = 0)
+{
+    {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        result = {false, false, "", {}};
+    }
+    testRequest = {url, imageSize, sha256, NULL};
+    uint32_t restarts = shimRestartCount();
+
+    xTaskCreatePinnedToCore(testUpdateTask, "testUpdateTask", 8192, NULL, 1, NULL, 0);
+    for (uint32_t waited = 0; shimTaskRunning("testUpdateTask") && waited < UPDATE_TIMEOUT_MS; waited++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        // Skip the delay of the reboot
+        std::lock_guard<std::mutex> lock(resultMutex);
+        if (result.reported && result.success)
+            shimAdvanceTime(OTA_REBOOT_DELAY_MS * 1000ULL);
+    }
+    TEST_ASSERT_FALSE(shimTaskRunning("testUpdateTask"));
+
+    std::lock_guard<std::mutex> lock(resultMutex);
+    TEST_ASSERT_TRUE(result.reported);
+    TEST_ASSERT_EQUAL(result.success ? restarts + 1 : restarts, shimRestartCount());
+    return result;
+}
+
+/**
+ * @brief Creates an app image with pseudo-random content.
+ */
+static std::vector<uint8_t> makeImage(size_t size, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::vector<uint8_t> image(size);
+    for (uint8_t &byte : image)
+        byte = random();
+    image[0] = APP_IMAGE_MAGIC;
+    return image;
+}
+
+/**
+ * @brief Creates an app image compressible like a real firmware: code patterns and random tables.
+ */
+static std::vector<uint8_t> makeCompressibleImage(size_t size, uint32_t seed)
+{
+    std::vector<uint8_t> image = makeImage(size, seed);
+    for (size_t i = 1; i < size; i++)
+    {
+        if ((i / 4096) % 4 != 3)
+            image[i] = i * 7 % 61;
+    }
+    return image;
+}
+
+/**
+ * @brief Compresses the data into a gzip member with zlib.
+ */
+static std::vector<uint8_t> gzipCompress(const std::vector<uint8_t> &data)
+{
+    z_stream stream = {};
+    deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY); // 16 = gzip wrapper
+
+    std::vector<uint8_t> compressed(deflateBound(&stream, data.size()));
+    stream.next_in = (Bytef *)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = compressed.data();
+    stream.avail_out = compressed.size();
+    deflate(&stream, Z_FINISH);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+    return compressed;
+}
+
+/**
+ * @brief Returns the SHA-256 of the data as a lowercase hexadecimal string.
+ */
+static std::string sha256Hex(const std::vector<uint8_t> &data)
+{
+    uint8_t digest[32];
+    mbedtls_sha256(data.data(), data.size(), digest, 0);
+
+    char hex[65];
+    for (int i = 0; i < 32; i++)
+        snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+    return hex;
+}
+
+/**
+ * @brief Checks that the OTA partition contains the image.
+ */
+static void assertFlashContains(const std::vector<uint8_t> &image)
+{
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), shimFlashData(), image.size());
+}
+
+void setUp()
+{
+    shimHttpReset();
+    shimFlashReset();
+    shimFlashSetTimings(0, 0);
+    shimSetTimeScale(1);
+
+    // Start without an interrupted download of a previous test
+    if (LittleFS.exists("/ota_resume.dat"))
+        LittleFS.remove("/ota_resume.dat");
+}
+
+void tearDown()
+{
+}
+
+void test_pipeline_overlaps_download_and_flash_writes()
+{
+    std::vector<uint8_t> image = makeImage(IMAGE_SIZE, 31);
+    shimHttpServe(FIRMWARE_URL, image);
+
+    // The network and the flash take about the same time for every buffer
+    shimHttpSetReadDelayUs(2000);
+    shimFlashSetTimings(1000, 0);
+
+    UpdateResult update = runUpdate(FIRMWARE_URL);
+    TEST_ASSERT_TRUE_MESSAGE(update.success, update.message.c_str());
+    assertFlashContains(image);
+    TEST_ASSERT_TRUE(shimOtaBootPartition() == esp_ota_get_next_update_partition(NULL));
+
+    // Done sequentially the download would take the sum of the stages
+    const FirmwareUpdateMetrics &metrics = getFirmwareUpdateMetrics();
+    TEST_ASSERT_EQUAL(IMAGE_SIZE, metrics.bytes);
+    TEST_ASSERT_GREATER_THAN(0, metrics.receiveTimeMs);
+    TEST_ASSERT_GREATER_THAN(0, metrics.writeTimeMs);
+    TEST_ASSERT_LESS_THAN((metrics.receiveTimeMs + metrics.writeTimeMs) * 8 / 10, metrics.totalTimeMs);
+    TEST_ASSERT_GREATER_THAN(0, metrics.throughputKBps);
+}
+
+void test_buffers_are_written_in_download_order()
+{
+    std::vector<uint8_t> image = makeImage(IMAGE_SIZE, 32);
+    shimHttpServe(FIRMWARE_URL, image);
+
+    // A slow flash makes the receiver fill all buffers ahead of the writer
+    shimFlashSetTimings(4000, 0);
+
+    UpdateResult update = runUpdate(FIRMWARE_URL);
+    TEST_ASSERT_TRUE_MESSAGE(update.success, update.message.c_str());
+    assertFlashContains(image);
+
+    size_t expectedOffset = 0;
+    for (const std::pair<size_t, size_t> &write : shimFlashWrites())
+    {
+        TEST_ASSERT_EQUAL(expectedOffset, write.first);
+        expectedOffset += write.second;
+    }
+    TEST_ASSERT_EQUAL(IMAGE_SIZE, expectedOffset);
+    TEST_ASSERT_GREATER_THAN(0, getFirmwareUpdateMetrics().receiverStalls);
+}
+
+void test_compressed_image_transfers_less()
+{
+    std::vector<uint8_t> image = makeCompressibleImage(IMAGE_SIZE, 33);
+    std::vector<uint8_t> compressed = gzipCompress(image);
+    shimHttpServe(FIRMWARE_URL, image);
+    shimHttpServe(COMPRESSED_FIRMWARE_URL, compressed);
+
+    UpdateResult update = runUpdate(FIRMWARE_URL);
+    TEST_ASSERT_TRUE_MESSAGE(update.success, update.message.c_str());
+    size_t rawTransfer = shimHttpSentBytes();
+
+    shimFlashReset();
+    update = runUpdate(COMPRESSED_FIRMWARE_URL, NULL, IMAGE_SIZE);
+    TEST_ASSERT_TRUE_MESSAGE(update.success, update.message.c_str());
+    size_t compressedTransfer = shimHttpSentBytes() - rawTransfer;
+    assertFlashContains(image);
+
+    const FirmwareUpdateMetrics &metrics = getFirmwareUpdateMetrics();
+    TEST_ASSERT_EQUAL(IMAGE_SIZE, metrics.bytes);
+    TEST_ASSERT_EQUAL(compressed.size(), metrics.downloadedBytes);
+    TEST_ASSERT_EQUAL(IMAGE_SIZE, rawTransfer);
+    TEST_ASSERT_EQUAL(compressed.size(), compressedTransfer);
+    TEST_ASSERT_LESS_THAN(rawTransfer / 2, compressedTransfer);
+    printf("Transferred %u bytes of the raw image and %u bytes of the compressed image\n",
+           (unsigned)rawTransfer, (unsigned)compressedTransfer);
+}
+
+void test_corrupted_compressed_image_is_not_activated()
+{
+    std::vector<uint8_t> compressed = gzipCompress(makeCompressibleImage(IMAGE_SIZE, 34));
+    compressed[compressed.size() / 2] ^= 0x10;
+    shimHttpServe(COMPRESSED_FIRMWARE_URL, compressed);
+
+    UpdateResult update = runUpdate(COMPRESSED_FIRMWARE_URL, NULL, IMAGE_SIZE);
+    TEST_ASSERT_FALSE(update.success);
+    TEST_ASSERT_NULL(shimOtaBootPartition());
+}
+
+void test_progress_of_an_oversized_image_does_not_wrap()
+{
+    // The image inflates to four times its declared size
+    shimHttpServe(COMPRESSED_FIRMWARE_URL, gzipCompress(makeCompressibleImage(IMAGE_SIZE, 35)));
+
+    shimSerialCapture(true);
+    UpdateResult update = runUpdate(COMPRESSED_FIRMWARE_URL, NULL, IMAGE_SIZE / 4);
+    std::string output = shimSerialTakeOutput().c_str();
+    shimSerialCapture(false);
+    TEST_ASSERT_FALSE(update.success);
+    TEST_ASSERT_NULL(shimOtaBootPartition());
+
+    // The reported progress never goes backwards and stops at 100 %
+    const std::string marker = "Firmware update progress: ";
+    int lastProgress = 0;
+    for (size_t pos = output.find(marker); pos != std::string::npos; pos = output.find(marker, pos + 1))
+    {
+        int progress = atoi(output.c_str() + pos + marker.size());
+        TEST_ASSERT_GREATER_OR_EQUAL(lastProgress, progress);
+        TEST_ASSERT_LESS_OR_EQUAL(100, progress);
+        lastProgress = progress;
+    }
+    TEST_ASSERT_EQUAL(100, lastProgress);
+}
+
+/**
+ * @brief Checks that every request after the first one continues at the end of the previous connection.
+ *
+ * @param requests The requests received by the server.
+ * @param lossOffsets The number of bytes received over each interrupted connection.
+ * @param firstOffset Offset requested by the first request.
+ */
+static void assertResumedAt(const std::vector<ShimHttpRequest> &requests, const std::vector<size_t> &lossOffsets,
+                            size_t firstOffset)
+{
+    TEST_ASSERT_EQUAL(lossOffsets.size() + 1, requests.size());
+
+    size_t offset = firstOffset;
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        std::string expectedRange = offset > 0 ? "bytes=" + std::to_string(offset) + "-" : "";
+        TEST_ASSERT_EQUAL_STRING(expectedRange.c_str(), requests[i].range.c_str());
+        TEST_ASSERT_EQUAL_STRING(offset > 0 ? "\"v1\"" : "", requests[i].ifRange.c_str());
+        TEST_ASSERT_EQUAL(offset > 0 ? HTTP_CODE_PARTIAL_CONTENT : HTTP_CODE_OK, requests[i].status);
+        if (i < lossOffsets.size())
+            offset += lossOffsets[i];
+    }
+}
+
+void test_download_resumes_after_random_connection_losses()
+{
+    std::mt19937 random(33);
+    shimSetTimeScale(100); // Skip the delays before resuming
+
+    for (int trial = 0; trial < RANDOM_LOSS_TRIALS; trial++)
+    {
+        shimHttpReset();
+        shimFlashReset();
+        std::vector<uint8_t> image = makeImage(IMAGE_SIZE, 330 + trial);
+        shimHttpServe(FIRMWARE_URL, image);
+
+        // Lose up to all resume attempts at random offsets, also inside the download buffers
+        std::vector<size_t> lossOffsets(1 + random() % OTA_RESUME_ATTEMPTS);
+        size_t remaining = IMAGE_SIZE;
+        for (size_t &offset : lossOffsets)
+        {
+            offset = 1 + random() % (remaining / 2);
+            remaining -= offset;
+        }
+        shimHttpLoseConnectionsAt(lossOffsets);
+
+        UpdateResult update = runUpdate(FIRMWARE_URL);
+        TEST_ASSERT_TRUE_MESSAGE(update.success, update.message.c_str());
+        assertFlashContains(image);
+        assertResumedAt(shimHttpRequests(), lossOffsets, 0);
+        TEST_ASSERT_EQUAL(lossOffsets.size(), getFirmwareUpdateMetrics().resumes);
+        TEST_ASSERT_EQUAL(IMAGE_SIZE, shimHttpSentBytes());
+    }
+}
+
+void test_next_update_resumes_the_failed_download()
+{
+    shimSetTimeScale(100);
+    std::vector<uint8_t> image = makeImage(IMAGE_SIZE, 34);
+    shimHttpServe(FIRMWARE_URL, image);
+
+    // More losses than resume attempts fail the first update
+    std::vector<size_t> lossOffsets(OTA_RESUME_ATTEMPTS + 1, 10000);
+    shimHttpLoseConnectionsAt(lossOffsets);
+    UpdateResult update = runUpdate(FIRMWARE_URL);
+    TEST_ASSERT_FALSE(update.success);
+    TEST_ASSERT_NULL(shimOtaBootPartition());
+
+    // The next update continues from the written data saved with the state of the download
+    size_t written = 10000 * lossOffsets.size();
+    update = runUpdate(FIRMWARE_URL);
+    TEST_ASSERT_TRUE_MESSAGE(update.success, update.message.c_str());
+    assertFlashContains(image);
+
+    std::vector<ShimHttpRequest> requests = shimHttpRequests();
+    std::string expectedRange = "bytes=" + std::to_string(written) + "-";
+    TEST_ASSERT_EQUAL_STRING(expectedRange.c_str(), requests.back().range.c_str());
+    TEST_ASSERT_EQUAL(IMAGE_SIZE, shimHttpSentBytes());
+    TEST_ASSERT_FALSE(LittleFS.exists("/ota_resume.dat"));
+}
+
+void test_download_restarts_without_range_support()
+{
+    shimSetTimeScale(100);
+    std::vector<uint8_t> image = makeImage(IMAGE_SIZE, 35);
+    shimHttpServe(FIRMWARE_URL, image);
+    shimHttpSetRangeSupport(false);
+    shimHttpLoseConnectionsAt({50000});
+
+    UpdateResult update = runUpdate(FIRMWARE_URL);
+    TEST_ASSERT_TRUE_MESSAGE(update.success, update.message.c_str());
+    assertFlashContains(image);
+
+    std::vector<ShimHttpRequest> requests = shimHttpRequests();
+    TEST_ASSERT_EQUAL(2, requests.size());
+    TEST_ASSERT_EQUAL(HTTP_CODE_OK, requests[1].status);
+    TEST_ASSERT_EQUAL(50000 + IMAGE_SIZE, shimHttpSentBytes());
+}
+
+void test_changed_firmware_is_downloaded_from_the_beginning()
+{
+    shimSetTimeScale(100);
+    shimHttpServe(FIRMWARE_URL, makeImage(IMAGE_SIZE, 36), "\"v1\"");
+    std::vector<size_t> lossOffsets(OTA_RESUME_ATTEMPTS + 1, 10000);
+    shimHttpLoseConnectionsAt(lossOffsets);
+    TEST_ASSERT_FALSE(runUpdate(FIRMWARE_URL).success);
+
+    // The If-Range validator does not match the new file, so the server sends it whole
+    std::vector<uint8_t> image = makeImage(IMAGE_SIZE, 37);
+    shimHttpServe(FIRMWARE_URL, image, "\"v2\"");
+    UpdateResult update = runUpdate(FIRMWARE_URL);
+    TEST_ASSERT_TRUE_MESSAGE(update.success, update.message.c_str());
+    assertFlashContains(image);
+    TEST_ASSERT_EQUAL(HTTP_CODE_OK, shimHttpRequests().back().status);
+}
+
+void test_reference_sha256()
+{
+    std::string digest = sha256Hex({'a', 'b', 'c'});
+    TEST_ASSERT_EQUAL_STRING("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", digest.c_str());
+}
+
+void test_matching_sha256_is_accepted()
+{
+    std::vector<uint8_t> image = makeImage(IMAGE_SIZE, 40);
+    shimHttpServe(FIRMWARE_URL, image);
+
+    // The digest is accepted in both cases
+    std::string sha256 = sha256Hex(image);
+    for (char &c : sha256)
+        c = toupper(c);
+
+    UpdateResult update = runUpdate(FIRMWARE_URL, sha256.c_str());
+    TEST_ASSERT_TRUE_MESSAGE(update.success, update.message.c_str());
+    assertFlashContains(image);
+}
+
+void test_corrupted_streams_are_rejected_before_activation()
+{
+    std::mt19937 random(34);
+    shimSetTimeScale(100); // Skip the delays before resuming
+
+    for (int trial = 0; trial < RANDOM_LOSS_TRIALS; trial++)
+    {
+        shimHttpReset();
+        shimFlashReset();
+
+        // Flip a bit of the served image, some downloads are also resumed over it
+        std::vector<uint8_t> image = makeImage(IMAGE_SIZE, 340 + trial);
+        std::vector<uint8_t> corrupted = image;
+        corrupted[1 + random() % (IMAGE_SIZE - 1)] ^= 1 << (random() % 8);
+        shimHttpServe(FIRMWARE_URL, corrupted);
+        if (trial % 2 == 1)
+            shimHttpLoseConnectionsAt({1 + random() % (IMAGE_SIZE / 2)});
+
+        UpdateResult update = runUpdate(FIRMWARE_URL, sha256Hex(image).c_str());
+        TEST_ASSERT_FALSE(update.success);
+        TEST_ASSERT_EQUAL(0, update.message.find("SHA-256 mismatch"));
+        TEST_ASSERT_NULL(shimOtaBootPartition());
+
+        // The image was hashed while writing, once
+        TEST_ASSERT_EQUAL(IMAGE_SIZE, shimHttpSentBytes());
+
+        // The failure is published with the metrics of the download
+        TEST_ASSERT_EQUAL(IMAGE_SIZE, update.metrics.bytes);
+        TEST_ASSERT_EQUAL(IMAGE_SIZE, update.metrics.downloadedBytes);
+        TEST_ASSERT_GREATER_THAN(0, update.metrics.totalTimeMs);
+        TEST_ASSERT_GREATER_THAN(0, update.metrics.hashTimeMs);
+        TEST_ASSERT_EQUAL(trial % 2, update.metrics.resumes);
+    }
+}
+
+void test_invalid_sha256_is_rejected_before_downloading()
+{
+    shimHttpServe(FIRMWARE_URL, makeImage(IMAGE_SIZE, 41));
+
+    const char *invalid[] = {"1234", "zz7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"};
+    for (const char *sha256 : invalid)
+    {
+        UpdateResult update = runUpdate(FIRMWARE_URL, sha256);
+        TEST_ASSERT_FALSE(update.success);
+        TEST_ASSERT_EQUAL(0, update.message.find("Invalid SHA-256"));
+    }
+    TEST_ASSERT_EQUAL(0, shimHttpRequests().size());
+}
+
+/**
+ * @brief Waits until the status of the update reaches a final state, recording the states seen.
+ *
+ * @param states The states seen, each one once.
+ * @return The final status.
+ */
+static FirmwareUpdateStatus waitForFinalState(std::vector<FirmwareUpdateState> &states)
+{
+    FirmwareUpdateStatus status = getFirmwareUpdateStatus();
+    for (uint32_t waited = 0; waited < UPDATE_TIMEOUT_MS; waited++)
+    {
+        status = getFirmwareUpdateStatus();
+        if (states.empty() || states.back() != status.state)
+            states.push_back(status.state);
+        if (status.state == FW_UPDATE_FAILED || status.state == FW_UPDATE_REBOOTING)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return status;
+}
+
+/**
+ * @brief Checks that the states were seen in the order of the state machine.
+ */
+static void assertStateOrder(const std::vector<FirmwareUpdateState> &states)
+{
+    const FirmwareUpdateState order[] = {FW_UPDATE_QUEUED, FW_UPDATE_DOWNLOADING, FW_UPDATE_VERIFYING};
+    size_t next = 0;
+    for (size_t i = 0; i + 1 < states.size(); i++)
+    {
+        while (next < 3 && order[next] != states[i])
+            next++;
+        TEST_ASSERT_LESS_THAN(3, next);
+    }
+}
+
+void test_update_is_rejected_until_the_failed_task_ends()
+{
+    TEST_ASSERT_EQUAL(FW_UPDATE_IDLE, getFirmwareUpdateStatus().state);
+
+    std::vector<uint8_t> image = makeImage(IMAGE_SIZE, 35);
+    shimHttpServe(FIRMWARE_URL, image);
+    shimHttpSetReadDelayUs(2000);
+
+    // The wrong digest fails the update after the whole download
+    std::string wrongSha256(64, '0');
+    FirmwareUpdateRequest request = {FIRMWARE_URL, 0, wrongSha256.c_str(), NULL};
+    TEST_ASSERT_NULL(startFirmwareUpdate(request));
+
+    // A concurrent command is rejected while downloading
+    std::vector<FirmwareUpdateState> states;
+    while (getFirmwareUpdateStatus().state == FW_UPDATE_QUEUED)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    TEST_ASSERT_EQUAL(FW_UPDATE_DOWNLOADING, getFirmwareUpdateStatus().state);
+    TEST_ASSERT_EQUAL_STRING("Firmware update already in progress", startFirmwareUpdate(request));
+
+    FirmwareUpdateStatus status = waitForFinalState(states);
+    TEST_ASSERT_EQUAL(FW_UPDATE_FAILED, status.state);
+    TEST_ASSERT_EQUAL(0, strncmp(status.message, "SHA-256 mismatch", 16));
+    assertStateOrder(states);
+
+    // The task still indicates the failure, so the next update waits for it to end
+    TEST_ASSERT_TRUE(shimTaskRunning("otaTask"));
+    TEST_ASSERT_EQUAL_STRING("Firmware update already in progress", startFirmwareUpdate(request));
+
+    shimAdvanceTime(OTA_FAILURE_INDICATION_MS * 1000ULL);
+    for (uint32_t waited = 0; shimTaskRunning("otaTask") && waited < UPDATE_TIMEOUT_MS; waited++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    TEST_ASSERT_FALSE(shimTaskRunning("otaTask"));
+
+    // A failure before the download has no indication and ends the task right away
+    FirmwareUpdateRequest missing = {"http://updates.local/missing.bin", 0, NULL, NULL};
+    uint32_t sequence = getFirmwareUpdateStatus().sequence;
+    TEST_ASSERT_NULL(startFirmwareUpdate(missing));
+    states.clear();
+    status = waitForFinalState(states);
+    TEST_ASSERT_EQUAL(FW_UPDATE_FAILED, status.state);
+    TEST_ASSERT_EQUAL_STRING("HTTP request returned: 404", status.message);
+    TEST_ASSERT_GREATER_THAN(sequence, status.sequence);
+}
+
+void test_invalid_requests_are_rejected()
+{
+    FirmwareUpdateRequest request = {NULL, 0, NULL, NULL};
+    TEST_ASSERT_NOT_NULL(startFirmwareUpdate(request));
+
+    std::string longUrl = "http://updates.local/" + std::string(600, 'a');
+    request.url = longUrl.c_str();
+    TEST_ASSERT_NOT_NULL(startFirmwareUpdate(request));
+}
+
+void test_successful_update_goes_through_all_states()
+{
+    // Wait until the task of the previous update has ended
+    for (uint32_t waited = 0; shimTaskRunning("otaTask") && waited < UPDATE_TIMEOUT_MS; waited++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::vector<uint8_t> image = makeImage(IMAGE_SIZE, 36);
+    shimHttpServe(FIRMWARE_URL, image);
+    shimHttpSetReadDelayUs(1000);
+    std::string sha256 = sha256Hex(image);
+
+    uint32_t sequence = getFirmwareUpdateStatus().sequence;
+    uint32_t restarts = shimRestartCount();
+    FirmwareUpdateRequest request = {FIRMWARE_URL, 0, sha256.c_str(), NULL};
+    TEST_ASSERT_NULL(startFirmwareUpdate(request));
+
+    std::vector<FirmwareUpdateState> states;
+    FirmwareUpdateStatus status = waitForFinalState(states);
+    TEST_ASSERT_EQUAL(FW_UPDATE_REBOOTING, status.state);
+    TEST_ASSERT_EQUAL(100, status.progress);
+    assertStateOrder(states);
+
+    // Queued, downloading, verifying and rebooting
+    TEST_ASSERT_EQUAL(sequence + 4, status.sequence);
+
+    // The device reboots after the result is published, further updates are rejected
+    TEST_ASSERT_NOT_NULL(startFirmwareUpdate(request));
+    shimAdvanceTime(OTA_REBOOT_DELAY_MS * 1000ULL);
+    for (uint32_t waited = 0; shimRestartCount() == restarts && waited < UPDATE_TIMEOUT_MS; waited++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    TEST_ASSERT_EQUAL(restarts + 1, shimRestartCount());
+    assertFlashContains(image);
+}
+
+int main()
+{
+    LittleFS.begin(true);
+
+    UNITY_BEGIN();
+
+    // The state machine of the background update runs first, it ends with the device rebooting.
+    // The other tests run the update directly, without the state machine
+    RUN_TEST(test_update_is_rejected_until_the_failed_task_ends);
+    RUN_TEST(test_invalid_requests_are_rejected);
+    RUN_TEST(test_successful_update_goes_through_all_states);
+
+    RUN_TEST(test_pipeline_overlaps_download_and_flash_writes);
+    RUN_TEST(test_buffers_are_written_in_download_order);
+    RUN_TEST(test_compressed_image_transfers_less);
+    RUN_TEST(test_corrupted_compressed_image_is_not_activated);
+    RUN_TEST(test_progress_of_an_oversized_image_does_not_wrap);
+    RUN_TEST(test_download_resumes_after_random_connection_losses);
+    RUN_TEST(test_next_update_resumes_the_failed_download);
+    RUN_TEST(test_download_restarts_without_range_support);
+    RUN_TEST(test_changed_firmware_is_downloaded_from_the_beginning);
+    RUN_TEST(test_reference_sha256);
+    RUN_TEST(test_matching_sha256_is_accepted);
+    RUN_TEST(test_corrupted_streams_are_rejected_before_activation);
+    RUN_TEST(test_invalid_sha256_is_rejected_before_downloading);
+    shimStopTasks();
+    return UNITY_END();
+}
@@ -0,0 +1,166 @@
+/**
+ * @file test_main.cpp
+ * @brief Round trips of gzip streams through the streaming decoder in random chunks.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <zlib.h>
+#include <random>
+#include <vector>
+#include "gzip_stream.h"
+
+// Number of round trips with different chunk sizes
+#define ROUND_TRIPS 20
+
+static std::mt19937 randomGenerator(32);
+
+/**
+ * @brief Creates data compressible like a firmware image: repeated code patterns and random tables.
+ */
+static std::vector<uint8_t> makeData(size_t size)
+{
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++)
+        data[i] = (i / 4096) % 4 == 3 ? (uint8_t)randomGenerator() : (uint8_t)(i * 7 % 61);
+    return data;
+}
+
+/**
+ * @brief Compresses the data into a gzip member with zlib.
+ */
+static std::vector<uint8_t> gzipCompress(const std::vector<uint8_t> &data)
+{
+    z_stream stream = {};
+    deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY); // 16 = gzip wrapper
+
+    std::vector<uint8_t> compressed(deflateBound(&stream, data.size()));
+    stream.next_in = (Bytef *)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = compressed.data();
+    stream.avail_out = compressed.size();
+    deflate(&stream, Z_FINISH);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+    return compressed;
+}
+
+/**
+ * @brief Collects the decompressed data.
+ */
+static bool collectOutput(const uint8_t *data, size_t length, void *context)
+{
+    std::vector<uint8_t> *output = (std::vector<uint8_t> *)context;
+    output->insert(output->end(), data, data + length);
+    return true;
+}
+
+/**
+ * @brief Feeds the compressed data to the decoder in random chunks.
+ *
+ * @param compressed The gzip stream.
+ * @param output The decompressed data.
+ * @param maxChunk The maximum size of a chunk.
+ * @return The status after the last chunk, or the first error.
+ */
+static GzipStatus decodeInChunks(const std::vector<uint8_t> &compressed, std::vector<uint8_t> &output, size_t maxChunk)
+{
+    GzipStream stream = {};
+    TEST_ASSERT_TRUE(gzipBegin(stream));
+
+    std::uniform_int_distribution<size_t> chunkSize(1, maxChunk);
+    GzipStatus status = GZIP_NEED_MORE_INPUT;
+    for (size_t offset = 0; offset < compressed.size() && status != GZIP_ERROR;)
+    {
+        size_t length = std::min(chunkSize(randomGenerator), compressed.size() - offset);
+        status = gzipWrite(stream, compressed.data() + offset, length, collectOutput, &output);
+        offset += length;
+    }
+
+    gzipEnd(stream);
+    return status;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_round_trip_in_random_chunks()
+{
+    for (int i = 0; i < ROUND_TRIPS; i++)
+    {
+        std::vector<uint8_t> data = makeData(64 * 1024 + randomGenerator() % 65536);
+        std::vector<uint8_t> compressed = gzipCompress(data);
+        TEST_ASSERT_TRUE(isGzipData(compressed.data(), compressed.size()));
+
+        // Chunks from single bytes up to the size of the download buffers
+        std::vector<uint8_t> output;
+        size_t maxChunk = i % 2 == 0 ? 16 : 2048;
+        TEST_ASSERT_EQUAL(GZIP_DONE, decodeInChunks(compressed, output, maxChunk));
+        TEST_ASSERT_EQUAL(data.size(), output.size());
+        TEST_ASSERT_EQUAL_MEMORY(data.data(), output.data(), data.size());
+    }
+}
+
+void test_raw_data_is_not_detected_as_gzip()
+{
+    std::vector<uint8_t> image = makeData(1024);
+    image[0] = 0xE9; // App image magic
+    TEST_ASSERT_FALSE(isGzipData(image.data(), image.size()));
+    TEST_ASSERT_FALSE(isGzipData(image.data(), 1));
+}
+
+void test_corrupted_streams_are_rejected()
+{
+    std::vector<uint8_t> data = makeData(96 * 1024);
+    std::vector<uint8_t> compressed = gzipCompress(data);
+
+    for (int i = 0; i < ROUND_TRIPS; i++)
+    {
+        // Flip a bit in the compressed data or in the CRC32 and size of the trailer
+        std::vector<uint8_t> corrupted = compressed;
+        size_t position = i % 4 == 0 ? corrupted.size() - 1 - randomGenerator() % 8
+                                     : 10 + randomGenerator() % (corrupted.size() - 18);
+        corrupted[position] ^= 1 << (randomGenerator() % 8);
+
+        std::vector<uint8_t> output;
+        TEST_ASSERT_NOT_EQUAL(GZIP_DONE, decodeInChunks(corrupted, output, 2048));
+    }
+}
+
+void test_truncated_stream_is_not_done()
+{
+    std::vector<uint8_t> data = makeData(96 * 1024);
+    std::vector<uint8_t> compressed = gzipCompress(data);
+    compressed.resize(compressed.size() / 2);
+
+    std::vector<uint8_t> output;
+    TEST_ASSERT_EQUAL(GZIP_NEED_MORE_INPUT, decodeInChunks(compressed, output, 2048));
+}
+
+void test_failing_output_aborts_the_decompression()
+{
+    std::vector<uint8_t> compressed = gzipCompress(makeData(96 * 1024));
+
+    GzipStream stream = {};
+    TEST_ASSERT_TRUE(gzipBegin(stream));
+    GzipStatus status = gzipWrite(stream, compressed.data(), compressed.size(),
+                                  [](const uint8_t *, size_t, void *) { return false; }, NULL);
+    gzipEnd(stream);
+    TEST_ASSERT_EQUAL(GZIP_ERROR, status);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_in_random_chunks);
+    RUN_TEST(test_raw_data_is_not_detected_as_gzip);
+    RUN_TEST(test_corrupted_streams_are_rejected);
+    RUN_TEST(test_truncated_stream_is_not_done);
+    RUN_TEST(test_failing_output_aborts_the_decompression);
+    return UNITY_END();
+}
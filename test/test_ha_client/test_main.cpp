@@ -0,0 +1,299 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the Home Assistant client against the in-memory MQTT broker.
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <unity.h>
+#include <atomic>
+#include <string>
+#include "config_store.h"
+#include "ha_client.h"
+#include "system_clock.h"
+
+#define CLIENT_ID     "AABBCC"
+#define STATUS_TOPIC  "int-cz-map/status/device/" CLIENT_ID
+#define ENABLE_TOPIC  "int-cz-map/cmd/enable/" CLIENT_ID
+
+// Longest wait for a loop of the task (in simulated milliseconds, 10 s of real time)
+#define LOOP_TIMEOUT_MS 200000
+
+extern PubSubClient haClient;
+void haMessageHandler(char *topic, byte *payload, unsigned int length);
+
+// Virtual time of the modules, the task loop runs on the simulated time of the shims
+static std::atomic<uint64_t> virtualTimeUs{1000000};
+
+static uint64_t virtualClock()
+{
+    return virtualTimeUs;
+}
+
+/**
+ * @brief Moves the virtual time forward and waits until the task completes a loop on the new time.
+ *
+ * The loop in progress could have read the time before the change, so the wait ends with the
+ * second call of loop() after the change, which follows a whole loop started on the new time.
+ */
+static void advance(uint32_t ms)
+{
+    virtualTimeUs += (uint64_t)ms * 1000;
+
+    uint32_t loops = haClient.shimLoops();
+    for (uint32_t waited = 0; haClient.shimLoops() < loops + 2; waited += 10)
+    {
+        TEST_ASSERT_LESS_THAN(LOOP_TIMEOUT_MS, waited);
+        delay(10);
+    }
+}
+
+/**
+ * @brief Returns the messages published to the topic since the last shimClear().
+ */
+static std::vector<ShimMqttMessage> publishedTo(const char *topic)
+{
+    std::vector<ShimMqttMessage> messages;
+    for (const ShimMqttMessage &message : haClient.shimPublished())
+    {
+        if (message.topic == topic)
+            messages.push_back(message);
+    }
+    return messages;
+}
+
+/**
+ * @brief Returns the discovery messages published since the last shimClear().
+ */
+static std::vector<ShimMqttMessage> publishedDiscovery()
+{
+    std::vector<ShimMqttMessage> messages;
+    for (const ShimMqttMessage &message : haClient.shimPublished())
+    {
+        if (message.topic.rfind("homeassistant/", 0) == 0)
+            messages.push_back(message);
+    }
+    return messages;
+}
+
+/**
+ * @brief Connects the station to the fake access point.
+ */
+static void connectWiFi()
+{
+    const uint8_t bssid[6] = {0x10, 0x20, 0x30, 0x40, 0x50, 0x60};
+    shimWiFiAddAccessPoint("home", "secret", bssid, 6, -50, IPAddress(192, 168, 1, 50), IPAddress(192, 168, 1, 1));
+    WiFi.begin("home", "secret");
+    while (!WiFi.isConnected())
+    {
+        shimAdvanceTime(100000);
+        shimWiFiPoll();
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_status_published_after_connect()
+{
+    for (int i = 0; i < 100 && publishedTo(STATUS_TOPIC).empty(); i++)
+        delay(100);
+
+    TEST_ASSERT_TRUE(haClient.connected());
+    TEST_ASSERT_EQUAL(1, publishedTo(STATUS_TOPIC).size());
+    TEST_ASSERT_TRUE(publishedTo(STATUS_TOPIC)[0].retained);
+}
+
+void test_unchanged_status_waits_for_uptime_refresh()
+{
+    haClient.shimClear();
+
+    advance(4 * 60 * 1000);
+    TEST_ASSERT_EQUAL(0, publishedTo(STATUS_TOPIC).size());
+
+    advance(61 * 1000);
+    TEST_ASSERT_EQUAL(1, publishedTo(STATUS_TOPIC).size());
+
+    advance(1000);
+    TEST_ASSERT_EQUAL(1, publishedTo(STATUS_TOPIC).size());
+}
+
+void test_counter_change_waits_for_counters_interval()
+{
+    haClient.shimClear();
+    awsMsgsReceived += 5;
+
+    advance(2000);
+    TEST_ASSERT_EQUAL(0, publishedTo(STATUS_TOPIC).size());
+
+    advance(59 * 1000);
+    std::vector<ShimMqttMessage> messages = publishedTo(STATUS_TOPIC);
+    TEST_ASSERT_EQUAL(1, messages.size());
+    std::string expected = "\"awsMsgsReceived\":" + std::to_string(awsMsgsReceived);
+    TEST_ASSERT_TRUE(messages[0].payload.find(expected) != std::string::npos);
+}
+
+void test_reconnect_changes_are_coalesced()
+{
+    haClient.shimClear();
+
+    // A burst of changes within the minimum interval results in a single publish
+    awsReconnectAttempts++;
+    advance(200);
+    awsReconnectAttempts++;
+    advance(200);
+    TEST_ASSERT_EQUAL(0, publishedTo(STATUS_TOPIC).size());
+
+    advance(700);
+    TEST_ASSERT_EQUAL(1, publishedTo(STATUS_TOPIC).size());
+
+    advance(2000);
+    TEST_ASSERT_EQUAL(1, publishedTo(STATUS_TOPIC).size());
+}
+
+void test_enable_command_publishes_only_changes()
+{
+    haClient.shimClear();
+
+    haClient.shimDeliver(ENABLE_TOPIC, "OFF");
+    advance(0);
+    std::vector<ShimMqttMessage> messages = publishedTo(STATUS_TOPIC);
+    TEST_ASSERT_EQUAL(1, messages.size());
+    TEST_ASSERT_TRUE(messages[0].payload.find("\"enabled\":\"OFF\"") != std::string::npos);
+    TEST_ASSERT_FALSE(isMapOn());
+
+    // The same state again is not published
+    haClient.shimDeliver(ENABLE_TOPIC, "OFF");
+    advance(0);
+    TEST_ASSERT_EQUAL(1, publishedTo(STATUS_TOPIC).size());
+
+    // Invalid payloads are ignored
+    haClient.shimDeliver(ENABLE_TOPIC, "MAYBE");
+    advance(0);
+    TEST_ASSERT_EQUAL(1, publishedTo(STATUS_TOPIC).size());
+
+    haClient.shimDeliver(ENABLE_TOPIC, "ON");
+    advance(0);
+    TEST_ASSERT_EQUAL(2, publishedTo(STATUS_TOPIC).size());
+    TEST_ASSERT_TRUE(isMapOn());
+}
+
+void test_discovery_published_and_hash_stored()
+{
+    std::vector<ShimMqttMessage> messages = publishedDiscovery();
+    TEST_ASSERT_EQUAL(HA_DISCOVERY_MESSAGES_COUNT, messages.size());
+    for (const ShimMqttMessage &message : messages)
+    {
+        TEST_ASSERT_TRUE(message.retained);
+        TEST_ASSERT_LESS_OR_EQUAL(HA_MQTT_BUFFER_SIZE,
+                                  MQTT_MAX_HEADER_SIZE + 2 + message.topic.size() + message.payload.size());
+    }
+
+    uint32_t hash = 0;
+    TEST_ASSERT_TRUE(configGetU32("ha.discovery", hash));
+    TEST_ASSERT_NOT_EQUAL(0, hash);
+    TEST_ASSERT_FALSE(LittleFS.exists("/ha_discovery.dat"));
+}
+
+void test_discovery_not_republished_on_reconnect()
+{
+    haClient.shimClear();
+    uint32_t connects = haClient.shimConnects();
+
+    haClient.shimDropConnection();
+    for (int i = 0; i < 20 && haClient.shimConnects() == connects; i++)
+        advance(200);
+
+    TEST_ASSERT_EQUAL(connects + 1, haClient.shimConnects());
+    TEST_ASSERT_EQUAL(0, publishedDiscovery().size());
+    TEST_ASSERT_EQUAL(1, publishedTo(STATUS_TOPIC).size());
+}
+
+void test_birth_message_republishes_discovery()
+{
+    haClient.shimClear();
+
+    haClient.shimDeliver("homeassistant/status", "offline");
+    advance(0);
+    TEST_ASSERT_EQUAL(0, publishedDiscovery().size());
+
+    haClient.shimDeliver("homeassistant/status", "online");
+    advance(0);
+    TEST_ASSERT_EQUAL(HA_DISCOVERY_MESSAGES_COUNT, publishedDiscovery().size());
+}
+
+/**
+ * @brief Handles an enable command in the calling thread and counts its heap allocations.
+ */
+static uint64_t enableCommandAllocations(const char *payload)
+{
+    char topic[] = ENABLE_TOPIC;
+    uint64_t before = shimThreadAllocations();
+    haMessageHandler(topic, (byte *)payload, strlen(payload));
+    return shimThreadAllocations() - before;
+}
+
+void test_enable_command_does_not_allocate()
+{
+    // Without the broker the status is not recorded by the shim, which would allocate
+    haClient.shimSetBrokerAvailable(false);
+    haClient.shimDropConnection();
+    advance(0);
+
+    // The counting of the allocations works
+    uint64_t before = shimThreadAllocations();
+    String text(ENABLE_TOPIC);
+    text += ENABLE_TOPIC;
+    TEST_ASSERT_GREATER_THAN(before, shimThreadAllocations());
+
+    TEST_ASSERT_EQUAL(0, enableCommandAllocations("ON"));
+    TEST_ASSERT_EQUAL(0, enableCommandAllocations("INVALID"));
+    TEST_ASSERT_EQUAL(0, enableCommandAllocations("OFF"));
+    TEST_ASSERT_EQUAL(0, enableCommandAllocations("OFF"));
+    TEST_ASSERT_EQUAL(0, enableCommandAllocations("ON"));
+    TEST_ASSERT_TRUE(isMapOn());
+
+    uint32_t connects = haClient.shimConnects();
+    haClient.shimSetBrokerAvailable(true);
+    for (int i = 0; i < 50 && haClient.shimConnects() == connects; i++)
+        advance(200);
+    TEST_ASSERT_EQUAL(connects + 1, haClient.shimConnects());
+}
+
+int main()
+{
+    // The task loop runs 20 times faster, the decisions use the virtual time
+    shimSetTimeScale(20);
+    setClockSource(virtualClock);
+    connectWiFi();
+
+    // The hash file of the previous firmware versions is replaced by the config store
+    LittleFS.begin(true);
+    File legacy = LittleFS.open("/ha_discovery.dat", "w");
+    legacy.write((const uint8_t *)"\x01\x02\x03\x04", 4);
+    legacy.close();
+    configStoreBegin();
+
+    char clientId[] = CLIENT_ID;
+    haClientTaskInit(clientId, sizeof(clientId));
+
+    UNITY_BEGIN();
+    RUN_TEST(test_status_published_after_connect);
+    RUN_TEST(test_discovery_published_and_hash_stored);
+    RUN_TEST(test_unchanged_status_waits_for_uptime_refresh);
+    RUN_TEST(test_counter_change_waits_for_counters_interval);
+    RUN_TEST(test_reconnect_changes_are_coalesced);
+    RUN_TEST(test_enable_command_publishes_only_changes);
+    RUN_TEST(test_discovery_not_republished_on_reconnect);
+    RUN_TEST(test_birth_message_republishes_discovery);
+    RUN_TEST(test_enable_command_does_not_allocate);
+    shimStopTasks();
+    return UNITY_END();
+}
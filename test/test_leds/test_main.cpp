@@ -0,0 +1,179 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the LED task and the LEDs command parser with the example payloads.
+ */
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <unity.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "command_latency.h"
+#include "constants.h"
+#include "leds.h"
+#include "leds_parser.h"
+
+// Time to wait for a frame showing the expected LEDs (in microseconds)
+#define FRAME_TIMEOUT_US 200000
+
+/**
+ * @brief Reads an example payload from the test directory.
+ */
+static std::string readPayload(const char *path)
+{
+    std::ifstream file(path);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+/**
+ * @brief Waits until the LED task shows the LED lit with the color, faded by any brightness.
+ *
+ * @param index The index of the LED.
+ * @param color The expected color at full brightness.
+ * @return true if a frame showed the LED in time.
+ */
+static bool waitForLed(uint8_t index, CRGB color)
+{
+    uint64_t start = esp_timer_get_time();
+    while (esp_timer_get_time() - start < FRAME_TIMEOUT_US)
+    {
+        CRGB shown = FastLED.shownLed(index);
+        if (shown != CRGB(CRGB::Black) && (shown.r > 0) == (color.r > 0) &&
+            (shown.g > 0) == (color.g > 0) && (shown.b > 0) == (color.b > 0))
+            return true;
+        delay(1);
+    }
+    return false;
+}
+
+/**
+ * @brief Waits until the LED task shows the LED turned off.
+ *
+ * @param index The index of the LED.
+ * @return true if a frame showed the LED off in time.
+ */
+static bool waitForLedOff(uint8_t index)
+{
+    uint64_t start = esp_timer_get_time();
+    while (esp_timer_get_time() - start < FRAME_TIMEOUT_US)
+    {
+        if (FastLED.shownLed(index) == CRGB(CRGB::Black))
+            return true;
+        delay(1);
+    }
+    return false;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_first_frame_turns_leds_off()
+{
+    uint64_t start = esp_timer_get_time();
+    while (FastLED.shownFrames() == 0 && esp_timer_get_time() - start < FRAME_TIMEOUT_US)
+        delay(1);
+
+    TEST_ASSERT_GREATER_THAN(0, FastLED.shownFrames());
+    for (uint8_t i = 0; i < LEDS_COUNT; i++)
+        TEST_ASSERT_TRUE(FastLED.shownLed(i) == CRGB(CRGB::Black));
+}
+
+void test_minimal_payload_lights_the_led()
+{
+    std::string payload = readPayload("test/example_leds_minimal_payload.json");
+    TEST_ASSERT_GREATER_THAN(0, payload.size());
+
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, payload.c_str(), payload.size()));
+    handleLedsCommand(doc, micros());
+
+    TEST_ASSERT_TRUE(waitForLed(63, CRGB(0xFFFF00)));
+}
+
+void test_full_payload_lights_the_leds()
+{
+    std::string payload = readPayload("test/example_leds_full_payload.json");
+    TEST_ASSERT_GREATER_THAN(0, payload.size());
+
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, payload.c_str(), payload.size()));
+    handleLedsCommand(doc, micros());
+
+    TEST_ASSERT_TRUE(waitForLed(0, CRGB(0xFF0000)));
+    TEST_ASSERT_TRUE(waitForLed(1, CRGB(0x00FF00)));
+    TEST_ASSERT_TRUE(waitForLed(2, CRGB(0x0000FF)));
+    TEST_ASSERT_EQUAL(0, getLedCommandDrops());
+}
+
+void test_binary_command_is_parsed()
+{
+    // LED 10, red, brightness 200, 300 ms, 1 cycle
+    const uint8_t command[] = {10, 0xFF, 0, 0, 200, 0x2C, 0x01, 1};
+    TEST_ASSERT_TRUE(handleBinaryLedsCommand(command, sizeof(command), micros()));
+    TEST_ASSERT_TRUE(waitForLed(9, CRGB(0xFF0000)));
+
+    TEST_ASSERT_FALSE(handleBinaryLedsCommand(command, sizeof(command) - 1, micros()));
+}
+
+void test_ambient_light_is_shown_on_idle_leds()
+{
+    LatencyHistogram before, after;
+    getLatencyHistogram(LATENCY_TOTAL, before);
+
+    AmbientLight light = {true, AMBIENT_SOLID, 0, 255, CRGB::Blue};
+    handleAmbientLightCommand(light, micros());
+    TEST_ASSERT_TRUE(waitForLed(40, CRGB(CRGB::Blue)));
+
+    // The first frame with the light completes the latency measurement
+    getLatencyHistogram(LATENCY_TOTAL, after);
+    TEST_ASSERT_EQUAL(before.count + 1, after.count);
+}
+
+void test_commands_are_shown_on_top_of_ambient_light()
+{
+    // LED 20, red, brightness 255, 100 ms, 1 cycle
+    const uint8_t command[] = {20, 0xFF, 0, 0, 255, 100, 0, 1};
+    TEST_ASSERT_TRUE(handleBinaryLedsCommand(command, sizeof(command), micros()));
+    TEST_ASSERT_TRUE(waitForLed(19, CRGB(CRGB::Red)));
+
+    // The LED returns to the ambient light once its command completes
+    TEST_ASSERT_TRUE(waitForLed(19, CRGB(CRGB::Blue)));
+    TEST_ASSERT_EQUAL(0, getLedCommandDrops());
+}
+
+void test_circle_ambient_light_lights_only_the_circle()
+{
+    AmbientLight light = {true, AMBIENT_CIRCLE, 50, 255, CRGB::Green};
+    handleAmbientLightCommand(light, micros());
+    TEST_ASSERT_TRUE(waitForLed(1, CRGB(CRGB::Green)));
+    TEST_ASSERT_TRUE(waitForLedOff(8));
+
+    light.on = false;
+    handleAmbientLightCommand(light, micros());
+    TEST_ASSERT_TRUE(waitForLedOff(1));
+    TEST_ASSERT_FALSE(getAmbientLight().on);
+}
+
+int main()
+{
+    ledsTaskInit();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_first_frame_turns_leds_off);
+    RUN_TEST(test_minimal_payload_lights_the_led);
+    RUN_TEST(test_binary_command_is_parsed);
+    RUN_TEST(test_ambient_light_is_shown_on_idle_leds);
+    RUN_TEST(test_commands_are_shown_on_top_of_ambient_light);
+    RUN_TEST(test_circle_ambient_light_lights_only_the_circle);
+    RUN_TEST(test_full_payload_lights_the_leds);
+    shimStopTasks();
+    return UNITY_END();
+}
@@ -0,0 +1,306 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the WebSocket and HTTP endpoints of the local API with in-process clients.
+ */
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <FastLED.h>
+#include <unity.h>
+#include <freertos/semphr.h>
+#include <string>
+#include "leds.h"
+#include "leds_parser.h"
+#include "local_api.h"
+
+// Time to wait for a frame showing the expected LEDs (in microseconds)
+#define FRAME_TIMEOUT_US 200000
+
+extern bool mapState;
+SemaphoreHandle_t getLedsCommandMutex();
+
+static LocalApiStats before;
+
+/**
+ * @brief Posts a JSON LEDs command and returns the response code.
+ */
+static int postJson(const char *json)
+{
+    return shimHttpPost(LOCAL_API_PORT, LOCAL_API_LEDS_PATH, "application/json", (const uint8_t *)json, strlen(json));
+}
+
+/**
+ * @brief Posts a binary LEDs command and returns the response code.
+ */
+static int postBinary(const uint8_t *command, size_t length)
+{
+    return shimHttpPost(LOCAL_API_PORT, LOCAL_API_LEDS_PATH, "application/octet-stream", command, length);
+}
+
+/**
+ * @brief Sends a WebSocket message in a single frame.
+ */
+static void sendFrame(uint32_t clientId, const uint8_t *data, size_t length, bool binary)
+{
+    AwsFrameInfo info = {};
+    info.final = 1;
+    info.opcode = binary ? WS_BINARY : WS_TEXT;
+    info.message_opcode = info.opcode;
+    info.len = length;
+    shimWebSocket(LOCAL_API_PORT, LOCAL_API_WS_PATH)->shimFrame(clientId, data, length, info);
+}
+
+/**
+ * @brief Returns a JSON LEDs command lighting the LED, padded with whitespace to the length.
+ */
+static std::string paddedJson(uint8_t id, size_t length)
+{
+    std::string json = "{\"leds\":[{\"id\":" + std::to_string(id) + ",\"cl\":\"00FF00\"}]";
+    json.append(length - json.size() - 1, ' ');
+    return json + "}";
+}
+
+/**
+ * @brief Returns the messages accepted since the start of the test.
+ */
+static uint32_t acceptedSince()
+{
+    return getLocalApiStats().messages - before.messages;
+}
+
+/**
+ * @brief Returns the messages rejected since the start of the test.
+ */
+static uint32_t rejectedSince()
+{
+    return getLocalApiStats().rejected - before.rejected;
+}
+
+/**
+ * @brief Waits until the LED task shows the LED lit with any brightness.
+ */
+static bool waitForLedOn(uint8_t index)
+{
+    uint64_t start = esp_timer_get_time();
+    while (esp_timer_get_time() - start < FRAME_TIMEOUT_US)
+    {
+        if (FastLED.shownLed(index) != CRGB(CRGB::Black))
+            return true;
+        delay(1);
+    }
+    return false;
+}
+
+void setUp()
+{
+    mapState = true;
+    resetLedsStates();
+    before = getLocalApiStats();
+}
+
+void tearDown()
+{
+}
+
+void test_valid_json_command_is_accepted()
+{
+    TEST_ASSERT_EQUAL(204, postJson("{\"leds\":[{\"id\":5,\"cl\":\"00FF00\"}]}"));
+    TEST_ASSERT_TRUE(waitForLedOn(4));
+    TEST_ASSERT_EQUAL(1, acceptedSince());
+    TEST_ASSERT_EQUAL(0, rejectedSince());
+}
+
+void test_invalid_json_commands_are_rejected()
+{
+    const char *const commands[] = {
+        "{\"leds\":[{\"id\":30,\"cl\":\"00FF00\"},{\"id\":500,\"cl\":\"00FF00\"}]}", // LED ID out of range
+        "{\"leds\":[{\"id\":6,\"cl\":\"GGGGGG\"}]}",                              // Invalid color
+        "{\"leds\":[{\"id\":7,\"cx\":3}],\"colors\":[\"FF0000\"]}",               // Palette index out of range
+        "{\"leds\":[{\"id\":8,\"cl\":\"FF0000\",\"dr\":-1}]}",                    // Invalid duration
+        "{\"bright\":300,\"leds\":[{\"id\":9,\"cl\":\"FF0000\"}]}",              // Invalid global brightness
+        "{\"leds\":[5]}",                                                        // Entry is not an object
+        "{\"led\":[{\"id\":10,\"cl\":\"FF0000\"}]}",                             // Missing LEDs array
+        "{\"leds\":",                                                            // Malformed JSON
+    };
+
+    for (const char *command : commands)
+        TEST_ASSERT_EQUAL_MESSAGE(400, postJson(command), command);
+
+    TEST_ASSERT_EQUAL(0, acceptedSince());
+    TEST_ASSERT_EQUAL(sizeof(commands) / sizeof(commands[0]), rejectedSince());
+
+    // The valid entries of a rejected command are still shown like from MQTT
+    TEST_ASSERT_TRUE(waitForLedOn(29));
+}
+
+void test_invalid_binary_commands_are_rejected()
+{
+    // LED 12, blue, brightness 255, 300 ms, 1 cycle
+    const uint8_t valid[] = {12, 0, 0, 0xFF, 255, 0x2C, 0x01, 1};
+    TEST_ASSERT_EQUAL(204, postBinary(valid, sizeof(valid)));
+    TEST_ASSERT_EQUAL(400, postBinary(valid, sizeof(valid) - 1));
+
+    // Invalid LED ID, duration and count
+    const uint8_t invalidId[] = {0, 0, 0, 0xFF, 255, 0x2C, 0x01, 1};
+    const uint8_t invalidDuration[] = {12, 0, 0, 0xFF, 255, 0xFF, 0xFF, 1};
+    const uint8_t invalidCount[] = {12, 0, 0, 0xFF, 255, 0x2C, 0x01, 0};
+    TEST_ASSERT_EQUAL(400, postBinary(invalidId, sizeof(invalidId)));
+    TEST_ASSERT_EQUAL(400, postBinary(invalidDuration, sizeof(invalidDuration)));
+    TEST_ASSERT_EQUAL(400, postBinary(invalidCount, sizeof(invalidCount)));
+
+    TEST_ASSERT_EQUAL(1, acceptedSince());
+    TEST_ASSERT_EQUAL(4, rejectedSince());
+}
+
+void test_commands_are_validated_while_the_map_is_off()
+{
+    mapState = false;
+
+    const uint8_t valid[] = {15, 0xFF, 0, 0, 255, 0x2C, 0x01, 1};
+    const uint8_t invalid[] = {15, 0xFF, 0, 0, 255, 0x2C, 0x01, 0};
+    TEST_ASSERT_EQUAL(204, postBinary(valid, sizeof(valid)));
+    TEST_ASSERT_EQUAL(400, postBinary(invalid, sizeof(invalid)));
+    TEST_ASSERT_EQUAL(400, postBinary(valid, 3));
+    TEST_ASSERT_EQUAL(204, postJson("{\"leds\":[{\"id\":16,\"cl\":\"FF0000\"}]}"));
+    TEST_ASSERT_EQUAL(400, postJson("{\"leds\":[{\"id\":0,\"cl\":\"FF0000\"}]}"));
+
+    TEST_ASSERT_EQUAL(2, acceptedSince());
+    TEST_ASSERT_EQUAL(3, rejectedSince());
+
+    // Nothing is shown
+    TEST_ASSERT_FALSE(waitForLedOn(14));
+    TEST_ASSERT_FALSE(waitForLedOn(15));
+}
+
+void test_websocket_messages_are_counted()
+{
+    AsyncWebSocket *socket = shimWebSocket(LOCAL_API_PORT, LOCAL_API_WS_PATH);
+    TEST_ASSERT_NOT_NULL(socket);
+    uint32_t clientId = socket->shimConnect();
+
+    const char *validJson = "{\"leds\":[{\"id\":20,\"cl\":\"0000FF\"}]}";
+    const char *invalidJson = "{\"leds\":[{\"id\":20,\"ct\":0}]}";
+    const uint8_t invalidBinary[] = {20, 0, 0, 0xFF, 255, 0x2C, 0x01, 0};
+    sendFrame(clientId, (const uint8_t *)validJson, strlen(validJson), false);
+    sendFrame(clientId, (const uint8_t *)invalidJson, strlen(invalidJson), false);
+    sendFrame(clientId, invalidBinary, sizeof(invalidBinary), true);
+
+    // A fragmented message is rejected once, with its first frame
+    AwsFrameInfo info = {};
+    info.opcode = WS_TEXT;
+    info.len = strlen(validJson);
+    socket->shimFrame(clientId, (const uint8_t *)validJson, 10, info);
+    info.index = 10;
+    info.final = 1;
+    socket->shimFrame(clientId, (const uint8_t *)validJson + 10, info.len - 10, info);
+
+    TEST_ASSERT_TRUE(waitForLedOn(19));
+    TEST_ASSERT_EQUAL(1, acceptedSince());
+    TEST_ASSERT_EQUAL(3, rejectedSince());
+    TEST_ASSERT_EQUAL(1, getLocalApiStats().clients);
+
+    socket->shimDisconnect(clientId);
+    TEST_ASSERT_EQUAL(0, getLocalApiStats().clients);
+}
+
+void test_request_split_into_segments_is_collected()
+{
+    // The body arrives in three TCP segments
+    std::string json = paddedJson(33, 3000);
+    TEST_ASSERT_EQUAL(204, shimHttpPost(LOCAL_API_PORT, LOCAL_API_LEDS_PATH, "application/json",
+                                        (const uint8_t *)json.c_str(), json.size()));
+    TEST_ASSERT_TRUE(waitForLedOn(32));
+
+    // A binary command split inside its records
+    const uint8_t command[] = {35, 0, 0, 0xFF, 255, 0x2C, 0x01, 1, 36, 0, 0, 0xFF, 255, 0x2C, 0x01, 1};
+    TEST_ASSERT_EQUAL(204, shimHttpPost(LOCAL_API_PORT, LOCAL_API_LEDS_PATH, "application/octet-stream", command,
+                                        sizeof(command), 5));
+    TEST_ASSERT_TRUE(waitForLedOn(34));
+    TEST_ASSERT_TRUE(waitForLedOn(35));
+
+    TEST_ASSERT_EQUAL(2, acceptedSince());
+    TEST_ASSERT_EQUAL(0, rejectedSince());
+}
+
+void test_websocket_frame_split_into_segments_is_collected()
+{
+    AsyncWebSocket *socket = shimWebSocket(LOCAL_API_PORT, LOCAL_API_WS_PATH);
+    uint32_t clientId = socket->shimConnect();
+
+    // Two messages of the largest size arrive in TCP segments, the buffer of the client is reused
+    for (uint8_t id : {38, 39})
+    {
+        std::string json = paddedJson(id, LOCAL_API_MAX_MESSAGE);
+        AwsFrameInfo info = {};
+        info.final = 1;
+        info.opcode = WS_TEXT;
+        info.message_opcode = WS_TEXT;
+        info.len = json.size();
+        for (info.index = 0; info.index < info.len; info.index += 1436)
+        {
+            size_t length = std::min((size_t)(info.len - info.index), (size_t)1436);
+            socket->shimFrame(clientId, (const uint8_t *)json.c_str() + info.index, length, info);
+        }
+        TEST_ASSERT_TRUE(waitForLedOn(id - 1));
+    }
+
+    TEST_ASSERT_EQUAL(2, acceptedSince());
+    TEST_ASSERT_EQUAL(0, rejectedSince());
+    socket->shimDisconnect(clientId);
+}
+
+void test_too_long_request_is_rejected()
+{
+    std::string json = "{\"leds\":[";
+    for (uint8_t i = 1; json.size() <= LOCAL_API_MAX_MESSAGE; i = i % LEDS_COUNT + 1)
+        json += "{\"id\":" + std::to_string(i) + ",\"cl\":\"FF0000\"},";
+    json.back() = ']';
+    json += "}";
+
+    TEST_ASSERT_EQUAL(413, shimHttpPost(LOCAL_API_PORT, LOCAL_API_LEDS_PATH, "application/json",
+                                        (const uint8_t *)json.c_str(), json.size(), json.size()));
+    TEST_ASSERT_EQUAL(1, rejectedSince());
+}
+
+void test_busy_command_mutex_drops_the_command()
+{
+    // Another source holds the mutex, the command is dropped right away instead of blocking the network task
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(getLedsCommandMutex(), 0));
+    uint64_t start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(503, postJson("{\"leds\":[{\"id\":25,\"cl\":\"FF0000\"}]}"));
+    uint64_t waitedUs = esp_timer_get_time() - start;
+    xSemaphoreGive(getLedsCommandMutex());
+
+    TEST_ASSERT_LESS_THAN(LEDS_COMMAND_MUTEX_TIMEOUT * 1000, waitedUs);
+    TEST_ASSERT_FALSE(waitForLedOn(24));
+    TEST_ASSERT_EQUAL(1, getLocalApiStats().dropped - before.dropped);
+    TEST_ASSERT_EQUAL(0, rejectedSince());
+
+    // The next command gets the mutex
+    TEST_ASSERT_EQUAL(204, postJson("{\"leds\":[{\"id\":25,\"cl\":\"FF0000\"}]}"));
+    TEST_ASSERT_TRUE(waitForLedOn(24));
+}
+
+int main()
+{
+    shimSerialCapture(true);
+    ledsTaskInit();
+    initLocalApi();
+
+    // Wait for the first frame of the LED task
+    while (FastLED.shownFrames() == 0)
+        delay(1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_valid_json_command_is_accepted);
+    RUN_TEST(test_invalid_json_commands_are_rejected);
+    RUN_TEST(test_invalid_binary_commands_are_rejected);
+    RUN_TEST(test_commands_are_validated_while_the_map_is_off);
+    RUN_TEST(test_websocket_messages_are_counted);
+    RUN_TEST(test_request_split_into_segments_is_collected);
+    RUN_TEST(test_websocket_frame_split_into_segments_is_collected);
+    RUN_TEST(test_too_long_request_is_rejected);
+    RUN_TEST(test_busy_command_mutex_drops_the_command);
+    shimStopTasks();
+    return UNITY_END();
+}
@@ -0,0 +1,103 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the messages formatted by the deferred logger task.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include "aws_iot.h"
+#include "logger.h"
+
+// Topic of a message logged by messageHandler()
+#define TOPIC "int-cz-map/cmd/update/0123456789abcdef0123456789abcdef"
+
+/**
+ * @brief Waits for the logger task to print the buffered messages and returns them.
+ */
+static std::string drainLog()
+{
+    delay(100);
+    return shimSerialTakeOutput().c_str();
+}
+
+void setUp()
+{
+    shimSerialTakeOutput();
+}
+
+void tearDown()
+{
+}
+
+void test_message_arrival_is_not_truncated()
+{
+    std::string payload(300, 'x');
+    for (size_t i = 0; i < payload.size(); i++)
+        payload[i] = 'a' + i % 26;
+
+    LOG_INFO("IoT message arrived. Topic: %s. Size: %u bytes. Payload (first %d bytes): %.*s",
+             TOPIC, (uint32_t)payload.size(), AWS_MAX_PRINTABLE_LENGTH, AWS_MAX_PRINTABLE_LENGTH, payload.c_str());
+
+    std::string expected = "I: IoT message arrived. Topic: " TOPIC ". Size: 300 bytes. Payload (first " +
+                           std::to_string(AWS_MAX_PRINTABLE_LENGTH) + " bytes): " +
+                           payload.substr(0, AWS_MAX_PRINTABLE_LENGTH) + "\n";
+    std::string output = drainLog();
+    TEST_ASSERT_TRUE(output.size() >= expected.size());
+    std::string tail = output.substr(output.size() - expected.size());
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), tail.c_str());
+}
+
+void test_arguments_keep_their_values()
+{
+    int value = 0;
+    LOG_WARN("%d %u %c %p %s %x", -42, 4000000000U, 'z', (void *)&value, "text", 0xBEEFU);
+
+    char expected[64];
+    snprintf(expected, sizeof(expected), "W: -42 4000000000 z %p text beef\n", (void *)&value);
+    std::string output = drainLog();
+    TEST_ASSERT_TRUE(output.find(expected) != std::string::npos);
+}
+
+void test_too_long_strings_are_truncated()
+{
+    std::string first(LOG_STRINGS_SIZE - 10, 'a');
+    std::string second(20, 'b');
+    LOG_ERROR("[%s] [%s] [%s]", first.c_str(), second.c_str(), "lost");
+
+    // The second string gets the remaining space, the last one is empty
+    std::string expected = "E: [" + first + "] [" + std::string(8, 'b') + "] []\n";
+    std::string output = drainLog();
+    TEST_ASSERT_TRUE(output.find(expected) != std::string::npos);
+}
+
+void test_flags_widths_and_length_modifiers_are_kept()
+{
+    LOG_INFO("[%5d] [%-4s] [%*u] [%08x] [%hd] [100%%]", -7, "ab", 6, 42U, 0xABCU, (short)-9);
+
+    std::string output = drainLog();
+    TEST_ASSERT_TRUE(output.find("I: [   -7] [ab  ] [    42] [00000abc] [-9] [100%]\n") != std::string::npos);
+}
+
+void test_arguments_after_the_maximum_are_not_printed()
+{
+    LOG_INFO("%d %d %d %d %d %d [%d]", 1, 2, 3, 4, 5, 6, 7);
+
+    std::string output = drainLog();
+    TEST_ASSERT_TRUE(output.find("I: 1 2 3 4 5 6 []\n") != std::string::npos);
+}
+
+int main()
+{
+    shimSerialCapture(true);
+    loggerInit();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_message_arrival_is_not_truncated);
+    RUN_TEST(test_arguments_keep_their_values);
+    RUN_TEST(test_too_long_strings_are_truncated);
+    RUN_TEST(test_flags_widths_and_length_modifiers_are_kept);
+    RUN_TEST(test_arguments_after_the_maximum_are_not_printed);
+    shimStopTasks();
+    return UNITY_END();
+}
@@ -0,0 +1,105 @@
+/**
+ * @file test_main.cpp
+ * @brief Host simulation of the standby mode counters over a virtual clock.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <atomic>
+#include <random>
+#include <thread>
+#include "power.h"
+#include "system_clock.h"
+
+// Simulated time, longer than the 49.7 days after which 32-bit milliseconds wrap
+#define SIMULATED_DAYS 60ULL
+#define DAY_US         (24ULL * 3600 * 1000000)
+
+static std::atomic<uint64_t> virtualTimeUs{0};
+
+static uint64_t virtualClock()
+{
+    return virtualTimeUs;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_counters_follow_the_simulated_modes()
+{
+    std::mt19937 random(30);
+    std::uniform_int_distribution<uint64_t> duration(1000, 6ULL * 3600 * 1000000);
+
+    uint64_t expectedStandbyUs = 0, expectedActiveUs = 0;
+    uint32_t expectedEntries = 0;
+    PowerStats before = getPowerStats();
+
+    // Alternate the modes with random durations, with repeated requests for the current mode
+    while (virtualTimeUs < SIMULATED_DAYS * DAY_US)
+    {
+        bool enterStandby = random() % 2;
+        if (enterStandby && !isInStandby())
+            expectedEntries++;
+        setStandby(enterStandby);
+        TEST_ASSERT_EQUAL(enterStandby, isInStandby());
+
+        uint64_t elapsed = duration(random);
+        (enterStandby ? expectedStandbyUs : expectedActiveUs) += elapsed;
+        virtualTimeUs += elapsed;
+    }
+
+    PowerStats stats = getPowerStats();
+    uint64_t standbyMs = stats.standbyTimeMs - before.standbyTimeMs;
+    uint64_t activeMs = stats.activeTimeMs - before.activeTimeMs;
+
+    TEST_ASSERT_EQUAL(before.standbyEntries + expectedEntries, stats.standbyEntries);
+    TEST_ASSERT_TRUE(standbyMs + activeMs > (1ULL << 32));
+    TEST_ASSERT_TRUE(standbyMs >= expectedStandbyUs / 1000 - 1 && standbyMs <= expectedStandbyUs / 1000 + 1);
+    TEST_ASSERT_TRUE(activeMs >= expectedActiveUs / 1000 - 1 && activeMs <= expectedActiveUs / 1000 + 1);
+
+    // The estimate is the time-weighted average of the modes
+    uint64_t totalMs = stats.standbyTimeMs + stats.activeTimeMs;
+    uint64_t expectedCurrent = (stats.activeTimeMs * ACTIVE_CURRENT_MA + stats.standbyTimeMs * STANDBY_CURRENT_MA) / totalMs;
+    TEST_ASSERT_UINT_WITHIN(1, expectedCurrent, stats.estimatedCurrentMa);
+}
+
+void test_concurrent_requests_enter_the_mode_once()
+{
+    setStandby(false);
+    PowerStats before = getPowerStats();
+
+    for (int round = 0; round < 100; round++)
+    {
+        std::thread first([] { setStandby(true); });
+        std::thread second([] { setStandby(true); });
+        first.join();
+        second.join();
+        TEST_ASSERT_TRUE(isInStandby());
+
+        virtualTimeUs += 1000;
+        setStandby(false);
+        virtualTimeUs += 1000;
+    }
+
+    PowerStats stats = getPowerStats();
+    TEST_ASSERT_EQUAL(before.standbyEntries + 100, stats.standbyEntries);
+    TEST_ASSERT_EQUAL(before.standbyTimeMs + 100, stats.standbyTimeMs);
+    TEST_ASSERT_EQUAL(before.activeTimeMs + 100, stats.activeTimeMs);
+}
+
+int main()
+{
+    setClockSource(virtualClock);
+    initPowerManagement();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_counters_follow_the_simulated_modes);
+    RUN_TEST(test_concurrent_requests_enter_the_mode_once);
+    shimStopTasks();
+    return UNITY_END();
+}
@@ -0,0 +1,405 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the DDP and E1.31 receiver with packets sent over the loopback interface:
+ * decoding, dropped packets, decode throughput and the time from a frame to its output.
+ *
+ * The receiver listens on free ports chosen by the host. The throughput and the latency depend
+ * on the load of the host and the sanitizers, they are only reported.
+ */
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <unity.h>
+#include <lwip/sockets.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "command_latency.h"
+#include "leds.h"
+#include "realtime_udp.h"
+
+// DDP header flags
+#define DDP_FLAG_VERSION_1 0x40
+#define DDP_FLAG_PUSH      0x01
+#define DDP_HEADER_SIZE    10
+
+// Size of the E1.31 data packet headers up to and including the DMX start code
+#define E131_HEADER_SIZE 126
+
+// Time to wait for the receiver and the LED task (in microseconds)
+#define WAIT_TIMEOUT_US 1000000
+
+// Frames sent in a burst before waiting for the receiver, the burst fits into the socket buffer
+#define THROUGHPUT_BURST  100
+#define THROUGHPUT_FRAMES 2000
+
+// Streamed frames of the latency test
+#define LATENCY_FRAMES 200
+
+// Ports the receiver listens on
+static uint16_t ddpPort = 0;
+static uint16_t e131Port = 0;
+
+static int senderSocket = -1;
+static uint8_t ddpSequence = 0;
+static uint8_t e131Sequence = 0;
+
+/**
+ * @brief Sends a UDP packet to the receiver over the loopback interface.
+ */
+static void sendPacket(uint16_t port, const std::vector<uint8_t> &packet)
+{
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL(packet.size(), sendto(senderSocket, packet.data(), packet.size(), 0,
+                                            (struct sockaddr *)&address, sizeof(address)));
+}
+
+/**
+ * @brief Builds a DDP packet with the pixel data at the offset.
+ *
+ * @param data The pixel data.
+ * @param length The length of the pixel data.
+ * @param offset The offset of the data in the frame.
+ * @param push true to show the frame with this packet.
+ * @param sequence The sequence number [1, 15], 0 to disable the check.
+ */
+static std::vector<uint8_t> ddpPacket(const uint8_t *data, uint16_t length, uint32_t offset, bool push, uint8_t sequence)
+{
+    std::vector<uint8_t> packet = {(uint8_t)(DDP_FLAG_VERSION_1 | (push ? DDP_FLAG_PUSH : 0)), sequence, 0x01, 1,
+                                   (uint8_t)(offset >> 24), (uint8_t)(offset >> 16), (uint8_t)(offset >> 8),
+                                   (uint8_t)offset, (uint8_t)(length >> 8), (uint8_t)length};
+    packet.insert(packet.end(), data, data + length);
+    return packet;
+}
+
+/**
+ * @brief Builds an E1.31 data packet of the universe.
+ *
+ * @param frame The channels, REALTIME_FRAME_SIZE bytes.
+ * @param sequence The sequence number.
+ * @param universe The universe.
+ */
+static std::vector<uint8_t> e131Packet(const uint8_t *frame, uint8_t sequence, uint16_t universe = E131_UNIVERSE)
+{
+    static const uint8_t packetId[] = {0x00, 0x10, 0x00, 0x00, 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0x00, 0x00, 0x00};
+    std::vector<uint8_t> packet(E131_HEADER_SIZE, 0);
+    memcpy(packet.data(), packetId, sizeof(packetId));
+    packet[21] = 0x04;  // Root vector: data
+    packet[43] = 0x02;  // Framing vector: data
+    packet[108] = 100;  // Priority
+    packet[111] = sequence;
+    packet[113] = universe >> 8;
+    packet[114] = universe & 0xFF;
+    packet[117] = 0x02; // DMP vector: set property
+    packet[123] = (REALTIME_FRAME_SIZE + 1) >> 8;
+    packet[124] = (REALTIME_FRAME_SIZE + 1) & 0xFF;
+    packet.insert(packet.end(), frame, frame + REALTIME_FRAME_SIZE);
+    return packet;
+}
+
+/**
+ * @brief Sends a whole frame in a single DDP packet with the next sequence number.
+ */
+static void sendDdpFrame(const uint8_t *frame)
+{
+    ddpSequence = ddpSequence % 15 + 1;
+    sendPacket(ddpPort, ddpPacket(frame, REALTIME_FRAME_SIZE, 0, true, ddpSequence));
+}
+
+/**
+ * @brief Sends a whole frame in an E1.31 packet with the next sequence number.
+ */
+static void sendE131Frame(const uint8_t *frame)
+{
+    sendPacket(e131Port, e131Packet(frame, ++e131Sequence));
+}
+
+/**
+ * @brief Fills the frame with a pattern unique to the number.
+ */
+static void fillFrame(uint8_t *frame, uint32_t number)
+{
+    for (uint16_t i = 0; i < REALTIME_FRAME_SIZE; i++)
+        frame[i] = (uint8_t)(number * 7 + i);
+    frame[0] = (uint8_t)number | 1; // Never black
+    frame[1] = (uint8_t)(number >> 8);
+}
+
+/**
+ * @brief Returns whether the LED task shows the frame.
+ */
+static bool isShown(const uint8_t *frame)
+{
+    for (uint8_t i = 0; i < LEDS_COUNT; i++)
+    {
+        if (FastLED.shownLed(i) != CRGB(frame[i * 3], frame[i * 3 + 1], frame[i * 3 + 2]))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Waits until the LED task shows the frame.
+ *
+ * @return The time from the start of the wait to the output (in microseconds), 0 on timeout.
+ */
+static uint32_t waitForFrame(const uint8_t *frame)
+{
+    uint64_t start = esp_timer_get_time();
+    while (esp_timer_get_time() - start < WAIT_TIMEOUT_US)
+    {
+        if (isShown(frame))
+            return max((uint64_t)1, esp_timer_get_time() - start);
+        delayMicroseconds(50);
+    }
+    return 0;
+}
+
+/**
+ * @brief Waits until the receiver completes the number of frames.
+ *
+ * @return true if the frames were received in time.
+ */
+static bool waitForReceivedFrames(uint32_t frames)
+{
+    uint64_t start = esp_timer_get_time();
+    while (getRealtimeStats().frames < frames)
+    {
+        if (esp_timer_get_time() - start > WAIT_TIMEOUT_US)
+            return false;
+        delayMicroseconds(50);
+    }
+    return true;
+}
+
+/**
+ * @brief Waits until the receiver counts the dropped packets.
+ *
+ * @return true if the packets were counted in time.
+ */
+static bool waitForDroppedPackets(uint32_t late, uint32_t invalid)
+{
+    uint64_t start = esp_timer_get_time();
+    RealtimeStats stats = getRealtimeStats();
+    while (stats.late < late || stats.invalid < invalid)
+    {
+        if (esp_timer_get_time() - start > WAIT_TIMEOUT_US)
+            return false;
+        delay(1);
+        stats = getRealtimeStats();
+    }
+    return true;
+}
+
+/**
+ * @brief Streams frames in bursts and returns the decode throughput (in frames per second).
+ *
+ * @param sendFrame The function sending a frame.
+ */
+static uint32_t measureThroughput(void (*sendFrame)(const uint8_t *))
+{
+    uint8_t frame[REALTIME_FRAME_SIZE];
+    RealtimeStats before = getRealtimeStats();
+
+    uint64_t start = esp_timer_get_time();
+    for (uint32_t sent = 0; sent < THROUGHPUT_FRAMES;)
+    {
+        for (uint32_t i = 0; i < THROUGHPUT_BURST; i++, sent++)
+        {
+            fillFrame(frame, sent);
+            sendFrame(frame);
+        }
+        TEST_ASSERT_TRUE_MESSAGE(waitForReceivedFrames(before.frames + sent), "Frames lost on the loopback");
+    }
+    uint64_t elapsedUs = esp_timer_get_time() - start;
+
+    // The last frame is shown, all the frames were decoded without drops
+    TEST_ASSERT_GREATER_THAN(0, waitForFrame(frame));
+    RealtimeStats after = getRealtimeStats();
+    TEST_ASSERT_EQUAL(before.frames + THROUGHPUT_FRAMES, after.frames);
+    TEST_ASSERT_EQUAL(before.late, after.late);
+    TEST_ASSERT_EQUAL(before.invalid, after.invalid);
+
+    return THROUGHPUT_FRAMES * 1000000ULL / elapsedUs;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_ddp_frame_in_two_packets_is_shown()
+{
+    uint8_t frame[REALTIME_FRAME_SIZE];
+    fillFrame(frame, 1);
+    RealtimeStats before = getRealtimeStats();
+
+    // The first half is only stored, the second one with the push flag shows the frame
+    sendPacket(ddpPort, ddpPacket(frame, REALTIME_FRAME_SIZE / 2, 0, false, 0));
+    sendPacket(ddpPort,
+               ddpPacket(frame + REALTIME_FRAME_SIZE / 2, REALTIME_FRAME_SIZE / 2, REALTIME_FRAME_SIZE / 2, true, 0));
+
+    TEST_ASSERT_GREATER_THAN(0, waitForFrame(frame));
+    RealtimeStats after = getRealtimeStats();
+    TEST_ASSERT_TRUE(after.active);
+    TEST_ASSERT_EQUAL(before.frames + 1, after.frames);
+    TEST_ASSERT_EQUAL(before.shown + 1, after.shown);
+    TEST_ASSERT_GREATER_THAN(0, after.latencyMaxUs);
+}
+
+void test_e131_frame_is_shown()
+{
+    uint8_t frame[REALTIME_FRAME_SIZE];
+    fillFrame(frame, 2);
+
+    // Other universes are ignored
+    sendPacket(e131Port, e131Packet(frame, ++e131Sequence, E131_UNIVERSE + 1));
+    fillFrame(frame, 3);
+    sendE131Frame(frame);
+
+    TEST_ASSERT_GREATER_THAN(0, waitForFrame(frame));
+}
+
+void test_late_and_invalid_packets_are_dropped()
+{
+    uint8_t frame[REALTIME_FRAME_SIZE];
+    fillFrame(frame, 4);
+    RealtimeStats before = getRealtimeStats();
+
+    // A repeated DDP sequence number and an E1.31 sequence number behind the last one are late
+    sendDdpFrame(frame);
+    sendPacket(ddpPort, ddpPacket(frame, REALTIME_FRAME_SIZE, 0, true, ddpSequence));
+    sendE131Frame(frame);
+    sendPacket(e131Port, e131Packet(frame, e131Sequence - 1));
+
+    // A DDP packet shorter than its data length and an E1.31 packet with another identifier are invalid
+    std::vector<uint8_t> truncated = ddpPacket(frame, REALTIME_FRAME_SIZE, 0, true, 0);
+    truncated.resize(truncated.size() - 1);
+    sendPacket(ddpPort, truncated);
+    std::vector<uint8_t> unknown = e131Packet(frame, ++e131Sequence);
+    unknown[4] = 'X';
+    sendPacket(e131Port, unknown);
+
+    TEST_ASSERT_TRUE(waitForDroppedPackets(before.late + 2, before.invalid + 2));
+    RealtimeStats after = getRealtimeStats();
+    TEST_ASSERT_EQUAL(before.late + 2, after.late);
+    TEST_ASSERT_EQUAL(before.invalid + 2, after.invalid);
+    TEST_ASSERT_EQUAL(before.frames + 2, after.frames);
+}
+
+void test_ddp_decode_throughput()
+{
+    uint32_t fps = measureThroughput(sendDdpFrame);
+
+    char message[64];
+    snprintf(message, sizeof(message), "DDP decode throughput: %u frames/s", fps);
+    TEST_MESSAGE(message);
+}
+
+void test_e131_decode_throughput()
+{
+    uint32_t fps = measureThroughput(sendE131Frame);
+
+    char message[64];
+    snprintf(message, sizeof(message), "E1.31 decode throughput: %u frames/s", fps);
+    TEST_MESSAGE(message);
+}
+
+void test_frame_to_output_latency()
+{
+    // Let the LED task show the frames of the previous tests
+    delay(50);
+
+    uint8_t frame[REALTIME_FRAME_SIZE];
+    RealtimeStats before = getRealtimeStats();
+    std::vector<uint32_t> latencies;
+    std::mt19937 random(50);
+
+    // Every frame is sent at a random phase of the LED task and is shown before the next one
+    for (uint32_t i = 0; i < LATENCY_FRAMES; i++)
+    {
+        fillFrame(frame, 1000 + i);
+        i % 2 == 0 ? sendDdpFrame(frame) : sendE131Frame(frame);
+        uint32_t latencyUs = waitForFrame(frame);
+        TEST_ASSERT_GREATER_THAN(0, latencyUs);
+        latencies.push_back(latencyUs);
+        delayMicroseconds(random() % 10000);
+    }
+
+    // Every frame was shown once
+    RealtimeStats after = getRealtimeStats();
+    TEST_ASSERT_EQUAL(before.shown + LATENCY_FRAMES, after.shown);
+    TEST_ASSERT_EQUAL(before.replaced, after.replaced);
+    TEST_ASSERT_GREATER_THAN(0, after.latencyMaxUs);
+
+    std::sort(latencies.begin(), latencies.end());
+    char message[128];
+    snprintf(message, sizeof(message), "Frame-to-output latency: p50 %u us, p99 %u us, max %u us (receiver max %u us)",
+             latencies[LATENCY_FRAMES / 2], latencies[LATENCY_FRAMES * 99 / 100], latencies.back(), after.latencyMaxUs);
+    TEST_MESSAGE(message);
+}
+
+void test_ambient_light_set_during_stream_is_shown_after_it()
+{
+    uint8_t frame[REALTIME_FRAME_SIZE];
+    fillFrame(frame, 5000);
+    sendDdpFrame(frame);
+    TEST_ASSERT_GREATER_THAN(0, waitForFrame(frame));
+
+    // A measured Home Assistant light command arrives while the stream is shown
+    LatencyHistogram before;
+    getLatencyHistogram(LATENCY_TOTAL, before);
+    AmbientLight light = {true, AMBIENT_SOLID, 0, 255, CRGB::Red};
+    uint8_t batch = latencyCommandParsed(micros());
+    setAmbientLight(light, batch);
+    latencyCommandEnqueued(batch);
+
+    // The streamed frames do not show the light, its latency is not recorded yet
+    for (uint32_t i = 1; i <= 5; i++)
+    {
+        fillFrame(frame, 5000 + i);
+        sendDdpFrame(frame);
+        TEST_ASSERT_GREATER_THAN(0, waitForFrame(frame));
+    }
+    LatencyHistogram histogram;
+    getLatencyHistogram(LATENCY_TOTAL, histogram);
+    TEST_ASSERT_EQUAL(before.count, histogram.count);
+
+    // The first frame of the LED states after the stream shows the light and completes the command
+    uint64_t start = esp_timer_get_time();
+    while (FastLED.shownLed(0) != CRGB(CRGB::Red) && esp_timer_get_time() - start < (REALTIME_TIMEOUT_MS * 1000ULL + WAIT_TIMEOUT_US))
+        delay(1);
+    TEST_ASSERT_FALSE(getRealtimeStats().active);
+    TEST_ASSERT_TRUE(FastLED.shownLed(0) == CRGB(CRGB::Red));
+    getLatencyHistogram(LATENCY_TOTAL, histogram);
+    TEST_ASSERT_EQUAL(before.count + 1, histogram.count);
+}
+
+int main()
+{
+    senderSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ledsTaskInit();
+    realtimeUdpInit(0, 0);
+
+    // Wait for the receiver to open its sockets on free ports
+    for (int i = 0; i < 100 && !getRealtimePorts(&ddpPort, &e131Port); i++)
+        delay(10);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_ddp_frame_in_two_packets_is_shown);
+    RUN_TEST(test_e131_frame_is_shown);
+    RUN_TEST(test_late_and_invalid_packets_are_dropped);
+    RUN_TEST(test_frame_to_output_latency);
+    RUN_TEST(test_ddp_decode_throughput);
+    RUN_TEST(test_e131_decode_throughput);
+    RUN_TEST(test_ambient_light_set_during_stream_is_shown_after_it);
+    shimStopTasks();
+    close(senderSocket);
+    return UNITY_END();
+}
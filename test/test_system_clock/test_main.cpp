@@ -0,0 +1,193 @@
+/**
+ * @file test_main.cpp
+ * @brief Simulations of hours of fades and reconnects on a virtual clock, across the 49-day rollover of the milliseconds.
+ */
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <unity.h>
+#include <atomic>
+#include <vector>
+#include "aws_iot.h"
+#include "leds.h"
+#include "system_clock.h"
+
+// Time when the 32-bit milliseconds roll over (in microseconds)
+#define ROLLOVER_US ((1ULL << 32) * 1000)
+#define HOUR_US     (3600ULL * 1000000)
+
+// Frame period of the simulated LED task (in milliseconds)
+#define FRAME_MS 10
+
+extern PubSubClient client;
+extern uint32_t awsReconnectAttempts;
+
+static std::atomic<uint64_t> virtualTimeUs{0};
+
+static uint64_t virtualClock()
+{
+    return virtualTimeUs;
+}
+
+/**
+ * @brief Renders one frame at the current virtual time and returns the shown brightness of the LED.
+ */
+static uint8_t renderFrame(uint8_t index)
+{
+    refreshLeds();
+    return FastLED.shownLed(index).r;
+}
+
+/**
+ * @brief Connects the station using the fake WiFi driver.
+ */
+static void connectWiFi()
+{
+    const uint8_t bssid[6] = {0x10, 0x20, 0x30, 0x40, 0x50, 0x60};
+    shimWiFiAddAccessPoint("home", "secret", bssid, 6, -50, IPAddress(192, 168, 1, 50), IPAddress(192, 168, 1, 1));
+    WiFi.begin("home", "secret");
+    while (!WiFi.isConnected())
+    {
+        shimAdvanceTime(100000);
+        shimWiFiPoll();
+    }
+}
+
+void setUp()
+{
+    resetLedsStates();
+}
+
+void tearDown()
+{
+}
+
+void test_deadlines_across_the_rollover()
+{
+    TEST_ASSERT_TRUE(clockReached(5, UINT32_MAX - 5));
+    TEST_ASSERT_FALSE(clockReached(UINT32_MAX - 5, 5));
+    TEST_ASSERT_TRUE(clockReached(UINT32_MAX, UINT32_MAX));
+    TEST_ASSERT_EQUAL(11, (uint32_t)(5 - (UINT32_MAX - 5)));
+
+    // The milliseconds wrap, the uptime keeps counting
+    virtualTimeUs = ROLLOVER_US + 1500000;
+    TEST_ASSERT_EQUAL(1500, clockMillis());
+    TEST_ASSERT_EQUAL(ROLLOVER_US / 1000000 + 1, clockUptimeSeconds());
+    TEST_ASSERT_EQUAL(ROLLOVER_US + 1500000, clockMicros64());
+}
+
+void test_hours_of_fades_across_the_rollover()
+{
+    const uint16_t fadeMs = 2000;
+    virtualTimeUs = ROLLOVER_US - HOUR_US - 7 * FRAME_MS * 1000;
+    pushLedCommand(0, {255, fadeMs, LOOP_INDEFINITELY, CRGB::White, 0});
+    renderFrame(0);
+    uint64_t startUs = virtualTimeUs;
+    virtualTimeUs += FRAME_MS * 1000;
+    uint8_t previous = renderFrame(0);
+
+    // The LED fades out and restarts at the full brightness every fade duration
+    uint64_t endUs = ROLLOVER_US + 2 * HOUR_US;
+    uint64_t lastRestartUs = 0;
+    uint32_t restarts = 0;
+    while (virtualTimeUs < endUs)
+    {
+        virtualTimeUs += FRAME_MS * 1000;
+        uint8_t brightness = renderFrame(0);
+        if (brightness > previous)
+        {
+            if (lastRestartUs != 0)
+                TEST_ASSERT_EQUAL(fadeMs * 1000ULL, virtualTimeUs - lastRestartUs);
+            lastRestartUs = virtualTimeUs;
+            restarts++;
+        }
+        previous = brightness;
+    }
+
+    TEST_ASSERT_EQUAL((endUs - startUs) / (fadeMs * 1000), restarts);
+}
+
+void test_counted_fade_ends_after_the_rollover()
+{
+    // Five fades of 2 s starting 3 s before the rollover end 7 s after it
+    virtualTimeUs = ROLLOVER_US - 3000000;
+    pushLedCommand(1, {255, 2000, 5, CRGB::White, 0});
+    renderFrame(1);
+
+    while (virtualTimeUs < ROLLOVER_US + 7000000 - FRAME_MS * 1000)
+    {
+        virtualTimeUs += FRAME_MS * 1000;
+        TEST_ASSERT_GREATER_THAN(0, renderFrame(1));
+    }
+
+    virtualTimeUs += FRAME_MS * 1000;
+    TEST_ASSERT_EQUAL(0, renderFrame(1));
+}
+
+void test_reconnect_backoff_across_the_rollover()
+{
+    virtualTimeUs = ROLLOVER_US - 10 * 60 * 1000000ULL;
+    client.shimSetBrokerAvailable(false);
+    char clientId[] = "AABBCC";
+    uint32_t attempts = awsReconnectAttempts;
+    initAWS(clientId, sizeof(clientId) - 1);
+    TEST_ASSERT_EQUAL(attempts + 1, awsReconnectAttempts);
+
+    // Two hours without the broker, the delay doubles up to the maximum and the attempts go on after the rollover
+    std::vector<uint64_t> attemptsUs = {virtualTimeUs};
+    attempts = awsReconnectAttempts;
+    uint64_t endUs = virtualTimeUs + 2 * HOUR_US;
+    while (virtualTimeUs < endUs)
+    {
+        virtualTimeUs += 100000;
+        maintainAWSConnection();
+        if (awsReconnectAttempts != attempts)
+        {
+            attempts = awsReconnectAttempts;
+            attemptsUs.push_back(virtualTimeUs);
+        }
+        shimSerialTakeOutput();
+    }
+
+    uint32_t expectedDelay = AWS_RECONNECT_INITIAL_DELAY;
+    for (size_t i = 1; i < attemptsUs.size(); i++)
+    {
+        TEST_ASSERT_EQUAL(expectedDelay * 1000ULL, attemptsUs[i] - attemptsUs[i - 1]);
+        expectedDelay = min(expectedDelay * 2, (uint32_t)AWS_RECONNECT_MAX_DELAY);
+    }
+    TEST_ASSERT_GREATER_THAN(2 * 3600 * 1000 / AWS_RECONNECT_MAX_DELAY - 10, attemptsUs.size());
+    TEST_ASSERT_TRUE(attemptsUs.back() > ROLLOVER_US + HOUR_US);
+
+    // The broker comes back, the client connects within the longest delay
+    client.shimSetBrokerAvailable(true);
+    uint64_t availableUs = virtualTimeUs;
+    while (!client.connected() && virtualTimeUs < availableUs + AWS_RECONNECT_MAX_DELAY * 1000ULL)
+    {
+        virtualTimeUs += 100000;
+        maintainAWSConnection();
+    }
+    TEST_ASSERT_TRUE(client.connected());
+}
+
+int main()
+{
+    setClockSource(virtualClock);
+    shimSerialCapture(true);
+
+    // The frames are rendered by the tests at the virtual time
+    ledsTaskInit();
+    setLedsRendering(false);
+    delay(100);
+
+    connectWiFi();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_deadlines_across_the_rollover);
+    RUN_TEST(test_hours_of_fades_across_the_rollover);
+    RUN_TEST(test_counted_fade_ends_after_the_rollover);
+    RUN_TEST(test_reconnect_backoff_across_the_rollover);
+    shimStopTasks();
+    return UNITY_END();
+}
@@ -0,0 +1,110 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the load of the cores measured by the idle hooks without the FreeRTOS run time stats.
+ */
+
+#include <Arduino.h>
+#include <esp_freertos_hooks.h>
+#include <unity.h>
+#include "task_monitor.h"
+
+// Step of the simulated time between the runs of the idle hooks (in microseconds)
+#define STEP_US 100
+
+static SystemUsage usage;
+
+/**
+ * @brief Simulates both cores for the duration.
+ *
+ * A core runs its idle hooks every step unless it is busy. The busy time repeats every period.
+ *
+ * @param durationUs The simulated time.
+ * @param periodUs The period of the busy time.
+ * @param busyUs The busy time of every period on each core.
+ */
+static void simulateCores(uint32_t durationUs, uint32_t periodUs, const uint32_t busyUs[2])
+{
+    for (uint32_t t = 0; t < durationUs; t += STEP_US)
+    {
+        shimAdvanceTime(STEP_US);
+        for (uint8_t cpu = 0; cpu < 2; cpu++)
+        {
+            if (t % periodUs >= busyUs[cpu])
+                shimRunIdleHooks(cpu);
+        }
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_first_sample_has_no_load()
+{
+    sampleSystemUsage(usage);
+    TEST_ASSERT_FALSE(usage.cpuAvailable);
+
+    // The heap is reported from the first sample
+    TEST_ASSERT_GREATER_THAN(0, usage.freeHeap);
+}
+
+void test_load_of_busy_cores()
+{
+    const uint32_t busyUs[2] = {0, 10000};
+    simulateCores(1000000, 25000, busyUs);
+
+    sampleSystemUsage(usage);
+    TEST_ASSERT_TRUE(usage.cpuAvailable);
+    TEST_ASSERT_EQUAL(0, usage.coreLoad[0]);
+    TEST_ASSERT_UINT_WITHIN(1, 40, usage.coreLoad[1]);
+}
+
+void test_load_follows_the_changes()
+{
+    const uint32_t busyUs[2] = {20000, 0};
+    simulateCores(500000, 50000, busyUs);
+
+    sampleSystemUsage(usage);
+    TEST_ASSERT_UINT_WITHIN(1, 40, usage.coreLoad[0]);
+    TEST_ASSERT_EQUAL(0, usage.coreLoad[1]);
+
+    // A core which never runs its idle task is fully loaded
+    const uint32_t alwaysBusyUs[2] = {50000, 0};
+    simulateCores(500000, 50000, alwaysBusyUs);
+
+    sampleSystemUsage(usage);
+    TEST_ASSERT_EQUAL(100, usage.coreLoad[0]);
+    TEST_ASSERT_EQUAL(0, usage.coreLoad[1]);
+}
+
+void test_idle_core_waiting_for_the_tick()
+{
+    // An idle core sleeps until the next tick interrupt between the runs of its hooks
+    for (uint32_t t = 0; t < 1000; t++)
+    {
+        shimAdvanceTime(portTICK_PERIOD_MS * 1000);
+        shimRunIdleHooks(0);
+        shimRunIdleHooks(1);
+    }
+
+    sampleSystemUsage(usage);
+    TEST_ASSERT_EQUAL(0, usage.coreLoad[0]);
+    TEST_ASSERT_EQUAL(0, usage.coreLoad[1]);
+}
+
+int main()
+{
+    shimSetTimeScale(0);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_first_sample_has_no_load);
+    RUN_TEST(test_load_of_busy_cores);
+    RUN_TEST(test_load_follows_the_changes);
+    RUN_TEST(test_idle_core_waiting_for_the_tick);
+    shimStopTasks();
+    return UNITY_END();
+}
@@ -0,0 +1,379 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the WiFi supervisor against the fake WiFi driver and scripted event sequences.
+ */
+
+#include <Arduino.h>
+#include <ESPAsync_WiFiManager.h>
+#include <WiFi.h>
+#include <unity.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+#include "config_store.h"
+#include "wifi_manager.h"
+
+#define CHIP_ID       "AABBCC"
+#define HOME_SSID     "HomeNet"
+#define HOME_PASSWORD "password123"
+
+// Step of the simulated time between the calls of the supervisor (in milliseconds)
+#define STEP_MS 10
+
+static const uint8_t homeBssid[6] = {0x10, 0x20, 0x30, 0x40, 0x50, 0x60};
+static const IPAddress homeLease(192, 168, 1, 50);
+static const IPAddress homeGateway(192, 168, 1, 1);
+
+// Link changes passed to the listener and the address at the time of the change
+struct LinkChange
+{
+    bool linkUp;
+    uint32_t localIP;
+};
+
+static std::vector<LinkChange> linkChanges;
+
+static void recordLinkChange(bool linkUp)
+{
+    linkChanges.push_back({linkUp, (uint32_t)WiFi.localIP()});
+}
+
+/**
+ * @brief Runs the driver and the supervisor for the simulated duration.
+ */
+static void runFor(uint32_t ms)
+{
+    for (uint32_t elapsed = 0; elapsed < ms; elapsed += STEP_MS)
+    {
+        shimAdvanceTime(STEP_MS * 1000);
+        shimWiFiPoll();
+        handleWiFi();
+    }
+}
+
+/**
+ * @brief Runs the driver and the supervisor until the condition holds.
+ *
+ * @return The simulated time it took (in milliseconds), or UINT32_MAX on the timeout.
+ */
+static uint32_t runUntil(std::function<bool()> condition, uint32_t timeoutMs)
+{
+    for (uint32_t elapsed = 0; elapsed < timeoutMs; elapsed += STEP_MS)
+    {
+        if (condition())
+            return elapsed;
+        runFor(STEP_MS);
+    }
+    return UINT32_MAX;
+}
+
+/**
+ * @brief Runs the driver and the supervisor and checks that the address never changes.
+ */
+static void runKeepingAddress(uint32_t ms, IPAddress address)
+{
+    for (uint32_t elapsed = 0; elapsed < ms; elapsed += STEP_MS)
+    {
+        runFor(STEP_MS);
+        TEST_ASSERT_EQUAL((uint32_t)address, (uint32_t)WiFi.localIP());
+    }
+}
+
+/**
+ * @brief Returns whether the listener was told that the link is up by the last change.
+ */
+static bool linkIsUp()
+{
+    return !linkChanges.empty() && linkChanges.back().linkUp;
+}
+
+/**
+ * @brief Drops the link and waits until the supervisor reconnects.
+ *
+ * @return The simulated time of the reconnection (in milliseconds).
+ */
+static uint32_t dropAndReconnect()
+{
+    shimWiFiDropLink(WIFI_REASON_BEACON_TIMEOUT);
+    runFor(STEP_MS);
+    TEST_ASSERT_FALSE(linkIsUp());
+
+    uint32_t duration = runUntil(linkIsUp, 30000);
+    TEST_ASSERT_NOT_EQUAL(UINT32_MAX, duration);
+    return duration;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_first_connection_scans_and_caches_the_access_point()
+{
+    initWiFiManager(CHIP_ID);
+    addWiFiLinkListener(recordLinkChange);
+
+    std::string hostname = WiFi.getHostname();
+    TEST_ASSERT_EQUAL_STRING("Interactive-CZ-Map_" CHIP_ID, hostname.c_str());
+
+    TEST_ASSERT_NOT_EQUAL(UINT32_MAX, runUntil(linkIsUp, 30000));
+    TEST_ASSERT_EQUAL(1, linkChanges.size());
+    TEST_ASSERT_EQUAL((uint32_t)homeLease, linkChanges[0].localIP);
+
+    ShimWiFiCounters counters = shimWiFiCounters();
+    TEST_ASSERT_EQUAL(1, counters.scans);
+    TEST_ASSERT_EQUAL(1, counters.dhcpStarts);
+    TEST_ASSERT_EQUAL(0, counters.staticConfigs);
+
+    const WiFiConnectStats &stats = getWiFiConnectStats();
+    TEST_ASSERT_EQUAL(1, stats.scanConnects);
+    TEST_ASSERT_FALSE(stats.lastFastPath);
+    TEST_ASSERT_GREATER_THAN(0, stats.bootToConnectedMs);
+
+    // The access point and the lease are persisted for the fast path
+    uint8_t cached[64];
+    TEST_ASSERT_GREATER_THAN(0, configGetBlob("wifi.fast", cached, sizeof(cached)));
+}
+
+void test_reconnect_uses_the_fast_path_and_keeps_the_lease()
+{
+    ShimWiFiCounters before = shimWiFiCounters();
+    uint32_t scanConnectMs = getWiFiConnectStats().lastConnectMs;
+    size_t changesBefore = linkChanges.size();
+
+    dropAndReconnect();
+
+    // Connected without a scan using the cached lease as a static IP
+    ShimWiFiCounters counters = shimWiFiCounters();
+    TEST_ASSERT_EQUAL(before.scans, counters.scans);
+    TEST_ASSERT_EQUAL(before.staticConfigs + 1, counters.staticConfigs);
+    TEST_ASSERT_EQUAL((uint32_t)homeLease, linkChanges.back().localIP);
+
+    const WiFiConnectStats &stats = getWiFiConnectStats();
+    TEST_ASSERT_TRUE(stats.lastFastPath);
+    TEST_ASSERT_EQUAL(1, stats.fastConnects);
+    TEST_ASSERT_LESS_THAN(scanConnectMs, stats.lastConnectMs);
+
+    // DHCP is not started on the established link, the address is usable right away
+    runKeepingAddress(5000, homeLease);
+    counters = shimWiFiCounters();
+    TEST_ASSERT_TRUE(shimWiFiStaticIP());
+    TEST_ASSERT_EQUAL(before.dhcpStarts, counters.dhcpStarts);
+    TEST_ASSERT_EQUAL(changesBefore + 2, linkChanges.size());
+    TEST_ASSERT_TRUE(linkIsUp());
+}
+
+void test_stale_lease_is_renewed_through_the_scan()
+{
+    const IPAddress newLease(192, 168, 1, 77);
+    shimWiFiSetLease(HOME_SSID, newLease);
+    size_t changesBefore = linkChanges.size();
+
+    // The cached lease is kept while it is fresh, also if the DHCP server would give another one
+    dropAndReconnect();
+    TEST_ASSERT_TRUE(getWiFiConnectStats().lastFastPath);
+    TEST_ASSERT_EQUAL((uint32_t)homeLease, linkChanges.back().localIP);
+    runKeepingAddress(5000, homeLease);
+    TEST_ASSERT_EQUAL(changesBefore + 2, linkChanges.size());
+
+    // The established link keeps the lease until it becomes stale, then the supervisor
+    // reconnects through the scan and obtains the new lease by DHCP
+    ShimWiFiCounters before = shimWiFiCounters();
+    TEST_ASSERT_NOT_EQUAL(UINT32_MAX, runUntil([] { return !linkIsUp(); }, WIFI_LEASE_MAX_AGE_MS));
+    TEST_ASSERT_EQUAL(changesBefore + 3, linkChanges.size());
+    TEST_ASSERT_EQUAL((uint32_t)homeLease, linkChanges.back().localIP);
+
+    TEST_ASSERT_NOT_EQUAL(UINT32_MAX, runUntil(linkIsUp, 30000));
+    ShimWiFiCounters counters = shimWiFiCounters();
+    TEST_ASSERT_FALSE(getWiFiConnectStats().lastFastPath);
+    TEST_ASSERT_EQUAL(before.scans + 1, counters.scans);
+    TEST_ASSERT_EQUAL(before.dhcpStarts + 1, counters.dhcpStarts);
+    TEST_ASSERT_FALSE(shimWiFiStaticIP());
+    TEST_ASSERT_EQUAL((uint32_t)newLease, linkChanges.back().localIP);
+
+    // The next fast connection uses the new lease
+    dropAndReconnect();
+    TEST_ASSERT_TRUE(getWiFiConnectStats().lastFastPath);
+    TEST_ASSERT_EQUAL((uint32_t)newLease, linkChanges.back().localIP);
+    runKeepingAddress(2000, newLease);
+}
+
+void test_moved_access_point_falls_back_to_scan()
+{
+    shimWiFiSetAccessPoint(HOME_SSID, 11, true);
+    ShimWiFiCounters before = shimWiFiCounters();
+    uint32_t scanConnects = getWiFiConnectStats().scanConnects;
+
+    // The fast connection to the cached channel times out before the scan
+    uint32_t duration = dropAndReconnect();
+    TEST_ASSERT_GREATER_OR_EQUAL(WIFI_FAST_CONNECT_TIMEOUT_MS, duration);
+
+    ShimWiFiCounters counters = shimWiFiCounters();
+    TEST_ASSERT_EQUAL(before.scans + 1, counters.scans);
+    TEST_ASSERT_EQUAL(before.begins + 2, counters.begins);
+    TEST_ASSERT_FALSE(shimWiFiStaticIP());
+    TEST_ASSERT_FALSE(getWiFiConnectStats().lastFastPath);
+    TEST_ASSERT_EQUAL(scanConnects + 1, getWiFiConnectStats().scanConnects);
+
+    // The new channel is cached for the next connection
+    before = shimWiFiCounters();
+    dropAndReconnect();
+    TEST_ASSERT_TRUE(getWiFiConnectStats().lastFastPath);
+    TEST_ASSERT_EQUAL(before.scans, shimWiFiCounters().scans);
+    runFor(2000);
+}
+
+void test_scripted_link_drops_notify_each_change()
+{
+    const uint8_t reasons[] = {WIFI_REASON_BEACON_TIMEOUT, WIFI_REASON_AUTH_EXPIRE, WIFI_REASON_ASSOC_LEAVE};
+    uint32_t restarts = shimRestartCount();
+
+    for (uint8_t reason : reasons)
+    {
+        size_t changesBefore = linkChanges.size();
+        shimSerialCapture(true);
+        shimWiFiDropLink(reason);
+        runFor(STEP_MS);
+        std::string output = shimSerialTakeOutput().c_str();
+        shimSerialCapture(false);
+
+        // Down once with the reason, then up once
+        std::string expected = "WiFi link lost, reason: " + std::to_string(reason);
+        TEST_ASSERT_TRUE(output.find(expected) != std::string::npos);
+        TEST_ASSERT_EQUAL(changesBefore + 1, linkChanges.size());
+        TEST_ASSERT_FALSE(linkIsUp());
+
+        TEST_ASSERT_NOT_EQUAL(UINT32_MAX, runUntil(linkIsUp, 30000));
+        runFor(2000);
+        TEST_ASSERT_EQUAL(changesBefore + 2, linkChanges.size());
+    }
+
+    TEST_ASSERT_EQUAL(restarts, shimRestartCount());
+}
+
+void test_lost_ip_restarts_the_connection()
+{
+    ShimWiFiCounters before = shimWiFiCounters();
+    size_t changesBefore = linkChanges.size();
+
+    // The disconnection caused by the new attempt itself is ignored
+    shimWiFiQueueEvent(ARDUINO_EVENT_WIFI_STA_LOST_IP);
+    runFor(STEP_MS);
+    TEST_ASSERT_FALSE(linkIsUp());
+    TEST_ASSERT_NOT_EQUAL(UINT32_MAX, runUntil(linkIsUp, 30000));
+    runFor(2000);
+
+    TEST_ASSERT_EQUAL(changesBefore + 2, linkChanges.size());
+    TEST_ASSERT_EQUAL(before.begins + 1, shimWiFiCounters().begins);
+}
+
+void test_unexpected_events_do_not_change_the_link()
+{
+    ShimWiFiCounters before = shimWiFiCounters();
+    size_t changesBefore = linkChanges.size();
+
+    shimWiFiQueueEvent(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    shimWiFiQueueEvent(ARDUINO_EVENT_WIFI_SCAN_DONE);
+    shimWiFiQueueEvent(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+    runFor(1000);
+
+    ShimWiFiCounters counters = shimWiFiCounters();
+    TEST_ASSERT_EQUAL(changesBefore, linkChanges.size());
+    TEST_ASSERT_EQUAL(before.begins, counters.begins);
+    TEST_ASSERT_EQUAL(before.scans, counters.scans);
+    TEST_ASSERT_EQUAL(before.dhcpStarts, counters.dhcpStarts);
+}
+
+void test_scan_failures_back_off_without_restart()
+{
+    uint32_t restarts = shimRestartCount();
+
+    // The cached channel is wrong and the scans could not be started
+    shimWiFiSetAccessPoint(HOME_SSID, 6, true);
+    shimWiFiFailScans(true);
+    ShimWiFiCounters before = shimWiFiCounters();
+    shimWiFiDropLink(WIFI_REASON_BEACON_TIMEOUT);
+    runFor(15000);
+
+    // Only the fast connection was attempted, the scans wait in the backoff
+    ShimWiFiCounters counters = shimWiFiCounters();
+    TEST_ASSERT_FALSE(linkIsUp());
+    TEST_ASSERT_EQUAL(before.begins + 1, counters.begins);
+    TEST_ASSERT_EQUAL(before.scans, counters.scans);
+    TEST_ASSERT_EQUAL(restarts, shimRestartCount());
+
+    shimWiFiFailScans(false);
+    TEST_ASSERT_NOT_EQUAL(UINT32_MAX, runUntil(linkIsUp, WIFI_BACKOFF_MAX_MS));
+    TEST_ASSERT_EQUAL(before.scans + 1, shimWiFiCounters().scans);
+    TEST_ASSERT_EQUAL(restarts, shimRestartCount());
+}
+
+void test_backoff_grows_up_to_the_maximum_without_restart()
+{
+    const uint32_t scanMs = 100;
+    shimWiFiSetTimings(200, 500, scanMs);
+    uint32_t restarts = shimRestartCount();
+
+    // The access point goes away, the link is lost after the beacon timeout
+    shimWiFiSetAccessPoint(HOME_SSID, 11, false);
+    TEST_ASSERT_NOT_EQUAL(UINT32_MAX, runUntil([] { return !linkIsUp(); }, 1000));
+
+    // Record the simulated times of the scans, each failed scan doubles the delay
+    std::vector<uint32_t> scanTimes;
+    uint32_t scans = shimWiFiCounters().scans;
+    for (uint32_t timeMs = 0; timeMs < 300000; timeMs += STEP_MS)
+    {
+        runFor(STEP_MS);
+        if (shimWiFiCounters().scans != scans)
+        {
+            scans = shimWiFiCounters().scans;
+            scanTimes.push_back(timeMs);
+        }
+    }
+
+    TEST_ASSERT_GREATER_OR_EQUAL(8, scanTimes.size());
+    uint32_t expectedBackoff = WIFI_BACKOFF_INITIAL_MS;
+    for (size_t i = 1; i < scanTimes.size(); i++)
+    {
+        uint32_t gap = scanTimes[i] - scanTimes[i - 1];
+        TEST_ASSERT_UINT_WITHIN(3 * STEP_MS, expectedBackoff + scanMs, gap);
+        expectedBackoff = std::min(expectedBackoff * 2, (uint32_t)WIFI_BACKOFF_MAX_MS);
+    }
+    TEST_ASSERT_EQUAL(WIFI_BACKOFF_MAX_MS, expectedBackoff);
+    TEST_ASSERT_EQUAL(restarts, shimRestartCount());
+
+    // The supervisor connects once the access point is back, within the longest backoff
+    shimWiFiSetAccessPoint(HOME_SSID, 11, true);
+    TEST_ASSERT_NOT_EQUAL(UINT32_MAX, runUntil(linkIsUp, WIFI_BACKOFF_MAX_MS + 5000));
+
+    // The backoff starts from the initial delay again after the connection
+    shimWiFiSetAccessPoint(HOME_SSID, 11, false);
+    TEST_ASSERT_NOT_EQUAL(UINT32_MAX, runUntil([] { return !linkIsUp(); }, 1000));
+    scans = shimWiFiCounters().scans;
+    TEST_ASSERT_NOT_EQUAL(UINT32_MAX, runUntil([&] { return shimWiFiCounters().scans == scans + 1; }, 10000));
+    uint32_t gap = runUntil([&] { return shimWiFiCounters().scans == scans + 2; }, 10000);
+    TEST_ASSERT_UINT_WITHIN(3 * STEP_MS, WIFI_BACKOFF_INITIAL_MS + scanMs, gap);
+}
+
+int main()
+{
+    shimWiFiAddAccessPoint(HOME_SSID, HOME_PASSWORD, homeBssid, 6, -55, homeLease, homeGateway);
+    shimPortalSetCredentials(HOME_SSID, HOME_PASSWORD);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_first_connection_scans_and_caches_the_access_point);
+    RUN_TEST(test_reconnect_uses_the_fast_path_and_keeps_the_lease);
+    RUN_TEST(test_stale_lease_is_renewed_through_the_scan);
+    RUN_TEST(test_moved_access_point_falls_back_to_scan);
+    RUN_TEST(test_scripted_link_drops_notify_each_change);
+    RUN_TEST(test_lost_ip_restarts_the_connection);
+    RUN_TEST(test_unexpected_events_do_not_change_the_link);
+    RUN_TEST(test_scan_failures_back_off_without_restart);
+    RUN_TEST(test_backoff_grows_up_to_the_maximum_without_restart);
+    shimStopTasks();
+    return UNITY_END();
+}
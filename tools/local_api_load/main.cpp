@@ -0,0 +1,192 @@
+/**
+ * @file main.cpp
+ * @brief Host load generator streaming LEDs commands into the local API of the firmware.
+ *
+ * The firmware sources run on the shims of the native environment. WebSocket clients stream
+ * random LEDs commands at the given rate, delivered by one thread like by the async_tcp task,
+ * while a second thread sends the same commands like the MQTT task, so both contend for the
+ * LEDs command mutex and the queues of the LED task. Build and run it with:
+ *
+ *   NATIVE_SANITIZER=none pio run -e local_api_load
+ *   .pio/build/local_api_load/program [seconds] [commands per second] [clients] [binary percent] [invalid percent] [MQTT commands per second]
+ *
+ * The report holds the accepted, rejected and dropped messages, the achieved rate, the dropped LED
+ * commands, the missed frames and the latency percentiles.
+ */
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "command_latency.h"
+#include "leds.h"
+#include "leds_parser.h"
+#include "local_api.h"
+#include "logger.h"
+
+// Most LEDs in one generated command
+#define MAX_LEDS_PER_COMMAND 8
+
+/**
+ * @brief Generates a random LEDs command, JSON or binary, optionally with an invalid LED ID.
+ *
+ * @param random The random generator of the calling thread.
+ * @param binary true for the binary format, false for JSON.
+ * @param invalid true to put an invalid LED ID into the command.
+ * @return The command.
+ */
+static std::string generateCommand(std::mt19937 &random, bool binary, bool invalid)
+{
+    uint8_t leds = random() % MAX_LEDS_PER_COMMAND + 1;
+    std::string command = binary ? "" : "{\"leds\":[";
+    for (uint8_t i = 0; i < leds; i++)
+    {
+        uint8_t ledId = invalid && i == 0 ? 0 : random() % LEDS_COUNT + 1;
+        uint32_t color = random() & 0xFFFFFF;
+        uint16_t duration = 100 + random() % 900;
+        if (binary)
+        {
+            const uint8_t record[] = {ledId, (uint8_t)(color >> 16), (uint8_t)(color >> 8), (uint8_t)color,
+                                      255, (uint8_t)duration, (uint8_t)(duration >> 8), 1};
+            command.append((const char *)record, sizeof(record));
+        }
+        else
+        {
+            char entry[48];
+            snprintf(entry, sizeof(entry), "%s{\"id\":%u,\"cl\":\"%06X\",\"dr\":%u}", i > 0 ? "," : "", ledId,
+                     color, duration);
+            command += entry;
+        }
+    }
+    if (!binary)
+        command += "]}";
+    return command;
+}
+
+/**
+ * @brief Waits until the time of the next command of a constant rate.
+ *
+ * @param startUs The start of the load (esp_timer_get_time()).
+ * @param sent The commands sent since the start.
+ * @param rate The commands per second.
+ */
+static void waitForNextCommand(uint64_t startUs, uint64_t sent, uint32_t rate)
+{
+    uint64_t dueUs = startUs + sent * 1000000 / rate;
+    while ((uint64_t)esp_timer_get_time() < dueUs)
+        delay(1);
+}
+
+/**
+ * @brief Prints the latency percentiles of all the stages.
+ */
+static void printLatencies()
+{
+    for (uint8_t stage = 0; stage < LATENCY_STAGES_COUNT; stage++)
+    {
+        LatencyHistogram histogram;
+        getLatencyHistogram((LatencyStage)stage, histogram);
+        printf("Latency %s: %u commands, p50 %u us, p90 %u us, p99 %u us, max %u us\n",
+               latencyStageToString(stage), histogram.count, latencyPercentileUs(histogram, 50),
+               latencyPercentileUs(histogram, 90), latencyPercentileUs(histogram, 99), histogram.maxUs);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t seconds = argc > 1 ? atoi(argv[1]) : 10;
+    uint32_t rate = argc > 2 ? atoi(argv[2]) : 200;
+    uint32_t clients = argc > 3 ? atoi(argv[3]) : 2;
+    uint32_t binaryPercent = argc > 4 ? atoi(argv[4]) : 50;
+    uint32_t invalidPercent = argc > 5 ? atoi(argv[5]) : 0;
+    uint32_t mqttRate = argc > 6 ? atoi(argv[6]) : 10;
+    if (seconds == 0 || rate == 0 || clients == 0 || clients > LOCAL_API_MAX_CLIENTS)
+    {
+        fprintf(stderr, "Usage: %s [seconds] [commands per second] [clients 1-%d] [binary percent] [invalid percent] "
+                        "[MQTT commands per second]\n",
+                argv[0], LOCAL_API_MAX_CLIENTS);
+        return 2;
+    }
+
+    loggerInit();
+    ledsTaskInit();
+    initLocalApi();
+
+    AsyncWebSocket *socket = shimWebSocket(LOCAL_API_PORT, LOCAL_API_WS_PATH);
+    std::vector<uint32_t> clientIds;
+    for (uint32_t i = 0; i < clients; i++)
+        clientIds.push_back(socket->shimConnect());
+
+    LatencyHistogram totalBefore;
+    getLatencyHistogram(LATENCY_TOTAL, totalBefore);
+    uint32_t dropsBefore = getLedCommandDrops();
+    uint32_t missesBefore = getFrameStats().totalMisses;
+
+    // The competing MQTT commands, all valid JSON
+    std::atomic<bool> running{true};
+    std::atomic<uint32_t> mqttRejected{0};
+    std::thread mqtt(
+        [&]()
+        {
+            std::mt19937 random(2);
+            uint64_t startUs = esp_timer_get_time();
+            for (uint64_t sent = 0; mqttRate > 0 && running; sent++)
+            {
+                waitForNextCommand(startUs, sent, mqttRate);
+                JsonDocument doc;
+                std::string command = generateCommand(random, false, false);
+                deserializeJson(doc, command.data(), command.size());
+                if (!handleLedsCommand(doc, micros()))
+                    mqttRejected++;
+            }
+        });
+
+    // The WebSocket messages, round robin over the clients
+    std::mt19937 random(1);
+    uint64_t startUs = esp_timer_get_time();
+    uint64_t sent = 0;
+    uint64_t sendUs = 0;
+    while (esp_timer_get_time() - startUs < seconds * 1000000ULL)
+    {
+        waitForNextCommand(startUs, sent, rate);
+        bool binary = random() % 100 < binaryPercent;
+        std::string command = generateCommand(random, binary, random() % 100 < invalidPercent);
+
+        AwsFrameInfo info = {};
+        info.final = 1;
+        info.opcode = binary ? WS_BINARY : WS_TEXT;
+        info.message_opcode = info.opcode;
+        info.len = command.size();
+
+        uint64_t frameStartUs = esp_timer_get_time();
+        socket->shimFrame(clientIds[sent % clients], (const uint8_t *)command.data(), command.size(), info);
+        sendUs += esp_timer_get_time() - frameStartUs;
+        sent++;
+    }
+    uint64_t elapsedUs = esp_timer_get_time() - startUs;
+
+    running = false;
+    mqtt.join();
+
+    // Let the LED task show the last commands and the logger print the last messages
+    delay(200);
+
+    LocalApiStats stats = getLocalApiStats();
+    LatencyHistogram total;
+    getLatencyHistogram(LATENCY_TOTAL, total);
+    printf("Messages sent: %llu in %.2f s (%.1f per second), %.1f us per message in the handler\n",
+           (unsigned long long)sent, elapsedUs / 1e6, sent * 1e6 / elapsedUs, sent > 0 ? (double)sendUs / sent : 0.0);
+    printf("Local API: %u accepted, %u rejected, %u dropped, %u clients; MQTT commands dropped: %u\n",
+           stats.messages, stats.rejected, stats.dropped, stats.clients, mqttRejected.load());
+    printf("LED commands dropped: %u, missed frames: %u, commands measured: %u\n", getLedCommandDrops() - dropsBefore,
+           getFrameStats().totalMisses - missesBefore, total.count - totalBefore.count);
+    printLatencies();
+
+    shimStopTasks();
+    return 0;
+}
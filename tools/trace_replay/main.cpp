@@ -0,0 +1,139 @@
+/**
+ * @file main.cpp
+ * @brief Host tool replaying a command trace captured on a device through the real parser and LED engine.
+ *
+ * The firmware sources run on the shims of the native environment, the time is simulated and
+ * could run faster than the real time. Build and run it with:
+ *
+ *   NATIVE_SANITIZER=none pio run -e trace_replay
+ *   .pio/build/trace_replay/program <trace directory> [speed percent] [time scale] [frames.csv]
+ *
+ * The trace directory holds trace.old and trace.bin from the LittleFS partition of the device.
+ * The report of the replay is printed like on the device, followed by the frame statistics and
+ * the latency percentiles. The optional CSV receives the shown frames sampled every millisecond
+ * of the simulated time, so the output of two firmware versions could be compared.
+ */
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <LittleFS.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <filesystem>
+#include "command_latency.h"
+#include "command_trace.h"
+#include "leds.h"
+#include "logger.h"
+
+// Segments of the trace, in the order of replay
+static const char *const traceFilenames[] = {"trace.old", "trace.bin"};
+
+/**
+ * @brief Copies the segments of the trace into the simulated file system.
+ *
+ * @param directory The directory holding the segments.
+ * @return The number of copied segments.
+ */
+static int loadTrace(const char *directory)
+{
+    int loaded = 0;
+    for (const char *filename : traceFilenames)
+    {
+        std::filesystem::path source = std::filesystem::path(directory) / filename;
+        if (!std::filesystem::exists(source))
+            continue;
+
+        String target = shimFsHostPath((String("/") + filename).c_str());
+        std::filesystem::copy_file(source, target.c_str(), std::filesystem::copy_options::overwrite_existing);
+        loaded++;
+    }
+
+    return loaded;
+}
+
+/**
+ * @brief Appends the shown frame to the CSV: time, frame number and the colors of the LEDs.
+ */
+static void writeFrame(FILE *csv, uint32_t frame)
+{
+    fprintf(csv, "%lu,%u", millis(), frame);
+    for (int i = 0; i < LEDS_COUNT; i++)
+    {
+        CRGB led = FastLED.shownLed(i);
+        fprintf(csv, ",%02X%02X%02X", led.r, led.g, led.b);
+    }
+    fputc('\n', csv);
+}
+
+/**
+ * @brief Prints the frame statistics and the latency percentiles of the replay.
+ */
+static void printReport(uint32_t framesShown)
+{
+    FrameStats frameStats = getFrameStats();
+    printf("Frames shown: %u, missed deadlines: %u\n", framesShown, frameStats.totalMisses);
+
+    for (uint8_t stage = 0; stage < LATENCY_STAGES_COUNT; stage++)
+    {
+        LatencyHistogram histogram;
+        getLatencyHistogram((LatencyStage)stage, histogram);
+        printf("Latency %s: %u commands, p50 %u us, p90 %u us, p99 %u us, max %u us\n",
+               latencyStageToString(stage), histogram.count, latencyPercentileUs(histogram, 50),
+               latencyPercentileUs(histogram, 90), latencyPercentileUs(histogram, 99), histogram.maxUs);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <trace directory> [speed percent] [time scale] [frames.csv]\n", argv[0]);
+        return 2;
+    }
+
+    uint16_t speedPercent = argc > 2 ? atoi(argv[2]) : 100;
+    uint32_t timeScale = argc > 3 ? atoi(argv[3]) : 1;
+    FILE *csv = NULL;
+    if (argc > 4 && (csv = fopen(argv[4], "w")) == NULL)
+    {
+        fprintf(stderr, "Failed to create %s\n", argv[4]);
+        return 2;
+    }
+
+    LittleFS.begin(true);
+    if (loadTrace(argv[1]) == 0)
+    {
+        fprintf(stderr, "No trace.old or trace.bin in %s\n", argv[1]);
+        return 2;
+    }
+
+    shimSetTimeScale(timeScale > 0 ? timeScale : 1);
+    loggerInit();
+    ledsTaskInit();
+
+    if (!startTraceReplay(speedPercent))
+        return 1;
+
+    uint32_t framesAtStart = FastLED.shownFrames();
+    uint32_t lastFrame = framesAtStart;
+    while (getTraceStats().replaying)
+    {
+        handleCommandTrace();
+
+        uint32_t frame = FastLED.shownFrames();
+        if (csv != NULL && frame != lastFrame)
+            writeFrame(csv, frame - framesAtStart);
+        lastFrame = frame;
+
+        delay(1);
+    }
+
+    // Let the logger print the last messages
+    delay(100);
+    printReport(FastLED.shownFrames() - framesAtStart);
+
+    if (csv != NULL)
+        fclose(csv);
+    shimStopTasks();
+    return 0;
+}